@@ -0,0 +1,123 @@
+// Instruction-set variants of the pixel kernels on a 12 MP photo.
+//
+// Variants that are not built for this architecture or not supported by
+// the CPU are skipped; `selected` marks the one the library picks. Perf
+// counters are added where the system allows them, see perf_report.hpp.
+
+#include "composite.hpp"
+#include "kernels.hpp"
+#include "perf_report.hpp"
+
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+using cutout::kernels::Isa;
+
+const int width = 4000;
+const int height = 3000;
+
+const cutout::kernels::KernelTable *
+get_table(benchmark::State &state) {
+  auto isa = static_cast<Isa>(state.range(0));
+  const auto *table = cutout::kernels::get(isa);
+  if (!table) {
+    state.SkipWithError("variant not available on this CPU");
+    return nullptr;
+  }
+  state.SetLabel(table->name);
+  state.counters["selected"] = &cutout::kernels::get() == table;
+  return table;
+}
+
+// Args: Isa
+void BM_Normalize(benchmark::State &state) {
+  const auto *table = get_table(state);
+  if (!table) {
+    return;
+  }
+
+  cv::Mat image(height, width, CV_8UC3);
+  cv::randu(image, 0, 256);
+  std::vector<float> planes(width * 3);
+  auto normalization = cutout::Normalization::from_mean_std(
+      1.0f / 255, {0.485f, 0.456f, 0.406f}, {0.229f, 0.224f, 0.225f});
+
+  PerfReport perf;
+  for (auto _ : state) {
+    for (int y = 0; y < height; y++) {
+      table->normalize_bgr(image.ptr<uint8_t>(y), width, normalization,
+                           planes.data(), planes.data() + width,
+                           planes.data() + width * 2);
+    }
+    benchmark::ClobberMemory();
+  }
+  perf.report(state, width * height);
+  state.SetItemsProcessed(state.iterations() * width * height);
+  state.SetBytesProcessed(state.iterations() * image.total() *
+                          image.elemSize());
+}
+
+// Args: Isa
+void BM_Composite(benchmark::State &state) {
+  const auto *table = get_table(state);
+  if (!table) {
+    return;
+  }
+
+  cv::Mat image(height, width, CV_8UC3);
+  cv::randu(image, 0, 256);
+  cv::Mat mask = cv::Mat::zeros(height, width, CV_8U);
+  cv::ellipse(mask, cv::Point(width / 2, height / 2),
+              cv::Size(width / 3, height / 3), 0, 0, 360, cv::Scalar(255),
+              cv::FILLED);
+  cv::Mat bgra(height, width, CV_8UC4);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    for (int y = 0; y < height; y++) {
+      table->composite(image.ptr<uint8_t>(y), mask.ptr<uint8_t>(y), width,
+                       bgra.ptr<uint8_t>(y));
+    }
+    benchmark::ClobberMemory();
+  }
+  perf.report(state, width * height);
+  state.SetItemsProcessed(state.iterations() * width * height);
+  state.SetBytesProcessed(state.iterations() * image.total() *
+                          image.elemSize());
+}
+
+// The OpenCV sequence the composite kernel replaces, for reference
+void BM_CompositeOpenCV(benchmark::State &state) {
+  cv::Mat image(height, width, CV_8UC3);
+  cv::randu(image, 0, 256);
+  cv::Mat mask = cv::Mat::zeros(height, width, CV_8U);
+  cv::ellipse(mask, cv::Point(width / 2, height / 2),
+              cv::Size(width / 3, height / 3), 0, 0, 360, cv::Scalar(255),
+              cv::FILLED);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    cv::Mat cutout;
+    cv::bitwise_and(image, image, cutout, mask);
+    cv::Mat result;
+    cv::cvtColor(cutout, result, cv::COLOR_BGR2BGRA);
+    result.setTo(cv::Scalar(0, 0, 0, 0), mask == 0);
+    benchmark::DoNotOptimize(result.data);
+  }
+  perf.report(state, width * height);
+  state.SetItemsProcessed(state.iterations() * width * height);
+}
+
+} // namespace
+
+BENCHMARK(BM_Normalize)
+    ->DenseRange((int)Isa::BASELINE, (int)Isa::AVX512)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Composite)
+    ->DenseRange((int)Isa::BASELINE, (int)Isa::AVX512)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CompositeOpenCV)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,58 @@
+#pragma once
+
+// Hardware event counts of a benchmark loop, reported next to its times.
+//
+// Construct a PerfReport right before the loop and call `report` after it.
+// Cycles, instructions, cache and branch misses and page faults are added
+// per iteration, with the IPC and the memory traffic per pixel (one cache
+// line per last-level miss), which tell memory-bound kernels from
+// compute-bound ones. Only the benchmark thread is counted, so work OpenCV
+// spreads over its pool shows up in the times but not in the counters.
+//
+// Collection needs Linux perf_event_open; elsewhere, in VMs without a PMU
+// or with a perf_event_paranoid above 2, the counters the kernel refuses
+// are left out, and `-DCUTOUT_PERF_COUNTERS=OFF` leaves them all out.
+
+#include "perf_counters.hpp"
+
+#include <benchmark/benchmark.h>
+
+class PerfReport {
+public:
+  PerfReport() {
+#if CUTOUT_PERF_COUNTERS
+    start = cutout::PerfCounters::for_thread().read();
+#endif
+  }
+
+  void report(benchmark::State &state, int64_t pixels_per_iteration) {
+#if CUTOUT_PERF_COUNTERS
+    auto perf = cutout::PerfCounters::for_thread().read().since(start);
+    if (perf.is_empty() || state.iterations() == 0) {
+      return;
+    }
+
+    for (int i = 0; i < cutout::PerfSample::count; i++) {
+      auto event = static_cast<cutout::PerfEvent>(i);
+      if (perf.has(event)) {
+        state.counters[cutout::perf_event_name(event)] = benchmark::Counter(
+            (double)perf.get(event), benchmark::Counter::kAvgIterations);
+      }
+    }
+    if (perf.has(cutout::PerfEvent::CYCLES) &&
+        perf.has(cutout::PerfEvent::INSTRUCTIONS)) {
+      state.counters["ipc"] = perf.ipc();
+    }
+    if (perf.has(cutout::PerfEvent::CACHE_MISSES)) {
+      state.counters["bytes_per_pixel"] = perf.bytes_per_pixel(
+          (int64_t)state.iterations() * pixels_per_iteration);
+    }
+#else
+    (void)state;
+    (void)pixels_per_iteration;
+#endif
+  }
+
+private:
+  cutout::PerfSample start;
+};
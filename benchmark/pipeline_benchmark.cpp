@@ -0,0 +1,212 @@
+// U2Net and SAM pipeline stages on photos from VGA to 48 MP.
+//
+// Images are synthetic JPEGs written to the temp directory once per size,
+// and the model outputs are synthetic logits, so no photos or model files
+// are needed. Throughput is reported per pixel of the photo. For results
+// to compare across commits, write them as JSON and diff two runs with
+// Google Benchmark's tools/compare.py:
+//
+//   ./pipeline_benchmark --benchmark_format=json > after.json
+//   compare.py benchmarks before.json after.json
+
+#include "perf_report.hpp"
+#include "sam.cpp"
+#include "synthetic.hpp"
+#include "u2net.cpp"
+
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <map>
+
+namespace {
+
+cv::Size get_size(const benchmark::State &state) {
+  return cv::Size((int)state.range(0), (int)state.range(1));
+}
+
+std::string temp_path(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Photos written on first use and removed at exit
+class PhotoFiles {
+public:
+  ~PhotoFiles() {
+    for (const auto &[size, path] : paths) {
+      std::filesystem::remove(path);
+    }
+  }
+
+  const std::string &get(cv::Size size) {
+    auto key = std::make_pair(size.width, size.height);
+    auto it = paths.find(key);
+    if (it != paths.end()) {
+      return it->second;
+    }
+
+    std::string path =
+        temp_path("cutout_benchmark_" + std::to_string(size.width) + "x" +
+                  std::to_string(size.height) + ".jpg");
+    cv::imwrite(path, make_image(size), {cv::IMWRITE_JPEG_QUALITY, 90});
+    return paths.emplace(key, path).first->second;
+  }
+
+private:
+  std::map<std::pair<int, int>, std::string> paths;
+};
+
+PhotoFiles photos;
+
+// VGA, 1080p, 12 MP and 48 MP
+void photo_sizes(benchmark::internal::Benchmark *family) {
+  family->ArgNames({"width", "height"})
+      ->Args({640, 480})
+      ->Args({1920, 1080})
+      ->Args({4000, 3000})
+      ->Args({8000, 6000})
+      ->Unit(benchmark::kMillisecond);
+}
+
+void set_pixels_processed(benchmark::State &state, cv::Size size) {
+  state.SetItemsProcessed(state.iterations() * size.area());
+  state.counters["megapixels"] = size.area() / 1e6;
+}
+
+// Decode, model-input resize and normalization into the 320x320 tensor
+void BM_U2NetPreprocess(benchmark::State &state) {
+  cv::Size size = get_size(state);
+  const std::string &path = photos.get(size);
+  U2NetSegmentImage u2net;
+
+  PerfReport perf;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(u2net.preprocess(path));
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+}
+
+// Mask upsampling to the photo, refinement, cutout and PNG encode
+void BM_U2NetPostprocess(benchmark::State &state) {
+  cv::Size size = get_size(state);
+  U2NetSegmentImage u2net;
+  u2net.preprocess(photos.get(size));
+  auto logits = make_logits(320, 320);
+  std::string output_path = temp_path("cutout_benchmark_u2net.png");
+
+  PerfReport perf;
+  for (auto _ : state) {
+    if (!u2net.postprocess(logits, output_path)) {
+      state.SkipWithError("no subject found in the mask");
+      break;
+    }
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+  std::filesystem::remove(output_path);
+}
+
+// Decode, longest-side resize to 1024 and the padded encoder tensor
+void BM_SAMPreprocess(benchmark::State &state) {
+  cv::Size size = get_size(state);
+  const std::string &path = photos.get(size);
+  SAMImage sam;
+
+  PerfReport perf;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sam.preprocess(path));
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+}
+
+// Prompt points mapped from the photo onto the 1024 encoder input; the
+// photo size only changes the scale
+void BM_SAMTransformCoords(benchmark::State &state) {
+  cv::Size size = get_size(state);
+  SAMImage sam;
+  sam.preprocess(photos.get(size));
+  sam.add_point_and_label({size.width / 2, size.height / 2}, 1);
+  sam.add_point_and_label({size.width / 3, size.height / 2}, 1);
+  sam.add_point_and_label({size.width / 20, size.height / 20}, 0);
+  sam.add_point_and_label({size.width * 19 / 20, size.height / 20}, 0);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sam.transform_coords());
+  }
+  state.SetItemsProcessed(state.iterations() * sam.get_total_points());
+}
+
+// SAM decoder output, 4 masks of 256x256 logits, to the photo's mask
+class SAMFixture : public benchmark::Fixture {
+public:
+  void SetUp(const benchmark::State &state) override {
+    size = get_size(state);
+    sam.preprocess(photos.get(size));
+
+    scores = {0.2f, 0.9f, 0.5f, 0.1f};
+    auto mask = make_logits(256, 256);
+    logits.clear();
+    for (int i = 0; i < 4; i++) {
+      logits.insert(logits.end(), mask.begin(), mask.end());
+    }
+  }
+
+  cv::Size size;
+  SAMImage sam;
+  std::vector<float> scores;
+  std::vector<float> logits;
+};
+
+// Best mask upsampled to the photo and thresholded
+BENCHMARK_DEFINE_F(SAMFixture, Postprocess)(benchmark::State &state) {
+  PerfReport perf;
+  for (auto _ : state) {
+    sam.postprocess(scores.data(), scores.size(), logits.data());
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+}
+
+// Cutout of the mask, cropped to the object, and PNG encode
+BENCHMARK_DEFINE_F(SAMFixture, MakeSticker)(benchmark::State &state) {
+  sam.postprocess(scores.data(), scores.size(), logits.data());
+  std::string output_path = temp_path("cutout_benchmark_sticker.png");
+
+  PerfReport perf;
+  for (auto _ : state) {
+    sam.make_sticker(output_path);
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+  std::filesystem::remove(output_path);
+}
+
+// Bounding box of the refined full-size mask, which is what both
+// pipelines' get_bbox computes before cropping
+void BM_GetBbox(benchmark::State &state) {
+  cv::Size size = get_size(state);
+  cv::Mat mask = make_mask(size);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cv::boundingRect(mask));
+  }
+  perf.report(state, size.area());
+  set_pixels_processed(state, size);
+  state.SetBytesProcessed(state.iterations() * mask.total());
+}
+
+} // namespace
+
+BENCHMARK(BM_U2NetPreprocess)->Apply(photo_sizes);
+BENCHMARK(BM_U2NetPostprocess)->Apply(photo_sizes);
+BENCHMARK(BM_SAMPreprocess)->Apply(photo_sizes);
+BENCHMARK(BM_SAMTransformCoords)
+    ->Apply(photo_sizes)
+    ->Unit(benchmark::kNanosecond);
+BENCHMARK_REGISTER_F(SAMFixture, Postprocess)->Apply(photo_sizes);
+BENCHMARK_REGISTER_F(SAMFixture, MakeSticker)->Apply(photo_sizes);
+BENCHMARK(BM_GetBbox)->Apply(photo_sizes)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,185 @@
+// fp32 vs 8-bit quantized input and mask paths on synthetic data.
+//
+// Throughput is reported per pixel; the quantized mask benchmarks also
+// report the IoU of their final binary mask against the fp32 path. Perf
+// counters are added where the system allows them, see perf_report.hpp.
+
+#include "perf_report.hpp"
+#include "sam.cpp"
+#include "synthetic.hpp"
+#include "u2net.cpp"
+
+#include <benchmark/benchmark.h>
+#include <filesystem>
+
+namespace {
+
+// Per-tensor asymmetric uint8 quantization, as exported by ONNX Runtime's
+// static quantizer
+std::vector<uint8_t> quantize(const std::vector<float> &values,
+                              cutout::QuantizationParams &params) {
+  auto [min_it, max_it] = std::minmax_element(values.begin(), values.end());
+  params.scale = (*max_it - *min_it) / 255.0f;
+  params.zero_point = (int)std::round(-*min_it / params.scale);
+  params.is_signed = false;
+
+  std::vector<uint8_t> codes(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    codes[i] = cv::saturate_cast<uchar>(
+        std::round(values[i] / params.scale) + params.zero_point);
+  }
+  return codes;
+}
+
+double iou(const cv::Mat &a, const cv::Mat &b) {
+  double intersection = cv::countNonZero(a & b);
+  double union_area = cv::countNonZero(a | b);
+  return union_area == 0 ? 1.0 : intersection / union_area;
+}
+
+cv::Mat binarize(const cv::Mat &normalized_mask) {
+  cv::Mat binary;
+  cv::threshold(normalized_mask, binary, 75, 255, cv::THRESH_BINARY);
+  return binary;
+}
+
+U2NetSegmentImage make_u2net(int size, MaskActivation activation) {
+  U2NetModelDescriptor descriptor;
+  descriptor.input_width = size;
+  descriptor.input_height = size;
+  descriptor.activation = activation;
+
+  U2NetSegmentImage u2net;
+  u2net.configure(descriptor);
+  return u2net;
+}
+
+// Args: model input size, MaskActivation
+void BM_U2NetMaskFp32(benchmark::State &state) {
+  int size = state.range(0);
+  auto u2net = make_u2net(size, static_cast<MaskActivation>(state.range(1)));
+  auto logits = make_logits(size, size);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(u2net.normalize_mask(logits));
+  }
+  perf.report(state, size * size);
+  state.SetItemsProcessed(state.iterations() * size * size);
+  state.SetBytesProcessed(state.iterations() * logits.size() * sizeof(float));
+}
+
+void BM_U2NetMaskQuantized(benchmark::State &state) {
+  int size = state.range(0);
+  auto u2net = make_u2net(size, static_cast<MaskActivation>(state.range(1)));
+  auto logits = make_logits(size, size);
+
+  cutout::QuantizationParams params;
+  auto codes = quantize(logits, params);
+  u2net.set_output_quantization(params);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(u2net.normalize_quantized(codes.data()));
+  }
+  perf.report(state, size * size);
+  state.SetItemsProcessed(state.iterations() * size * size);
+  state.SetBytesProcessed(state.iterations() * codes.size());
+  state.counters["iou"] =
+      iou(binarize(u2net.normalize_mask(logits)),
+          binarize(u2net.normalize_quantized(codes.data())));
+}
+
+// Args: model input size
+template <typename T> void BM_U2NetInput(benchmark::State &state) {
+  int size = state.range(0);
+  cv::Mat image(size, size, CV_8UC3);
+  cv::randu(image, 0, 256);
+  std::vector<T> tensor(3 * size * size);
+
+  auto normalization = cutout::Normalization::from_mean_std(
+      1.0f / 255, {0.485f, 0.456f, 0.406f}, {0.229f, 0.224f, 0.225f});
+  cutout::Preprocessor<cutout::Layout::NCHW, T> preprocessor(normalization);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    preprocessor(image, tensor.data(), cv::Size(size, size));
+    benchmark::ClobberMemory();
+  }
+  perf.report(state, size * size);
+  state.SetItemsProcessed(state.iterations() * size * size);
+  state.SetBytesProcessed(state.iterations() * tensor.size() * sizeof(T));
+}
+
+// SAM decoder output for a 1920x1080 image: 4 masks of 256x256 logits
+class SAMMaskFixture : public benchmark::Fixture {
+public:
+  void SetUp(const benchmark::State &) override {
+    auto directory = std::filesystem::temp_directory_path();
+    image_path = (directory / "cutout_benchmark_image.jpg").string();
+    mask_path = (directory / "cutout_benchmark_mask.png").string();
+
+    cv::Mat image(1080, 1920, CV_8UC3);
+    cv::randu(image, 0, 256);
+    cv::imwrite(image_path, image);
+    sam.preprocess(image_path);
+
+    scores = {0.2f, 0.9f, 0.5f, 0.1f};
+    auto mask = make_logits(256, 256);
+    for (int i = 0; i < 4; i++) {
+      logits.insert(logits.end(), mask.begin(), mask.end());
+    }
+    codes = quantize(logits, params);
+  }
+
+  void TearDown(const benchmark::State &) override {
+    std::filesystem::remove(image_path);
+    std::filesystem::remove(mask_path);
+  }
+
+  cv::Mat read_mask() {
+    sam.get_mask(mask_path);
+    return cv::imread(mask_path, cv::IMREAD_GRAYSCALE);
+  }
+
+  SAMImage sam;
+  std::string image_path;
+  std::string mask_path;
+  std::vector<float> scores;
+  std::vector<float> logits;
+  std::vector<uint8_t> codes;
+  cutout::QuantizationParams params;
+};
+
+BENCHMARK_F(SAMMaskFixture, Fp32)(benchmark::State &state) {
+  PerfReport perf;
+  for (auto _ : state) {
+    sam.postprocess(scores.data(), scores.size(), logits.data());
+  }
+  perf.report(state, 1920 * 1080);
+  state.SetItemsProcessed(state.iterations() * 1920 * 1080);
+}
+
+BENCHMARK_F(SAMMaskFixture, Quantized)(benchmark::State &state) {
+  sam.set_mask_quantization(params);
+
+  PerfReport perf;
+  for (auto _ : state) {
+    sam.postprocess_quantized(scores.data(), scores.size(), codes.data());
+  }
+  perf.report(state, 1920 * 1080);
+  state.SetItemsProcessed(state.iterations() * 1920 * 1080);
+
+  cv::Mat quantized_mask = read_mask();
+  sam.postprocess(scores.data(), scores.size(), logits.data());
+  state.counters["iou"] = iou(read_mask(), quantized_mask);
+}
+
+} // namespace
+
+BENCHMARK(BM_U2NetMaskFp32)->ArgsProduct({{320, 1024}, {0, 1}});
+BENCHMARK(BM_U2NetMaskQuantized)->ArgsProduct({{320, 1024}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_U2NetInput, float)->Arg(320)->Arg(1024);
+BENCHMARK_TEMPLATE(BM_U2NetInput, uint8_t)->Arg(320)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,56 @@
+#pragma once
+
+// Synthetic inputs for the benchmarks, so they need no photos or model
+// files: a subject-like ellipse that the images, masks and logits share.
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include <random>
+#include <vector>
+
+// Soft-edged subject logits in [-8, 8]: an ellipse with a noisy border
+inline std::vector<float> make_logits(int rows, int cols) {
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.0f, 0.5f);
+  std::vector<float> logits(rows * cols);
+
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < cols; x++) {
+      float dx = (x - cols * 0.5f) / (cols * 0.3f);
+      float dy = (y - rows * 0.5f) / (rows * 0.4f);
+      float distance = std::sqrt(dx * dx + dy * dy);
+      float logit = (1.0f - distance) * 12.0f + noise(rng);
+      logits[y * cols + x] = std::min(8.0f, std::max(-8.0f, logit));
+    }
+  }
+  return logits;
+}
+
+// Binary mask of the subject ellipse at full size
+inline cv::Mat make_mask(cv::Size size) {
+  cv::Mat mask = cv::Mat::zeros(size, CV_8U);
+  cv::ellipse(mask, cv::Point(size.width / 2, size.height / 2),
+              cv::Size(size.width * 3 / 10, size.height * 2 / 5), 0, 0, 360,
+              cv::Scalar(255), cv::FILLED);
+  return mask;
+}
+
+// A photo-like BGR image: smooth gradients with the subject in front and
+// mild sensor noise, which compresses and decodes like a real photo rather
+// than like pure noise
+inline cv::Mat make_image(cv::Size size) {
+  cv::Mat image(size, CV_8UC3);
+  for (int y = 0; y < size.height; y++) {
+    auto *row = image.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < size.width; x++) {
+      row[x] = cv::Vec3b(x * 255 / size.width, y * 255 / size.height, 128);
+    }
+  }
+  image.setTo(cv::Scalar(40, 90, 200), make_mask(size));
+
+  cv::Mat noise(size, CV_8UC3);
+  cv::randu(noise, 0, 8);
+  image += noise;
+  return image;
+}
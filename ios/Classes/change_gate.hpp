@@ -0,0 +1,107 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/video.hpp>
+#include <string>
+
+namespace cutout {
+
+// Tells whether a frame differs enough from the last frame that went
+// through the model for a new inference to be worth it. Frames are compared
+// by a small blurred grayscale signature, or with a MOG2 background model
+// for scenes with lighting flicker or sensor noise.
+//
+// The reference is only replaced by frames reported as changed, so a slow
+// drift still triggers once it adds up.
+class ChangeGate {
+public:
+  void configure(bool enabled, float threshold, bool use_background_model,
+                 float foreground_ratio) {
+    this->enabled = enabled;
+    this->threshold = threshold;
+    this->use_background_model = use_background_model;
+    this->foreground_ratio = foreground_ratio;
+    reset();
+  }
+
+  bool is_enabled() const { return enabled; }
+
+  // Accepts a grayscale or BGR frame of any size
+  bool is_changed(const cv::Mat &frame) {
+    if (!enabled) {
+      return true;
+    }
+
+    cv::Mat signature = make_signature(frame);
+    bool changed;
+
+    if (use_background_model) {
+      if (background.empty() || reference.size() != signature.size()) {
+        background = cv::createBackgroundSubtractorMOG2(100, 16, false);
+      }
+      cv::Mat foreground;
+      background->apply(signature, foreground);
+      changed = reference.size() != signature.size() ||
+                cv::countNonZero(foreground) >
+                    foreground_ratio * foreground.total();
+    } else {
+      changed = reference.size() != signature.size() ||
+                cv::norm(signature, reference, cv::NORM_L1) >
+                    threshold * signature.total();
+    }
+
+    if (changed) {
+      reference = signature;
+    }
+    return changed;
+  }
+
+  // Decodes the file at 1/8 scale, which is much cheaper than a full decode
+  bool is_changed(const std::string &image_path) {
+    if (!enabled) {
+      return true;
+    }
+
+    cv::Mat reduced = cv::imread(image_path, cv::IMREAD_REDUCED_GRAYSCALE_8);
+    if (reduced.empty()) {
+      return true;
+    }
+    return is_changed(reduced);
+  }
+
+  void reset() {
+    reference.release();
+    background.reset();
+  }
+
+private:
+  cv::Mat make_signature(const cv::Mat &frame) {
+    cv::Mat gray = frame;
+    if (frame.channels() == 3) {
+      cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+
+    int height = std::max(1, gray.rows * signature_width / gray.cols);
+    cv::Mat signature;
+    cv::resize(gray, signature, cv::Size(signature_width, height), 0, 0,
+               cv::INTER_AREA);
+    // Suppresses sensor noise and single-pixel compression artifacts
+    cv::GaussianBlur(signature, signature, cv::Size(3, 3), 0);
+    return signature;
+  }
+
+  // Static parameters
+  bool enabled{false};
+  // Mean absolute gray level difference that counts as a change
+  float threshold{3.0f};
+  bool use_background_model{false};
+  // Share of foreground pixels that counts as a change
+  float foreground_ratio{0.01f};
+  const int signature_width{64};
+
+  // State variables
+  cv::Mat reference;
+  cv::Ptr<cv::BackgroundSubtractorMOG2> background;
+};
+
+} // namespace cutout
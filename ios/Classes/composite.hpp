@@ -0,0 +1,31 @@
+#pragma once
+
+#include "kernels.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace cutout {
+
+// BGRA cutout of the `roi` of a BGR image: pixels with a non-zero mask keep
+// their color with the mask as alpha, the others are transparent black.
+// One pass per row instead of masking, converting and clearing the whole
+// image, and only the region that is kept is touched. The result is
+// written to `bgra`, e.g. a Mat from a MatPool.
+inline cv::Mat composite(const cv::Mat &bgr, const cv::Mat &mask,
+                         const cv::Rect &roi, cv::Mat bgra = cv::Mat()) {
+  CV_Assert(bgr.type() == CV_8UC3 && mask.type() == CV_8UC1 &&
+            bgr.size() == mask.size());
+
+  bgra.create(roi.size(), CV_8UC4);
+  const auto composite_row = kernels::get().composite;
+
+  cv::parallel_for_(cv::Range(0, roi.height), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; y++) {
+      composite_row(bgr.ptr<uint8_t>(roi.y + y) + roi.x * 3,
+                    mask.ptr<uint8_t>(roi.y + y) + roi.x, roi.width,
+                    bgra.ptr<uint8_t>(y));
+    }
+  });
+  return bgra;
+}
+
+} // namespace cutout
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/flann.hpp>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace cutout {
+
+// A cached result that can stand in for a new image, with the homography
+// that maps pixels of the cached image onto the new one
+struct DuplicateMatch {
+  cv::Mat payload;
+  cv::Mat homography;
+  cv::Size size;
+};
+
+// Recent images with the result computed for each of them (a mask, an
+// embedding), looked up by perceptual similarity so burst shots and
+// re-framed copies reuse a result instead of running the model again.
+//
+// Candidates are preselected by the Hamming distance of a DCT hash, then
+// confirmed by ORB features matched through a FLANN LSH index and a RANSAC
+// homography. Only matches with enough inliers and a small, well-behaved
+// warp are reported.
+//
+// Each pipeline instance owns its index. The isolates a model runs requests
+// on call into the same instance, so the state is guarded by a mutex; the
+// features are computed and matched outside of it, on copies of the
+// candidate entries.
+class DuplicateIndex {
+public:
+  DuplicateIndex() = default;
+  DuplicateIndex(const DuplicateIndex &) = delete;
+  DuplicateIndex &operator=(const DuplicateIndex &) = delete;
+
+  // Takes the settings and entries over; each index keeps its own mutex,
+  // so the pipelines holding one stay movable
+  DuplicateIndex(DuplicateIndex &&other) {
+    std::lock_guard<std::mutex> lock(other.mutex);
+    enabled = other.enabled;
+    max_hash_distance = other.max_hash_distance;
+    min_inliers = other.min_inliers;
+    capacity = other.capacity;
+    max_corner_shift = other.max_corner_shift;
+    entries = std::move(other.entries);
+    pending = std::move(other.pending);
+    has_pending = other.has_pending;
+    other.entries.clear();
+    other.has_pending = false;
+  }
+
+  // `max_corner_shift` is the share of the image diagonal a corner may
+  // move by under the homography of an accepted match
+  void configure(bool enabled, int max_hash_distance, int min_inliers,
+                 int capacity, float max_corner_shift = 0.1f) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->enabled = enabled;
+    this->max_hash_distance = max_hash_distance;
+    this->min_inliers = min_inliers;
+    this->capacity = std::max(capacity, 1);
+    this->max_corner_shift = max_corner_shift;
+    entries.clear();
+    has_pending = false;
+  }
+
+  bool is_enabled() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return enabled;
+  }
+
+  // Looks for a near duplicate of a BGR image. On a miss, the signature of
+  // the image is kept so the following add() does not compute it again.
+  bool find(const cv::Mat &image, DuplicateMatch &match) {
+    std::vector<std::pair<int, Entry>> candidates;
+    int required_inliers;
+    float corner_shift;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      has_pending = false;
+      if (!enabled || image.empty()) {
+        return false;
+      }
+      required_inliers = min_inliers;
+      corner_shift = max_corner_shift;
+    }
+
+    Signature signature = make_signature(image);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const Entry &entry : entries) {
+        int distance = hamming(entry.signature.hash, signature.hash);
+        if (distance <= max_hash_distance) {
+          candidates.push_back({distance, entry});
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    for (const auto &candidate : candidates) {
+      const Entry &entry = candidate.second;
+      cv::Mat homography;
+      if (estimate(entry.signature, signature, required_inliers, homography) &&
+          is_small_warp(homography, entry.signature.size, signature.size,
+                        corner_shift)) {
+        match.payload = entry.payload;
+        match.homography = homography;
+        match.size = entry.signature.size;
+        return true;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = std::move(signature);
+    has_pending = true;
+    return false;
+  }
+
+  // Stores the result computed for the image of the last missed find()
+  void add(const cv::Mat &payload) {
+    cv::Mat copy = payload.clone();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!has_pending) {
+      return;
+    }
+    has_pending = false;
+
+    entries.push_front({std::move(pending), copy});
+    if ((int)entries.size() > capacity) {
+      entries.pop_back();
+    }
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    has_pending = false;
+  }
+
+  int size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+  }
+
+private:
+  struct Signature {
+    uint64_t hash{0};
+    cv::Size size;
+    // Keypoints in full image coordinates
+    std::vector<cv::Point2f> points;
+    cv::Mat descriptors;
+  };
+
+  struct Entry {
+    Signature signature;
+    cv::Mat payload;
+  };
+
+  Signature make_signature(const cv::Mat &image) const {
+    Signature signature;
+    signature.size = image.size();
+
+    cv::Mat gray;
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+
+    // Features on a bounded size keep the cost flat from VGA to 48 MP
+    float scale = std::min(1.0f, (float)feature_size /
+                                     std::max(gray.cols, gray.rows));
+    cv::Mat small;
+    cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+
+    signature.hash = dct_hash(small);
+
+    // One detector per call, as concurrent finds would share its state
+    cv::Ptr<cv::ORB> orb = cv::ORB::create(max_features);
+    std::vector<cv::KeyPoint> keypoints;
+    orb->detectAndCompute(small, cv::noArray(), keypoints,
+                          signature.descriptors);
+    for (const cv::KeyPoint &keypoint : keypoints) {
+      signature.points.push_back(keypoint.pt / scale);
+    }
+    return signature;
+  }
+
+  // 64 bits telling whether each low frequency of the 32x32 DCT is above
+  // their median; robust to scaling, compression and small shifts
+  static uint64_t dct_hash(const cv::Mat &gray) {
+    cv::Mat resized, coefficients;
+    cv::resize(gray, resized, cv::Size(32, 32), 0, 0, cv::INTER_AREA);
+    resized.convertTo(resized, CV_32F);
+    cv::dct(resized, coefficients);
+
+    // The DC term only carries the mean brightness
+    cv::Mat low = coefficients(cv::Rect(0, 0, 8, 8)).clone();
+    low.at<float>(0, 0) = 0;
+    std::vector<float> values(low.begin<float>(), low.end<float>());
+    std::nth_element(values.begin(), values.begin() + 32, values.end());
+    float median = values[32];
+
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i++) {
+      if (low.at<float>(i / 8, i % 8) > median) {
+        hash |= uint64_t(1) << i;
+      }
+    }
+    return hash;
+  }
+
+  static int hamming(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+  }
+
+  bool estimate(const Signature &from, const Signature &to,
+                int required_inliers, cv::Mat &homography) const {
+    if (from.descriptors.rows < required_inliers ||
+        to.descriptors.rows < required_inliers) {
+      return false;
+    }
+
+    // LSH suits binary ORB descriptors, where KD-trees do not apply
+    cv::FlannBasedMatcher matcher(cv::makePtr<cv::flann::LshIndexParams>(6, 12, 1),
+                                  cv::makePtr<cv::flann::SearchParams>(32));
+    std::vector<std::vector<cv::DMatch>> knn_matches;
+    matcher.knnMatch(to.descriptors, from.descriptors, knn_matches, 2);
+
+    std::vector<cv::Point2f> from_points, to_points;
+    for (const auto &pair : knn_matches) {
+      // Lowe's ratio test
+      if (pair.size() == 2 && pair[0].distance < 0.75f * pair[1].distance) {
+        from_points.push_back(from.points[pair[0].trainIdx]);
+        to_points.push_back(to.points[pair[0].queryIdx]);
+      }
+    }
+    if ((int)from_points.size() < required_inliers) {
+      return false;
+    }
+
+    float threshold = 0.005f * std::max(to.size.width, to.size.height);
+    cv::Mat inliers;
+    homography = cv::findHomography(from_points, to_points, cv::RANSAC,
+                                    threshold, inliers);
+    return !homography.empty() &&
+           cv::countNonZero(inliers) >= required_inliers;
+  }
+
+  // Rejects warps that move a corner by more than a share of the diagonal,
+  // where a reused result would be visibly off
+  static bool is_small_warp(const cv::Mat &homography, cv::Size from,
+                            cv::Size to, float max_corner_shift) {
+    std::vector<cv::Point2f> corners{{0, 0},
+                                     {(float)from.width, 0},
+                                     {(float)from.width, (float)from.height},
+                                     {0, (float)from.height}};
+    std::vector<cv::Point2f> targets{{0, 0},
+                                     {(float)to.width, 0},
+                                     {(float)to.width, (float)to.height},
+                                     {0, (float)to.height}};
+    std::vector<cv::Point2f> warped;
+    cv::perspectiveTransform(corners, warped, homography);
+
+    float limit = max_corner_shift * std::hypot(to.width, to.height);
+    for (size_t i = 0; i < warped.size(); i++) {
+      if (cv::norm(warped[i] - targets[i]) > limit) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Static parameters
+  bool enabled{false};
+  int max_hash_distance{10};
+  int min_inliers{40};
+  int capacity{8};
+  const int feature_size{640};
+  const int max_features{500};
+  float max_corner_shift{0.1f};
+
+  // State variables
+  mutable std::mutex mutex;
+  std::deque<Entry> entries;
+  Signature pending;
+  bool has_pending{false};
+};
+
+} // namespace cutout
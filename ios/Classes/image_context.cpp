@@ -0,0 +1,27 @@
+#pragma once
+
+#include "image_context.hpp"
+#include "u2net.hpp"
+
+extern "C" {
+// The caller owns the returned reference
+FUNCTION_ATTRIBUTE
+ImageContext *create_image_context(const char *image_path) {
+  return new ImageContext(image_path);
+}
+
+FUNCTION_ATTRIBUTE
+void retain_image_context(ImageContext *context) { context->retain(); }
+
+FUNCTION_ATTRIBUTE
+void release_image_context(ImageContext *context) { context->release(); }
+
+// False when the file could not be decoded
+FUNCTION_ATTRIBUTE
+bool get_size_image_context(ImageContext *context, int *width, int *height) {
+  const cv::Mat &image = context->get_image();
+  *width = image.cols;
+  *height = image.rows;
+  return !image.empty();
+}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "memory_budget.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// A decoded image shared by every pipeline working on the same photo, so
+// auto-cutout, SAM refinement and sticker export decode and hold it once.
+//
+// Contexts are reference counted: the creator owns one reference, and each
+// pipeline that keeps the context retains its own. Halved pyramid levels
+// are built on first use and kept for later callers. The pixels are never
+// modified after decoding, so users share them without copies.
+//
+// Images are decoded within the MemoryBudget, so the pixels may be smaller
+// than the file; `get_original_size` keeps the size of the file, which
+// prompt coordinates refer to.
+class ImageContext {
+public:
+  explicit ImageContext(const std::string &image_path)
+      : path(image_path),
+        image(cutout::MemoryBudget::instance().decode(image_path,
+                                                      original_size)) {
+    levels.push_back(image);
+  }
+
+  ImageContext(const ImageContext &) = delete;
+  ImageContext &operator=(const ImageContext &) = delete;
+
+  void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+
+  // Deletes the context with the last reference
+  void release() {
+    if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  const std::string &get_path() const { return path; }
+  const cv::Mat &get_image() const { return image; }
+  cv::Size get_original_size() const { return original_size; }
+  bool is_empty() const { return image.empty(); }
+
+  // The smallest pyramid level still covering `size` in both dimensions,
+  // so a following resize is a mild downscale instead of a large one
+  cv::Mat get_level(cv::Size size) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t index = 0;; index++) {
+      const cv::Mat &level = levels[index];
+      cv::Size half((level.cols + 1) / 2, (level.rows + 1) / 2);
+      if (level.empty() || half.width < size.width ||
+          half.height < size.height) {
+        return level;
+      }
+      if (index + 1 == levels.size()) {
+        cv::Mat next;
+        cv::resize(level, next, half, 0, 0, cv::INTER_AREA);
+        levels.push_back(next);
+      }
+    }
+  }
+
+private:
+  ~ImageContext() = default;
+
+  const std::string path;
+  // Set while decoding `image`, so declared before it
+  cv::Size original_size;
+  const cv::Mat image;
+
+  std::atomic<int> references{1};
+  std::mutex mutex;
+  // levels[0] is the full image, each next level half the previous one
+  std::vector<cv::Mat> levels;
+};
+
+struct ImageContextRelease {
+  void operator()(ImageContext *context) const { context->release(); }
+};
+
+// Owning reference to a context, released when it goes out of scope
+using ImageContextRef = std::unique_ptr<ImageContext, ImageContextRelease>;
+
+inline ImageContextRef retain_context(ImageContext *context) {
+  context->retain();
+  return ImageContextRef(context);
+}
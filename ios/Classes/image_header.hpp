@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace cutout {
+
+enum class ImageFormat { UNKNOWN = 0, JPEG = 1, PNG = 2, WEBP = 3 };
+
+namespace detail {
+
+inline int read_be16(const uint8_t *bytes) { return bytes[0] << 8 | bytes[1]; }
+
+inline int64_t read_be32(const uint8_t *bytes) {
+  return (int64_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+}
+
+inline int read_le16(const uint8_t *bytes) { return bytes[0] | bytes[1] << 8; }
+
+inline int read_le24(const uint8_t *bytes) {
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16;
+}
+
+// Walks the JPEG markers up to the first start-of-frame segment
+inline bool read_jpeg_size(std::ifstream &file, cv::Size &size) {
+  file.seekg(2);
+  uint8_t header[7];
+  while (file.read(reinterpret_cast<char *>(header), 2)) {
+    if (header[0] != 0xff) {
+      return false;
+    }
+    int marker = header[1];
+    // Fill bytes before a marker
+    if (marker == 0xff) {
+      file.seekg(-1, std::ios::cur);
+      continue;
+    }
+    // Markers without a segment
+    if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd9)) {
+      continue;
+    }
+
+    if (!file.read(reinterpret_cast<char *>(header), 2)) {
+      return false;
+    }
+    int length = read_be16(header);
+    if (length < 2) {
+      return false;
+    }
+
+    // SOF0 to SOF15, except DHT, JPG and DAC which share the range
+    bool is_frame = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+                    marker != 0xc8 && marker != 0xcc;
+    if (is_frame) {
+      if (!file.read(reinterpret_cast<char *>(header), 5)) {
+        return false;
+      }
+      size = cv::Size(read_be16(header + 3), read_be16(header + 1));
+      return true;
+    }
+    file.seekg(length - 2, std::ios::cur);
+  }
+  return false;
+}
+
+} // namespace detail
+
+// Dimensions of a JPEG, PNG or WebP file from its header, without decoding
+// it. They are those stored in the file: an EXIF orientation that
+// cv::imread applies may swap them.
+inline bool read_image_size(const std::string &image_path, cv::Size &size,
+                            ImageFormat *format = nullptr) {
+  ImageFormat unused;
+  format = format ? format : &unused;
+  *format = ImageFormat::UNKNOWN;
+
+  std::ifstream file(image_path, std::ios::binary);
+  uint8_t header[30] = {};
+  if (!file.read(reinterpret_cast<char *>(header), 2)) {
+    return false;
+  }
+
+  if (header[0] == 0xff && header[1] == 0xd8) {
+    *format = ImageFormat::JPEG;
+    return detail::read_jpeg_size(file, size) && !size.empty();
+  }
+
+  file.read(reinterpret_cast<char *>(header) + 2, sizeof(header) - 2);
+  if (file.gcount() < (std::streamsize)sizeof(header) - 2) {
+    return false;
+  }
+
+  // Signature, then the IHDR chunk
+  static const uint8_t png_signature[8] = {0x89, 'P',  'N',  'G',
+                                           '\r', '\n', 0x1a, '\n'};
+  if (std::equal(png_signature, png_signature + 8, header)) {
+    *format = ImageFormat::PNG;
+    size = cv::Size(detail::read_be32(header + 16),
+                    detail::read_be32(header + 20));
+    return !size.empty();
+  }
+
+  // RIFF container with a lossy, lossless or extended first chunk
+  if (std::equal(header, header + 4, "RIFF") &&
+      std::equal(header + 8, header + 12, "WEBP")) {
+    *format = ImageFormat::WEBP;
+    const uint8_t *chunk = header + 12;
+    if (std::equal(chunk, chunk + 4, "VP8 ")) {
+      size = cv::Size(detail::read_le16(header + 26) & 0x3fff,
+                      detail::read_le16(header + 28) & 0x3fff);
+    } else if (std::equal(chunk, chunk + 4, "VP8L")) {
+      uint32_t bits = header[21] | header[22] << 8 | header[23] << 16 |
+                      (uint32_t)header[24] << 24;
+      size = cv::Size((bits & 0x3fff) + 1, ((bits >> 14) & 0x3fff) + 1);
+    } else if (std::equal(chunk, chunk + 4, "VP8X")) {
+      size = cv::Size(detail::read_le24(header + 24) + 1,
+                      detail::read_le24(header + 27) + 1);
+    } else {
+      return false;
+    }
+    return !size.empty();
+  }
+
+  return false;
+}
+
+} // namespace cutout
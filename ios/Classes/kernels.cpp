@@ -0,0 +1,97 @@
+#pragma once
+
+#include "u2net.hpp"
+
+// The baseline variant uses the instruction set the whole library is built
+// for: SSE2 on x86-64, NEON on arm64
+#define CUTOUT_KERNEL_NAMESPACE baseline
+#define CUTOUT_KERNEL_ISA Isa::BASELINE
+#define CUTOUT_KERNEL_NAME "baseline"
+#include "kernels_impl.hpp"
+#undef CUTOUT_KERNEL_NAMESPACE
+#undef CUTOUT_KERNEL_ISA
+#undef CUTOUT_KERNEL_NAME
+
+#include <chrono>
+#include <initializer_list>
+#include <vector>
+
+namespace cutout {
+namespace kernels {
+
+const KernelTable *get_baseline() { return &baseline::table; }
+
+// OpenCV's CPU detection also checks that the OS saves the wide registers,
+// and honors OPENCV_CPU_DISABLE for testing the fallbacks
+const KernelTable *get(Isa isa) {
+  switch (isa) {
+  case Isa::BASELINE:
+    return get_baseline();
+  case Isa::AVX2: {
+    const KernelTable *table = get_avx2();
+    return table && cv::checkHardwareSupport(CV_CPU_AVX2) &&
+                   cv::checkHardwareSupport(CV_CPU_FMA3)
+               ? table
+               : nullptr;
+  }
+  case Isa::AVX512: {
+    const KernelTable *table = get_avx512();
+    return table && cv::checkHardwareSupport(CV_CPU_AVX512_SKX) ? table
+                                                                 : nullptr;
+  }
+  }
+  return nullptr;
+}
+
+// Wider is not always faster: the pixel loops are close to memory bound,
+// and 512-bit deinterleaving costs more than it saves on some cores. The
+// supported variants are timed on a small synthetic batch instead, which
+// takes well under a millisecond.
+static const KernelTable *select_fastest() {
+  const int width = 1024, rows = 64;
+  std::vector<uint8_t> bgr(width * 3, 128), mask(width, 255);
+  std::vector<uint8_t> bgra(width * 4);
+  std::vector<float> planes(width * 3);
+  Normalization normalization;
+
+  const KernelTable *fastest = get_baseline();
+  auto fastest_time = std::chrono::steady_clock::duration::max();
+  for (Isa isa : {Isa::BASELINE, Isa::AVX2, Isa::AVX512}) {
+    const KernelTable *table = get(isa);
+    if (!table) {
+      continue;
+    }
+
+    auto best_time = std::chrono::steady_clock::duration::max();
+    for (int repeat = 0; repeat < 3; repeat++) {
+      auto start = std::chrono::steady_clock::now();
+      for (int row = 0; row < rows; row++) {
+        table->normalize_bgr(bgr.data(), width, normalization, planes.data(),
+                             planes.data() + width,
+                             planes.data() + width * 2);
+        table->composite(bgr.data(), mask.data(), width, bgra.data());
+      }
+      best_time = std::min(best_time, std::chrono::steady_clock::now() - start);
+    }
+
+    if (best_time < fastest_time) {
+      fastest = table;
+      fastest_time = best_time;
+    }
+  }
+  return fastest;
+}
+
+const KernelTable &get() {
+  static const KernelTable *best = select_fastest();
+  return *best;
+}
+
+} // namespace kernels
+} // namespace cutout
+
+extern "C" {
+// Name of the kernel variant in use, for diagnostics
+FUNCTION_ATTRIBUTE
+const char *get_kernels_name() { return cutout::kernels::get().name; }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Kept free of OpenCV includes: the instruction-set variants of the kernels
+// include this header before setting up OpenCV's SIMD macros for their
+// target.
+
+namespace cutout {
+
+// Per-channel normalization folded into out = pixel * alpha + beta, indexed
+// in tensor channel order
+struct Normalization {
+  std::array<float, 3> alpha{1.0f, 1.0f, 1.0f};
+  std::array<float, 3> beta{0.0f, 0.0f, 0.0f};
+
+  // (pixel * scale - mean) / std
+  static Normalization from_mean_std(float scale,
+                                     const std::array<float, 3> &mean,
+                                     const std::array<float, 3> &std) {
+    Normalization normalization;
+    for (int c = 0; c < 3; c++) {
+      normalization.alpha[c] = scale / std[c];
+      normalization.beta[c] = -mean[c] / std[c];
+    }
+    return normalization;
+  }
+};
+
+namespace kernels {
+
+// arm64 only has the baseline: NEON is always there, and the kernels have
+// no dot products or other work the later extensions would speed up
+enum class Isa { BASELINE = 0, AVX2 = 1, AVX512 = 2 };
+
+// Row kernels of the hot pixel loops. Each instruction set gets its own
+// table, built from the same source with OpenCV's universal intrinsics
+// widened to that target, and the fastest one the CPU supports is picked
+// at runtime.
+struct KernelTable {
+  Isa isa;
+  const char *name;
+
+  // Splits an interleaved BGR row into three normalized float rows, in BGR
+  // or RGB tensor channel order
+  void (*normalize_bgr)(const uint8_t *src, int width,
+                        const Normalization &normalization, float *c0,
+                        float *c1, float *c2);
+  void (*normalize_rgb)(const uint8_t *src, int width,
+                        const Normalization &normalization, float *c0,
+                        float *c1, float *c2);
+
+  // BGR pixels with a non-zero mask become BGRA with the mask as alpha,
+  // the others transparent black
+  void (*composite)(const uint8_t *bgr, const uint8_t *mask, int width,
+                    uint8_t *bgra);
+};
+
+// Tables of the variants, or nullptr when a variant is not built for this
+// architecture; whether the CPU runs it is checked by `get`
+const KernelTable *get_baseline();
+const KernelTable *get_avx2();
+const KernelTable *get_avx512();
+
+// The variant for `isa` when it is built and the CPU supports it
+const KernelTable *get(Isa isa);
+
+// The fastest variant on this CPU, chosen on first use
+const KernelTable &get();
+
+} // namespace kernels
+} // namespace cutout
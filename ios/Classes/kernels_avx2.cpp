@@ -0,0 +1,53 @@
+#pragma once
+
+// AVX2 + FMA variant of the kernels. The target is set with pragmas rather
+// than per-file compiler flags, so every build system compiles this file
+// the same way; only code after the pragma may use AVX2.
+
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#define CV_CPU_DISPATCH_MODE AVX2
+#define CV_AVX 1
+#define CV_AVX2 1
+#define CV_FMA3 1
+#define CV_FP16 1
+
+// Shared OpenCV and system headers are parsed for the baseline first, so
+// none of their inline functions are emitted with AVX2 instructions
+#include <cmath>
+#include <immintrin.h>
+#include <opencv2/core/cvdef.h>
+#include <opencv2/core/saturate.hpp>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx,avx2,fma,f16c"))), \
+                             apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx,avx2,fma,f16c")
+#endif
+
+#define CUTOUT_KERNEL_NAMESPACE avx2
+#define CUTOUT_KERNEL_ISA Isa::AVX2
+#define CUTOUT_KERNEL_NAME "avx2"
+#include "kernels_impl.hpp"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+const cutout::kernels::KernelTable *cutout::kernels::get_avx2() {
+  return &avx2::table;
+}
+
+#else
+
+const cutout::kernels::KernelTable *cutout::kernels::get_avx2() {
+  return nullptr;
+}
+
+#endif
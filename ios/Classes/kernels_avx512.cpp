@@ -0,0 +1,58 @@
+#pragma once
+
+// AVX-512 (Skylake-X feature set) variant of the kernels, see
+// kernels_avx2.cpp for how the target is set.
+
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#define CV_CPU_DISPATCH_MODE AVX512_SKX
+#define CV_AVX 1
+#define CV_AVX2 1
+#define CV_FMA3 1
+#define CV_FP16 1
+#define CV_AVX_512F 1
+#define CV_AVX_512CD 1
+#define CV_AVX_512BW 1
+#define CV_AVX_512DQ 1
+#define CV_AVX_512VL 1
+#define CV_AVX512_SKX 1
+
+#include <cmath>
+#include <immintrin.h>
+#include <opencv2/core/cvdef.h>
+#include <opencv2/core/saturate.hpp>
+
+#if defined(__clang__)
+#pragma clang attribute push(                                                 \
+    __attribute__((target(                                                     \
+        "avx,avx2,fma,f16c,avx512f,avx512cd,avx512bw,avx512dq,avx512vl"))),    \
+    apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx,avx2,fma,f16c,avx512f,avx512cd,avx512bw,avx512dq,avx512vl")
+#endif
+
+#define CUTOUT_KERNEL_NAMESPACE avx512
+#define CUTOUT_KERNEL_ISA Isa::AVX512
+#define CUTOUT_KERNEL_NAME "avx512"
+#include "kernels_impl.hpp"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+const cutout::kernels::KernelTable *cutout::kernels::get_avx512() {
+  return &avx512::table;
+}
+
+#else
+
+const cutout::kernels::KernelTable *cutout::kernels::get_avx512() {
+  return nullptr;
+}
+
+#endif
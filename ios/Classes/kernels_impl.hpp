@@ -0,0 +1,115 @@
+#pragma once
+
+// Kernel bodies, compiled once per instruction set. The including file
+// defines CUTOUT_KERNEL_NAMESPACE, CUTOUT_KERNEL_ISA, CUTOUT_KERNEL_NAME
+// and, for variants above the baseline, OpenCV's dispatch and SIMD feature
+// macros before any OpenCV header, so the universal intrinsics below widen
+// to that target and live in their own namespace.
+
+#include "kernels.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace cutout {
+namespace kernels {
+namespace CUTOUT_KERNEL_NAMESPACE {
+
+#if CV_SIMD
+// Widens 8-bit lanes to float, normalizes them and stores them contiguously
+static inline void expand_normalize_store(const cv::v_uint8 &pixels,
+                                          const cv::v_float32 &alpha,
+                                          const cv::v_float32 &beta,
+                                          float *dst) {
+  using namespace cv;
+  const int lanes = VTraits<v_float32>::vlanes();
+
+  v_uint16 w0, w1;
+  v_expand(pixels, w0, w1);
+  v_uint32 d0, d1, d2, d3;
+  v_expand(w0, d0, d1);
+  v_expand(w1, d2, d3);
+
+  v_store(dst, v_fma(v_cvt_f32(v_reinterpret_as_s32(d0)), alpha, beta));
+  v_store(dst + lanes,
+          v_fma(v_cvt_f32(v_reinterpret_as_s32(d1)), alpha, beta));
+  v_store(dst + lanes * 2,
+          v_fma(v_cvt_f32(v_reinterpret_as_s32(d2)), alpha, beta));
+  v_store(dst + lanes * 3,
+          v_fma(v_cvt_f32(v_reinterpret_as_s32(d3)), alpha, beta));
+}
+#endif
+
+// `swap` selects RGB tensor order
+template <bool swap>
+static void normalize_row(const uint8_t *src, int width,
+                          const Normalization &normalization, float *c0,
+                          float *c1, float *c2) {
+  // Source channel feeding each tensor channel
+  constexpr int s0 = swap ? 2 : 0;
+  constexpr int s2 = swap ? 0 : 2;
+
+  int x = 0;
+#if CV_SIMD
+  using namespace cv;
+  const int lanes = VTraits<v_uint8>::vlanes();
+  const v_float32 alpha0 = vx_setall_f32(normalization.alpha[0]);
+  const v_float32 alpha1 = vx_setall_f32(normalization.alpha[1]);
+  const v_float32 alpha2 = vx_setall_f32(normalization.alpha[2]);
+  const v_float32 beta0 = vx_setall_f32(normalization.beta[0]);
+  const v_float32 beta1 = vx_setall_f32(normalization.beta[1]);
+  const v_float32 beta2 = vx_setall_f32(normalization.beta[2]);
+
+  for (; x <= width - lanes; x += lanes) {
+    v_uint8 b, g, r;
+    v_load_deinterleave(src + x * 3, b, g, r);
+    expand_normalize_store(swap ? r : b, alpha0, beta0, c0 + x);
+    expand_normalize_store(g, alpha1, beta1, c1 + x);
+    expand_normalize_store(swap ? b : r, alpha2, beta2, c2 + x);
+  }
+  vx_cleanup();
+#endif
+
+  for (; x < width; x++) {
+    const uint8_t *pixel = src + x * 3;
+    c0[x] = pixel[s0] * normalization.alpha[0] + normalization.beta[0];
+    c1[x] = pixel[1] * normalization.alpha[1] + normalization.beta[1];
+    c2[x] = pixel[s2] * normalization.alpha[2] + normalization.beta[2];
+  }
+}
+
+static void composite(const uint8_t *bgr, const uint8_t *mask, int width,
+                      uint8_t *bgra) {
+  int x = 0;
+#if CV_SIMD
+  using namespace cv;
+  const int lanes = VTraits<v_uint8>::vlanes();
+  const v_uint8 zero = vx_setzero_u8();
+
+  for (; x <= width - lanes; x += lanes) {
+    v_uint8 b, g, r;
+    v_load_deinterleave(bgr + x * 3, b, g, r);
+    v_uint8 alpha = vx_load(mask + x);
+    v_uint8 keep = v_ne(alpha, zero);
+    v_store_interleave(bgra + x * 4, v_and(b, keep), v_and(g, keep),
+                       v_and(r, keep), alpha);
+  }
+  vx_cleanup();
+#endif
+
+  for (; x < width; x++) {
+    const uint8_t *pixel = bgr + x * 3;
+    uint8_t *out = bgra + x * 4;
+    uint8_t keep = mask[x] ? 0xff : 0;
+    out[0] = pixel[0] & keep;
+    out[1] = pixel[1] & keep;
+    out[2] = pixel[2] & keep;
+    out[3] = mask[x];
+  }
+}
+
+static const KernelTable table{CUTOUT_KERNEL_ISA, CUTOUT_KERNEL_NAME,
+                               normalize_row<false>, normalize_row<true>,
+                               composite};
+
+} // namespace CUTOUT_KERNEL_NAMESPACE
+} // namespace kernels
+} // namespace cutout
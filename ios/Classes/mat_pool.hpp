@@ -0,0 +1,303 @@
+#pragma once
+
+#include "native_memory.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace cutout {
+
+struct MatPoolStats {
+  // Bytes of pooled buffers held by Mats
+  int64_t in_use{0};
+  // Bytes of returned buffers kept for reuse
+  int64_t cached{0};
+  // Largest in_use + cached since the pool was created or last trimmed
+  int64_t high_water{0};
+  // Pooled requests served from the cache, and those that hit the heap
+  int64_t hits{0};
+  int64_t misses{0};
+};
+
+// cv::MatAllocator that keeps the large buffers of a session for reuse.
+// The pipelines allocate the same full-resolution temporaries for every
+// image (resized masks, morphology outputs, the BGRA cutout), so after the
+// first image of a size they come from the pool instead of the heap, with
+// no page faults on fresh memory.
+//
+// Sizes are rounded up to one of eight classes per power of two, wasting
+// at most 12.5%, so images of slightly different sizes share buffers.
+// Buffers below `min_pooled_bytes` are not worth keeping and go straight to
+// the heap.
+//
+// Buffers handed out count as allocated for the stage and session in
+// MemoryAttribution, whether they come from the cache or the heap, and as
+// freed when they come back; the cache itself is in the pool stats.
+//
+// Mats only use the pool when created from `mat()`; results derived from
+// them with the usual OpenCV calls keep using it. A Mat may outlive its
+// session, so the owner calls `release`, which frees the cached buffers at
+// once and the pool itself when the last buffer comes back.
+class MatPool : public cv::MatAllocator {
+public:
+  static const size_t min_pooled_bytes = 64 * 1024;
+
+  MatPool() = default;
+  MatPool(const MatPool &) = delete;
+  MatPool &operator=(const MatPool &) = delete;
+
+  // An empty Mat whose data will come from the pool
+  cv::Mat mat() const {
+    cv::Mat mat;
+    mat.allocator = const_cast<MatPool *>(this);
+    return mat;
+  }
+
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                         size_t *step, cv::AccessFlag,
+                         cv::UMatUsageFlags) const override {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+      if (step) {
+        if (data && step[i] != cv::Mat::AUTO_STEP) {
+          total = step[i];
+        } else {
+          step[i] = total;
+        }
+      }
+      total *= sizes[i];
+    }
+
+    cv::UMatData *u = new cv::UMatData(this);
+    u->size = total;
+    if (data) {
+      u->data = u->origdata = static_cast<uchar *>(data);
+      u->flags |= cv::UMatData::USER_ALLOCATED;
+    } else {
+      u->data = u->origdata = acquire(total);
+      MemoryAttribution::allocated(u);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    live_buffers++;
+    return u;
+  }
+
+  bool allocate(cv::UMatData *u, cv::AccessFlag,
+                cv::UMatUsageFlags) const override {
+    return u != nullptr;
+  }
+
+  void deallocate(cv::UMatData *u) const override {
+    if (!u) {
+      return;
+    }
+    CV_Assert(u->urefcount == 0 && u->refcount == 0);
+
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+      recycle(u->origdata, u->size);
+      MemoryAttribution::freed(u);
+    }
+    delete u;
+
+    bool is_last;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_last = --live_buffers == 0 && is_released;
+    }
+    if (is_last) {
+      delete this;
+    }
+  }
+
+  MatPoolStats get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+  }
+
+  // Frees the cached buffers, e.g. under memory pressure, and restarts the
+  // high-water mark from what is still in use
+  void trim() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_cached();
+    stats.high_water = stats.in_use;
+  }
+
+  // Deletes the pool once no Mat uses it anymore
+  void release() {
+    bool is_unused;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      free_cached();
+      is_released = true;
+      is_unused = live_buffers == 0;
+    }
+    if (is_unused) {
+      delete this;
+    }
+  }
+
+private:
+  ~MatPool() override = default;
+
+  // Eight classes per power of two
+  static size_t size_class(size_t size) {
+    int log2 = 0;
+    while ((size >> (log2 + 1)) != 0) {
+      log2++;
+    }
+    size_t step = size_t(1) << std::max(0, log2 - 3);
+    return (size + step - 1) / step * step;
+  }
+
+  uchar *acquire(size_t size) const {
+    if (size < min_pooled_bytes) {
+      NativeMemory::allocated(size);
+      return static_cast<uchar *>(cv::fastMalloc(size));
+    }
+
+    size_t capacity = size_class(size);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.in_use += capacity;
+      auto free_list = free_buffers.find(capacity);
+      if (free_list != free_buffers.end() && !free_list->second.empty()) {
+        uchar *buffer = free_list->second.back();
+        free_list->second.pop_back();
+        stats.cached -= capacity;
+        NativeMemory::cached(-(int64_t)capacity);
+        stats.hits++;
+        return buffer;
+      }
+      stats.misses++;
+      stats.high_water =
+          std::max(stats.high_water, stats.in_use + stats.cached);
+    }
+    NativeMemory::allocated(capacity);
+    return static_cast<uchar *>(cv::fastMalloc(capacity));
+  }
+
+  void recycle(uchar *buffer, size_t size) const {
+    if (size < min_pooled_bytes) {
+      cv::fastFree(buffer);
+      NativeMemory::freed(size);
+      return;
+    }
+
+    size_t capacity = size_class(size);
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.in_use -= capacity;
+    if (is_released) {
+      cv::fastFree(buffer);
+      NativeMemory::freed(capacity);
+      return;
+    }
+    free_buffers[capacity].push_back(buffer);
+    stats.cached += capacity;
+    NativeMemory::cached(capacity);
+  }
+
+  // Called with the mutex held
+  void free_cached() const {
+    for (auto &free_list : free_buffers) {
+      for (uchar *buffer : free_list.second) {
+        cv::fastFree(buffer);
+        NativeMemory::freed(free_list.first);
+      }
+    }
+    free_buffers.clear();
+    NativeMemory::cached(-stats.cached);
+    stats.cached = 0;
+  }
+
+  mutable std::mutex mutex;
+  // Returned buffers by size class
+  mutable std::map<size_t, std::vector<uchar *>> free_buffers;
+  mutable MatPoolStats stats;
+  mutable int64_t live_buffers{0};
+  bool is_released{false};
+};
+
+struct MatPoolRelease {
+  void operator()(MatPool *pool) const { pool->release(); }
+};
+
+// Owning reference to a pool, released when it goes out of scope
+using MatPoolRef = std::unique_ptr<MatPool, MatPoolRelease>;
+
+inline MatPoolRef make_mat_pool() { return MatPoolRef(new MatPool()); }
+
+// FFI tensor buffers of a session kept for reuse, for the model inputs and
+// outputs that have the same few sizes on every call. Buffers come from
+// `allocate_tensor` and are matched by exact size and stage; a reused one
+// still holds the data of its last call.
+//
+// Like MatPool, a buffer counts for its stage while handed out and in
+// NativeMemory's cached bytes while kept here.
+class TensorPool {
+public:
+  TensorPool() = default;
+  TensorPool(const TensorPool &) = delete;
+  TensorPool &operator=(const TensorPool &) = delete;
+  ~TensorPool() { trim(); }
+
+  void *acquire(int64_t bytes, Stage stage) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto free_list = free_buffers.find({bytes, stage});
+      if (free_list != free_buffers.end() && !free_list->second.empty()) {
+        void *data = free_list->second.back();
+        free_list->second.pop_back();
+        cached -= bytes;
+        NativeMemory::cached(-bytes);
+        MemoryAttribution::stage(stage).allocated(bytes);
+        return data;
+      }
+    }
+    return allocate_tensor(bytes, stage);
+  }
+
+  void recycle(void *data) {
+    if (!data) {
+      return;
+    }
+    int64_t bytes = tensor_bytes(data);
+    Stage stage = tensor_stage(data);
+    MemoryAttribution::stage(stage).freed(bytes);
+    NativeMemory::cached(bytes);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    free_buffers[{bytes, stage}].push_back(data);
+    cached += bytes;
+  }
+
+  // Bytes of the buffers kept for reuse
+  int64_t get_cached() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cached;
+  }
+
+  void trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &free_list : free_buffers) {
+      for (void *data : free_list.second) {
+        NativeMemory::freed(free_list.first.first);
+        std::free(static_cast<uint8_t *>(data) - tensor_header_bytes);
+      }
+    }
+    free_buffers.clear();
+    NativeMemory::cached(-cached);
+    cached = 0;
+  }
+
+private:
+  mutable std::mutex mutex;
+  // Returned buffers by size and stage
+  std::map<std::pair<int64_t, Stage>, std::vector<void *>> free_buffers;
+  int64_t cached{0};
+};
+
+} // namespace cutout
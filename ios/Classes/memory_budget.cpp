@@ -0,0 +1,73 @@
+#pragma once
+
+#include "memory_budget.hpp"
+#include "u2net.hpp"
+
+extern "C" {
+// Native memory the pipelines may use, in bytes; zero removes the limit
+FUNCTION_ATTRIBUTE
+void set_memory_budget(int64_t bytes) {
+  cutout::MemoryBudget::instance().set_limit(bytes);
+}
+
+// Current and peak native bytes, then the budget
+FUNCTION_ATTRIBUTE
+void get_memory_usage(int64_t *usage) {
+  auto &budget = cutout::MemoryBudget::instance();
+  usage[0] = cutout::NativeMemory::current();
+  usage[1] = cutout::NativeMemory::peak();
+  usage[2] = budget.get_limit();
+}
+
+FUNCTION_ATTRIBUTE
+void reset_peak_memory() {
+  // Installs the counting allocator if nothing was decoded yet
+  cutout::MemoryBudget::instance();
+  cutout::NativeMemory::reset_peak();
+}
+
+// Width and height of the file, the decode reduction, the width and height
+// it will be processed at, the estimated bytes and the rows per strip of
+// the strip pipeline. False when the header could not be read.
+FUNCTION_ATTRIBUTE
+bool plan_memory_budget(const char *image_path, int64_t *plan) {
+  auto decode_plan = cutout::MemoryBudget::instance().plan(image_path);
+  plan[0] = decode_plan.original.width;
+  plan[1] = decode_plan.original.height;
+  plan[2] = decode_plan.reduction;
+  plan[3] = decode_plan.target.width;
+  plan[4] = decode_plan.target.height;
+  plan[5] = decode_plan.estimate;
+  plan[6] = decode_plan.strip_rows;
+  return !decode_plan.original.empty();
+}
+
+// Bytes allocated, live and peak per stage, three values for each stage in
+// the order of cutout::Stage, the last being allocations outside any stage
+FUNCTION_ATTRIBUTE
+void get_stage_memory(int64_t *stats) {
+  for (int stage = 0; stage < (int)cutout::Stage::COUNT; stage++) {
+    auto snapshot =
+        cutout::MemoryAttribution::stage((cutout::Stage)stage).snapshot();
+    stats[stage * 3] = snapshot.allocated;
+    stats[stage * 3 + 1] = snapshot.live;
+    stats[stage * 3 + 2] = snapshot.peak;
+  }
+}
+
+FUNCTION_ATTRIBUTE
+void reset_stage_memory() {
+  for (int stage = 0; stage < (int)cutout::Stage::COUNT; stage++) {
+    cutout::MemoryAttribution::stage((cutout::Stage)stage).reset();
+  }
+}
+
+// Zeroed tensor buffer for FFI calls, counted for `stage`
+FUNCTION_ATTRIBUTE
+void *allocate_tensor(int64_t bytes, int stage) {
+  return cutout::allocate_tensor(bytes, (cutout::Stage)stage);
+}
+
+FUNCTION_ATTRIBUTE
+void free_tensor(void *data) { cutout::free_tensor(data); }
+}
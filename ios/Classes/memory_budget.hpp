@@ -0,0 +1,189 @@
+#pragma once
+
+#include "image_header.hpp"
+#include "native_memory.hpp"
+#include "strip.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace cutout {
+
+// How an image is decoded to fit the memory budget
+struct DecodePlan {
+  // As stored in the file, or empty when the header could not be read
+  cv::Size original;
+  ImageFormat format{ImageFormat::UNKNOWN};
+  // Denominator of the reduced decode: 1, 2, 4 or 8
+  int reduction{1};
+  // Size after decoding, and after a further downscale when even the
+  // largest reduction does not fit
+  cv::Size target;
+  // Native memory the pipelines are expected to need at the target size
+  int64_t estimate{0};
+  // Rows per strip when the whole image does not fit but the strip
+  // pipeline does at full size; zero otherwise
+  int strip_rows{0};
+};
+
+// Process-wide cap on the native memory of the pipelines. Before an image
+// is decoded, its header is read for the dimensions, and images whose
+// processing would not fit in what is left of the budget are decoded at a
+// reduced size, which the cutouts then have too.
+//
+// JPEG decodes natively at 1/2, 1/4 and 1/8 scale, so the full-resolution
+// pixels never exist; other formats are decoded whole and shrunk at once.
+//
+// What is left is the limit minus the memory in use; buffers the session
+// pools keep for reuse do not count, since the next image is processed in
+// them. Images are never planned below `min_target_side`, where no cutout
+// is worth having, even if that goes over the budget.
+class MemoryBudget {
+public:
+  // Peak bytes per decoded pixel through a pipeline: the BGR pixels (3),
+  // their pyramid (1), the float mask at full size (4), its 8-bit
+  // refinement temporaries (3) and the BGRA cutout (4), rounded up
+  static const int64_t bytes_per_pixel = 16;
+
+  // Bytes per pixel of a strip: the BGR rows (3), the mask band with its
+  // refinement temporaries (3) and the cutout rows (4)
+  static const int64_t strip_bytes_per_pixel = 10;
+
+  static MemoryBudget &instance() {
+    static MemoryBudget budget;
+    return budget;
+  }
+
+  // Zero means no limit
+  void set_limit(int64_t bytes) {
+    limit.store(std::max<int64_t>(bytes, 0), std::memory_order_relaxed);
+  }
+
+  int64_t get_limit() const { return limit.load(std::memory_order_relaxed); }
+
+  DecodePlan plan(const std::string &image_path) const {
+    DecodePlan plan;
+    if (!read_image_size(image_path, plan.original, &plan.format)) {
+      return plan;
+    }
+    plan.target = plan.original;
+    plan.estimate = plan.original.area() * bytes_per_pixel;
+
+    int64_t limit = get_limit();
+    if (limit == 0) {
+      return plan;
+    }
+
+    int64_t available = std::max<int64_t>(limit - NativeMemory::in_use(), 0);
+    int min_side = std::min(min_target_side, longest_side(plan.original));
+    while (plan.estimate > available && plan.reduction < max_reduction &&
+           longest_side(reduced(plan.original, plan.reduction * 2)) >= min_side) {
+      plan.reduction *= 2;
+      plan.target = reduced(plan.original, plan.reduction);
+      plan.estimate = plan.target.area() * bytes_per_pixel;
+    }
+
+    // Past the largest reduction, shrink to the area that fits, but not
+    // below the floor
+    if (plan.estimate > available) {
+      double scale = std::max(std::sqrt((double)available / plan.estimate),
+                              (double)min_side / longest_side(plan.target));
+      if (scale < 1) {
+        plan.target =
+            cv::Size(std::max(1, (int)std::lround(plan.target.width * scale)),
+                     std::max(1, (int)std::lround(plan.target.height * scale)));
+        plan.estimate = plan.target.area() * bytes_per_pixel;
+      }
+    }
+
+    if (plan.target != plan.original) {
+      plan.strip_rows = fit_strip_rows(plan, available);
+    }
+    return plan;
+  }
+
+  // Decodes the image as planned; `original` is set to the full size in
+  // the orientation of the decoded pixels
+  cv::Mat decode(const std::string &image_path, cv::Size &original) const {
+    // Without a limit there is nothing to plan and no header to read
+    DecodePlan plan = get_limit() == 0 ? DecodePlan() : this->plan(image_path);
+
+    cv::Mat image = cv::imread(image_path, read_flags(plan.reduction));
+    if (image.empty()) {
+      original = cv::Size();
+      return image;
+    }
+
+    // The stored size, or the decoded one when the header was not read.
+    // EXIF rotations swap the stored dimensions.
+    original = plan.original.empty() ? image.size() : plan.original;
+    bool is_rotated = (original.width > original.height) !=
+                      (image.cols > image.rows);
+    if (is_rotated) {
+      std::swap(original.width, original.height);
+    }
+
+    cv::Size target = plan.target;
+    if (!target.empty() && target != reduced(plan.original, plan.reduction)) {
+      if (is_rotated) {
+        std::swap(target.width, target.height);
+      }
+      cv::resize(image, image, target, 0, 0, cv::INTER_AREA);
+    }
+    return image;
+  }
+
+private:
+  static const int max_reduction = 8;
+  // Longest side of the smallest planned target, the input size of U2Net
+  static const int min_target_side = 320;
+  static const int max_strip_rows = 1024;
+  static const int min_strip_rows = 32;
+
+  // The tallest strips that fit; PNGs are streamed, other formats are held
+  // whole while the strips go through
+  static int fit_strip_rows(const DecodePlan &plan, int64_t available) {
+    int64_t whole =
+        plan.format == ImageFormat::PNG ? 0 : plan.original.area() * 3;
+    for (int rows = max_strip_rows; rows >= min_strip_rows; rows /= 2) {
+      int64_t band = (int64_t)(rows + 2 * MaskStrips::halo) *
+                     plan.original.width * strip_bytes_per_pixel;
+      if (whole + band <= available) {
+        return rows;
+      }
+    }
+    return 0;
+  }
+
+  MemoryBudget() { install_counting_allocator(); }
+
+  static int longest_side(const cv::Size &size) {
+    return std::max(size.width, size.height);
+  }
+
+  // Rounded up, as the JPEG decoder does
+  static cv::Size reduced(const cv::Size &size, int reduction) {
+    return cv::Size((size.width + reduction - 1) / reduction,
+                    (size.height + reduction - 1) / reduction);
+  }
+
+  static int read_flags(int reduction) {
+    switch (reduction) {
+    case 2:
+      return cv::IMREAD_REDUCED_COLOR_2;
+    case 4:
+      return cv::IMREAD_REDUCED_COLOR_4;
+    case 8:
+      return cv::IMREAD_REDUCED_COLOR_8;
+    default:
+      return cv::IMREAD_COLOR;
+    }
+  }
+
+  std::atomic<int64_t> limit{0};
+};
+
+} // namespace cutout
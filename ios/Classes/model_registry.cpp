@@ -0,0 +1,212 @@
+#pragma once
+
+#include "u2net.hpp"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Process-wide table of loaded model sessions, so every model object and
+// isolate using the same model shares one session and one copy of its
+// weights. Sessions are created and freed by the caller; the registry only
+// hands out their addresses and counts who uses them.
+//
+// Holders keep a model loaded for their lifetime, while leases cover a
+// single request. Swapping a model publishes a new session for new leases
+// and retires the old one, which is freed by whoever returns its last
+// lease, so in-flight requests finish on the session they started with.
+//
+// Each model has a version that changes with every swap, and the content
+// identity its loader published, e.g. a hash of the model bytes, for
+// results cached by model to tell the weights that produced them apart.
+class ModelRegistry {
+public:
+  static ModelRegistry &instance() {
+    static ModelRegistry registry;
+    return registry;
+  }
+
+  // Adds a holder of a loaded model and returns its session; zero means
+  // the model is not loaded yet and no holder was added, so the caller
+  // loads it and becomes a holder by publishing the session
+  int64_t acquire(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    if (found == models.end() || found->second.address == 0) {
+      return 0;
+    }
+    found->second.holders++;
+    return found->second.address;
+  }
+
+  // Makes a session the current one unless another caller was faster, in
+  // which case the caller frees its own and uses the returned one; either
+  // way the caller is a holder afterwards. A caller whose load failed
+  // publishes nothing and holds nothing.
+  int64_t publish(const std::string &key, int64_t address,
+                  uint64_t content = 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Model &model = models[key];
+    if (model.address == 0) {
+      model.address = address;
+      model.content = content;
+      sessions[address] = Session{};
+    }
+    model.holders++;
+    return model.address;
+  }
+
+  // Removes a holder; returns the session to free when nothing uses it
+  // anymore, or zero
+  int64_t release(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    if (found == models.end() || --found->second.holders > 0) {
+      return 0;
+    }
+
+    int64_t address = found->second.address;
+    models.erase(found);
+    return retire(address);
+  }
+
+  // Current session for one request, or zero when none is loaded
+  int64_t lease(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    if (found == models.end() || found->second.address == 0) {
+      return 0;
+    }
+    sessions[found->second.address].leases++;
+    return found->second.address;
+  }
+
+  // Ends a request; true when the caller holds the last lease of a retired
+  // session and must free it
+  bool return_lease(int64_t address) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = sessions.find(address);
+    if (found == sessions.end()) {
+      return false;
+    }
+    Session &session = found->second;
+    if (--session.leases > 0 || !session.is_retired) {
+      return false;
+    }
+    sessions.erase(found);
+    return true;
+  }
+
+  // Publishes a new session for a held model; returns the previous one
+  // when it can be freed right away, or zero. A model nobody holds is not
+  // swapped, since nothing would free the new session: the caller gets its
+  // own address back and frees it.
+  int64_t swap(const std::string &key, int64_t address,
+               uint64_t content = 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    if (found == models.end() || found->second.holders == 0) {
+      return address;
+    }
+    Model &model = found->second;
+    int64_t previous = model.address;
+    model.address = address;
+    model.version = epoch + ++swaps;
+    model.content = content;
+    sessions[address] = Session{};
+    return previous == 0 ? 0 : retire(previous);
+  }
+
+  // Zero for the model as it was loaded, a value unique to the process run
+  // after every swap, so results on disk from swapped weights of an
+  // earlier run never match
+  uint64_t version(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    return found == models.end() ? 0 : found->second.version;
+  }
+
+  // Content identity published with the current session, zero when the
+  // model is not loaded or its loader published none
+  uint64_t content(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = models.find(key);
+    return found == models.end() ? 0 : found->second.content;
+  }
+
+private:
+  struct Model {
+    int64_t address{0};
+    int holders{0};
+    uint64_t version{0};
+    uint64_t content{0};
+  };
+
+  struct Session {
+    int leases{0};
+    bool is_retired{false};
+  };
+
+  int64_t retire(int64_t address) {
+    auto found = sessions.find(address);
+    if (found == sessions.end()) {
+      return 0;
+    }
+    if (found->second.leases > 0) {
+      found->second.is_retired = true;
+      return 0;
+    }
+    sessions.erase(found);
+    return address;
+  }
+
+  const uint64_t epoch =
+      std::chrono::system_clock::now().time_since_epoch().count();
+  uint64_t swaps{0};
+  std::mutex mutex;
+  std::map<std::string, Model> models;
+  std::unordered_map<int64_t, Session> sessions;
+};
+
+extern "C" {
+FUNCTION_ATTRIBUTE
+int64_t acquire_model(const char *key) {
+  return ModelRegistry::instance().acquire(key);
+}
+
+FUNCTION_ATTRIBUTE
+int64_t publish_model(const char *key, int64_t address, uint64_t content) {
+  return ModelRegistry::instance().publish(key, address, content);
+}
+
+FUNCTION_ATTRIBUTE
+int64_t release_model(const char *key) {
+  return ModelRegistry::instance().release(key);
+}
+
+FUNCTION_ATTRIBUTE
+int64_t lease_model(const char *key) {
+  return ModelRegistry::instance().lease(key);
+}
+
+FUNCTION_ATTRIBUTE
+bool return_lease_model(int64_t address) {
+  return ModelRegistry::instance().return_lease(address);
+}
+
+FUNCTION_ATTRIBUTE
+int64_t swap_model(const char *key, int64_t address, uint64_t content) {
+  return ModelRegistry::instance().swap(key, address, content);
+}
+
+FUNCTION_ATTRIBUTE
+uint64_t get_model_version(const char *key) {
+  return ModelRegistry::instance().version(key);
+}
+
+FUNCTION_ATTRIBUTE
+uint64_t get_model_content(const char *key) {
+  return ModelRegistry::instance().content(key);
+}
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "stage.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+namespace cutout {
+
+// Bytes of pixel memory held by the native side: every Mat allocated
+// through OpenCV's default allocator, once `install_counting_allocator` has
+// run, the buffers of the session pools and the FFI tensor buffers
+class NativeMemory {
+public:
+  static void allocated(int64_t bytes) {
+    int64_t now = current_bytes.fetch_add(bytes, std::memory_order_relaxed) +
+                  bytes;
+    int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (now > peak && !peak_bytes.compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  static void freed(int64_t bytes) {
+    current_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  static int64_t current() {
+    return current_bytes.load(std::memory_order_relaxed);
+  }
+
+  static int64_t peak() { return peak_bytes.load(std::memory_order_relaxed); }
+
+  // Part of current() held by the session pools for reuse rather than in
+  // use: the next image takes its buffers from there, and a trim frees them
+  static void cached(int64_t bytes) {
+    cached_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  static int64_t pool_cached() {
+    return cached_bytes.load(std::memory_order_relaxed);
+  }
+
+  // Bytes held outside the pool caches
+  static int64_t in_use() { return current() - pool_cached(); }
+
+  // Restarts the peak from the current usage, e.g. before one request
+  static void reset_peak() {
+    peak_bytes.store(current(), std::memory_order_relaxed);
+  }
+
+private:
+  static inline std::atomic<int64_t> current_bytes{0};
+  static inline std::atomic<int64_t> peak_bytes{0};
+  static inline std::atomic<int64_t> cached_bytes{0};
+};
+
+// Bytes allocated since the last reset, bytes still held, and the most
+// held at once since the last reset
+struct MemorySnapshot {
+  int64_t allocated{0};
+  int64_t live{0};
+  int64_t peak{0};
+};
+
+// Allocation counters of one stage or session. Buffers counted for a
+// session may outlive it, so session counters are reference counted by the
+// session and by each of those buffers.
+class MemoryCounters {
+public:
+  void allocated(int64_t bytes) {
+    allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    int64_t now =
+        live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (now > peak && !peak_bytes.compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  void freed(int64_t bytes) {
+    live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  MemorySnapshot snapshot() const {
+    MemorySnapshot snapshot;
+    snapshot.allocated = allocated_bytes.load(std::memory_order_relaxed);
+    snapshot.live = live_bytes.load(std::memory_order_relaxed);
+    snapshot.peak = peak_bytes.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+  // Live bytes are still held, so the peak restarts from them
+  void reset() {
+    allocated_bytes.store(0, std::memory_order_relaxed);
+    peak_bytes.store(live_bytes.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+  }
+
+  void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+
+  void release() {
+    if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+private:
+  std::atomic<int64_t> allocated_bytes{0};
+  std::atomic<int64_t> live_bytes{0};
+  std::atomic<int64_t> peak_bytes{0};
+  std::atomic<int> references{1};
+};
+
+struct MemoryCountersRelease {
+  void operator()(MemoryCounters *counters) const { counters->release(); }
+};
+
+using MemoryCountersRef =
+    std::unique_ptr<MemoryCounters, MemoryCountersRelease>;
+
+inline MemoryCountersRef make_memory_counters() {
+  return MemoryCountersRef(new MemoryCounters());
+}
+
+// Attributes allocations to the stage and session the allocating thread is
+// in, which the pipeline's TraceSpans switch. The stage and session are
+// kept in the buffer's UMatData, so the bytes are given back to them when
+// it is freed, wherever that happens.
+class MemoryAttribution {
+public:
+  static MemoryCounters &stage(Stage stage) {
+    static MemoryCounters counters[(int)Stage::COUNT];
+    return counters[stage < Stage::COUNT ? (int)stage : (int)Stage::OTHER];
+  }
+
+  static Stage &current_stage() {
+    thread_local Stage stage = Stage::OTHER;
+    return stage;
+  }
+
+  static MemoryCounters *&current_session() {
+    thread_local MemoryCounters *session = nullptr;
+    return session;
+  }
+
+  static void allocated(cv::UMatData *u) {
+    Stage stage = current_stage();
+    MemoryCounters *session = current_session();
+    MemoryAttribution::stage(stage).allocated(u->size);
+    if (session) {
+      session->retain();
+      session->allocated(u->size);
+    }
+    u->allocatorFlags_ = (int)stage;
+    u->userdata = session;
+  }
+
+  static void freed(cv::UMatData *u) {
+    stage((Stage)u->allocatorFlags_).freed(u->size);
+    if (auto *session = static_cast<MemoryCounters *>(u->userdata)) {
+      session->freed(u->size);
+      session->release();
+    }
+  }
+};
+
+// OpenCV's standard allocator with NativeMemory accounting
+class CountingAllocator : public cv::MatAllocator {
+public:
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                         size_t *step, cv::AccessFlag,
+                         cv::UMatUsageFlags) const override {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+      if (step) {
+        if (data && step[i] != cv::Mat::AUTO_STEP) {
+          total = step[i];
+        } else {
+          step[i] = total;
+        }
+      }
+      total *= sizes[i];
+    }
+
+    cv::UMatData *u = new cv::UMatData(this);
+    u->size = total;
+    if (data) {
+      u->data = u->origdata = static_cast<uchar *>(data);
+      u->flags |= cv::UMatData::USER_ALLOCATED;
+    } else {
+      u->data = u->origdata = static_cast<uchar *>(cv::fastMalloc(total));
+      NativeMemory::allocated(total);
+      MemoryAttribution::allocated(u);
+    }
+    return u;
+  }
+
+  bool allocate(cv::UMatData *u, cv::AccessFlag,
+                cv::UMatUsageFlags) const override {
+    return u != nullptr;
+  }
+
+  void deallocate(cv::UMatData *u) const override {
+    if (!u) {
+      return;
+    }
+    CV_Assert(u->urefcount == 0 && u->refcount == 0);
+
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+      cv::fastFree(u->origdata);
+      NativeMemory::freed(u->size);
+      MemoryAttribution::freed(u);
+    }
+    delete u;
+  }
+};
+
+// Makes the counting allocator OpenCV's default for the process. Mats
+// allocated before keep their allocator and are not counted. The allocator
+// is never deleted, as Mats may be freed during static destruction.
+inline void install_counting_allocator() {
+  static CountingAllocator *allocator = [] {
+    auto *allocator = new CountingAllocator();
+    cv::Mat::setDefaultAllocator(allocator);
+    return allocator;
+  }();
+  (void)allocator;
+}
+
+// Zeroed buffers for the model tensors passed through FFI, counted in
+// NativeMemory and for `stage`. The size and stage are kept in a header in
+// front of the data, which stays 16-byte aligned.
+const int64_t tensor_header_bytes = 16;
+
+inline void *allocate_tensor(int64_t bytes, Stage stage) {
+  auto *buffer = static_cast<uint8_t *>(
+      std::calloc(1, tensor_header_bytes + bytes));
+  if (!buffer) {
+    return nullptr;
+  }
+  *reinterpret_cast<int64_t *>(buffer) = bytes;
+  buffer[8] = (uint8_t)stage;
+  NativeMemory::allocated(bytes);
+  MemoryAttribution::stage(stage).allocated(bytes);
+  return buffer + tensor_header_bytes;
+}
+
+// Size and stage of a buffer from allocate_tensor
+inline int64_t tensor_bytes(const void *data) {
+  return *reinterpret_cast<const int64_t *>(static_cast<const uint8_t *>(data) -
+                                            tensor_header_bytes);
+}
+
+inline Stage tensor_stage(const void *data) {
+  return (Stage)(static_cast<const uint8_t *>(data) - tensor_header_bytes)[8];
+}
+
+inline void free_tensor(void *data) {
+  if (!data) {
+    return;
+  }
+  int64_t bytes = tensor_bytes(data);
+  NativeMemory::freed(bytes);
+  MemoryAttribution::stage(tensor_stage(data)).freed(bytes);
+  std::free(static_cast<uint8_t *>(data) - tensor_header_bytes);
+}
+
+} // namespace cutout
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cutout {
+
+enum class PerfEvent : uint8_t {
+  CYCLES = 0,
+  INSTRUCTIONS = 1,
+  CACHE_MISSES = 2,
+  BRANCH_MISSES = 3,
+  PAGE_FAULTS = 4,
+  COUNT = 5,
+};
+
+inline const char *perf_event_name(PerfEvent event) {
+  switch (event) {
+  case PerfEvent::CYCLES:
+    return "cycles";
+  case PerfEvent::INSTRUCTIONS:
+    return "instructions";
+  case PerfEvent::CACHE_MISSES:
+    return "cache_misses";
+  case PerfEvent::BRANCH_MISSES:
+    return "branch_misses";
+  case PerfEvent::PAGE_FAULTS:
+    return "page_faults";
+  default:
+    return "unknown";
+  }
+}
+
+// Counts of the events of one thread; negative for those it has no counter
+// for
+struct PerfSample {
+  static const int count = (int)PerfEvent::COUNT;
+  // Lines the last-level cache misses are charged with
+  static const int64_t cache_line = 64;
+
+  int64_t values[count];
+
+  PerfSample() { std::fill(values, values + count, -1); }
+
+  int64_t get(PerfEvent event) const { return values[(int)event]; }
+  bool has(PerfEvent event) const { return get(event) >= 0; }
+  bool is_empty() const {
+    return std::all_of(values, values + count,
+                       [](int64_t value) { return value < 0; });
+  }
+
+  // Counts between `start` and this sample
+  PerfSample since(const PerfSample &start) const {
+    PerfSample delta;
+    for (int i = 0; i < count; i++) {
+      if (values[i] >= 0 && start.values[i] >= 0) {
+        delta.values[i] = std::max<int64_t>(values[i] - start.values[i], 0);
+      }
+    }
+    return delta;
+  }
+
+  // Instructions per cycle; zero without both counters
+  double ipc() const {
+    if (!has(PerfEvent::CYCLES) || !has(PerfEvent::INSTRUCTIONS) ||
+        get(PerfEvent::CYCLES) == 0) {
+      return 0;
+    }
+    return (double)get(PerfEvent::INSTRUCTIONS) / get(PerfEvent::CYCLES);
+  }
+
+  // Memory traffic per pixel, estimated as one cache line per last-level
+  // miss; high values against a low IPC mean the work is memory-bound
+  double bytes_per_pixel(int64_t pixels) const {
+    if (!has(PerfEvent::CACHE_MISSES) || pixels <= 0) {
+      return 0;
+    }
+    return (double)get(PerfEvent::CACHE_MISSES) * cache_line / pixels;
+  }
+};
+
+// Hardware and software event counters of the calling thread, from Linux
+// perf_event_open. User space only, so they open with the default
+// perf_event_paranoid of 2; where the kernel refuses an event, as on most
+// Android builds, in VMs without a PMU and on other systems, it reads as
+// missing and everything else keeps working.
+//
+// Each counter counts from its creation; a region's counts are the
+// difference of two `read`s on the same thread.
+class PerfCounters {
+public:
+  PerfCounters() {
+    std::fill(fds, fds + PerfSample::count, -1);
+#if defined(__linux__)
+    for (int i = 0; i < PerfSample::count; i++) {
+      fds[i] = open_event((PerfEvent)i);
+    }
+#endif
+  }
+
+  ~PerfCounters() {
+#if defined(__linux__)
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // Counters of the calling thread, opened on first use and kept for the
+  // lifetime of the thread
+  static PerfCounters &for_thread() {
+    thread_local PerfCounters counters;
+    return counters;
+  }
+
+  bool is_available() const {
+    return std::any_of(fds, fds + PerfSample::count,
+                       [](int fd) { return fd >= 0; });
+  }
+
+  // Running totals, scaled up when the kernel multiplexed a counter
+  PerfSample read() const {
+    PerfSample sample;
+#if defined(__linux__)
+    for (int i = 0; i < PerfSample::count; i++) {
+      // value, time enabled, time running
+      uint64_t buffer[3];
+      if (fds[i] < 0 ||
+          ::read(fds[i], buffer, sizeof(buffer)) != sizeof(buffer)) {
+        continue;
+      }
+      if (buffer[2] == 0) {
+        sample.values[i] = 0;
+      } else if (buffer[2] < buffer[1]) {
+        sample.values[i] = (int64_t)((double)buffer[0] * buffer[1] / buffer[2]);
+      } else {
+        sample.values[i] = (int64_t)buffer[0];
+      }
+    }
+#endif
+    return sample;
+  }
+
+private:
+#if defined(__linux__)
+  static int open_event(PerfEvent event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+    case PerfEvent::CYCLES:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PerfEvent::INSTRUCTIONS:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PerfEvent::CACHE_MISSES:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case PerfEvent::BRANCH_MISSES:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    default:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+      break;
+    }
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                        PERF_FLAG_FD_CLOEXEC);
+  }
+#endif
+
+  int fds[PerfSample::count];
+};
+
+} // namespace cutout
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace cutout {
+
+namespace detail {
+
+inline uint32_t load_be32(const uint8_t *bytes) {
+  return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+         (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+inline void store_be32(uint8_t *bytes, uint32_t value) {
+  bytes[0] = value >> 24;
+  bytes[1] = value >> 16;
+  bytes[2] = value >> 8;
+  bytes[3] = value;
+}
+
+static const uint8_t png_signature[8] = {0x89, 'P',  'N',  'G',
+                                         '\r', '\n', 0x1a, '\n'};
+
+} // namespace detail
+
+// Writes an 8-bit RGBA PNG a row at a time, so cutouts of any size are
+// encoded with memory for one row and the deflate state. Rows use the Sub
+// filter, which needs no previous row and suits photos well.
+class PngStripWriter {
+public:
+  PngStripWriter() = default;
+  PngStripWriter(const PngStripWriter &) = delete;
+  PngStripWriter &operator=(const PngStripWriter &) = delete;
+
+  // An unfinished file is incomplete, so it is removed
+  ~PngStripWriter() {
+    if (file) {
+      deflateEnd(&stream);
+      std::fclose(file);
+      std::remove(path.c_str());
+    }
+  }
+
+  bool open(const std::string &path, int width, int height,
+            int compression_level = 1) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    this->path = path;
+    this->width = width;
+    this->height = height;
+
+    if (deflateInit(&stream, compression_level) != Z_OK) {
+      std::fclose(file);
+      file = nullptr;
+      return false;
+    }
+
+    uint8_t header[13];
+    detail::store_be32(header, width);
+    detail::store_be32(header + 4, height);
+    header[8] = 8;  // Bit depth
+    header[9] = 6;  // RGBA
+    header[10] = 0; // Deflate
+    header[11] = 0; // Adaptive filtering
+    header[12] = 0; // Not interlaced
+    std::fwrite(detail::png_signature, 1, 8, file);
+    write_chunk("IHDR", header, sizeof(header));
+
+    row.resize(1 + (size_t)width * 4);
+    output.resize(64 * 1024);
+    return true;
+  }
+
+  // One row of BGRA pixels
+  bool write_row(const uint8_t *bgra) {
+    if (!file || rows_written == height) {
+      return false;
+    }
+
+    row[0] = 1; // Sub
+    uint8_t *filtered = row.data() + 1;
+    uint8_t left[4] = {0, 0, 0, 0};
+    for (int x = 0; x < width; x++) {
+      const uint8_t *pixel = bgra + x * 4;
+      uint8_t rgba[4] = {pixel[2], pixel[1], pixel[0], pixel[3]};
+      for (int c = 0; c < 4; c++) {
+        filtered[x * 4 + c] = rgba[c] - left[c];
+        left[c] = rgba[c];
+      }
+    }
+
+    stream.next_in = row.data();
+    stream.avail_in = row.size();
+    rows_written++;
+    return deflate_output(Z_NO_FLUSH);
+  }
+
+  // Completes the file once every row was written
+  bool finish() {
+    if (!file || rows_written != height) {
+      return false;
+    }
+
+    bool is_written = deflate_output(Z_FINISH);
+    deflateEnd(&stream);
+    write_chunk("IEND", nullptr, 0);
+    is_written = std::fclose(file) == 0 && is_written;
+    file = nullptr;
+    if (!is_written) {
+      std::remove(path.c_str());
+    }
+    return is_written;
+  }
+
+private:
+  // Runs deflate and writes every full output buffer as an IDAT chunk
+  bool deflate_output(int flush) {
+    int status;
+    do {
+      stream.next_out = output.data();
+      stream.avail_out = output.size();
+      status = deflate(&stream, flush);
+      if (status == Z_STREAM_ERROR) {
+        return false;
+      }
+      size_t size = output.size() - stream.avail_out;
+      if (size > 0) {
+        write_chunk("IDAT", output.data(), size);
+      }
+    } while (stream.avail_out == 0 ||
+             (flush == Z_FINISH && status != Z_STREAM_END));
+    return !std::ferror(file);
+  }
+
+  void write_chunk(const char *type, const uint8_t *data, size_t size) {
+    uint8_t bytes[4];
+    detail::store_be32(bytes, size);
+    std::fwrite(bytes, 1, 4, file);
+    std::fwrite(type, 1, 4, file);
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+    if (size > 0) {
+      std::fwrite(data, 1, size, file);
+      crc = crc32(crc, data, size);
+    }
+    detail::store_be32(bytes, crc);
+    std::fwrite(bytes, 1, 4, file);
+  }
+
+  FILE *file{nullptr};
+  std::string path;
+  z_stream stream{};
+  int width{0};
+  int height{0};
+  int rows_written{0};
+  // Filter byte and filtered RGBA pixels
+  std::vector<uint8_t> row;
+  std::vector<uint8_t> output;
+};
+
+// Reads a PNG a row at a time as BGR, so images of any size are decoded
+// with memory for two rows and the inflate state. Covers 8-bit grayscale
+// and color PNGs without interlacing, with or without alpha, which is
+// dropped as cv::imread does; `open` fails for the rest.
+class PngStripReader {
+public:
+  PngStripReader() = default;
+  PngStripReader(const PngStripReader &) = delete;
+  PngStripReader &operator=(const PngStripReader &) = delete;
+
+  ~PngStripReader() { close(); }
+
+  bool open(const std::string &path) {
+    close();
+    file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+      return false;
+    }
+
+    uint8_t header[8 + 8 + 13];
+    if (std::fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        std::memcmp(header, detail::png_signature, 8) != 0 ||
+        std::memcmp(header + 12, "IHDR", 4) != 0) {
+      close();
+      return false;
+    }
+
+    const uint8_t *ihdr = header + 16;
+    width = detail::load_be32(ihdr);
+    height = detail::load_be32(ihdr + 4);
+    int bit_depth = ihdr[8];
+    int color_type = ihdr[9];
+    int interlace = ihdr[12];
+    channels = color_type == 0   ? 1
+               : color_type == 2 ? 3
+               : color_type == 4 ? 2
+               : color_type == 6 ? 4
+                                 : 0;
+    if (bit_depth != 8 || channels == 0 || interlace != 0 || width <= 0 ||
+        height <= 0 || inflateInit(&stream) != Z_OK) {
+      close();
+      return false;
+    }
+    is_inflating = true;
+
+    // Skips the IHDR CRC
+    std::fseek(file, 4, SEEK_CUR);
+    row.assign(1 + (size_t)width * channels, 0);
+    previous.assign(row.size(), 0);
+    input.resize(64 * 1024);
+    has_chunk = false;
+    idat_remaining = 0;
+    rows_read = 0;
+    return true;
+  }
+
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+
+  // The next row as BGR pixels
+  bool read_row(uint8_t *bgr) {
+    if (!file || rows_read == height) {
+      return false;
+    }
+
+    std::swap(row, previous);
+    stream.next_out = row.data();
+    stream.avail_out = row.size();
+    while (stream.avail_out > 0) {
+      if (stream.avail_in == 0 && !fill_input()) {
+        return false;
+      }
+      int status = inflate(&stream, Z_NO_FLUSH);
+      if (status != Z_OK &&
+          !(status == Z_STREAM_END && stream.avail_out == 0)) {
+        return false;
+      }
+    }
+
+    if (!unfilter()) {
+      return false;
+    }
+    to_bgr(row.data() + 1, bgr);
+    rows_read++;
+    return true;
+  }
+
+  void close() {
+    if (is_inflating) {
+      inflateEnd(&stream);
+      stream = z_stream{};
+      is_inflating = false;
+    }
+    if (file) {
+      std::fclose(file);
+      file = nullptr;
+    }
+  }
+
+private:
+  // Reads the next IDAT data, skipping any other chunk
+  bool fill_input() {
+    while (idat_remaining == 0) {
+      // CRC of the previous chunk, then the next chunk header
+      if (has_chunk) {
+        std::fseek(file, 4, SEEK_CUR);
+      }
+      uint8_t header[8];
+      if (std::fread(header, 1, 8, file) != 8) {
+        return false;
+      }
+      has_chunk = true;
+      uint32_t length = detail::load_be32(header);
+      if (std::memcmp(header + 4, "IDAT", 4) == 0) {
+        idat_remaining = length;
+      } else if (std::memcmp(header + 4, "IEND", 4) == 0) {
+        return false;
+      } else if (std::fseek(file, length, SEEK_CUR) != 0) {
+        return false;
+      }
+    }
+
+    size_t size = std::min<size_t>(idat_remaining, input.size());
+    size = std::fread(input.data(), 1, size, file);
+    if (size == 0) {
+      return false;
+    }
+    idat_remaining -= size;
+    stream.next_in = input.data();
+    stream.avail_in = size;
+    return true;
+  }
+
+  // False for a filter type PNG does not define, which only a corrupt file
+  // has
+  bool unfilter() {
+    uint8_t *current = row.data() + 1;
+    const uint8_t *above = previous.data() + 1;
+    int bpp = channels;
+    int size = width * channels;
+    // The row above the first one is all zeros
+    if (rows_read == 0) {
+      std::fill(previous.begin(), previous.end(), 0);
+    }
+
+    if (row[0] > 4) {
+      return false;
+    }
+    switch (row[0]) {
+    case 1: // Sub
+      for (int i = bpp; i < size; i++) {
+        current[i] += current[i - bpp];
+      }
+      break;
+    case 2: // Up
+      for (int i = 0; i < size; i++) {
+        current[i] += above[i];
+      }
+      break;
+    case 3: // Average
+      for (int i = 0; i < size; i++) {
+        int left = i >= bpp ? current[i - bpp] : 0;
+        current[i] += (left + above[i]) / 2;
+      }
+      break;
+    case 4: // Paeth
+      for (int i = 0; i < size; i++) {
+        int a = i >= bpp ? current[i - bpp] : 0;
+        int b = above[i];
+        int c = i >= bpp ? above[i - bpp] : 0;
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        current[i] += pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+      }
+      break;
+    default: // None
+      break;
+    }
+    return true;
+  }
+
+  void to_bgr(const uint8_t *pixels, uint8_t *bgr) const {
+    for (int x = 0; x < width; x++) {
+      const uint8_t *pixel = pixels + x * channels;
+      uint8_t *out = bgr + x * 3;
+      if (channels <= 2) {
+        out[0] = out[1] = out[2] = pixel[0];
+      } else {
+        out[0] = pixel[2];
+        out[1] = pixel[1];
+        out[2] = pixel[0];
+      }
+    }
+  }
+
+  FILE *file{nullptr};
+  z_stream stream{};
+  bool is_inflating{false};
+  bool has_chunk{false};
+  uint32_t idat_remaining{0};
+  int width{0};
+  int height{0};
+  int channels{0};
+  int rows_read{0};
+  // Filter byte and pixels of the current and the previous row
+  std::vector<uint8_t> row;
+  std::vector<uint8_t> previous;
+  std::vector<uint8_t> input;
+};
+
+} // namespace cutout
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "kernels.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace cutout {
+
+enum class Layout { NCHW = 0, NHWC = 1 };
+enum class ChannelOrder { BGR = 0, RGB = 1 };
+
+namespace detail {
+
+inline void interleave_row(const float *c0, const float *c1, const float *c2,
+                           int width, float *dst) {
+  int x = 0;
+#if CV_SIMD
+  using namespace cv;
+  const int lanes = VTraits<v_float32>::vlanes();
+  for (; x <= width - lanes; x += lanes) {
+    v_store_interleave(dst + x * 3, vx_load(c0 + x), vx_load(c1 + x),
+                       vx_load(c2 + x));
+  }
+#endif
+
+  for (; x < width; x++) {
+    dst[x * 3] = c0[x];
+    dst[x * 3 + 1] = c1[x];
+    dst[x * 3 + 2] = c2[x];
+  }
+}
+
+// Raw 8-bit planes for quantized models, which fold normalization into the
+// input quantization parameters
+template <ChannelOrder C>
+inline void split_row(const uchar *src, int width, uchar *c0, uchar *c1,
+                      uchar *c2) {
+  constexpr int s0 = C == ChannelOrder::BGR ? 0 : 2;
+  constexpr int s2 = C == ChannelOrder::BGR ? 2 : 0;
+
+  int x = 0;
+#if CV_SIMD
+  using namespace cv;
+  const int lanes = VTraits<v_uint8>::vlanes();
+  for (; x <= width - lanes; x += lanes) {
+    v_uint8 b, g, r;
+    v_load_deinterleave(src + x * 3, b, g, r);
+    v_store(c0 + x, C == ChannelOrder::BGR ? b : r);
+    v_store(c1 + x, g);
+    v_store(c2 + x, C == ChannelOrder::BGR ? r : b);
+  }
+#endif
+
+  for (; x < width; x++) {
+    const uchar *pixel = src + x * 3;
+    c0[x] = pixel[s0];
+    c1[x] = pixel[1];
+    c2[x] = pixel[s2];
+  }
+}
+
+template <ChannelOrder C>
+inline void copy_row(const uchar *src, int width, uchar *dst) {
+  if constexpr (C == ChannelOrder::BGR) {
+    std::copy(src, src + width * 3, dst);
+  } else {
+    for (int x = 0; x < width; x++) {
+      dst[x * 3] = src[x * 3 + 2];
+      dst[x * 3 + 1] = src[x * 3 + 1];
+      dst[x * 3 + 2] = src[x * 3];
+    }
+  }
+}
+
+// OpenCV's vectorized F32 -> F16 conversion, writing into existing memory
+inline void convert_row(const float *src, int length, cv::hfloat *dst) {
+  cv::Mat src_row(1, length, CV_32F, const_cast<float *>(src));
+  cv::Mat dst_row(1, length, CV_16F, dst);
+  src_row.convertTo(dst_row, CV_16F);
+}
+
+} // namespace detail
+
+// Compile-time specialized image -> tensor conversion. The layout, element
+// type (float, cv::hfloat or uint8_t) and channel order are template parameters, and
+// a non-zero W x H fixes the tensor size so the row loops see constants.
+//
+// The source is an already resized CV_8UC3 BGR image no larger than the
+// tensor; the remaining area is zero padding, as SAM expects. uint8_t
+// tensors carry the raw pixels and ignore the normalization.
+template <Layout L, typename T, ChannelOrder C = ChannelOrder::BGR, int W = 0,
+          int H = 0>
+class Preprocessor {
+public:
+  static_assert(std::is_same<T, float>::value ||
+                    std::is_same<T, cv::hfloat>::value ||
+                    std::is_same<T, uint8_t>::value,
+                "Preprocessor produces float, cv::hfloat or uint8_t tensors");
+  static constexpr bool is_fixed_size = W > 0 && H > 0;
+  static constexpr bool needs_scratch =
+      std::is_same<T, cv::hfloat>::value ||
+      (L == Layout::NHWC && std::is_same<T, float>::value);
+
+  explicit Preprocessor(const Normalization &normalization)
+      : normalization(normalization) {}
+
+  void operator()(const cv::Mat &src, T *dst,
+                  cv::Size tensor_size = cv::Size(W, H)) const {
+    const int tensor_width = is_fixed_size ? W : tensor_size.width;
+    const int tensor_height = is_fixed_size ? H : tensor_size.height;
+    const size_t plane = (size_t)tensor_width * tensor_height;
+    const int width = std::min(src.cols, tensor_width);
+    const int height = std::min(src.rows, tensor_height);
+    CV_Assert(src.type() == CV_8UC3);
+
+    // Widest kernel variant the CPU supports
+    const auto &table = kernels::get();
+    const auto normalize_row = C == ChannelOrder::BGR ? table.normalize_bgr
+                                                      : table.normalize_rgb;
+
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range &range) {
+      // Float staging rows, only used by the layouts that cannot normalize
+      // straight into the tensor
+      std::vector<float> scratch(needs_scratch ? width * 6 : 0);
+      float *c0 = scratch.data();
+      float *c1 = c0 + width;
+      float *c2 = c1 + width;
+      float *interleaved = c2 + width;
+
+      for (int y = range.start; y < range.end; y++) {
+        const uchar *src_row = src.ptr<uchar>(y);
+
+        if constexpr (L == Layout::NCHW) {
+          T *d0 = dst + (size_t)y * tensor_width;
+          T *d1 = d0 + plane;
+          T *d2 = d1 + plane;
+
+          if constexpr (std::is_same<T, uint8_t>::value) {
+            detail::split_row<C>(src_row, width, d0, d1, d2);
+          } else if constexpr (std::is_same<T, float>::value) {
+            normalize_row(src_row, width, normalization, d0, d1, d2);
+          } else {
+            normalize_row(src_row, width, normalization, c0, c1, c2);
+            detail::convert_row(c0, width, d0);
+            detail::convert_row(c1, width, d1);
+            detail::convert_row(c2, width, d2);
+          }
+
+          std::fill(d0 + width, d0 + tensor_width, T(0.0f));
+          std::fill(d1 + width, d1 + tensor_width, T(0.0f));
+          std::fill(d2 + width, d2 + tensor_width, T(0.0f));
+        } else {
+          T *d = dst + (size_t)y * tensor_width * 3;
+
+          if constexpr (std::is_same<T, uint8_t>::value) {
+            detail::copy_row<C>(src_row, width, d);
+          } else if constexpr (std::is_same<T, float>::value) {
+            normalize_row(src_row, width, normalization, c0, c1, c2);
+            detail::interleave_row(c0, c1, c2, width, d);
+          } else {
+            normalize_row(src_row, width, normalization, c0, c1, c2);
+            detail::interleave_row(c0, c1, c2, width, interleaved);
+            detail::convert_row(interleaved, width * 3, d);
+          }
+
+          std::fill(d + width * 3, d + tensor_width * 3, T(0.0f));
+        }
+      }
+    });
+
+    // Rows below the image are padding
+    if (height < tensor_height) {
+      size_t padded_rows = (size_t)(tensor_height - height) * tensor_width;
+      if constexpr (L == Layout::NCHW) {
+        for (int c = 0; c < 3; c++) {
+          T *start = dst + c * plane + (size_t)height * tensor_width;
+          std::fill(start, start + padded_rows, T(0.0f));
+        }
+      } else {
+        T *start = dst + (size_t)height * tensor_width * 3;
+        std::fill(start, start + padded_rows * 3, T(0.0f));
+      }
+    }
+  }
+
+private:
+  Normalization normalization;
+};
+
+} // namespace cutout
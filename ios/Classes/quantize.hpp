@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+namespace cutout {
+
+// Affine quantization of a model output: real = (q - zero_point) * scale.
+// int8 outputs are handled as uint8 codes shifted by 128, which keeps their
+// order, so every kernel below works on CV_8U.
+struct QuantizationParams {
+  float scale{1.0f};
+  int zero_point{0};
+  bool is_signed{false};
+
+  int code_zero_point() const {
+    return is_signed ? zero_point + 128 : zero_point;
+  }
+
+  float dequantize(int code) const {
+    return (code - code_zero_point()) * scale;
+  }
+
+  // Largest code whose real value is not above `threshold`, so a code is
+  // above the threshold exactly when it is above this value. -1 keeps
+  // everything and 255 nothing.
+  int threshold_code(float threshold) const {
+    double code = std::floor(code_zero_point() + threshold / scale);
+    return (int)std::min(255.0, std::max(-1.0, code));
+  }
+};
+
+// Wraps raw output bytes as ordered uint8 codes, flipping the sign bit of
+// int8 data into a new matrix
+inline cv::Mat to_codes(const uint8_t *data, int rows, int cols,
+                        const QuantizationParams &params) {
+  cv::Mat raw(rows, cols, CV_8U, const_cast<uint8_t *>(data));
+  if (!params.is_signed) {
+    return raw;
+  }
+
+  cv::Mat codes;
+  cv::bitwise_xor(raw, cv::Scalar(0x80), codes);
+  return codes;
+}
+
+} // namespace cutout
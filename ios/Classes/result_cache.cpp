@@ -0,0 +1,345 @@
+#pragma once
+
+#include "hash.hpp"
+#include "u2net.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <list>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utime.h>
+
+enum class CacheResult { MISS = -1, FAILURE = 0, HIT = 1 };
+
+// Cutouts keyed by the hash of the encoded input file and of everything
+// that shapes the output (model, descriptor, postprocess parameters), so a
+// resubmitted photo skips decode, inference and PNG encoding altogether.
+//
+// Results live in a memory tier and a disk tier, each bounded in bytes and
+// evicted least recently used first. Disk entries are named after their key
+// and the disk index is rebuilt from file modification times, so the cache
+// survives restarts. Failed runs are cached in memory only, so a failure
+// from a bad run or an older model is retried after a restart rather than
+// kept for good; each counts a nominal size so the LRU bound covers them.
+class ResultCache {
+public:
+  void configure(const std::string &directory, size_t memory_bytes,
+                 size_t disk_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->directory = directory;
+    this->memory_bytes = memory_bytes;
+    this->disk_bytes = disk_bytes;
+    if (!this->directory.empty() && this->directory.back() != '/') {
+      this->directory += '/';
+    }
+
+    evict_memory();
+    scan_disk();
+  }
+
+  // Zero when the image cannot be read, which callers treat as uncacheable
+  uint64_t key(const std::string &image_path, const std::string &model_key) {
+    std::vector<uint8_t> bytes;
+    if (!read_file(image_path, bytes)) {
+      return 0;
+    }
+    uint64_t key = cutout::hash64(bytes.data(), bytes.size(),
+                                  cutout::hash64(model_key));
+    return key == 0 ? 1 : key;
+  }
+
+  CacheResult lookup(uint64_t key, const std::string &output_path) {
+    if (key == 0) {
+      return CacheResult::MISS;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = memory_index.find(key);
+    if (cached != memory_index.end()) {
+      memory.splice(memory.begin(), memory, cached->second);
+      const MemoryEntry &entry = *cached->second;
+      if (!entry.is_success) {
+        return CacheResult::FAILURE;
+      }
+      return write_file(output_path, entry.bytes) ? CacheResult::HIT
+                                                  : CacheResult::MISS;
+    }
+
+    auto stored = disk_index.find(key);
+    if (stored == disk_index.end()) {
+      return CacheResult::MISS;
+    }
+
+    std::vector<uint8_t> bytes;
+    std::string path = disk_path(key);
+    if (!read_file(path, bytes) || bytes.empty()) {
+      // Removed behind our back
+      erase_disk(key);
+      return CacheResult::MISS;
+    }
+    disk.splice(disk.begin(), disk, stored->second);
+    // Keeps the LRU order across restarts
+    utime(path.c_str(), nullptr);
+
+    if (!write_file(output_path, bytes)) {
+      return CacheResult::MISS;
+    }
+    insert_memory(key, std::move(bytes), true);
+    return CacheResult::HIT;
+  }
+
+  // Caches the file at output_path, or a failure in memory when is_success
+  // is false
+  bool store(uint64_t key, const std::string &output_path, bool is_success) {
+    if (key == 0) {
+      return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    if (is_success && (!read_file(output_path, bytes) || bytes.empty())) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!is_success) {
+      erase_disk(key);
+    } else if (!directory.empty() && disk_bytes > 0 &&
+               bytes.size() <= disk_bytes) {
+      store_disk(key, bytes);
+    }
+    insert_memory(key, std::move(bytes), is_success);
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    memory.clear();
+    memory_index.clear();
+    memory_used = 0;
+
+    for (const DiskEntry &entry : disk) {
+      unlink(disk_path(entry.key).c_str());
+    }
+    disk.clear();
+    disk_index.clear();
+    disk_used = 0;
+  }
+
+private:
+  struct MemoryEntry {
+    uint64_t key;
+    std::vector<uint8_t> bytes;
+    bool is_success;
+  };
+
+  struct DiskEntry {
+    uint64_t key;
+    size_t size;
+  };
+
+  // Bytes a memory entry counts against memory_bytes
+  static size_t entry_size(const MemoryEntry &entry) {
+    return sizeof(MemoryEntry) + entry.bytes.size();
+  }
+
+  void insert_memory(uint64_t key, std::vector<uint8_t> bytes,
+                     bool is_success) {
+    auto cached = memory_index.find(key);
+    if (cached != memory_index.end()) {
+      memory_used -= entry_size(*cached->second);
+      memory.erase(cached->second);
+      memory_index.erase(cached);
+    }
+    MemoryEntry entry{key, std::move(bytes), is_success};
+    if (entry_size(entry) > memory_bytes) {
+      return;
+    }
+
+    memory_used += entry_size(entry);
+    memory.push_front(std::move(entry));
+    memory_index[key] = memory.begin();
+    evict_memory();
+  }
+
+  void evict_memory() {
+    while (memory_used > memory_bytes && !memory.empty()) {
+      memory_used -= entry_size(memory.back());
+      memory_index.erase(memory.back().key);
+      memory.pop_back();
+    }
+  }
+
+  void store_disk(uint64_t key, const std::vector<uint8_t> &bytes) {
+    // Written aside and renamed so a crash never leaves a truncated entry
+    std::string path = disk_path(key);
+    std::string temporary = path + ".tmp";
+    if (!write_file(temporary, bytes) ||
+        rename(temporary.c_str(), path.c_str()) != 0) {
+      unlink(temporary.c_str());
+      return;
+    }
+
+    auto stored = disk_index.find(key);
+    if (stored != disk_index.end()) {
+      disk_used -= stored->second->size;
+      disk.erase(stored->second);
+    }
+    disk_used += bytes.size();
+    disk.push_front({key, bytes.size()});
+    disk_index[key] = disk.begin();
+    evict_disk();
+  }
+
+  void erase_disk(uint64_t key) {
+    auto stored = disk_index.find(key);
+    if (stored == disk_index.end()) {
+      return;
+    }
+    unlink(disk_path(key).c_str());
+    disk_used -= stored->second->size;
+    disk.erase(stored->second);
+    disk_index.erase(stored);
+  }
+
+  void evict_disk() {
+    while (disk_used > disk_bytes && !disk.empty()) {
+      unlink(disk_path(disk.back().key).c_str());
+      disk_used -= disk.back().size;
+      disk_index.erase(disk.back().key);
+      disk.pop_back();
+    }
+  }
+
+  void scan_disk() {
+    disk.clear();
+    disk_index.clear();
+    disk_used = 0;
+    if (directory.empty()) {
+      return;
+    }
+
+    mkdir(directory.c_str(), 0755);
+    DIR *handle = opendir(directory.c_str());
+    if (handle == nullptr) {
+      return;
+    }
+
+    std::vector<std::pair<time_t, DiskEntry>> found;
+    while (dirent *item = readdir(handle)) {
+      std::string name = item->d_name;
+      // Entries are named <16 hex digits>.png
+      if (name.size() != 20 || name.compare(16, 4, ".png") != 0) {
+        continue;
+      }
+      struct stat info;
+      if (stat((directory + name).c_str(), &info) != 0) {
+        continue;
+      }
+      // Failures written by earlier versions
+      if (info.st_size == 0) {
+        unlink((directory + name).c_str());
+        continue;
+      }
+      uint64_t key = std::strtoull(name.substr(0, 16).c_str(), nullptr, 16);
+      found.push_back(
+          {info.st_mtime, {key, static_cast<size_t>(info.st_size)}});
+    }
+    closedir(handle);
+
+    // Most recently used first
+    std::sort(found.begin(), found.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (const auto &item : found) {
+      disk.push_back(item.second);
+      disk_index[item.second.key] = std::prev(disk.end());
+      disk_used += item.second.size;
+    }
+    evict_disk();
+  }
+
+  std::string disk_path(uint64_t key) const {
+    char name[21];
+    std::snprintf(name, sizeof(name), "%016llx.png",
+                  static_cast<unsigned long long>(key));
+    return directory + name;
+  }
+
+  static bool read_file(const std::string &path, std::vector<uint8_t> &bytes) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    bytes.resize(size > 0 ? size : 0);
+    bool is_read = size >= 0 && std::fread(bytes.data(), 1, bytes.size(),
+                                           file) == bytes.size();
+    std::fclose(file);
+    return is_read;
+  }
+
+  static bool write_file(const std::string &path,
+                         const std::vector<uint8_t> &bytes) {
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+      return false;
+    }
+    bool is_written =
+        std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && is_written;
+  }
+
+  // Static parameters
+  std::string directory;
+  size_t memory_bytes{32 << 20};
+  size_t disk_bytes{256 << 20};
+
+  // State variables
+  std::mutex mutex;
+  std::list<MemoryEntry> memory;
+  std::unordered_map<uint64_t, std::list<MemoryEntry>::iterator> memory_index;
+  size_t memory_used{0};
+  std::list<DiskEntry> disk;
+  std::unordered_map<uint64_t, std::list<DiskEntry>::iterator> disk_index;
+  size_t disk_used{0};
+};
+
+extern "C" {
+FUNCTION_ATTRIBUTE
+ResultCache *create_cache() { return new ResultCache(); }
+
+FUNCTION_ATTRIBUTE
+void destroy_cache(ResultCache *cache) { delete cache; }
+
+FUNCTION_ATTRIBUTE
+void configure_cache(ResultCache *cache, const char *directory,
+                     int64_t memory_bytes, int64_t disk_bytes) {
+  cache->configure(directory, std::max<int64_t>(memory_bytes, 0),
+                   std::max<int64_t>(disk_bytes, 0));
+}
+
+FUNCTION_ATTRIBUTE
+uint64_t key_cache(ResultCache *cache, const char *image_path,
+                   const char *model_key) {
+  return cache->key(image_path, model_key);
+}
+
+FUNCTION_ATTRIBUTE
+int lookup_cache(ResultCache *cache, uint64_t key, const char *output_path) {
+  return static_cast<int>(cache->lookup(key, output_path));
+}
+
+FUNCTION_ATTRIBUTE
+bool store_cache(ResultCache *cache, uint64_t key, const char *output_path,
+                 bool is_success) {
+  return cache->store(key, output_path, is_success);
+}
+
+FUNCTION_ATTRIBUTE
+void clear_cache(ResultCache *cache) { cache->clear(); }
+}
@@ -1,6 +1,14 @@
 #pragma once
 
+#include "composite.hpp"
+#include "duplicate_index.hpp"
+#include "image_context.hpp"
+#include "mat_pool.hpp"
+#include "preprocess.hpp"
+#include "quantize.hpp"
+#include "trace.hpp"
 #include <array>
+#include <map>
 #include <memory>
 #include <opencv2/opencv.hpp>
 #include <stdbool.h>
@@ -26,6 +34,10 @@ public:
   cv::Mat apply_image(const cv::Mat &image);
   cv::Mat apply_coords(const cv::Mat &coords,
                        const std::array<int, 2> &original_size);
+  void apply_coords(float *coords, int num_points,
+                    const std::array<int, 2> &original_size);
+  void set_target_length(int target_length);
+  std::array<int, 2> get_target_shape(int oldh, int oldw);
 
 private:
   int target_length;
@@ -34,6 +46,30 @@ private:
                                           int long_side_length);
 };
 
+// Input geometry and normalization of a SAM encoder/decoder pair. The
+// defaults describe the original ViT-B/H export, which MobileSAM's TinyViT
+// encoder shares.
+struct SAMModelDescriptor {
+  int img_size{1024};
+  int embed_dim{256};
+  int embed_size{64};
+  int low_res_mask_size{256};
+  float mask_threshold{0.0};
+  std::array<float, 3> pixel_mean{123.675, 116.28, 103.53};
+  std::array<float, 3> pixel_std{58.395, 57.12, 57.375};
+  // Quantization of 8-bit low_res_masks outputs
+  cutout::QuantizationParams mask_quantization;
+};
+
+struct SAMObject {
+  std::string name;
+  std::vector<std::array<int, 2>> point_coords;
+  std::vector<int> point_labels;
+  cv::Mat mask;
+  // Prompts changed since the last decode
+  bool is_dirty{false};
+};
+
 class SAMImage {
 public:
   SAMImage() { this->reset(); };
@@ -43,16 +79,36 @@ public:
   SAMImage(SAMImage &&) = default;
   SAMImage &operator=(SAMImage &&) = delete;
 
+  void configure(const SAMModelDescriptor &descriptor);
+  void configure_duplicates(bool enabled, int max_hash_distance,
+                            int min_inliers, int capacity,
+                            bool warp_features);
+  bool reuse_duplicate(const std::string &image_path, float *features);
+  void set_context(ImageContext *context);
   std::vector<float> preprocess(const std::string &image_path);
   std::vector<float> encode(const std::vector<float> &data);
   void set_features(const cv::Mat &features);
+  void set_features(const float *features, int features_size);
   std::pair<std::vector<float>, std::vector<float>> transform_coords();
+  int get_prompt_bucket(int num_points);
+  void transform_coords_padded(int bucket, float *point_coords,
+                               float *point_labels);
   std::pair<std::vector<float>, std::vector<float>>
   decode(const int num_points, const std::vector<float> &features,
          const std::vector<float> &point_coords,
          const std::vector<float> &point_labels);
   void postprocess(const std::vector<float> &scores,
                    const std::vector<float> &low_res_masks);
+  void postprocess(const float *scores, int scores_size,
+                   const float *low_res_masks);
+  void postprocess(const float *scores, int scores_size,
+                   const float *low_res_masks, int low_res_masks_size);
+  void set_mask_quantization(const cutout::QuantizationParams &params);
+  void postprocess_quantized(const float *scores, int scores_size,
+                             const uint8_t *low_res_masks);
+  void postprocess_quantized(const float *scores, int scores_size,
+                             const uint8_t *low_res_masks,
+                             int low_res_masks_size);
   bool add_point_and_label(const std::array<int, 2> &point, const int &label);
   bool pop_point_and_label();
   std::pair<std::vector<std::array<int, 2>>, std::vector<int>>
@@ -63,21 +119,72 @@ public:
   bool check_set_image();
   void clear();
 
+  // Multi-object session: several named objects share one embedding
+  int add_object(const std::string &name);
+  bool remove_object(int object_id);
+  bool add_object_point_and_label(int object_id,
+                                  const std::array<int, 2> &point,
+                                  const int &label);
+  bool pop_object_point_and_label(int object_id);
+  int get_total_objects();
+  std::vector<int> get_dirty_objects(int &max_points);
+  void transform_coords_batch(const std::vector<int> &object_ids,
+                              int num_points, float *point_coords,
+                              float *point_labels);
+  void postprocess_batch(const std::vector<int> &object_ids,
+                         const float *scores, int scores_size,
+                         const float *low_res_masks, int low_res_masks_size);
+  cv::Mat get_label_map();
+  bool get_label_map(const std::string &label_map_path);
+  int make_stickers(const std::string &output_dir);
+  int get_batch_decode() const;
+  void set_batch_decode(int batch_decode);
+  cutout::MatPoolStats get_pool_stats() const;
+  void trim_pool();
+  void *acquire_tensor(int64_t bytes, cutout::Stage stage);
+  void recycle_tensor(void *data);
+  void set_trace_request(uint64_t request);
+  cutout::MemorySnapshot get_memory_stats() const;
+  void reset_memory_stats();
+
 private:
   // Helper methods
+  void load(const std::string &image_path);
+  void use_context(ImageContextRef context);
+  cv::Mat warp_features(const cutout::DuplicateMatch &match);
+  bool has_masks(int num_masks, int low_res_masks_size) const;
+  cv::Mat postprocess_mask(const float *scores, int num_masks,
+                           const float *low_res_masks);
+  cv::Mat postprocess_mask_quantized(const float *scores, int num_masks,
+                                     const uint8_t *low_res_masks);
+  template <typename T>
+  cv::Mat resize_to_original(const T *low_res_mask, int type);
+  void refine_mask(cv::Mat &pred);
   void threshold_1d_simple(cv::Mat &masks, float thresh);
   cv::Rect get_bbox(const cv::Mat &mask);
+  static bool is_object_name(const std::string &name);
   void reset();
 
+  // Buffers of the full-resolution masks, reused across prompts and images.
+  // Declared first so Mats below return their buffers before it goes.
+  cutout::MatPoolRef pool{cutout::make_mat_pool()};
+  // Decoder prompts and outputs passed through FFI, one set per prompt
+  // bucket and concurrent call
+  std::unique_ptr<cutout::TensorPool> tensors{
+      std::make_unique<cutout::TensorPool>()};
+
   // Static parameters
-  const float mask_threshold{0.0};
-  const int img_size{1024};
-  const std::array<float, 3> pixel_mean{123.675, 116.28, 103.53};
-  const std::array<float, 3> pixel_std{58.395, 57.12, 57.375};
+  SAMModelDescriptor descriptor;
+  // Object ids double as label map values, so 0 is kept for background
+  const int max_objects{255};
+  // Prompts are padded up to one of these sizes so decoder shapes repeat
+  const std::array<int, 3> prompt_buckets{4, 8, 16};
 
   // State variables
-  ResizeLongestSide transform{img_size};
+  ResizeLongestSide transform{descriptor.img_size};
   bool is_image_set{false};
+  ImageContextRef context;
+  // Full resolution pixels of the context, shared rather than copied
   cv::Mat image;
   cv::Mat features;
   cv::Mat mask;
@@ -86,6 +193,16 @@ private:
   std::vector<int> point_labels;
   std::array<int, 2> original_size;
   std::array<int, 2> input_size;
+  std::map<int, SAMObject> objects;
+  // Whether the decoder takes a batch of prompts, which many exports fix at
+  // one: 0 until the first multi-object decode finds out, 1 yes, -1 no
+  int batch_decode{0};
+  // Already decoded, by set_context or reuse_duplicate, so the following
+  // preprocess of this path can skip it
+  std::string preloaded_path;
+  cutout::DuplicateIndex duplicates;
+  // Request of the following calls and the counters of their allocations
+  cutout::TraceSession trace;
 };
 
 ResizeLongestSide::ResizeLongestSide(int target_length)
@@ -130,6 +247,28 @@ ResizeLongestSide::apply_coords(const cv::Mat &coords,
   return coords_float;
 }
 
+void ResizeLongestSide::apply_coords(float *coords, int num_points,
+                                     const std::array<int, 2> &original_size) {
+  auto target_size =
+      get_preprocess_shape(original_size[0], original_size[1], target_length);
+  float scale_w = (float)target_size[1] / original_size[1];
+  float scale_h = (float)target_size[0] / original_size[0];
+
+  // Scale in place so the caller's buffer is the only storage involved
+  for (int i = 0; i < num_points; i++) {
+    coords[i * 2] *= scale_w;
+    coords[i * 2 + 1] *= scale_h;
+  }
+}
+
+void ResizeLongestSide::set_target_length(int target_length) {
+  this->target_length = target_length;
+}
+
+std::array<int, 2> ResizeLongestSide::get_target_shape(int oldh, int oldw) {
+  return get_preprocess_shape(oldh, oldw, target_length);
+}
+
 std::array<int, 2>
 ResizeLongestSide::get_preprocess_shape(int oldh, int oldw,
                                         int long_side_length) {
@@ -143,98 +282,143 @@ ResizeLongestSide::get_preprocess_shape(int oldh, int oldw,
   return std::array<int, 2>{newh_int, neww_int};
 }
 
-std::vector<float> SAMImage::preprocess(const std::string &image_path) {
-  cv::Mat image = cv::imread(image_path);
+void SAMImage::configure(const SAMModelDescriptor &descriptor) {
+  this->descriptor = descriptor;
+  this->transform.set_target_length(descriptor.img_size);
+  this->batch_decode = 0;
   this->reset();
-  this->image = image.clone();
-
-  cv::Mat input_image = transform.apply_image(image);
-  // Start: Transform to format [1, C, H, W]
-  // First transpose from [H, W, C] to [C, H, W]
-  std::vector<cv::Mat> channels;
-  cv::split(input_image, channels);
+}
 
-  // Create a new matrix to store the transposed channels
-  int height = input_image.rows;
-  int width = input_image.cols;
-  int channels_count = input_image.channels();
+// Embeddings only stand in for images aligned with the cached one to
+// within half an embedding cell, unless `warp_features` accepts the usual
+// duplicate warps: resampled embeddings are an approximation whose masks
+// have not been validated against a fresh encoder run on every model.
+void SAMImage::configure_duplicates(bool enabled, int max_hash_distance,
+                                    int min_inliers, int capacity,
+                                    bool warp_features) {
+  float max_corner_shift =
+      warp_features ? 0.1f
+                    : 0.5f / descriptor.embed_size / std::sqrt(2.0f);
+  duplicates.configure(enabled, max_hash_distance, min_inliers, capacity,
+                       max_corner_shift);
+}
 
-  cv::Mat temp(channels_count, height * width, CV_32F);
-  for (int i = 0; i < channels_count; i++) {
-    channels[i].reshape(1, 1).copyTo(temp.row(i));
+void SAMImage::load(const std::string &image_path) {
+  if (!preloaded_path.empty() && preloaded_path == image_path) {
+    preloaded_path.clear();
+    return;
   }
+  preloaded_path.clear();
 
-  // Reshape to [C, H, W]
-  cv::Mat transposed_image;
-  transposed_image = temp.reshape(1, {channels_count, height, width});
+  // The previous image goes first, so the decode is planned against the
+  // memory actually left
+  this->reset();
+  cutout::TraceSpan span(cutout::Stage::DECODE);
+  ImageContextRef context(new ImageContext(image_path));
+  use_context(std::move(context));
+}
 
-  // Add extra dimension to make it [1, C, H, W]
-  std::vector<int> new_shape = {1, channels_count, height, width};
-  input_image = transposed_image.reshape(1, new_shape);
-  // End: Transform to format [1, C, H, W]
+// Uses an image decoded once for several pipelines, e.g. after an
+// auto-cutout of the same photo; the next preprocess of its path does not
+// decode it again
+void SAMImage::set_context(ImageContext *context) {
+  use_context(retain_context(context));
+  this->preloaded_path = this->context->get_path();
+}
 
-  this->original_size = std::array<int, 2>{image.rows, image.cols};
+void SAMImage::use_context(ImageContextRef context) {
+  this->reset();
+  this->context = std::move(context);
+  this->image = this->context->get_image();
+  // Prompts refer to the file, which is larger than the pixels when the
+  // memory budget reduced the decode; masks have the size of the pixels
+  cv::Size original = this->context->get_original_size();
+  this->original_size = std::array<int, 2>{original.height, original.width};
   this->input_size =
-      std::array<int, 2>{input_image.size[2], input_image.size[3]};
-
-  cv::Mat pixel_mean = cv::Mat(this->pixel_mean);
-  pixel_mean = pixel_mean.reshape(1, {1, 3, 1, 1});
-  cv::Mat pixel_std = cv::Mat(this->pixel_std);
-  pixel_std = pixel_std.reshape(1, {1, 3, 1, 1});
-
-  // Process each channel separately for normalization
-  std::vector<cv::Mat> norm_channels(3); // Variable name changed
-  for (int c = 0; c < 3; c++) {
-    // Extract slice for each channel
-    cv::Mat channel(input_image.size[2], input_image.size[3], CV_32F);
-    float *input_ptr = (float *)input_image.data +
-                       c * input_image.size[2] * input_image.size[3];
-    std::memcpy(channel.data, input_ptr,
-                input_image.size[2] * input_image.size[3] * sizeof(float));
-
-    // Apply normalization
-    float mean_val = ((float *)pixel_mean.data)[c];
-    float std_val = ((float *)pixel_std.data)[c];
-    channel = (channel - mean_val) / std_val;
-
-    // Copy normalized data back to original location
-    std::memcpy(input_ptr, channel.data,
-                input_image.size[2] * input_image.size[3] * sizeof(float));
-  }
-
-  int h = input_image.size[2];
-  int w = input_image.size[3];
-  int padh = this->img_size - h;
-  int padw = this->img_size - w;
-
-  // Padding should be applied using copyMakeBorder
-  // Create a 4D tensor to store the result
-  std::vector<int> padded_shape = {1, 3, h + padh, w + padw};
-  cv::Mat padded_image(padded_shape.size(), padded_shape.data(), CV_32F,
-                       cv::Scalar(0));
-
-  // Process each channel separately for padding
-  for (int c = 0; c < 3; c++) {
-    // Extract current channel
-    cv::Mat channel(h, w, CV_32F);
-    float *input_ptr = (float *)input_image.data + c * h * w;
-    std::memcpy(channel.data, input_ptr, h * w * sizeof(float));
-
-    // Apply padding
-    cv::Mat padded_channel;
-    cv::copyMakeBorder(channel, padded_channel, 0, padh, // top, bottom
-                       0, padw,                          // left, right
-                       cv::BORDER_CONSTANT, cv::Scalar(0));
-
-    // Copy result to 4D tensor
-    float *output_ptr =
-        (float *)padded_image.data + c * (h + padh) * (w + padw);
-    std::memcpy(output_ptr, padded_channel.data,
-                (h + padh) * (w + padw) * sizeof(float));
-  }
-
-  return std::vector<float>(padded_image.begin<float>(),
-                            padded_image.end<float>());
+      transform.get_target_shape(original.height, original.width);
+  trace.pixels = image.total();
+}
+
+// Sets the embedding of a near-duplicate image seen before, warped onto
+// this one, and copies it to `features` so the encoder can be skipped. On a
+// miss, the decoded image is kept for preprocess and the embedding passed
+// to set_features next is added to the index.
+bool SAMImage::reuse_duplicate(const std::string &image_path,
+                               float *features) {
+  if (!duplicates.is_enabled()) {
+    return false;
+  }
+
+  load(image_path);
+  preloaded_path = image_path;
+
+  cutout::DuplicateMatch match;
+  if (image.empty() || !duplicates.find(image, match)) {
+    return false;
+  }
+  preloaded_path.clear();
+
+  cv::Mat warped = warp_features(match);
+  std::copy(warped.begin<float>(), warped.end<float>(), features);
+  set_features(warped);
+  return true;
+}
+
+// Resamples every embedding channel through the homography. Each embedding
+// cell covers img_size / embed_size input pixels of the resized image.
+cv::Mat SAMImage::warp_features(const cutout::DuplicateMatch &match) {
+  int embed_dim = descriptor.embed_dim;
+  int embed_size = descriptor.embed_size;
+  double cell = (double)descriptor.img_size / embed_size;
+  double cached_scale = (double)descriptor.img_size /
+                        std::max(match.size.width, match.size.height);
+  double scale =
+      (double)descriptor.img_size / std::max(image.rows, image.cols);
+
+  // Maps embedding cells of this image to those of the cached one
+  cv::Matx33d to_image(cell / scale, 0, 0, 0, cell / scale, 0, 0, 0, 1);
+  cv::Matx33d to_cells(cached_scale / cell, 0, 0, 0, cached_scale / cell, 0,
+                       0, 0, 1);
+  cv::Mat transform =
+      cv::Mat(to_cells) * match.homography.inv() * cv::Mat(to_image);
+
+  cv::Mat warped(match.payload.dims, match.payload.size.p, CV_32F);
+  cv::Size plane_size(embed_size, embed_size);
+  for (int channel = 0; channel < embed_dim; channel++) {
+    size_t offset = (size_t)channel * embed_size * embed_size;
+    cv::Mat source(plane_size, CV_32F,
+                   const_cast<float *>(match.payload.ptr<float>()) + offset);
+    cv::Mat target(plane_size, CV_32F, warped.ptr<float>() + offset);
+    cv::warpPerspective(source, target, transform, plane_size,
+                        cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                        cv::BORDER_REPLICATE);
+  }
+  return warped;
+}
+
+std::vector<float> SAMImage::preprocess(const std::string &image_path) {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  load(image_path);
+
+  // Resized from the smallest pyramid level that still covers the encoder
+  // input instead of the full image
+  cutout::TraceSpan step_span(cutout::Stage::RESIZE);
+  cv::Size input_shape(input_size[1], input_size[0]);
+  cv::Mat input_image = pool->mat();
+  cv::resize(context->get_level(input_shape), input_image, input_shape, 0, 0,
+             cv::INTER_LINEAR);
+
+  // [1, 3, img_size, img_size], normalized and zero padded bottom-right
+  step_span.next(cutout::Stage::NORMALIZE);
+  int img_size = this->descriptor.img_size;
+  std::vector<float> input(3 * img_size * img_size);
+  auto normalization = cutout::Normalization::from_mean_std(
+      1.0f, this->descriptor.pixel_mean, this->descriptor.pixel_std);
+  cutout::Preprocessor<cutout::Layout::NCHW, float> preprocessor(
+      normalization);
+  preprocessor(input_image, input.data(), cv::Size(img_size, img_size));
+
+  return input;
 }
 
 void SAMImage::set_features(const cv::Mat &features) {
@@ -242,6 +426,17 @@ void SAMImage::set_features(const cv::Mat &features) {
   this->is_image_set = true;
 }
 
+void SAMImage::set_features(const float *features, int features_size) {
+  std::vector<float> features_vector(features, features + features_size);
+  cv::Mat features_mat(features_vector, true);
+  features_mat =
+      features_mat.reshape(1, {1, this->descriptor.embed_dim,
+                               this->descriptor.embed_size,
+                               this->descriptor.embed_size});
+  set_features(features_mat);
+  duplicates.add(features_mat);
+}
+
 std::pair<std::vector<float>, std::vector<float>> SAMImage::transform_coords() {
   std::vector<int> point_coords_vector;
   for (const auto &coord : this->point_coords) {
@@ -286,6 +481,35 @@ std::pair<std::vector<float>, std::vector<float>> SAMImage::transform_coords() {
   return std::make_pair(point_coords_float_vector, point_labels_float_vector);
 }
 
+int SAMImage::get_prompt_bucket(int num_points) {
+  for (int bucket : this->prompt_buckets) {
+    if (num_points <= bucket) {
+      return bucket;
+    }
+  }
+
+  // Past the largest bucket, grow in steps of it
+  int largest = this->prompt_buckets.back();
+  return (num_points + largest - 1) / largest * largest;
+}
+
+void SAMImage::transform_coords_padded(int bucket, float *point_coords,
+                                       float *point_labels) {
+  int num_points = std::min(this->total_points, bucket);
+
+  // Unused slots get SAM's padding label (-1) and are ignored by the decoder
+  std::fill(point_coords, point_coords + bucket * 2, 0.0f);
+  std::fill(point_labels, point_labels + bucket, -1.0f);
+
+  for (int i = 0; i < num_points; i++) {
+    point_coords[i * 2] = this->point_coords[i][0];
+    point_coords[i * 2 + 1] = this->point_coords[i][1];
+    point_labels[i] = this->point_labels[i];
+  }
+
+  this->transform.apply_coords(point_coords, num_points, this->original_size);
+}
+
 void SAMImage::threshold_1d_simple(cv::Mat &masks, float thresh) {
   int h = masks.size[0]; // 1080
   int w = masks.size[1]; // 810
@@ -303,47 +527,126 @@ void SAMImage::threshold_1d_simple(cv::Mat &masks, float thresh) {
 void SAMImage::postprocess(const std::vector<float> &scores,
                            const std::vector<float> &low_res_masks) {
   // Shape of low_res_masks: [4, 256, 256]
-  cv::Mat mask = cv::Mat(low_res_masks, CV_32F);
-  mask = mask.reshape(1, {4, 256 * 256});
-
-  // Resize mask to original image size
-  std::vector<cv::Mat> resized_masks;
+  postprocess(scores.data(), scores.size(), low_res_masks.data());
+}
 
-  for (int i = 0; i < 4; i++) {
-    // Extract i-th row and reshape to [256, 256]
-    cv::Mat single_mask = mask.row(i).reshape(1, 256);
+void SAMImage::postprocess(const float *scores, int scores_size,
+                           const float *low_res_masks) {
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+  this->mask = postprocess_mask(scores, scores_size, low_res_masks);
+}
 
-    // First resize
-    cv::Mat resized_single_mask;
-    cv::resize(single_mask, resized_single_mask,
-               cv::Size(this->img_size, this->img_size), 0, 0,
-               cv::INTER_LINEAR);
+// Decoder outputs of unknown size: masks too short for the scores leave no
+// mask instead of being read past their end
+void SAMImage::postprocess(const float *scores, int scores_size,
+                           const float *low_res_masks,
+                           int low_res_masks_size) {
+  if (!has_masks(scores_size, low_res_masks_size)) {
+    this->mask.release();
+    return;
+  }
+  postprocess(scores, scores_size, low_res_masks);
+}
 
-    // Second crop padding
-    cv::Rect roi(0, 0, this->input_size[1], this->input_size[0]);
-    resized_single_mask = resized_single_mask(roi);
+// Whether low_res_masks holds a full mask for each of num_masks scores
+bool SAMImage::has_masks(int num_masks, int low_res_masks_size) const {
+  int64_t mask_area = (int64_t)this->descriptor.low_res_mask_size *
+                      this->descriptor.low_res_mask_size;
+  return num_masks > 0 && num_masks * mask_area <= low_res_masks_size;
+}
 
-    // Second resize - convert to original image size
-    cv::resize(resized_single_mask, resized_single_mask,
-               cv::Size(this->original_size[1], this->original_size[0]), 0, 0,
-               cv::INTER_LINEAR);
+void SAMImage::set_mask_quantization(const cutout::QuantizationParams &params) {
+  this->descriptor.mask_quantization = params;
+}
 
-    // Store result in vector
-    resized_masks.push_back(resized_single_mask);
-  }
+void SAMImage::postprocess_quantized(const float *scores, int scores_size,
+                                     const uint8_t *low_res_masks) {
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+  this->mask = postprocess_mask_quantized(scores, scores_size, low_res_masks);
+}
 
-  // Threshold masks
-  for (int i = 0; i < 4; i++) {
-    threshold_1d_simple(resized_masks[i], this->mask_threshold);
+// Quantized decoder outputs of unknown size, checked as in postprocess
+void SAMImage::postprocess_quantized(const float *scores, int scores_size,
+                                     const uint8_t *low_res_masks,
+                                     int low_res_masks_size) {
+  if (!has_masks(scores_size, low_res_masks_size)) {
+    this->mask.release();
+    return;
   }
+  postprocess_quantized(scores, scores_size, low_res_masks);
+}
 
-  int max_index =
-      std::max_element(scores.begin(), scores.end()) - scores.begin();
-
-  cv::Mat pred = resized_masks[max_index];
+cv::Mat SAMImage::postprocess_mask(const float *scores, int num_masks,
+                                   const float *low_res_masks) {
+  // Only the best scoring mask is kept, so resize and threshold just that one
+  int max_index = std::max_element(scores, scores + num_masks) - scores;
+  int low_res_mask_size = this->descriptor.low_res_mask_size;
+  cutout::TraceSpan span(cutout::Stage::UPSAMPLE);
+  cv::Mat resized_mask = resize_to_original(
+      low_res_masks + max_index * low_res_mask_size * low_res_mask_size,
+      CV_32F);
+
+  // Threshold mask
+  span.next(cutout::Stage::MORPHOLOGY);
+  threshold_1d_simple(resized_mask, this->descriptor.mask_threshold);
+
+  cv::Mat pred = resized_mask;
   pred = pred * 255;
   pred.convertTo(pred, CV_8UC1);
 
+  refine_mask(pred);
+  return pred;
+}
+
+// 8-bit counterpart of postprocess_mask: the mask is resized as uint8 codes
+// and the logit threshold becomes a code threshold
+cv::Mat SAMImage::postprocess_mask_quantized(const float *scores,
+                                             int num_masks,
+                                             const uint8_t *low_res_masks) {
+  const auto &params = this->descriptor.mask_quantization;
+  int max_index = std::max_element(scores, scores + num_masks) - scores;
+  int low_res_mask_size = this->descriptor.low_res_mask_size;
+  cutout::TraceSpan span(cutout::Stage::UPSAMPLE);
+  cv::Mat codes = cutout::to_codes(
+      low_res_masks + max_index * low_res_mask_size * low_res_mask_size,
+      low_res_mask_size, low_res_mask_size, params);
+
+  cv::Mat pred = resize_to_original(codes.ptr<uint8_t>(), CV_8U);
+  span.next(cutout::Stage::MORPHOLOGY);
+  cv::threshold(pred, pred,
+                params.threshold_code(this->descriptor.mask_threshold), 255,
+                cv::THRESH_BINARY);
+
+  refine_mask(pred);
+  return pred;
+}
+
+// Upsamples a low-res mask to the padded input, crops the padding and
+// resizes it to the decoded image
+template <typename T>
+cv::Mat SAMImage::resize_to_original(const T *low_res_mask, int type) {
+  int low_res_mask_size = this->descriptor.low_res_mask_size;
+  int img_size = this->descriptor.img_size;
+  cv::Mat single_mask(low_res_mask_size, low_res_mask_size, type,
+                      const_cast<T *>(low_res_mask));
+
+  // First resize
+  cv::Mat resized_mask = pool->mat();
+  cv::resize(single_mask, resized_mask, cv::Size(img_size, img_size), 0, 0,
+             cv::INTER_LINEAR);
+
+  // Second crop padding
+  cv::Rect roi(0, 0, this->input_size[1], this->input_size[0]);
+  resized_mask = resized_mask(roi);
+
+  // Second resize - convert to the size of the decoded image
+  cv::resize(resized_mask, resized_mask, this->image.size(), 0, 0,
+             cv::INTER_LINEAR);
+
+  return resized_mask;
+}
+
+void SAMImage::refine_mask(cv::Mat &pred) {
   // kernel
   cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
   cv::Mat erode_kernel =
@@ -356,8 +659,6 @@ void SAMImage::postprocess(const std::vector<float> &scores,
   cv::erode(pred, pred, erode_kernel, cv::Point(-1, -1), 3);
   cv::threshold(pred, pred, 75, 255, cv::THRESH_BINARY);
   pred.convertTo(pred, CV_8UC1);
-
-  this->mask = pred;
 }
 
 bool SAMImage::add_point_and_label(const std::array<int, 2> &point,
@@ -399,32 +700,22 @@ bool SAMImage::get_mask(const std::string &mask_path) {
     return false;
   }
 
+  cutout::TraceSpan span(cutout::Stage::ENCODE);
   cv::imwrite(mask_path, this->mask);
   return true;
 }
 
 void SAMImage::make_sticker(const std::string &output_path) {
-  cv::Mat mask = this->mask.clone();
-
-  cv::Mat cutout;
-  cv::bitwise_and(this->image, this->image, cutout, mask);
-
-  // Split BGR channels
-  std::vector<cv::Mat> channels;
-  cv::split(cutout, channels);
+  cutout::TraceSpan span(cutout::Stage::STICKER, trace);
 
-  // Add alpha channel (mask)
-  channels.push_back(mask);
-
-  // Merge all channels to create BGRA image
-  cv::Mat rgba_image;
-  cv::merge(channels, rgba_image);
-
-  // Get bounding box and crop
-  cv::Rect bbox = get_bbox(mask);
-  cv::Mat cropped = rgba_image(bbox);
+  // BGRA with the mask as alpha, cropped to the object
+  cutout::TraceSpan step_span(cutout::Stage::COMPOSITE);
+  cv::Rect bbox = get_bbox(this->mask);
+  cv::Mat cropped =
+      cutout::composite(this->image, this->mask, bbox, pool->mat());
 
   // Save image
+  step_span.next(cutout::Stage::ENCODE);
   cv::imwrite(output_path, cropped);
 }
 
@@ -436,6 +727,7 @@ void SAMImage::clear() { this->reset(); }
 
 void SAMImage::reset() {
   this->is_image_set = false;
+  this->context.reset();
   this->image.release();
   this->features.release();
   this->mask.release();
@@ -444,31 +736,250 @@ void SAMImage::reset() {
   this->point_labels.clear();
   this->original_size = std::array<int, 2>{0, 0};
   this->input_size = std::array<int, 2>{0, 0};
+  this->objects.clear();
 }
 
-cv::Rect SAMImage::get_bbox(const cv::Mat &mask) {
-  std::vector<cv::Point> points;
-  cv::findNonZero(mask, points);
+// Stickers are written as `<output_dir>/<name>.png`, so names that could
+// leave the directory are rejected: empty, "." or "..", or with a separator
+bool SAMImage::is_object_name(const std::string &name) {
+  return !name.empty() && name != "." && name != ".." &&
+         name.find_first_of("/\\") == std::string::npos;
+}
+
+int SAMImage::add_object(const std::string &name) {
+  if (!is_object_name(name)) {
+    return -1;
+  }
+
+  // Reuse the smallest free id so labels stay within the 8-bit label map
+  for (int object_id = 1; object_id <= this->max_objects; object_id++) {
+    if (this->objects.count(object_id) == 0) {
+      this->objects[object_id].name = name;
+      return object_id;
+    }
+  }
+
+  return -1;
+}
+
+bool SAMImage::remove_object(int object_id) {
+  return this->objects.erase(object_id) > 0;
+}
+
+bool SAMImage::add_object_point_and_label(int object_id,
+                                          const std::array<int, 2> &point,
+                                          const int &label) {
+  auto it = this->objects.find(object_id);
+  if (it == this->objects.end()) {
+    return false;
+  }
+
+  it->second.point_coords.push_back(point);
+  it->second.point_labels.push_back(label);
+  it->second.is_dirty = true;
+  return true;
+}
+
+bool SAMImage::pop_object_point_and_label(int object_id) {
+  auto it = this->objects.find(object_id);
+  if (it == this->objects.end() || it->second.point_coords.empty()) {
+    return false;
+  }
+
+  it->second.point_coords.pop_back();
+  it->second.point_labels.pop_back();
+  it->second.is_dirty = true;
+
+  // An object without prompts has nothing to decode
+  if (it->second.point_coords.empty()) {
+    it->second.mask.release();
+    it->second.is_dirty = false;
+  }
+
+  return true;
+}
+
+int SAMImage::get_total_objects() { return this->objects.size(); }
+
+std::vector<int> SAMImage::get_dirty_objects(int &max_points) {
+  std::vector<int> object_ids;
+  max_points = 0;
+
+  for (const auto &entry : this->objects) {
+    const SAMObject &object = entry.second;
+    if (object.is_dirty && !object.point_coords.empty()) {
+      object_ids.push_back(entry.first);
+      max_points = std::max(max_points, (int)object.point_coords.size());
+    }
+  }
+
+  return object_ids;
+}
+
+void SAMImage::transform_coords_batch(const std::vector<int> &object_ids,
+                                      int num_points, float *point_coords,
+                                      float *point_labels) {
+  int batch = object_ids.size();
+
+  // Shorter prompts are padded with SAM's "not a point" label (-1)
+  std::vector<int> coords_shape = {batch, num_points, 2};
+  cv::Mat coords(coords_shape, CV_32F, cv::Scalar(0));
+  std::fill(point_labels, point_labels + batch * num_points, -1.0f);
+
+  for (int b = 0; b < batch; b++) {
+    const SAMObject &object = this->objects.at(object_ids[b]);
+    float *coords_ptr = (float *)coords.data + b * num_points * 2;
+
+    for (size_t i = 0; i < object.point_coords.size(); i++) {
+      coords_ptr[i * 2] = object.point_coords[i][0];
+      coords_ptr[i * 2 + 1] = object.point_coords[i][1];
+      point_labels[b * num_points + i] = object.point_labels[i];
+    }
+  }
+
+  coords = this->transform.apply_coords(coords, this->original_size);
+  std::copy(coords.begin<float>(), coords.end<float>(), point_coords);
+}
+
+void SAMImage::postprocess_batch(const std::vector<int> &object_ids,
+                                 const float *scores, int scores_size,
+                                 const float *low_res_masks,
+                                 int low_res_masks_size) {
+  int batch = object_ids.size();
+  if (batch == 0 || !has_masks(scores_size, low_res_masks_size)) {
+    return;
+  }
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+
+  // Shape of scores: [B, 4], shape of low_res_masks: [B, 4, 256, 256]
+  int num_masks = scores_size / batch;
+  int masks_stride = low_res_masks_size / batch;
+
+  std::vector<cv::Mat> masks(batch);
+  cv::parallel_for_(cv::Range(0, batch), [&](const cv::Range &range) {
+    for (int b = range.start; b < range.end; b++) {
+      masks[b] = postprocess_mask(scores + b * num_masks, num_masks,
+                                  low_res_masks + b * masks_stride);
+    }
+  });
+
+  for (int b = 0; b < batch; b++) {
+    SAMObject &object = this->objects.at(object_ids[b]);
+    object.mask = masks[b];
+    object.is_dirty = false;
+  }
+}
+
+cv::Mat SAMImage::get_label_map() {
+  cv::Mat label_map = pool->mat();
+  label_map.create(this->image.size(), CV_8UC1);
+  label_map.setTo(0);
+
+  // Later objects are painted over earlier ones where they overlap
+  for (const auto &entry : this->objects) {
+    if (!entry.second.mask.empty()) {
+      label_map.setTo(entry.first, entry.second.mask);
+    }
+  }
+
+  return label_map;
+}
 
-  if (points.empty()) {
-    return cv::Rect();
+bool SAMImage::get_label_map(const std::string &label_map_path) {
+  if (this->objects.empty()) {
+    return false;
   }
 
-  int x_min = std::numeric_limits<int>::max();
-  int y_min = std::numeric_limits<int>::max();
-  int x_max = std::numeric_limits<int>::min();
-  int y_max = std::numeric_limits<int>::min();
+  cutout::TraceSpan span(cutout::Stage::ENCODE);
+  cv::imwrite(label_map_path, get_label_map());
+  return true;
+}
+
+int SAMImage::make_stickers(const std::string &output_dir) {
+  cutout::TraceSpan span(cutout::Stage::STICKER, trace);
+  cutout::TraceSpan step_span(cutout::Stage::COMPOSITE);
+  cv::Mat label_map = get_label_map();
+
+  // Collect every object's bounding box in a single scan of the label map
+  std::array<cv::Point, 256> top_left;
+  std::array<cv::Point, 256> bottom_right;
+  top_left.fill(cv::Point(std::numeric_limits<int>::max(),
+                          std::numeric_limits<int>::max()));
+  bottom_right.fill(cv::Point(-1, -1));
+
+  for (int y = 0; y < label_map.rows; y++) {
+    const uchar *row = label_map.ptr<uchar>(y);
+    for (int x = 0; x < label_map.cols; x++) {
+      int label = row[x];
+      if (label == 0) {
+        continue;
+      }
+      top_left[label].x = std::min(top_left[label].x, x);
+      top_left[label].y = std::min(top_left[label].y, y);
+      bottom_right[label].x = std::max(bottom_right[label].x, x);
+      bottom_right[label].y = std::max(bottom_right[label].y, y);
+    }
+  }
 
-  for (const auto &point : points) {
-    x_min = std::min(x_min, point.x);
-    y_min = std::min(y_min, point.y);
-    x_max = std::max(x_max, point.x);
-    y_max = std::max(y_max, point.y);
+  int total_stickers = 0;
+  for (const auto &entry : this->objects) {
+    int label = entry.first;
+    if (bottom_right[label].x < 0) {
+      continue;
+    }
+
+    cv::Rect bbox(top_left[label], bottom_right[label] + cv::Point(1, 1));
+    cv::Mat alpha = pool->mat();
+    cv::compare(label_map(bbox), label, alpha, cv::CMP_EQ);
+    cv::Mat sticker =
+        cutout::composite(this->image(bbox), alpha,
+                          cv::Rect(cv::Point(), bbox.size()), pool->mat());
+    step_span.next(cutout::Stage::ENCODE);
+    cv::imwrite(output_dir + "/" + entry.second.name + ".png", sticker);
+    step_span.next(cutout::Stage::COMPOSITE);
+    total_stickers++;
   }
 
-  return cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1);
+  return total_stickers;
+}
+
+int SAMImage::get_batch_decode() const { return this->batch_decode; }
+
+void SAMImage::set_batch_decode(int batch_decode) {
+  this->batch_decode = batch_decode;
+}
+
+// Bounding box of the non-zero pixels, found in place rather than by
+// collecting every foreground point
+cv::Rect SAMImage::get_bbox(const cv::Mat &mask) {
+  return cv::boundingRect(mask);
+}
+
+cutout::MatPoolStats SAMImage::get_pool_stats() const {
+  return this->pool->get_stats();
+}
+
+void SAMImage::trim_pool() {
+  this->pool->trim();
+  this->tensors->trim();
 }
 
+void *SAMImage::acquire_tensor(int64_t bytes, cutout::Stage stage) {
+  return this->tensors->acquire(bytes, stage);
+}
+
+void SAMImage::recycle_tensor(void *data) { this->tensors->recycle(data); }
+
+void SAMImage::set_trace_request(uint64_t request) {
+  this->trace.request = request;
+}
+
+cutout::MemorySnapshot SAMImage::get_memory_stats() const {
+  return this->trace.memory->snapshot();
+}
+
+void SAMImage::reset_memory_stats() { this->trace.memory->reset(); }
+
 // Avoiding name mangling
 extern "C" {
 FUNCTION_ATTRIBUTE
@@ -483,12 +994,43 @@ void preprocess_sam(SAMImage *sam, const char *image_path, float *output_data) {
   std::copy(preprocessed.begin(), preprocessed.end(), output_data);
 }
 
+FUNCTION_ATTRIBUTE
+void configure_sam(SAMImage *sam, int img_size, int embed_dim, int embed_size,
+                   int low_res_mask_size, float mask_threshold,
+                   const float *pixel_mean, const float *pixel_std) {
+  SAMModelDescriptor descriptor;
+  descriptor.img_size = img_size;
+  descriptor.embed_dim = embed_dim;
+  descriptor.embed_size = embed_size;
+  descriptor.low_res_mask_size = low_res_mask_size;
+  descriptor.mask_threshold = mask_threshold;
+  std::copy(pixel_mean, pixel_mean + 3, descriptor.pixel_mean.begin());
+  std::copy(pixel_std, pixel_std + 3, descriptor.pixel_std.begin());
+  sam->configure(descriptor);
+}
+
 FUNCTION_ATTRIBUTE
 void set_features_sam(SAMImage *sam, const float *features, int features_size) {
-  std::vector<float> features_vector(features, features + features_size);
-  cv::Mat features_mat(features_vector, CV_32F);
-  features_mat = features_mat.reshape(1, {1, 256, 64, 64});
-  sam->set_features(features_mat);
+  sam->set_features(features, features_size);
+}
+
+FUNCTION_ATTRIBUTE
+void set_context_sam(SAMImage *sam, ImageContext *context) {
+  sam->set_context(context);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_duplicates_sam(SAMImage *sam, bool enabled,
+                              int max_hash_distance, int min_inliers,
+                              int capacity, bool warp_features) {
+  sam->configure_duplicates(enabled, max_hash_distance, min_inliers, capacity,
+                            warp_features);
+}
+
+FUNCTION_ATTRIBUTE
+bool reuse_duplicate_sam(SAMImage *sam, const char *image_path,
+                         float *features) {
+  return sam->reuse_duplicate(image_path, features);
 }
 
 FUNCTION_ATTRIBUTE
@@ -505,10 +1047,34 @@ void transform_coords_sam(SAMImage *sam, float *point_coords,
 FUNCTION_ATTRIBUTE
 void postprocess_sam(SAMImage *sam, const float *scores, int scores_size,
                      const float *low_res_masks, int low_res_masks_size) {
-  std::vector<float> scores_vector(scores, scores + scores_size);
-  std::vector<float> low_res_masks_vector(low_res_masks,
-                                          low_res_masks + low_res_masks_size);
-  sam->postprocess(scores_vector, low_res_masks_vector);
+  // Read the decoder output in place instead of copying it into vectors
+  sam->postprocess(scores, scores_size, low_res_masks, low_res_masks_size);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_quantization_sam(SAMImage *sam, float scale, int zero_point,
+                                bool is_signed) {
+  sam->set_mask_quantization({scale, zero_point, is_signed});
+}
+
+// low_res_masks as raw uint8/int8 decoder output
+FUNCTION_ATTRIBUTE
+void postprocess_quantized_sam(SAMImage *sam, const float *scores,
+                               int scores_size, const uint8_t *low_res_masks,
+                               int low_res_masks_size) {
+  sam->postprocess_quantized(scores, scores_size, low_res_masks,
+                             low_res_masks_size);
+}
+
+FUNCTION_ATTRIBUTE
+int get_prompt_bucket_sam(SAMImage *sam, int num_points) {
+  return sam->get_prompt_bucket(num_points);
+}
+
+FUNCTION_ATTRIBUTE
+void transform_coords_padded_sam(SAMImage *sam, int bucket,
+                                 float *point_coords, float *point_labels) {
+  sam->transform_coords_padded(bucket, point_coords, point_labels);
 }
 
 FUNCTION_ATTRIBUTE
@@ -560,4 +1126,121 @@ bool check_set_image_sam(SAMImage *sam) { return sam->check_set_image(); }
 
 FUNCTION_ATTRIBUTE
 void clear_sam(SAMImage *sam) { sam->clear(); }
+
+FUNCTION_ATTRIBUTE
+int add_object_sam(SAMImage *sam, const char *name) {
+  return sam->add_object(name);
+}
+
+FUNCTION_ATTRIBUTE
+bool remove_object_sam(SAMImage *sam, int object_id) {
+  return sam->remove_object(object_id);
+}
+
+FUNCTION_ATTRIBUTE
+bool add_object_point_and_label_sam(SAMImage *sam, int object_id,
+                                    const int *point, const int *label) {
+  std::array<int, 2> point_array{point[0], point[1]};
+  int label_int = label[0];
+  return sam->add_object_point_and_label(object_id, point_array, label_int);
+}
+
+FUNCTION_ATTRIBUTE
+bool pop_object_point_and_label_sam(SAMImage *sam, int object_id) {
+  return sam->pop_object_point_and_label(object_id);
+}
+
+FUNCTION_ATTRIBUTE
+int get_total_objects_sam(SAMImage *sam) { return sam->get_total_objects(); }
+
+FUNCTION_ATTRIBUTE
+int get_dirty_objects_sam(SAMImage *sam, int *object_ids, int *max_points) {
+  auto dirty_objects = sam->get_dirty_objects(*max_points);
+  std::copy(dirty_objects.begin(), dirty_objects.end(), object_ids);
+  return dirty_objects.size();
+}
+
+FUNCTION_ATTRIBUTE
+void transform_coords_batch_sam(SAMImage *sam, const int *object_ids,
+                                int batch, int num_points, float *point_coords,
+                                float *point_labels) {
+  std::vector<int> object_ids_vector(object_ids, object_ids + batch);
+  sam->transform_coords_batch(object_ids_vector, num_points, point_coords,
+                              point_labels);
+}
+
+FUNCTION_ATTRIBUTE
+void postprocess_batch_sam(SAMImage *sam, const int *object_ids, int batch,
+                           const float *scores, int scores_size,
+                           const float *low_res_masks,
+                           int low_res_masks_size) {
+  std::vector<int> object_ids_vector(object_ids, object_ids + batch);
+  sam->postprocess_batch(object_ids_vector, scores, scores_size, low_res_masks,
+                         low_res_masks_size);
+}
+
+FUNCTION_ATTRIBUTE
+bool get_label_map_sam(SAMImage *sam, const char *label_map_path) {
+  return sam->get_label_map(label_map_path);
+}
+
+FUNCTION_ATTRIBUTE
+int make_stickers_sam(SAMImage *sam, const char *output_dir) {
+  return sam->make_stickers(output_dir);
+}
+
+// 0 while unknown, 1 when the decoder takes a batch of prompts, -1 when not
+FUNCTION_ATTRIBUTE
+int get_batch_decode_sam(SAMImage *sam) { return sam->get_batch_decode(); }
+
+FUNCTION_ATTRIBUTE
+void set_batch_decode_sam(SAMImage *sam, int batch_decode) {
+  sam->set_batch_decode(batch_decode);
+}
+
+// In use, cached and high-water bytes, then cache hits and misses
+FUNCTION_ATTRIBUTE
+void get_pool_stats_sam(SAMImage *sam, int64_t *stats) {
+  auto pool_stats = sam->get_pool_stats();
+  stats[0] = pool_stats.in_use;
+  stats[1] = pool_stats.cached;
+  stats[2] = pool_stats.high_water;
+  stats[3] = pool_stats.hits;
+  stats[4] = pool_stats.misses;
+}
+
+FUNCTION_ATTRIBUTE
+void trim_pool_sam(SAMImage *sam) { sam->trim_pool(); }
+
+// Tensor buffer like allocate_tensor, taken from the buffers the session
+// got back from earlier calls when one of the size and stage is left
+FUNCTION_ATTRIBUTE
+void *acquire_tensor_sam(SAMImage *sam, int64_t bytes, int stage) {
+  return sam->acquire_tensor(bytes, (cutout::Stage)stage);
+}
+
+// Gives a buffer of acquire_tensor_sam back for the following calls
+FUNCTION_ATTRIBUTE
+void recycle_tensor_sam(SAMImage *sam, void *data) {
+  sam->recycle_tensor(data);
+}
+
+// Request ID from next_trace_request that the following spans carry
+FUNCTION_ATTRIBUTE
+void set_trace_request_sam(SAMImage *sam, uint64_t request) {
+  sam->set_trace_request(request);
+}
+
+// Bytes allocated by the session's calls since the last reset, bytes of
+// those still held and the most held at once
+FUNCTION_ATTRIBUTE
+void get_memory_stats_sam(SAMImage *sam, int64_t *stats) {
+  auto snapshot = sam->get_memory_stats();
+  stats[0] = snapshot.allocated;
+  stats[1] = snapshot.live;
+  stats[2] = snapshot.peak;
+}
+
+FUNCTION_ATTRIBUTE
+void reset_memory_stats_sam(SAMImage *sam) { sam->reset_memory_stats(); }
 }
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cutout {
+
+// Pipeline stages that time and memory are attributed to. The outer stages
+// cover a whole native call and the inner ones its steps; inference runs in
+// Dart and is reported through the C API. OTHER collects what happens
+// outside any stage.
+enum class Stage : uint8_t {
+  PREPROCESS = 0,
+  POSTPROCESS = 1,
+  STICKER = 2,
+  DECODE = 3,
+  RESIZE = 4,
+  // Normalization and the layout conversion run as one pass
+  NORMALIZE = 5,
+  INFERENCE = 6,
+  UPSAMPLE = 7,
+  MORPHOLOGY = 8,
+  COMPOSITE = 9,
+  ENCODE = 10,
+  OTHER = 11,
+  COUNT = 12,
+};
+
+inline const char *stage_name(Stage stage) {
+  static const char *const names[] = {
+      "preprocess", "postprocess", "sticker",   "decode",
+      "resize",     "normalize",   "inference", "upsample",
+      "morphology", "composite",   "encode",    "other",
+  };
+  return stage < Stage::COUNT ? names[(int)stage] : "unknown";
+}
+
+} // namespace cutout
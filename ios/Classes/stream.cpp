@@ -0,0 +1,399 @@
+#include "u2net.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <opencv2/video.hpp>
+
+enum class FrameFormat { BGRA = 0, RGBA = 1, BGR = 2, NV21 = 3 };
+enum class StreamAction {
+  NONE = 0,
+  KEYFRAME = 1,
+  PROPAGATED = 2,
+  UNCHANGED = 3
+};
+
+struct StreamFrame {
+  cv::Mat bgr;
+  // Rotation target, kept so recycled frames reuse its buffer too
+  cv::Mat rotated;
+  int64_t timestamp_us{0};
+};
+
+// Single-slot handoff from the camera thread to the inference thread. Both
+// sides only exchange pointers, so neither ever blocks; a frame that was
+// not taken in time is dropped in favour of the newer one. Consumed and
+// dropped frames go back through a spare slot so their buffers are reused.
+class FrameMailbox {
+public:
+  FrameMailbox() = default;
+  ~FrameMailbox() {
+    delete pending.exchange(nullptr);
+    delete spare.exchange(nullptr);
+  }
+  FrameMailbox(const FrameMailbox &) = delete;
+  FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+  // Producer: an empty frame to fill, recycled when one is available
+  std::unique_ptr<StreamFrame> acquire() {
+    StreamFrame *frame = spare.exchange(nullptr, std::memory_order_acquire);
+    return std::unique_ptr<StreamFrame>(frame ? frame : new StreamFrame());
+  }
+
+  // Producer: publishes a frame, dropping the one still waiting
+  void post(std::unique_ptr<StreamFrame> frame) {
+    StreamFrame *dropped =
+        pending.exchange(frame.release(), std::memory_order_acq_rel);
+    if (dropped != nullptr) {
+      dropped_frames.fetch_add(1, std::memory_order_relaxed);
+      recycle(std::unique_ptr<StreamFrame>(dropped));
+    }
+  }
+
+  // Consumer: the latest frame, or nullptr when nothing new arrived
+  std::unique_ptr<StreamFrame> take() {
+    return std::unique_ptr<StreamFrame>(
+        pending.exchange(nullptr, std::memory_order_acq_rel));
+  }
+
+  void recycle(std::unique_ptr<StreamFrame> frame) {
+    delete spare.exchange(frame.release(), std::memory_order_acq_rel);
+  }
+
+  int get_dropped_frames() const {
+    return dropped_frames.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<StreamFrame *> pending{nullptr};
+  std::atomic<StreamFrame *> spare{nullptr};
+  std::atomic<int> dropped_frames{0};
+};
+
+struct StreamStats {
+  int frames{0};
+  int keyframes{0};
+  int dropped_frames{0};
+  // Frames the change gate found identical to the last processed one
+  int unchanged_frames{0};
+  // Output frames per second, smoothed
+  double fps{0.0};
+  // Mean 1 - IoU between the propagated mask and the model mask of the
+  // same keyframe
+  double propagation_error{0.0};
+};
+
+// Live segmentation of a frame stream. The model runs only on keyframes;
+// in between, the last mask is warped along dense optical flow computed on
+// small grayscale frames.
+//
+// push_frame is called from the camera thread; poll, submit_mask, get_mask
+// and get_stats from a single consumer thread.
+class U2NetStream {
+public:
+  U2NetStream();
+  ~U2NetStream() = default;
+  U2NetStream(const U2NetStream &) = delete;
+  U2NetStream &operator=(const U2NetStream &) = delete;
+
+  void configure(int keyframe_interval, int flow_width, float max_motion);
+  void configure_gate(bool enabled, float threshold, bool use_background_model,
+                      float foreground_ratio);
+  U2NetSegmentImage *get_u2net();
+  void push_frame(const uint8_t *data, int width, int height, int stride,
+                  FrameFormat format, int rotation, int64_t timestamp_us);
+  StreamAction poll(float *input);
+  void submit_mask(const float *mask, int mask_size);
+  bool get_mask(uint8_t *output, int width, int height);
+  StreamStats get_stats();
+
+private:
+  cv::Mat to_flow_gray(const cv::Mat &bgr);
+  cv::Mat propagate(const cv::Mat &gray, float &motion);
+  void record_frame();
+
+  // Static parameters
+  // A keyframe is forced after this many frames...
+  int keyframe_interval{5};
+  // ...or when the mean flow exceeds this many flow pixels per frame
+  float max_motion{4.0f};
+  int flow_width{160};
+
+  U2NetSegmentImage u2net;
+  FrameMailbox mailbox;
+  cutout::ChangeGate gate;
+  cv::Ptr<cv::DISOpticalFlow> flow;
+
+  // State variables
+  std::unique_ptr<StreamFrame> current;
+  cv::Mat prev_gray;
+  // Pixel coordinates of the flow resolution, the identity map for remap
+  cv::Mat grid;
+  // Soft 8-bit mask at flow resolution
+  cv::Mat mask;
+  // Propagated mask of the pending keyframe, scored against the model mask
+  cv::Mat predicted;
+  int frames_since_keyframe{0};
+  double error_sum{0.0};
+  int scored_keyframes{0};
+  std::chrono::steady_clock::time_point last_output;
+  StreamStats stats;
+};
+
+U2NetStream::U2NetStream() {
+  flow = cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_ULTRAFAST);
+}
+
+void U2NetStream::configure(int keyframe_interval, int flow_width,
+                            float max_motion) {
+  this->keyframe_interval = std::max(1, keyframe_interval);
+  this->flow_width = flow_width;
+  this->max_motion = max_motion;
+  this->prev_gray.release();
+  this->mask.release();
+}
+
+void U2NetStream::configure_gate(bool enabled, float threshold,
+                                 bool use_background_model,
+                                 float foreground_ratio) {
+  gate.configure(enabled, threshold, use_background_model, foreground_ratio);
+}
+
+// The model geometry is configured through the regular U2Net API
+U2NetSegmentImage *U2NetStream::get_u2net() { return &u2net; }
+
+void U2NetStream::push_frame(const uint8_t *data, int width, int height,
+                             int stride, FrameFormat format, int rotation,
+                             int64_t timestamp_us) {
+  auto frame = mailbox.acquire();
+  uint8_t *pixels = const_cast<uint8_t *>(data);
+
+  switch (format) {
+  case FrameFormat::BGRA:
+    cv::cvtColor(cv::Mat(height, width, CV_8UC4, pixels, stride), frame->bgr,
+                 cv::COLOR_BGRA2BGR);
+    break;
+  case FrameFormat::RGBA:
+    cv::cvtColor(cv::Mat(height, width, CV_8UC4, pixels, stride), frame->bgr,
+                 cv::COLOR_RGBA2BGR);
+    break;
+  case FrameFormat::BGR:
+    cv::Mat(height, width, CV_8UC3, pixels, stride).copyTo(frame->bgr);
+    break;
+  case FrameFormat::NV21:
+    cv::cvtColor(cv::Mat(height * 3 / 2, width, CV_8UC1, pixels, stride),
+                 frame->bgr, cv::COLOR_YUV2BGR_NV21);
+    break;
+  }
+
+  // Camera sensors are usually mounted sideways. cv::rotate cannot work in
+  // place on non-square frames.
+  if (rotation == 90 || rotation == 180 || rotation == 270) {
+    int code = rotation == 90    ? cv::ROTATE_90_CLOCKWISE
+               : rotation == 180 ? cv::ROTATE_180
+                                 : cv::ROTATE_90_COUNTERCLOCKWISE;
+    cv::rotate(frame->bgr, frame->rotated, code);
+    cv::swap(frame->bgr, frame->rotated);
+  }
+
+  frame->timestamp_us = timestamp_us;
+  mailbox.post(std::move(frame));
+}
+
+// Takes the latest frame. On a keyframe the model input is written to
+// `input` and the caller answers with submit_mask; otherwise the mask has
+// already been propagated to the new frame.
+StreamAction U2NetStream::poll(float *input) {
+  auto frame = mailbox.take();
+  if (!frame) {
+    return StreamAction::NONE;
+  }
+
+  if (current) {
+    mailbox.recycle(std::move(current));
+  }
+  current = std::move(frame);
+
+  cv::Mat gray = to_flow_gray(current->bgr);
+
+  // A static scene keeps the current mask without flow or inference
+  if (!gate.is_changed(gray) && !mask.empty()) {
+    stats.unchanged_frames++;
+    record_frame();
+    return StreamAction::UNCHANGED;
+  }
+
+  cv::Mat propagated;
+  float motion = 0.0f;
+  if (!mask.empty() && prev_gray.size() == gray.size()) {
+    propagated = propagate(gray, motion);
+  }
+  prev_gray = gray;
+
+  bool is_keyframe = propagated.empty() ||
+                     frames_since_keyframe + 1 >= keyframe_interval ||
+                     motion > max_motion;
+  if (!is_keyframe) {
+    mask = propagated;
+    frames_since_keyframe++;
+    record_frame();
+    return StreamAction::PROPAGATED;
+  }
+
+  predicted = propagated;
+  u2net.set_image(current->bgr);
+  u2net.preprocess_into(input);
+  return StreamAction::KEYFRAME;
+}
+
+void U2NetStream::submit_mask(const float *mask, int mask_size) {
+  std::vector<float> mask_vector(mask, mask + mask_size);
+  cv::resize(u2net.normalize_mask(mask_vector), this->mask, prev_gray.size(),
+             0, 0, cv::INTER_LINEAR);
+
+  if (!predicted.empty()) {
+    cv::Mat model_binary = this->mask > 127;
+    cv::Mat predicted_binary = predicted > 127;
+    double union_area = cv::countNonZero(model_binary | predicted_binary);
+    if (union_area > 0) {
+      double intersection = cv::countNonZero(model_binary & predicted_binary);
+      error_sum += 1.0 - intersection / union_area;
+      scored_keyframes++;
+    }
+    predicted.release();
+  }
+
+  frames_since_keyframe = 0;
+  stats.keyframes++;
+  record_frame();
+}
+
+// Current mask resized to the caller's preview size
+bool U2NetStream::get_mask(uint8_t *output, int width, int height) {
+  if (mask.empty()) {
+    return false;
+  }
+
+  cv::Mat output_mat(height, width, CV_8UC1, output);
+  cv::resize(mask, output_mat, output_mat.size(), 0, 0, cv::INTER_LINEAR);
+  return true;
+}
+
+StreamStats U2NetStream::get_stats() {
+  stats.dropped_frames = mailbox.get_dropped_frames();
+  stats.propagation_error =
+      scored_keyframes == 0 ? 0.0 : error_sum / scored_keyframes;
+  return stats;
+}
+
+cv::Mat U2NetStream::to_flow_gray(const cv::Mat &bgr) {
+  int flow_height = std::max(1, bgr.rows * flow_width / bgr.cols);
+  cv::Mat small, gray;
+  cv::resize(bgr, small, cv::Size(flow_width, flow_height), 0, 0,
+             cv::INTER_AREA);
+  cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+  return gray;
+}
+
+// Warps the mask from the previous frame onto `gray`. Flow is computed
+// from the new frame back to the old one, so every new pixel looks up
+// where it came from.
+cv::Mat U2NetStream::propagate(const cv::Mat &gray, float &motion) {
+  cv::Mat backward_flow;
+  flow->calc(gray, prev_gray, backward_flow);
+
+  cv::Scalar mean_flow = cv::mean(cv::abs(backward_flow));
+  motion = mean_flow[0] + mean_flow[1];
+
+  if (grid.size() != gray.size()) {
+    grid.create(gray.size(), CV_32FC2);
+    for (int y = 0; y < grid.rows; y++) {
+      auto *row = grid.ptr<cv::Vec2f>(y);
+      for (int x = 0; x < grid.cols; x++) {
+        row[x] = cv::Vec2f(x, y);
+      }
+    }
+  }
+
+  cv::Mat map = grid + backward_flow;
+  cv::Mat propagated;
+  cv::remap(mask, propagated, map, cv::noArray(), cv::INTER_LINEAR,
+            cv::BORDER_REPLICATE);
+  return propagated;
+}
+
+void U2NetStream::record_frame() {
+  auto now = std::chrono::steady_clock::now();
+  if (stats.frames > 0) {
+    double seconds = std::chrono::duration<double>(now - last_output).count();
+    if (seconds > 0) {
+      double fps = 1.0 / seconds;
+      stats.fps = stats.frames == 1 ? fps : stats.fps * 0.9 + fps * 0.1;
+    }
+  }
+  last_output = now;
+  stats.frames++;
+}
+
+// Avoiding name mangling
+extern "C" {
+FUNCTION_ATTRIBUTE
+U2NetStream *create_stream() { return new U2NetStream(); }
+
+FUNCTION_ATTRIBUTE
+void destroy_stream(U2NetStream *stream) { delete stream; }
+
+FUNCTION_ATTRIBUTE
+void configure_stream(U2NetStream *stream, int keyframe_interval,
+                      int flow_width, float max_motion) {
+  stream->configure(keyframe_interval, flow_width, max_motion);
+}
+
+FUNCTION_ATTRIBUTE
+U2NetSegmentImage *get_u2net_stream(U2NetStream *stream) {
+  return stream->get_u2net();
+}
+
+FUNCTION_ATTRIBUTE
+void push_frame_stream(U2NetStream *stream, const uint8_t *data, int width,
+                       int height, int stride, int format, int rotation,
+                       int64_t timestamp_us) {
+  stream->push_frame(data, width, height, stride,
+                     static_cast<FrameFormat>(format), rotation, timestamp_us);
+}
+
+FUNCTION_ATTRIBUTE
+int poll_stream(U2NetStream *stream, float *input) {
+  return static_cast<int>(stream->poll(input));
+}
+
+FUNCTION_ATTRIBUTE
+void submit_mask_stream(U2NetStream *stream, const float *mask,
+                        int mask_size) {
+  stream->submit_mask(mask, mask_size);
+}
+
+FUNCTION_ATTRIBUTE
+bool get_mask_stream(U2NetStream *stream, uint8_t *output, int width,
+                     int height) {
+  return stream->get_mask(output, width, height);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_gate_stream(U2NetStream *stream, bool enabled, float threshold,
+                           bool use_background_model, float foreground_ratio) {
+  stream->configure_gate(enabled, threshold, use_background_model,
+                         foreground_ratio);
+}
+
+// frames, keyframes, dropped frames, fps, propagation error, unchanged frames
+FUNCTION_ATTRIBUTE
+void get_stats_stream(U2NetStream *stream, double *output) {
+  StreamStats stats = stream->get_stats();
+  output[0] = stats.frames;
+  output[1] = stats.keyframes;
+  output[2] = stats.dropped_frames;
+  output[3] = stats.fps;
+  output[4] = stats.propagation_error;
+  output[5] = stats.unchanged_frames;
+}
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "png_strip.hpp"
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace cutout {
+
+// Image rows read top to bottom in strips. PNGs are decoded as they are
+// read, so only the strip is held; other formats have no row-wise decoder
+// available to us and are decoded whole once, which still avoids the mask
+// and cutout temporaries of the full-size pipeline.
+class StripSource {
+public:
+  bool open(const std::string &image_path) {
+    next_row = 0;
+    image.release();
+    if (png.open(image_path)) {
+      size = cv::Size(png.get_width(), png.get_height());
+      return true;
+    }
+
+    image = cv::imread(image_path);
+    size = image.size();
+    return !image.empty();
+  }
+
+  cv::Size get_size() const { return size; }
+  bool is_streamed() const { return image.empty(); }
+  int get_next_row() const { return next_row; }
+
+  // The next `rows` rows, fewer at the bottom, as BGR; `bgr` is a view of
+  // the decoded image when it is not streamed
+  bool read(int rows, cv::Mat &bgr) {
+    rows = std::min(rows, size.height - next_row);
+    if (rows <= 0) {
+      return false;
+    }
+
+    if (!is_streamed()) {
+      bgr = image.rowRange(next_row, next_row + rows);
+      next_row += rows;
+      return true;
+    }
+
+    bgr.create(rows, size.width, CV_8UC3);
+    for (int y = 0; y < rows; y++) {
+      if (!png.read_row(bgr.ptr<uint8_t>(y))) {
+        return false;
+      }
+    }
+    next_row += rows;
+    return true;
+  }
+
+private:
+  PngStripReader png;
+  cv::Mat image;
+  cv::Size size;
+  int next_row{0};
+};
+
+// Downscales the whole source by a power of two, strip by strip, until its
+// longer side is at most twice `min_side`. Strips are a multiple of the
+// factor high, so the box filter of INTER_AREA sees the same pixels as on
+// the whole image.
+inline cv::Mat read_preview(StripSource &source, int strip_rows,
+                            int min_side) {
+  cv::Size size = source.get_size();
+  int factor = 1;
+  while (std::max(size.width, size.height) / (factor * 2) >= min_side) {
+    factor *= 2;
+  }
+  strip_rows = std::max(factor, strip_rows / factor * factor);
+
+  cv::Size preview_size((size.width + factor - 1) / factor,
+                        (size.height + factor - 1) / factor);
+  cv::Mat preview(preview_size, CV_8UC3);
+  cv::Mat strip;
+  int preview_row = 0;
+  while (source.read(strip_rows, strip)) {
+    int rows = std::min((strip.rows + factor - 1) / factor,
+                        preview_size.height - preview_row);
+    cv::Mat target = preview.rowRange(preview_row, preview_row + rows);
+    cv::resize(strip, target, target.size(), 0, 0, cv::INTER_AREA);
+    preview_row += rows;
+  }
+  return preview_row == preview_size.height ? preview : cv::Mat();
+}
+
+// Upsamples an 8-bit low resolution mask to `size` and refines it as the
+// full-size U2Net pipeline does (3x3 open, 5x5 blur, threshold), a band of
+// rows at a time. Each band is computed with `halo` extra rows on both
+// sides, which covers the reach of the morphology and blur. The upsampling
+// is a warpAffine, which quantizes source positions to 1/32 pixel, so the
+// mask is close to, but not exactly, the cv::resize of the full-size
+// pipeline.
+class MaskStrips {
+public:
+  static const int halo = 4;
+
+  MaskStrips(const cv::Mat &low_res_mask, cv::Size size)
+      : low_res_mask(low_res_mask), size(size),
+        kernel(cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3))) {
+  }
+
+  // Refined mask of rows [y0, y1)
+  void refine(int y0, int y1, cv::Mat &mask) {
+    int top = std::max(0, y0 - halo);
+    int bottom = std::min(size.height, y1 + halo);
+
+    // Output pixel centers mapped onto the low resolution mask with the
+    // same half-pixel alignment as cv::resize
+    double scale_x = (double)low_res_mask.cols / size.width;
+    double scale_y = (double)low_res_mask.rows / size.height;
+    cv::Matx23d to_source(scale_x, 0, 0.5 * scale_x - 0.5, 0, scale_y,
+                          (top + 0.5) * scale_y - 0.5);
+    cv::warpAffine(low_res_mask, band, to_source,
+                   cv::Size(size.width, bottom - top),
+                   cv::INTER_LANCZOS4 | cv::WARP_INVERSE_MAP,
+                   cv::BORDER_REPLICATE);
+
+    cv::morphologyEx(band, band, cv::MORPH_OPEN, kernel);
+    cv::GaussianBlur(band, band, cv::Size(5, 5), 2, 2);
+    cv::threshold(band.rowRange(y0 - top, y1 - top), mask, 75, 255,
+                  cv::THRESH_BINARY);
+  }
+
+  // Bounding box of the refined mask, found band by band
+  cv::Rect get_bbox(int strip_rows) {
+    cv::Rect bbox;
+    cv::Mat mask;
+    for (int y = 0; y < size.height; y += strip_rows) {
+      int y1 = std::min(size.height, y + strip_rows);
+      refine(y, y1, mask);
+      cv::Rect strip_bbox = cv::boundingRect(mask);
+      if (!strip_bbox.empty()) {
+        strip_bbox.y += y;
+        bbox = bbox.empty() ? strip_bbox : bbox | strip_bbox;
+      }
+    }
+    return bbox;
+  }
+
+private:
+  cv::Mat low_res_mask;
+  cv::Size size;
+  cv::Mat kernel;
+  cv::Mat band;
+};
+
+} // namespace cutout
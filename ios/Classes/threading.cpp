@@ -0,0 +1,12 @@
+#pragma once
+
+#include "u2net.hpp"
+
+extern "C" {
+// Threads of OpenCV's parallel backend, shared by the whole process
+FUNCTION_ATTRIBUTE
+void set_threads_opencv(int threads) { cv::setNumThreads(threads); }
+
+FUNCTION_ATTRIBUTE
+int get_threads_opencv() { return cv::getNumThreads(); }
+}
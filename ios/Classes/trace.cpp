@@ -0,0 +1,47 @@
+#pragma once
+
+#include "trace.hpp"
+#include "u2net.hpp"
+
+extern "C" {
+FUNCTION_ATTRIBUTE
+void set_trace_enabled(bool enabled) { cutout::Trace::set_enabled(enabled); }
+
+FUNCTION_ATTRIBUTE
+bool is_trace_enabled() { return cutout::Trace::is_enabled(); }
+
+// Adds the thread's perf counters to the spans; false when the system
+// counts none of the events
+FUNCTION_ATTRIBUTE
+bool set_trace_perf_enabled(bool enabled) {
+  bool is_available = cutout::PerfCounters::for_thread().is_available();
+  cutout::Trace::set_perf_enabled(enabled && is_available);
+  return is_available;
+}
+
+FUNCTION_ATTRIBUTE
+bool is_trace_perf_enabled() { return cutout::Trace::is_perf_enabled(); }
+
+// Zero while tracing is disabled
+FUNCTION_ATTRIBUTE
+uint64_t next_trace_request() { return cutout::Trace::next_request(); }
+
+// Nanoseconds on the clock of the native spans, so stages timed outside,
+// like inference, line up with them
+FUNCTION_ATTRIBUTE
+int64_t get_trace_time() { return cutout::Trace::now(); }
+
+FUNCTION_ATTRIBUTE
+void add_trace_span(int stage, uint64_t request, int64_t start, int64_t end) {
+  if (cutout::Trace::is_enabled()) {
+    cutout::Trace::record((cutout::Stage)stage, request, start, end);
+  }
+}
+
+FUNCTION_ATTRIBUTE
+void clear_trace() { cutout::Trace::clear(); }
+
+// Writes the recorded spans as Chrome trace JSON
+FUNCTION_ATTRIBUTE
+bool dump_trace(const char *path) { return cutout::Trace::dump(path); }
+}
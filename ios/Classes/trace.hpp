@@ -0,0 +1,353 @@
+#pragma once
+
+#include "native_memory.hpp"
+#include "perf_counters.hpp"
+#include "stage.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace cutout {
+
+namespace detail {
+
+struct TraceSlot {
+  // Index + 1 of the span once written, with `busy` set while it is
+  // written
+  static const uint64_t busy = uint64_t(1) << 63;
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<uint64_t> request{0};
+  std::atomic<int64_t> start{0};
+  std::atomic<int64_t> duration{0};
+  std::atomic<uint32_t> thread{0};
+  std::atomic<uint8_t> stage{0};
+  // Event counts of the span, negative when not counted
+  std::atomic<int64_t> perf[PerfSample::count];
+  std::atomic<int64_t> pixels{0};
+};
+
+} // namespace detail
+
+// Process-wide ring of the most recent spans. Writers claim a slot with one
+// atomic increment and publish it with a sequence number; readers skip
+// slots that are being overwritten. A writer only waits when the ring laps
+// it while it writes, and a lapped writer drops its span rather than
+// overwrite a later one. While
+// tracing is disabled a span costs a relaxed load, besides switching the
+// thread's memory attribution.
+//
+// With perf counters enabled too, spans also carry the hardware events of
+// their thread (see PerfCounters) and the pixels of the session's image,
+// for IPC and memory traffic per pixel. Reading them costs a few system
+// calls per span.
+class Trace {
+public:
+  static const uint64_t capacity = 1 << 15;
+
+  static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+  static void set_enabled(bool is_enabled) {
+    enabled.store(is_enabled, std::memory_order_relaxed);
+  }
+
+  static bool is_perf_enabled() {
+    return perf_enabled.load(std::memory_order_relaxed);
+  }
+
+  static void set_perf_enabled(bool is_enabled) {
+    perf_enabled.store(is_enabled, std::memory_order_relaxed);
+  }
+
+  // Nanoseconds on the clock of every span
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // A new request ID, or zero while tracing is disabled
+  static uint64_t next_request() {
+    if (!is_enabled()) {
+      return 0;
+    }
+    return last_request.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // Request of the outermost span open on this thread, which the spans
+  // nested in it inherit
+  static uint64_t &current_request() {
+    thread_local uint64_t request = 0;
+    return request;
+  }
+
+  // Pixels of the image of the outermost span open on this thread, read
+  // when a span ends since the image may be decoded within it
+  static const int64_t *&current_pixels() {
+    thread_local const int64_t *pixels = nullptr;
+    return pixels;
+  }
+
+  static void record(Stage stage, uint64_t request, int64_t start,
+                     int64_t end, const PerfSample &perf = PerfSample(),
+                     int64_t pixels = 0) {
+    uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    detail::TraceSlot &slot = slots[index & (capacity - 1)];
+    if (!claim(slot, index)) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.stage.store((uint8_t)stage, std::memory_order_relaxed);
+    slot.request.store(request, std::memory_order_relaxed);
+    slot.thread.store(thread_id(), std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(end - start, std::memory_order_relaxed);
+    for (int i = 0; i < PerfSample::count; i++) {
+      slot.perf[i].store(perf.values[i], std::memory_order_relaxed);
+    }
+    slot.pixels.store(pixels, std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+  }
+
+  // Drops the spans recorded so far
+  static void clear() {
+    tail.store(head.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+  }
+
+  // The spans in the ring as Chrome trace event JSON, which Perfetto and
+  // chrome://tracing open; timestamps are in microseconds
+  static std::string to_json() {
+    std::string json = "{\"traceEvents\":[";
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = std::max(tail.load(std::memory_order_relaxed),
+                              end > capacity ? end - capacity : 0);
+    bool is_first = true;
+    char event[256];
+    for (uint64_t index = begin; index < end; index++) {
+      const detail::TraceSlot &slot = slots[index & (capacity - 1)];
+      if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+        continue;
+      }
+      auto stage = (Stage)slot.stage.load(std::memory_order_relaxed);
+      uint64_t request = slot.request.load(std::memory_order_relaxed);
+      uint32_t thread = slot.thread.load(std::memory_order_relaxed);
+      int64_t start = slot.start.load(std::memory_order_relaxed);
+      int64_t duration = slot.duration.load(std::memory_order_relaxed);
+      PerfSample perf;
+      for (int i = 0; i < PerfSample::count; i++) {
+        perf.values[i] = slot.perf[i].load(std::memory_order_relaxed);
+      }
+      int64_t pixels = slot.pixels.load(std::memory_order_relaxed);
+      // Overwritten while it was read
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != index + 1) {
+        continue;
+      }
+
+      std::snprintf(event, sizeof(event),
+                    "%s{\"name\":\"%s\",\"cat\":\"cutout\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+                    "\"args\":{\"request\":%llu",
+                    is_first ? "" : ",", stage_name(stage), start / 1e3,
+                    duration / 1e3, thread, (unsigned long long)request);
+      json += event;
+      append_perf(json, perf, pixels);
+      json += "}}";
+      is_first = false;
+    }
+    json += "],\"displayTimeUnit\":\"ms\"}";
+    return json;
+  }
+
+  static bool dump(const std::string &path) {
+    std::string json = to_json();
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    bool is_written = std::fwrite(json.data(), 1, json.size(), file) ==
+                      json.size();
+    return std::fclose(file) == 0 && is_written;
+  }
+
+private:
+  // Counted events as span arguments, with the ratios derived from them
+  static void append_perf(std::string &json, const PerfSample &perf,
+                          int64_t pixels) {
+    char arg[64];
+    for (int i = 0; i < PerfSample::count; i++) {
+      if (perf.values[i] >= 0) {
+        std::snprintf(arg, sizeof(arg), ",\"%s\":%lld",
+                      perf_event_name((PerfEvent)i),
+                      (long long)perf.values[i]);
+        json += arg;
+      }
+    }
+    if (perf.has(PerfEvent::CYCLES) && perf.has(PerfEvent::INSTRUCTIONS)) {
+      std::snprintf(arg, sizeof(arg), ",\"ipc\":%.3f", perf.ipc());
+      json += arg;
+    }
+    if (perf.has(PerfEvent::CACHE_MISSES) && pixels > 0) {
+      std::snprintf(arg, sizeof(arg),
+                    ",\"pixels\":%lld,\"bytes_per_pixel\":%.3f",
+                    (long long)pixels, perf.bytes_per_pixel(pixels));
+      json += arg;
+    }
+  }
+
+  // Marks the slot as written for the span at `index`, unless a later span
+  // already took it; waits while an earlier writer is still in it
+  static bool claim(detail::TraceSlot &slot, uint64_t index) {
+    const uint64_t busy = detail::TraceSlot::busy;
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    while (true) {
+      if ((sequence & ~busy) > index + 1) {
+        return false;
+      }
+      if (sequence & busy) {
+        std::this_thread::yield();
+        sequence = slot.sequence.load(std::memory_order_relaxed);
+      } else if (slot.sequence.compare_exchange_weak(
+                     sequence, (index + 1) | busy,
+                     std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+
+  // Small sequential IDs read better in trace viewers than native ones
+  static uint32_t thread_id() {
+    static std::atomic<uint32_t> last_thread{0};
+    thread_local uint32_t id =
+        last_thread.fetch_add(1, std::memory_order_relaxed) + 1;
+    return id;
+  }
+
+  static inline std::atomic<bool> enabled{false};
+  static inline std::atomic<bool> perf_enabled{false};
+  static inline std::atomic<uint64_t> last_request{0};
+  static inline std::atomic<uint64_t> head{0};
+  static inline std::atomic<uint64_t> tail{0};
+  static inline detail::TraceSlot slots[capacity];
+};
+
+// What the calls of a pipeline session are attributed to: the request
+// their spans carry and the counters of their allocations. `pixels` is
+// the size of the session's current image, which the perf counters of its
+// spans are normalized by.
+struct TraceSession {
+  uint64_t request{0};
+  MemoryCountersRef memory{make_memory_counters()};
+  int64_t pixels{0};
+};
+
+// Records the time from its construction to `end` or its destruction as a
+// span of `stage`, and attributes the thread's allocations to the stage
+// meanwhile. Spans given a session make its request and memory counters
+// the thread's current ones until they end, for the spans nested in them.
+class TraceSpan {
+public:
+  explicit TraceSpan(Stage stage) : stage(stage) {
+    enter();
+    if (Trace::is_enabled()) {
+      request = Trace::current_request();
+      begin();
+    }
+  }
+
+  TraceSpan(Stage stage, const TraceSession &session)
+      : stage(stage), is_outer(true) {
+    enter();
+    previous_session = MemoryAttribution::current_session();
+    MemoryAttribution::current_session() = session.memory.get();
+    if (Trace::is_enabled()) {
+      request = session.request;
+      previous_request = Trace::current_request();
+      Trace::current_request() = request;
+      previous_pixels = Trace::current_pixels();
+      Trace::current_pixels() = &session.pixels;
+      begin();
+    }
+  }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  ~TraceSpan() { end(); }
+
+  // Ends this span and starts one of `stage`, for consecutive steps
+  void next(Stage stage) {
+    if (!is_open) {
+      return;
+    }
+    MemoryAttribution::current_stage() = stage;
+    if (start >= 0) {
+      record();
+      begin();
+    }
+    this->stage = stage;
+  }
+
+  void end() {
+    if (!is_open) {
+      return;
+    }
+    is_open = false;
+    MemoryAttribution::current_stage() = previous_stage;
+    if (is_outer) {
+      MemoryAttribution::current_session() = previous_session;
+    }
+    if (start >= 0) {
+      record();
+      if (is_outer) {
+        Trace::current_request() = previous_request;
+        Trace::current_pixels() = previous_pixels;
+      }
+    }
+  }
+
+private:
+  void enter() {
+    previous_stage = MemoryAttribution::current_stage();
+    MemoryAttribution::current_stage() = stage;
+  }
+
+  // The counters are read outside the timed part
+  void begin() {
+    is_counted = Trace::is_perf_enabled();
+    if (is_counted) {
+      perf_start = PerfCounters::for_thread().read();
+    }
+    start = Trace::now();
+  }
+
+  void record() {
+    int64_t end = Trace::now();
+    if (!is_counted) {
+      Trace::record(stage, request, start, end);
+      return;
+    }
+    PerfSample perf = PerfCounters::for_thread().read().since(perf_start);
+    const int64_t *pixels = Trace::current_pixels();
+    Trace::record(stage, request, start, end, perf, pixels ? *pixels : 0);
+  }
+
+  Stage stage;
+  Stage previous_stage{Stage::OTHER};
+  bool is_outer{false};
+  bool is_open{true};
+  uint64_t request{0};
+  uint64_t previous_request{0};
+  MemoryCounters *previous_session{nullptr};
+  const int64_t *previous_pixels{nullptr};
+  // Negative when the span is not recorded
+  int64_t start{-1};
+  bool is_counted{false};
+  PerfSample perf_start;
+};
+
+} // namespace cutout
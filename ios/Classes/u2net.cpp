@@ -1,90 +1,229 @@
 #pragma once
 
-#include <array>
-#include <opencv2/opencv.hpp>
+#include "u2net.hpp"
 #include <stdbool.h>
 #include <string>
 #include <vector>
 
-#if defined(__GNUC__)
-// Attributes to prevent 'unused' function from being removed and to make it
-// visible
-#define FUNCTION_ATTRIBUTE                                                     \
-  __attribute__((visibility("default"))) __attribute__((used))
-#elif defined(_MSC_VER)
-// Marking a function for export
-#define FUNCTION_ATTRIBUTE __declspec(dllexport)
-#endif
-
-class U2NetSegmentImage {
-public:
-  U2NetSegmentImage() {};
-  ~U2NetSegmentImage() = default;
-  U2NetSegmentImage(const U2NetSegmentImage &) = delete;
-  U2NetSegmentImage &operator=(const U2NetSegmentImage &) = delete;
-  U2NetSegmentImage(U2NetSegmentImage &&) = default;
-  U2NetSegmentImage &operator=(U2NetSegmentImage &&) = delete;
-
-  std::vector<float> preprocess(const std::string &image_path);
-  bool postprocess(const std::vector<float> &mask_vector,
-                   const std::string &output_path);
-  void clear();
-
-private:
-  cv::Rect get_bbox(const cv::Mat &mask);
-
-  // 5% of the image area: 320 * 320 * 0.05 = 5120
-  const int area_threshold = 5120;
-
-  cv::Mat image;
-};
+void U2NetSegmentImage::configure(const U2NetModelDescriptor &descriptor) {
+  this->descriptor = descriptor;
+  this->area_threshold =
+      descriptor.input_width * descriptor.input_height * descriptor.area_ratio;
+}
+
+void U2NetSegmentImage::load(const std::string &image_path) {
+  if (!preloaded_path.empty() && preloaded_path == image_path) {
+    preloaded_path.clear();
+    return;
+  }
+  // The previous image goes first, so the decode is planned against the
+  // memory actually left
+  clear();
+  cutout::TraceSpan span(cutout::Stage::DECODE);
+  this->context = ImageContextRef(new ImageContext(image_path));
+  this->image = context->get_image();
+  trace.pixels = image.total();
+}
+
+// Uses an image decoded once for several pipelines; the next load of its
+// path does not decode it again
+void U2NetSegmentImage::set_context(ImageContext *context) {
+  this->context = retain_context(context);
+  this->image = this->context->get_image();
+  this->preloaded_path = this->context->get_path();
+  trace.pixels = image.total();
+}
+
+// Uses the image another instance loaded, e.g. the full model of a cascade
+// after the fast one, each keeping its own configuration. An image the
+// source has preloaded for its next load is preloaded here as well.
+void U2NetSegmentImage::share_image(const U2NetSegmentImage &source) {
+  this->context =
+      source.context ? retain_context(source.context.get()) : nullptr;
+  this->image = source.image;
+  this->preloaded_path = source.preloaded_path;
+  trace.pixels = image.total();
+}
+
+// Uses an already decoded frame, e.g. from a camera stream
+void U2NetSegmentImage::set_image(const cv::Mat &image) {
+  this->context.reset();
+  this->image = image;
+  trace.pixels = image.total();
+}
+
+// The image the model input is resized from: the smallest pyramid level
+// covering the input size when a context is loaded, which makes the final
+// resize cheap on multi-megapixel photos
+cv::Mat U2NetSegmentImage::model_source() {
+  if (!context) {
+    return image;
+  }
+  cutout::TraceSpan span(cutout::Stage::RESIZE);
+  return context->get_level(
+      cv::Size(descriptor.input_width, descriptor.input_height));
+}
+
+void U2NetSegmentImage::configure_gate(bool enabled, float threshold,
+                                       bool use_background_model,
+                                       float foreground_ratio) {
+  gate.configure(enabled, threshold, use_background_model, foreground_ratio);
+}
+
+// Whether the image differs from the last one that was segmented; callers
+// reuse the previous result when it does not
+bool U2NetSegmentImage::is_changed(const std::string &image_path) {
+  return gate.is_changed(image_path);
+}
+
+void U2NetSegmentImage::configure_duplicates(bool enabled,
+                                             int max_hash_distance,
+                                             int min_inliers, int capacity) {
+  duplicates.configure(enabled, max_hash_distance, min_inliers, capacity);
+}
+
+// Writes the cutout from the mask of a near-duplicate image seen before,
+// warped onto this one. On a miss, the decoded image is kept for the model
+// run that follows and its mask is added to the index once saved.
+bool U2NetSegmentImage::reuse_duplicate(const std::string &image_path,
+                                        const std::string &output_path) {
+  if (!duplicates.is_enabled()) {
+    return false;
+  }
+
+  load(image_path);
+  preloaded_path = image_path;
+
+  cutout::DuplicateMatch match;
+  if (!duplicates.find(image, match)) {
+    return false;
+  }
+
+  // Stored masks are downscaled, so their pixels are mapped onto the
+  // cached image first
+  cv::Matx33d to_cached(
+      (double)match.size.width / match.payload.cols, 0, 0, 0,
+      (double)match.size.height / match.payload.rows, 0, 0, 0, 1);
+  cv::Mat transform = match.homography * cv::Mat(to_cached);
+
+  cv::Mat warped_mask = pool->mat();
+  cv::warpPerspective(match.payload, warped_mask, transform, image.size(),
+                      cv::INTER_LINEAR, cv::BORDER_CONSTANT, 0);
+  preloaded_path.clear();
+  return refine_and_save(warped_mask, output_path);
+}
+
+void U2NetSegmentImage::set_output_quantization(
+    const cutout::QuantizationParams &params) {
+  this->descriptor.output_quantization = params;
+}
 
 std::vector<float>
 U2NetSegmentImage::preprocess(const std::string &image_path) {
-  // mean, std, and image size are constant values
-  std::array<float, 3> mean = {0.485f, 0.456f, 0.406f};
-  std::array<float, 3> std = {0.229f, 0.224f, 0.225f};
-  std::array<int, 2> size = {320, 320};
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  load(image_path);
 
-  cv::Mat image = cv::imread(image_path);
-  this->image = image.clone();
+  return preprocess(model_source());
+}
 
-  cv::Mat resized, float_img;
-  cv::resize(image, resized, cv::Size(size[0], size[1]), 0, 0,
-             cv::INTER_LANCZOS4);
+// Builds the input tensor from the already loaded image, so a second model
+// with different input geometry does not decode the file again
+std::vector<float> U2NetSegmentImage::preprocess() {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  return preprocess(model_source());
+}
 
-  double max_val;
-  cv::minMaxLoc(resized, nullptr, &max_val);
-  resized.convertTo(float_img, CV_32F, 1.0 / max_val);
+std::vector<float> U2NetSegmentImage::preprocess(const cv::Mat &image) {
+  std::vector<float> input(3 * descriptor.input_width * descriptor.input_height);
+  preprocess_into(image, input.data());
 
-  std::vector<cv::Mat> channels(3);
-  cv::split(float_img, channels);
+  return input;
+}
 
-  for (int i = 0; i < 3; ++i) {
-    channels[i] = (channels[i] - mean[i]) / std[i];
+cv::Mat U2NetSegmentImage::to_probability(const std::vector<float> &mask_vector) {
+  cv::Mat mask_mat(descriptor.input_height, descriptor.input_width, CV_32F,
+                   const_cast<float *>(mask_vector.data()));
+  if (descriptor.activation == MaskActivation::SIGMOID) {
+    // 1 / (1 + exp(-x)), computed in a pooled Mat; assigning the result
+    // to mask_mat would write it into the caller's buffer
+    cv::Mat probability = pool->mat();
+    cv::exp(-mask_mat, probability);
+    probability += 1.0;
+    cv::divide(1.0, probability, probability);
+    return probability;
   }
 
-  cv::Mat normalized;
-  cv::merge(channels, normalized);
-
-  // 채널 순서 변경 (H, W, C) -> (C, H, W)
-  cv::Mat transposed;
-  std::vector<cv::Mat> transposed_channels;
-  cv::split(normalized, transposed_channels);
-  cv::vconcat(transposed_channels, transposed);
+  return mask_mat;
+}
 
-  // 배치 차원 추가 (C, H, W) -> (1, C, H, W)
-  cv::Mat reshaped = transposed.reshape(1, {1, 3, size[0], size[1]});
+// Mean distance of the min-max normalized mask from 0.5, scaled to [0, 1].
+// Clean backgrounds give near-binary masks and score close to 1, uncertain
+// outputs with large grey regions score low.
+float U2NetSegmentImage::score_mask(const std::vector<float> &mask_vector) {
+  cv::Mat normalized_mask = pool->mat();
+  cv::normalize(to_probability(mask_vector), normalized_mask, 0, 1,
+                cv::NORM_MINMAX, CV_32F);
 
-  return std::vector<float>(reshaped.begin<float>(), reshaped.end<float>());
+  cv::Mat certainty = cv::abs(normalized_mask * 2 - 1);
+  return cv::mean(certainty)[0];
 }
 
 bool U2NetSegmentImage::postprocess(const std::vector<float> &mask_vector,
                                     const std::string &output_path) {
-  cv::Mat mask_mat(320, 320, CV_32F, const_cast<float *>(mask_vector.data()));
-  cv::Mat normalized_mask;
-  cv::normalize(mask_mat, normalized_mask, 0, 255, cv::NORM_MINMAX, CV_8U);
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+  return save_mask(normalize_mask(mask_vector), output_path);
+}
+
+// Mask probabilities min-max normalized to 8 bits
+cv::Mat U2NetSegmentImage::normalize_mask(const std::vector<float> &mask_vector) {
+  cutout::TraceSpan span(cutout::Stage::NORMALIZE);
+  cv::Mat normalized_mask = pool->mat();
+  cv::normalize(to_probability(mask_vector), normalized_mask, 0, 255,
+                cv::NORM_MINMAX, CV_8U);
+  return normalized_mask;
+}
+
+// Same as postprocess for uint8/int8 mask outputs, without going through
+// float: the activation and min-max normalization of every code are folded
+// into one 256-entry lookup table
+bool U2NetSegmentImage::postprocess_quantized(const uint8_t *mask,
+                                              const std::string &output_path) {
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+  return save_mask(normalize_quantized(mask), output_path);
+}
+
+cv::Mat U2NetSegmentImage::normalize_quantized(const uint8_t *mask) {
+  cutout::TraceSpan span(cutout::Stage::NORMALIZE);
+  const auto &params = descriptor.output_quantization;
+  cv::Mat codes = cutout::to_codes(mask, descriptor.input_height,
+                                   descriptor.input_width, params);
+
+  double min_code, max_code;
+  cv::minMaxLoc(codes, &min_code, &max_code);
+
+  auto probability = [&](int code) {
+    float value = params.dequantize(code);
+    if (descriptor.activation == MaskActivation::SIGMOID) {
+      value = 1.0f / (1.0f + std::exp(-value));
+    }
+    return value;
+  };
+  float low = probability(min_code);
+  float range = probability(max_code) - low;
+
+  cv::Mat lut(1, 256, CV_8U);
+  for (int code = 0; code < 256; code++) {
+    float scaled = range > 0 ? (probability(code) - low) * 255 / range : 0;
+    lut.at<uchar>(code) = cv::saturate_cast<uchar>(scaled);
+  }
+
+  cv::Mat normalized_mask = pool->mat();
+  cv::LUT(codes, lut, normalized_mask);
+  return normalized_mask;
+}
 
+bool U2NetSegmentImage::save_mask(const cv::Mat &normalized_mask,
+                                  const std::string &output_path) {
   // count non-zero elements
   int non_zero_count = cv::countNonZero(normalized_mask);
   if (non_zero_count < area_threshold) {
@@ -92,58 +231,271 @@ bool U2NetSegmentImage::postprocess(const std::vector<float> &mask_vector,
   }
 
   // Resize mask
-  cv::Mat resized_mask;
+  cutout::TraceSpan span(cutout::Stage::UPSAMPLE);
+  cv::Mat resized_mask = pool->mat();
   cv::resize(normalized_mask, resized_mask, image.size(), 0, 0,
              cv::INTER_LANCZOS4);
+  span.end();
 
+  return refine_and_save(resized_mask, output_path);
+}
+
+// Finds the subject in the first-pass mask and builds the model input for
+// that region, widened by `margin` of the box size on every side. Returns
+// false when the subject already fills most of the frame.
+bool U2NetSegmentImage::prepare_roi(const std::vector<float> &mask_vector,
+                                    float margin,
+                                    std::vector<float> &roi_input) {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  cv::Mat normalized_mask = pool->mat();
+  cv::normalize(to_probability(mask_vector), normalized_mask, 0, 255,
+                cv::NORM_MINMAX, CV_8U);
+  cv::threshold(normalized_mask, normalized_mask, 75, 255, cv::THRESH_BINARY);
+
+  cv::Rect low_res_bbox = get_bbox(normalized_mask);
+  if (low_res_bbox.empty()) {
+    return false;
+  }
+
+  float scale_x = (float)image.cols / descriptor.input_width;
+  float scale_y = (float)image.rows / descriptor.input_height;
+  int margin_x = low_res_bbox.width * scale_x * margin;
+  int margin_y = low_res_bbox.height * scale_y * margin;
+
+  cv::Rect bbox(low_res_bbox.x * scale_x - margin_x,
+                low_res_bbox.y * scale_y - margin_y,
+                low_res_bbox.width * scale_x + margin_x * 2,
+                low_res_bbox.height * scale_y + margin_y * 2);
+  bbox &= cv::Rect(0, 0, image.cols, image.rows);
+
+  if (bbox.area() > image.total() * max_roi_ratio) {
+    return false;
+  }
+
+  this->roi = bbox;
+  this->roi_margin = cv::Size(margin_x, margin_y);
+  roi_input = preprocess(image(bbox));
+  return true;
+}
+
+// Upsamples the first-pass mask to the full image and blends the
+// second-pass mask, which was inferred at full model resolution, into the
+// ROI
+bool U2NetSegmentImage::postprocess_roi(
+    const std::vector<float> &mask_vector,
+    const std::vector<float> &roi_mask_vector,
+    const std::string &output_path) {
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
+  cv::Mat normalized_mask = pool->mat();
+  cv::normalize(to_probability(mask_vector), normalized_mask, 0, 255,
+                cv::NORM_MINMAX, CV_8U);
+
+  if (cv::countNonZero(normalized_mask) < area_threshold) {
+    return false;
+  }
+
+  cutout::TraceSpan upsample_span(cutout::Stage::UPSAMPLE);
+  cv::Mat resized_mask = pool->mat();
+  cv::resize(normalized_mask, resized_mask, image.size(), 0, 0,
+             cv::INTER_LANCZOS4);
+
+  cv::Mat normalized_roi_mask = pool->mat();
+  cv::normalize(to_probability(roi_mask_vector), normalized_roi_mask, 0, 255,
+                cv::NORM_MINMAX, CV_8U);
+
+  cv::Mat roi_mask = pool->mat();
+  cv::resize(normalized_roi_mask, roi_mask, roi.size(), 0, 0,
+             cv::INTER_LANCZOS4);
+  cv::Mat coarse_roi_mask = resized_mask(roi);
+  blend_roi(roi_mask, coarse_roi_mask);
+  upsample_span.end();
+
+  return refine_and_save(resized_mask, output_path);
+}
+
+// Writes the second-pass mask over the ROI of the first-pass one, fading it
+// in linearly across `roi_margin` on the sides inside the image, so the
+// passes meet without a seam. Sides on the image border are not faded, and
+// past the margin only the second pass counts.
+void U2NetSegmentImage::blend_roi(const cv::Mat &roi_mask, cv::Mat &mask) {
+  // Weight of the second pass out of 256 along one axis
+  auto ramp = [](int length, int margin, bool fade_start, bool fade_end) {
+    std::vector<int> weights(length, 256);
+    for (int i = 0; i < std::min(margin, length); i++) {
+      int weight = (i + 1) * 256 / (margin + 1);
+      if (fade_start) {
+        weights[i] = std::min(weights[i], weight);
+      }
+      if (fade_end) {
+        weights[length - 1 - i] = std::min(weights[length - 1 - i], weight);
+      }
+    }
+    return weights;
+  };
+  std::vector<int> weights_x = ramp(roi.width, roi_margin.width, roi.x > 0,
+                                    roi.br().x < image.cols);
+  std::vector<int> weights_y = ramp(roi.height, roi_margin.height, roi.y > 0,
+                                    roi.br().y < image.rows);
+
+  for (int y = 0; y < roi.height; y++) {
+    const uchar *fine = roi_mask.ptr<uchar>(y);
+    uchar *coarse = mask.ptr<uchar>(y);
+    for (int x = 0; x < roi.width; x++) {
+      int weight = std::min(weights_x[x], weights_y[y]);
+      coarse[x] = (fine[x] * weight + coarse[x] * (256 - weight) + 128) >> 8;
+    }
+  }
+}
+
+bool U2NetSegmentImage::refine_and_save(const cv::Mat &resized_mask,
+                                        const std::string &output_path) {
   // Make smooth mask
+  cutout::TraceSpan span(cutout::Stage::MORPHOLOGY);
   cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-  cv::Mat processed_mask;
+  cv::Mat processed_mask = pool->mat();
   cv::morphologyEx(resized_mask, processed_mask, cv::MORPH_OPEN, kernel);
   cv::GaussianBlur(processed_mask, processed_mask, cv::Size(5, 5), 2, 2);
   cv::threshold(processed_mask, processed_mask, 75, 255, cv::THRESH_BINARY);
 
-  // Cutout
-  cv::Mat cutout;
-  cv::bitwise_and(image, image, cutout, processed_mask);
-
-  cv::Mat result;
-  cv::cvtColor(cutout, result, cv::COLOR_BGR2BGRA);
-  result.setTo(cv::Scalar(0, 0, 0, 0), processed_mask == 0);
-
-  // Crop
+  // Cutout, cropped to the subject
+  span.next(cutout::Stage::COMPOSITE);
   cv::Rect bbox = get_bbox(processed_mask);
-  cv::Mat cropped = result(bbox);
+  cv::Mat cropped =
+      cutout::composite(image, processed_mask, bbox, pool->mat());
 
+  span.next(cutout::Stage::ENCODE);
   cv::imwrite(output_path, cropped);
+  span.end();
+
+  if (duplicates.is_enabled()) {
+    float scale = std::min(1.0f, (float)duplicate_mask_size /
+                                     std::max(image.cols, image.rows));
+    cv::Mat stored_mask;
+    cv::resize(resized_mask, stored_mask, cv::Size(), scale, scale,
+               cv::INTER_AREA);
+    duplicates.add(stored_mask);
+  }
 
   return true;
 }
 
-cv::Rect U2NetSegmentImage::get_bbox(const cv::Mat &mask) {
-  std::vector<cv::Point> points;
-  cv::findNonZero(mask, points);
+// Streams the file once for a downscaled preview to build the model input
+// from, instead of decoding it whole. postprocess_strips reads it again.
+bool U2NetSegmentImage::load_strips(const std::string &image_path,
+                                    int strip_rows) {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  cutout::StripSource source;
+  if (strip_rows <= 0 || !source.open(image_path)) {
+    return false;
+  }
 
-  if (points.empty()) {
-    return cv::Rect();
+  clear();
+  cutout::TraceSpan decode_span(cutout::Stage::DECODE);
+  int min_side = 2 * std::max(descriptor.input_width, descriptor.input_height);
+  cv::Mat preview = cutout::read_preview(source, strip_rows, min_side);
+  if (preview.empty()) {
+    return false;
   }
 
-  int x_min = std::numeric_limits<int>::max();
-  int y_min = std::numeric_limits<int>::max();
-  int x_max = std::numeric_limits<int>::min();
-  int y_max = std::numeric_limits<int>::min();
+  this->image = preview;
+  this->strip_path = image_path;
+  this->strip_size = source.get_size();
+  this->strip_rows = strip_rows;
+  trace.pixels = strip_size.area();
+  return true;
+}
 
-  for (const auto &point : points) {
-    x_min = std::min(x_min, point.x);
-    y_min = std::min(y_min, point.y);
-    x_max = std::max(x_max, point.x);
-    y_max = std::max(y_max, point.y);
+// Full resolution cutout of an image loaded by load_strips, with memory
+// proportional to the strip height: the mask is upsampled and refined a
+// band at a time, and composited rows go straight into a PNG encoder. A
+// first pass over the mask alone finds the subject box to crop to.
+bool U2NetSegmentImage::postprocess_strips(
+    const std::vector<float> &mask_vector, const std::string &output_path) {
+  if (strip_path.empty()) {
+    return false;
   }
+  cutout::TraceSpan span(cutout::Stage::POSTPROCESS, trace);
 
-  return cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1);
+  cv::Mat normalized_mask = normalize_mask(mask_vector);
+  if (cv::countNonZero(normalized_mask) < area_threshold) {
+    return false;
+  }
+
+  cutout::TraceSpan bbox_span(cutout::Stage::MORPHOLOGY);
+  cutout::MaskStrips mask_strips(normalized_mask, strip_size);
+  cv::Rect bbox = mask_strips.get_bbox(strip_rows);
+  bbox_span.end();
+  if (bbox.empty()) {
+    return false;
+  }
+
+  cutout::StripSource source;
+  cutout::PngStripWriter writer;
+  if (!source.open(strip_path) ||
+      !writer.open(output_path, bbox.width, bbox.height)) {
+    return false;
+  }
+
+  cv::Mat strip = pool->mat();
+  cv::Mat mask = pool->mat();
+  cv::Mat cropped = pool->mat();
+  int end = bbox.y + bbox.height;
+  while (source.get_next_row() < end) {
+    int y = source.get_next_row();
+    // Rows above the subject are decoded and dropped
+    int rows = y < bbox.y ? bbox.y - y : end - y;
+    cutout::TraceSpan strip_span(cutout::Stage::DECODE);
+    if (!source.read(std::min(rows, strip_rows), strip)) {
+      return false;
+    }
+    if (y < bbox.y) {
+      continue;
+    }
+
+    strip_span.next(cutout::Stage::MORPHOLOGY);
+    mask_strips.refine(y, y + strip.rows, mask);
+    strip_span.next(cutout::Stage::COMPOSITE);
+    cropped = cutout::composite(
+        strip, mask, cv::Rect(bbox.x, 0, bbox.width, strip.rows), cropped);
+    strip_span.next(cutout::Stage::ENCODE);
+    for (int row = 0; row < cropped.rows; row++) {
+      if (!writer.write_row(cropped.ptr<uint8_t>(row))) {
+        return false;
+      }
+    }
+  }
+  cutout::TraceSpan finish_span(cutout::Stage::ENCODE);
+  return writer.finish();
+}
+
+// Bounding box of the non-zero pixels, found in place rather than by
+// collecting every foreground point
+cv::Rect U2NetSegmentImage::get_bbox(const cv::Mat &mask) {
+  return cv::boundingRect(mask);
+}
+
+cutout::MatPoolStats U2NetSegmentImage::get_pool_stats() const {
+  return pool->get_stats();
+}
+
+void U2NetSegmentImage::trim_pool() { pool->trim(); }
+
+void U2NetSegmentImage::set_trace_request(uint64_t request) {
+  trace.request = request;
 }
 
-void U2NetSegmentImage::clear() { image.release(); }
+cutout::MemorySnapshot U2NetSegmentImage::get_memory_stats() const {
+  return trace.memory->snapshot();
+}
+
+void U2NetSegmentImage::reset_memory_stats() { trace.memory->reset(); }
+
+void U2NetSegmentImage::clear() {
+  image.release();
+  context.reset();
+  preloaded_path.clear();
+  strip_path.clear();
+}
 
 // Avoiding name mangling
 extern "C" {
@@ -153,11 +505,105 @@ U2NetSegmentImage *create_u2net() { return new U2NetSegmentImage(); }
 FUNCTION_ATTRIBUTE
 void destroy_u2net(U2NetSegmentImage *u2net) { delete u2net; }
 
+FUNCTION_ATTRIBUTE
+void configure_u2net(U2NetSegmentImage *u2net, int input_width,
+                     int input_height, const float *mean, const float *std,
+                     bool scale_by_max, int layout, int activation,
+                     float area_ratio) {
+  U2NetModelDescriptor descriptor;
+  descriptor.input_width = input_width;
+  descriptor.input_height = input_height;
+  std::copy(mean, mean + 3, descriptor.mean.begin());
+  std::copy(std, std + 3, descriptor.std.begin());
+  descriptor.scale_by_max = scale_by_max;
+  descriptor.layout = static_cast<TensorLayout>(layout);
+  descriptor.activation = static_cast<MaskActivation>(activation);
+  descriptor.area_ratio = area_ratio;
+  u2net->configure(descriptor);
+}
+
 FUNCTION_ATTRIBUTE
 void preprocess_u2net(U2NetSegmentImage *u2net, const char *input_path,
                       float *output_data) {
-  auto preprocessed = u2net->preprocess(input_path);
-  std::copy(preprocessed.begin(), preprocessed.end(), output_data);
+  u2net->preprocess_into(input_path, output_data);
+}
+
+FUNCTION_ATTRIBUTE
+void preprocess_loaded_u2net(U2NetSegmentImage *u2net, float *output_data) {
+  u2net->preprocess_into(output_data);
+}
+
+// Half precision input for fp16-exported models, as raw IEEE 754 binary16
+FUNCTION_ATTRIBUTE
+void preprocess_fp16_u2net(U2NetSegmentImage *u2net, const char *input_path,
+                           uint16_t *output_data) {
+  u2net->preprocess_into(input_path,
+                         reinterpret_cast<cv::hfloat *>(output_data));
+}
+
+// Raw pixels for quantized models that fold normalization into the graph
+FUNCTION_ATTRIBUTE
+void preprocess_uint8_u2net(U2NetSegmentImage *u2net, const char *input_path,
+                            uint8_t *output_data) {
+  u2net->preprocess_into(input_path, output_data);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_quantization_u2net(U2NetSegmentImage *u2net, float scale,
+                                  int zero_point, bool is_signed) {
+  u2net->set_output_quantization({scale, zero_point, is_signed});
+}
+
+FUNCTION_ATTRIBUTE
+bool postprocess_quantized_u2net(U2NetSegmentImage *u2net,
+                                 const uint8_t *mask_buffer,
+                                 const char *output_path) {
+  return u2net->postprocess_quantized(mask_buffer, output_path);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_gate_u2net(U2NetSegmentImage *u2net, bool enabled,
+                          float threshold, bool use_background_model,
+                          float foreground_ratio) {
+  u2net->configure_gate(enabled, threshold, use_background_model,
+                        foreground_ratio);
+}
+
+FUNCTION_ATTRIBUTE
+void set_context_u2net(U2NetSegmentImage *u2net, ImageContext *context) {
+  u2net->set_context(context);
+}
+
+FUNCTION_ATTRIBUTE
+void share_image_u2net(U2NetSegmentImage *u2net,
+                       const U2NetSegmentImage *source) {
+  u2net->share_image(*source);
+}
+
+FUNCTION_ATTRIBUTE
+bool is_changed_u2net(U2NetSegmentImage *u2net, const char *image_path) {
+  return u2net->is_changed(image_path);
+}
+
+FUNCTION_ATTRIBUTE
+void configure_duplicates_u2net(U2NetSegmentImage *u2net, bool enabled,
+                                int max_hash_distance, int min_inliers,
+                                int capacity) {
+  u2net->configure_duplicates(enabled, max_hash_distance, min_inliers,
+                              capacity);
+}
+
+FUNCTION_ATTRIBUTE
+bool reuse_duplicate_u2net(U2NetSegmentImage *u2net, const char *image_path,
+                           const char *output_path) {
+  return u2net->reuse_duplicate(image_path, output_path);
+}
+
+FUNCTION_ATTRIBUTE
+float score_mask_u2net(U2NetSegmentImage *u2net, float *mask_buffer,
+                       int mask_size) {
+  std::vector<float> mask_vector(mask_buffer, mask_buffer + mask_size);
+  return u2net->score_mask(mask_vector);
 }
 
 FUNCTION_ATTRIBUTE
@@ -167,6 +613,79 @@ bool postprocess_u2net(U2NetSegmentImage *u2net, float *mask_buffer,
   return u2net->postprocess(mask_vector, output_path);
 }
 
+FUNCTION_ATTRIBUTE
+bool prepare_roi_u2net(U2NetSegmentImage *u2net, float *mask_buffer,
+                       int mask_size, float margin, float *output_data) {
+  std::vector<float> mask_vector(mask_buffer, mask_buffer + mask_size);
+  std::vector<float> roi_input;
+  if (!u2net->prepare_roi(mask_vector, margin, roi_input)) {
+    return false;
+  }
+
+  std::copy(roi_input.begin(), roi_input.end(), output_data);
+  return true;
+}
+
+FUNCTION_ATTRIBUTE
+bool postprocess_roi_u2net(U2NetSegmentImage *u2net, float *mask_buffer,
+                           float *roi_mask_buffer, int mask_size,
+                           const char *output_path) {
+  std::vector<float> mask_vector(mask_buffer, mask_buffer + mask_size);
+  std::vector<float> roi_mask_vector(roi_mask_buffer,
+                                     roi_mask_buffer + mask_size);
+  return u2net->postprocess_roi(mask_vector, roi_mask_vector, output_path);
+}
+
+// Loads a preview for preprocess_loaded_u2net; the cutout is then written
+// by postprocess_strips_u2net as a PNG
+FUNCTION_ATTRIBUTE
+bool load_strips_u2net(U2NetSegmentImage *u2net, const char *image_path,
+                       int strip_rows) {
+  return u2net->load_strips(image_path, strip_rows);
+}
+
+FUNCTION_ATTRIBUTE
+bool postprocess_strips_u2net(U2NetSegmentImage *u2net, float *mask_buffer,
+                              int mask_size, const char *output_path) {
+  std::vector<float> mask_vector(mask_buffer, mask_buffer + mask_size);
+  return u2net->postprocess_strips(mask_vector, output_path);
+}
+
 FUNCTION_ATTRIBUTE
 void clear_u2net(U2NetSegmentImage *u2net) { u2net->clear(); }
+
+// In use, cached and high-water bytes, then cache hits and misses
+FUNCTION_ATTRIBUTE
+void get_pool_stats_u2net(U2NetSegmentImage *u2net, int64_t *stats) {
+  auto pool_stats = u2net->get_pool_stats();
+  stats[0] = pool_stats.in_use;
+  stats[1] = pool_stats.cached;
+  stats[2] = pool_stats.high_water;
+  stats[3] = pool_stats.hits;
+  stats[4] = pool_stats.misses;
+}
+
+FUNCTION_ATTRIBUTE
+void trim_pool_u2net(U2NetSegmentImage *u2net) { u2net->trim_pool(); }
+
+// Request ID from next_trace_request that the following spans carry
+FUNCTION_ATTRIBUTE
+void set_trace_request_u2net(U2NetSegmentImage *u2net, uint64_t request) {
+  u2net->set_trace_request(request);
+}
+
+// Bytes allocated by the session's calls since the last reset, bytes of
+// those still held and the most held at once
+FUNCTION_ATTRIBUTE
+void get_memory_stats_u2net(U2NetSegmentImage *u2net, int64_t *stats) {
+  auto snapshot = u2net->get_memory_stats();
+  stats[0] = snapshot.allocated;
+  stats[1] = snapshot.live;
+  stats[2] = snapshot.peak;
+}
+
+FUNCTION_ATTRIBUTE
+void reset_memory_stats_u2net(U2NetSegmentImage *u2net) {
+  u2net->reset_memory_stats();
+}
 }
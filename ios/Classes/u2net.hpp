@@ -0,0 +1,191 @@
+#pragma once
+
+#include "change_gate.hpp"
+#include "composite.hpp"
+#include "duplicate_index.hpp"
+#include "image_context.hpp"
+#include "mat_pool.hpp"
+#include "preprocess.hpp"
+#include "quantize.hpp"
+#include "strip.hpp"
+#include "trace.hpp"
+#include <array>
+#include <opencv2/opencv.hpp>
+#include <stdbool.h>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__)
+// Attributes to prevent 'unused' function from being removed and to make it
+// visible
+#define FUNCTION_ATTRIBUTE                                                     \
+  __attribute__((visibility("default"))) __attribute__((used))
+#elif defined(_MSC_VER)
+// Marking a function for export
+#define FUNCTION_ATTRIBUTE __declspec(dllexport)
+#endif
+
+using TensorLayout = cutout::Layout;
+enum class MaskActivation { NONE = 0, SIGMOID = 1 };
+
+// Input geometry, normalization and output handling of a salient-object
+// model. The defaults describe the original U2Net export.
+struct U2NetModelDescriptor {
+  int input_width{320};
+  int input_height{320};
+  std::array<float, 3> mean{0.485f, 0.456f, 0.406f};
+  std::array<float, 3> std{0.229f, 0.224f, 0.225f};
+  // Scale pixels by the image maximum (U2Net reference code) or by 255
+  bool scale_by_max{true};
+  TensorLayout layout{TensorLayout::NCHW};
+  MaskActivation activation{MaskActivation::NONE};
+  // Masks covering less than this share of the input are rejected
+  float area_ratio{0.05f};
+  // Output quantization of 8-bit mask exports
+  cutout::QuantizationParams output_quantization;
+};
+
+class U2NetSegmentImage {
+public:
+  U2NetSegmentImage() {};
+  ~U2NetSegmentImage() = default;
+  U2NetSegmentImage(const U2NetSegmentImage &) = delete;
+  U2NetSegmentImage &operator=(const U2NetSegmentImage &) = delete;
+  U2NetSegmentImage(U2NetSegmentImage &&) = default;
+  U2NetSegmentImage &operator=(U2NetSegmentImage &&) = delete;
+
+  void configure(const U2NetModelDescriptor &descriptor);
+  void set_output_quantization(const cutout::QuantizationParams &params);
+  void load(const std::string &image_path);
+  void set_context(ImageContext *context);
+  void share_image(const U2NetSegmentImage &source);
+  void set_image(const cv::Mat &image);
+  void configure_gate(bool enabled, float threshold, bool use_background_model,
+                      float foreground_ratio);
+  bool is_changed(const std::string &image_path);
+  void configure_duplicates(bool enabled, int max_hash_distance,
+                            int min_inliers, int capacity);
+  bool reuse_duplicate(const std::string &image_path,
+                       const std::string &output_path);
+  std::vector<float> preprocess(const std::string &image_path);
+  std::vector<float> preprocess();
+  template <typename T> void preprocess_into(T *output);
+  template <typename T>
+  void preprocess_into(const std::string &image_path, T *output);
+  float score_mask(const std::vector<float> &mask_vector);
+  bool postprocess(const std::vector<float> &mask_vector,
+                   const std::string &output_path);
+  bool postprocess_quantized(const uint8_t *mask,
+                             const std::string &output_path);
+  cv::Mat normalize_mask(const std::vector<float> &mask_vector);
+  cv::Mat normalize_quantized(const uint8_t *mask);
+  bool prepare_roi(const std::vector<float> &mask_vector, float margin,
+                   std::vector<float> &roi_input);
+  bool postprocess_roi(const std::vector<float> &mask_vector,
+                       const std::vector<float> &roi_mask_vector,
+                       const std::string &output_path);
+  bool load_strips(const std::string &image_path, int strip_rows);
+  bool postprocess_strips(const std::vector<float> &mask_vector,
+                          const std::string &output_path);
+  cutout::MatPoolStats get_pool_stats() const;
+  void trim_pool();
+  void set_trace_request(uint64_t request);
+  cutout::MemorySnapshot get_memory_stats() const;
+  void reset_memory_stats();
+  void clear();
+
+private:
+  cv::Mat model_source();
+  std::vector<float> preprocess(const cv::Mat &source);
+  template <typename T> void preprocess_into(const cv::Mat &source, T *output);
+  cv::Mat to_probability(const std::vector<float> &mask_vector);
+  bool save_mask(const cv::Mat &normalized_mask,
+                 const std::string &output_path);
+  bool refine_and_save(const cv::Mat &resized_mask,
+                       const std::string &output_path);
+  void blend_roi(const cv::Mat &roi_mask, cv::Mat &mask);
+  cv::Rect get_bbox(const cv::Mat &mask);
+
+  // Buffers of the full-resolution intermediates, reused across images.
+  // Declared first so Mats below return their buffers before it goes.
+  cutout::MatPoolRef pool{cutout::make_mat_pool()};
+
+  U2NetModelDescriptor descriptor;
+  // 5% of the image area: 320 * 320 * 0.05 = 5120
+  int area_threshold = 5120;
+
+  // ROIs covering more of the image than this gain too little detail
+  const float max_roi_ratio = 0.6f;
+
+  // Longest side of the masks kept for near-duplicate reuse
+  const int duplicate_mask_size{1024};
+
+  ImageContextRef context;
+  // Full resolution pixels of the context, or a frame set directly
+  cv::Mat image;
+  // Already decoded, by set_context or reuse_duplicate, so the following
+  // load of this path can skip it
+  std::string preloaded_path;
+  cv::Rect roi;
+  // Margin prepare_roi added around the subject, across which the two
+  // passes are blended
+  cv::Size roi_margin;
+  // File and full size of an image loaded by load_strips, whose `image` is
+  // only a preview
+  std::string strip_path;
+  cv::Size strip_size;
+  int strip_rows{0};
+  cutout::ChangeGate gate;
+  cutout::DuplicateIndex duplicates;
+  // Request of the following calls and the counters of their allocations
+  cutout::TraceSession trace;
+};
+
+// Writes the input tensor of the loaded image straight into a caller buffer
+// of the model's element type
+template <typename T> void U2NetSegmentImage::preprocess_into(T *output) {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  preprocess_into(model_source(), output);
+}
+
+template <typename T>
+void U2NetSegmentImage::preprocess_into(const std::string &image_path,
+                                        T *output) {
+  cutout::TraceSpan span(cutout::Stage::PREPROCESS, trace);
+  load(image_path);
+  preprocess_into(model_source(), output);
+}
+
+template <typename T>
+void U2NetSegmentImage::preprocess_into(const cv::Mat &image, T *output) {
+  using cutout::ChannelOrder;
+  using cutout::Layout;
+  using cutout::Preprocessor;
+
+  cutout::TraceSpan span(cutout::Stage::RESIZE);
+  cv::Size size(descriptor.input_width, descriptor.input_height);
+  cv::Mat resized = pool->mat();
+  cv::resize(image, resized, size, 0, 0, cv::INTER_LANCZOS4);
+
+  span.next(cutout::Stage::NORMALIZE);
+
+  double max_val = 255.0;
+  if (descriptor.scale_by_max) {
+    cv::minMaxLoc(resized, nullptr, &max_val);
+  }
+  auto normalization = cutout::Normalization::from_mean_std(
+      1.0 / max_val, descriptor.mean, descriptor.std);
+
+  if (descriptor.layout == TensorLayout::NHWC) {
+    Preprocessor<Layout::NHWC, T> preprocessor(normalization);
+    preprocessor(resized, output, size);
+  } else if (size == cv::Size(320, 320)) {
+    // The original U2Net geometry gets loops with constant bounds
+    Preprocessor<Layout::NCHW, T, ChannelOrder::BGR, 320, 320> preprocessor(
+        normalization);
+    preprocessor(resized, output);
+  } else {
+    Preprocessor<Layout::NCHW, T> preprocessor(normalization);
+    preprocessor(resized, output, size);
+  }
+}
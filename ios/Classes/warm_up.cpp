@@ -0,0 +1,87 @@
+#pragma once
+
+#include "u2net.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+// A photo-like test image: a vertical gradient background with a noisy,
+// roughly centered ellipse as the subject, so every stage takes the same
+// branches it takes on a real photo
+static cv::Mat make_warm_up_image(int width, int height) {
+  cv::Mat gradient(height, 1, CV_8U);
+  for (int y = 0; y < height; y++) {
+    gradient.at<uint8_t>(y) = (uint8_t)(64 + 128 * y / std::max(1, height - 1));
+  }
+
+  cv::Mat gray;
+  cv::resize(gradient, gray, cv::Size(width, height), 0, 0,
+             cv::INTER_NEAREST);
+  cv::Mat image;
+  cv::cvtColor(gray, image, cv::COLOR_GRAY2BGR);
+
+  cv::Point center(width / 2, height / 2);
+  cv::Size axes(width / 4, height / 3);
+  cv::ellipse(image, center, axes, 0, 0, 360, cv::Scalar(40, 90, 200),
+              cv::FILLED, cv::LINE_AA);
+
+  cv::Mat noise(image.size(), image.type());
+  cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(8));
+  cv::add(image, noise, image);
+  return image;
+}
+
+// Runs the OpenCV work that is otherwise initialized lazily by the first
+// real image: the parallel backend's thread pool, the optimized kernel
+// dispatch of the resize, filter and morphology paths, the choice of our
+// own pixel kernels, and the PNG and JPEG codecs. Returns the time taken in
+// milliseconds.
+static double run_opencv_warm_up() {
+  auto start = std::chrono::steady_clock::now();
+
+  cutout::kernels::get();
+
+  cv::Mat image = make_warm_up_image(1024, 768);
+
+  cv::Mat resized;
+  cv::resize(image, resized, cv::Size(320, 320), 0, 0, cv::INTER_LANCZOS4);
+  cv::resize(image, resized, cv::Size(512, 384), 0, 0, cv::INTER_AREA);
+  cv::resize(image, resized, cv::Size(1024, 1024), 0, 0, cv::INTER_LINEAR);
+
+  cv::Mat mask;
+  cv::cvtColor(image, mask, cv::COLOR_BGR2GRAY);
+  cv::threshold(mask, mask, 100, 255, cv::THRESH_BINARY);
+  cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
+  cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel);
+  cv::GaussianBlur(mask, mask, cv::Size(5, 5), 2, 2);
+
+  cv::Mat normalized;
+  cv::normalize(mask, normalized, 0, 255, cv::NORM_MINMAX, CV_8U);
+  std::vector<cv::Point> points;
+  cv::findNonZero(normalized, points);
+
+  cv::Mat bgra;
+  cv::cvtColor(image, bgra, cv::COLOR_BGR2BGRA);
+  bgra.setTo(cv::Scalar(0, 0, 0, 0), mask == 0);
+
+  std::vector<uint8_t> buffer;
+  cv::imencode(".png", bgra, buffer);
+  cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+  cv::imencode(".jpg", image, buffer);
+  cv::imdecode(buffer, cv::IMREAD_COLOR);
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+extern "C" {
+FUNCTION_ATTRIBUTE
+double warm_up_opencv() { return run_opencv_warm_up(); }
+
+// Writes the test image as a JPEG for a warm-up pass of a whole model
+FUNCTION_ATTRIBUTE
+bool write_warm_up_image(const char *image_path, int width, int height) {
+  return cv::imwrite(image_path, make_warm_up_image(width, height));
+}
+}
@@ -11,11 +11,97 @@ base class U2NetSegmentImage extends ffi.Opaque {}
 typedef _CCreateU2NetFunc = ffi.Pointer<U2NetSegmentImage> Function();
 typedef _CDestroyU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>);
 typedef _CClearU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _CConfigureU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Bool,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Float,
+);
 typedef _CPreprocessU2NetFunc = ffi.Void Function(
   ffi.Pointer<U2NetSegmentImage>,
   ffi.Pointer<Utf8>,
   ffi.Pointer<ffi.Float>,
 );
+typedef _CPreprocessLoadedU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _CPreprocessFp16U2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Uint16>,
+);
+typedef _CPreprocessUint8U2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Uint8>,
+);
+typedef _CConfigureQuantizationU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Float,
+  ffi.Int32,
+  ffi.Bool,
+);
+typedef _CPostprocessQuantizedU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Uint8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CConfigureGateU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Bool,
+  ffi.Float,
+  ffi.Bool,
+  ffi.Float,
+);
+typedef _CSetContextU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ImageContext>,
+);
+typedef _CShareImageU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<U2NetSegmentImage>,
+);
+typedef _CIsChangedU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CConfigureDuplicatesU2NetFunc = ffi.Void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Bool,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+);
+typedef _CReuseDuplicateU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CScoreMaskU2NetFunc = ffi.Float Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+);
+typedef _CPrepareRoiU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+  ffi.Float,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _CPostprocessRoiU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+  ffi.Pointer<Utf8>,
+);
 typedef _CPostprocessU2NetFunc = ffi.Bool Function(
   ffi.Pointer<U2NetSegmentImage>,
   ffi.Pointer<ffi.Float>,
@@ -35,11 +121,38 @@ typedef _CPreprocessSAMFunc = ffi.Void Function(
   ffi.Pointer<Utf8>,
   ffi.Pointer<ffi.Float>,
 );
+typedef _CConfigureSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Float,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
 typedef _CSetFeaturesSAMFunc = ffi.Void Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Float>,
   ffi.Int32,
 );
+typedef _CSetContextSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ImageContext>,
+);
+typedef _CConfigureDuplicatesSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Bool,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Bool,
+);
+typedef _CReuseDuplicateSAMFunc = ffi.Bool Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Float>,
+);
 typedef _CTransformCoordsSAMFunc = ffi.Void Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Float>,
@@ -52,6 +165,19 @@ typedef _CPostprocessSAMFunc = ffi.Void Function(
   ffi.Pointer<ffi.Float>,
   ffi.Int32,
 );
+typedef _CConfigureQuantizationSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Float,
+  ffi.Int32,
+  ffi.Bool,
+);
+typedef _CPostprocessQuantizedSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+  ffi.Pointer<ffi.Uint8>,
+  ffi.Int32,
+);
 typedef _CAddPointAndLabelSAMFunc = ffi.Bool Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Int32>,
@@ -73,18 +199,318 @@ typedef _CMakeStickerSAMFunc = ffi.Void Function(
 );
 typedef _CGetTotalPointsSAMFunc = ffi.Int32 Function(ffi.Pointer<SAMImage>);
 typedef _CCheckSetImageSAMFunc = ffi.Bool Function(ffi.Pointer<SAMImage>);
+typedef _CGetPromptBucketSAMFunc = ffi.Int32 Function(ffi.Pointer<SAMImage>, ffi.Int32);
+typedef _CTransformCoordsPaddedSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Int32,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _CAddObjectSAMFunc = ffi.Int32 Function(ffi.Pointer<SAMImage>, ffi.Pointer<Utf8>);
+typedef _CRemoveObjectSAMFunc = ffi.Bool Function(ffi.Pointer<SAMImage>, ffi.Int32);
+typedef _CAddObjectPointAndLabelSAMFunc = ffi.Bool Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Int32,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+typedef _CPopObjectPointAndLabelSAMFunc = ffi.Bool Function(ffi.Pointer<SAMImage>, ffi.Int32);
+typedef _CGetTotalObjectsSAMFunc = ffi.Int32 Function(ffi.Pointer<SAMImage>);
+typedef _CGetDirtyObjectsSAMFunc = ffi.Int32 Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+typedef _CTransformCoordsBatchSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _CPostprocessBatchSAMFunc = ffi.Void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Int32,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+);
+typedef _CGetLabelMapSAMFunc = ffi.Bool Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CMakeStickersSAMFunc = ffi.Int32 Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CGetBatchDecodeSAMFunc = ffi.Int32 Function(ffi.Pointer<SAMImage>);
+typedef _CSetBatchDecodeSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>, ffi.Int32);
 // End SAMImage functions
 
+// Start U2NetStream functions
+base class U2NetStream extends ffi.Opaque {}
+
+typedef _CCreateStreamFunc = ffi.Pointer<U2NetStream> Function();
+typedef _CDestroyStreamFunc = ffi.Void Function(ffi.Pointer<U2NetStream>);
+typedef _CConfigureStreamFunc = ffi.Void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Float,
+);
+typedef _CGetU2NetStreamFunc = ffi.Pointer<U2NetSegmentImage> Function(ffi.Pointer<U2NetStream>);
+typedef _CPushFrameStreamFunc = ffi.Void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Uint8>,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int32,
+  ffi.Int64,
+);
+typedef _CPollStreamFunc = ffi.Int32 Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _CSubmitMaskStreamFunc = ffi.Void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+);
+typedef _CGetMaskStreamFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Uint8>,
+  ffi.Int32,
+  ffi.Int32,
+);
+typedef _CConfigureGateStreamFunc = ffi.Void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Bool,
+  ffi.Float,
+  ffi.Bool,
+  ffi.Float,
+);
+typedef _CGetStatsStreamFunc = ffi.Void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Double>,
+);
+// End U2NetStream functions
+
+// Start ResultCache functions
+base class ResultCache extends ffi.Opaque {}
+
+typedef _CCreateCacheFunc = ffi.Pointer<ResultCache> Function();
+typedef _CDestroyCacheFunc = ffi.Void Function(ffi.Pointer<ResultCache>);
+typedef _CConfigureCacheFunc = ffi.Void Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Pointer<Utf8>,
+  ffi.Int64,
+  ffi.Int64,
+);
+typedef _CKeyCacheFunc = ffi.Uint64 Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _CLookupCacheFunc = ffi.Int32 Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Uint64,
+  ffi.Pointer<Utf8>,
+);
+typedef _CStoreCacheFunc = ffi.Bool Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Uint64,
+  ffi.Pointer<Utf8>,
+  ffi.Bool,
+);
+typedef _CClearCacheFunc = ffi.Void Function(ffi.Pointer<ResultCache>);
+// End ResultCache functions
+
+// Start ImageContext functions
+base class ImageContext extends ffi.Opaque {}
+
+typedef _CCreateImageContextFunc = ffi.Pointer<ImageContext> Function(ffi.Pointer<Utf8>);
+typedef _CRetainImageContextFunc = ffi.Void Function(ffi.Pointer<ImageContext>);
+typedef _CReleaseImageContextFunc = ffi.Void Function(ffi.Pointer<ImageContext>);
+typedef _CGetSizeImageContextFunc = ffi.Bool Function(
+  ffi.Pointer<ImageContext>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+// End ImageContext functions
+
+// Start ModelRegistry functions
+typedef _CAcquireModelFunc = ffi.Int64 Function(ffi.Pointer<Utf8>);
+typedef _CPublishModelFunc = ffi.Int64 Function(ffi.Pointer<Utf8>, ffi.Int64, ffi.Uint64);
+typedef _CReleaseModelFunc = ffi.Int64 Function(ffi.Pointer<Utf8>);
+typedef _CLeaseModelFunc = ffi.Int64 Function(ffi.Pointer<Utf8>);
+typedef _CReturnLeaseModelFunc = ffi.Bool Function(ffi.Int64);
+typedef _CSwapModelFunc = ffi.Int64 Function(ffi.Pointer<Utf8>, ffi.Int64, ffi.Uint64);
+typedef _CGetModelVersionFunc = ffi.Uint64 Function(ffi.Pointer<Utf8>);
+typedef _CGetModelContentFunc = ffi.Uint64 Function(ffi.Pointer<Utf8>);
+// End ModelRegistry functions
+
+// Start WarmUp functions
+typedef _CWarmUpOpenCVFunc = ffi.Double Function();
+typedef _CWriteWarmUpImageFunc = ffi.Bool Function(ffi.Pointer<Utf8>, ffi.Int32, ffi.Int32);
+// End WarmUp functions
+
+// Start Threading functions
+typedef _CSetThreadsOpenCVFunc = ffi.Void Function(ffi.Int32);
+typedef _CGetThreadsOpenCVFunc = ffi.Int32 Function();
+// End Threading functions
+
+// Start MatPool functions
+typedef _CGetPoolStatsU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<ffi.Int64>);
+typedef _CTrimPoolU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _CGetPoolStatsSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Int64>);
+typedef _CTrimPoolSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>);
+typedef _CAcquireTensorSAMFunc = ffi.Pointer<ffi.Void> Function(ffi.Pointer<SAMImage>, ffi.Int64, ffi.Int32);
+typedef _CRecycleTensorSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Void>);
+// End MatPool functions
+
+// Start MemoryBudget functions
+typedef _CSetMemoryBudgetFunc = ffi.Void Function(ffi.Int64);
+typedef _CGetMemoryUsageFunc = ffi.Void Function(ffi.Pointer<ffi.Int64>);
+typedef _CResetPeakMemoryFunc = ffi.Void Function();
+typedef _CPlanMemoryBudgetFunc = ffi.Bool Function(ffi.Pointer<Utf8>, ffi.Pointer<ffi.Int64>);
+// End MemoryBudget functions
+
+// Start Strip functions
+typedef _CLoadStripsU2NetFunc = ffi.Bool Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<Utf8>, ffi.Int32);
+typedef _CPostprocessStripsU2NetFunc = ffi.Bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Int32,
+  ffi.Pointer<Utf8>,
+);
+// End Strip functions
+
+// Start Trace functions
+typedef _CSetTraceEnabledFunc = ffi.Void Function(ffi.Bool);
+typedef _CIsTraceEnabledFunc = ffi.Bool Function();
+typedef _CSetTracePerfEnabledFunc = ffi.Bool Function(ffi.Bool);
+typedef _CIsTracePerfEnabledFunc = ffi.Bool Function();
+typedef _CNextTraceRequestFunc = ffi.Uint64 Function();
+typedef _CGetTraceTimeFunc = ffi.Int64 Function();
+typedef _CAddTraceSpanFunc = ffi.Void Function(ffi.Int32, ffi.Uint64, ffi.Int64, ffi.Int64);
+typedef _CClearTraceFunc = ffi.Void Function();
+typedef _CDumpTraceFunc = ffi.Bool Function(ffi.Pointer<Utf8>);
+typedef _CSetTraceRequestU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>, ffi.Uint64);
+typedef _CSetTraceRequestSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>, ffi.Uint64);
+// End Trace functions
+
+// Start MemoryStats functions
+typedef _CAllocateTensorFunc = ffi.Pointer<ffi.Void> Function(ffi.Int64, ffi.Int32);
+typedef _CFreeTensorFunc = ffi.Void Function(ffi.Pointer<ffi.Void>);
+typedef _CGetStageMemoryFunc = ffi.Void Function(ffi.Pointer<ffi.Int64>);
+typedef _CResetStageMemoryFunc = ffi.Void Function();
+typedef _CGetMemoryStatsU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<ffi.Int64>);
+typedef _CResetMemoryStatsU2NetFunc = ffi.Void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _CGetMemoryStatsSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Int64>);
+typedef _CResetMemoryStatsSAMFunc = ffi.Void Function(ffi.Pointer<SAMImage>);
+// End MemoryStats functions
+
 // Dart function signatures
 // Start U2Net functions
 typedef _CreateU2NetFunc = ffi.Pointer<U2NetSegmentImage> Function();
 typedef _DestroyU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>);
 typedef _ClearU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _ConfigureU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  int,
+  int,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+  bool,
+  int,
+  int,
+  double,
+);
 typedef _PreprocessU2NetFunc = void Function(
   ffi.Pointer<U2NetSegmentImage>,
   ffi.Pointer<Utf8>,
   ffi.Pointer<ffi.Float>,
 );
+typedef _PreprocessLoadedU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _PreprocessFp16U2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Uint16>,
+);
+typedef _PreprocessUint8U2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Uint8>,
+);
+typedef _ConfigureQuantizationU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  double,
+  int,
+  bool,
+);
+typedef _PostprocessQuantizedU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Uint8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _ConfigureGateU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  bool,
+  double,
+  bool,
+  double,
+);
+typedef _SetContextU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ImageContext>,
+);
+typedef _ShareImageU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<U2NetSegmentImage>,
+);
+typedef _IsChangedU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _ConfigureDuplicatesU2NetFunc = void Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  bool,
+  int,
+  int,
+  int,
+);
+typedef _ReuseDuplicateU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _ScoreMaskU2NetFunc = double Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  int,
+);
+typedef _PrepareRoiU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  int,
+  double,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _PostprocessRoiU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+  int,
+  ffi.Pointer<Utf8>,
+);
 typedef _PostprocessU2NetFunc = bool Function(
   ffi.Pointer<U2NetSegmentImage>,
   ffi.Pointer<ffi.Float>,
@@ -102,11 +528,38 @@ typedef _PreprocessSAMFunc = void Function(
   ffi.Pointer<Utf8>,
   ffi.Pointer<ffi.Float>,
 );
+typedef _ConfigureSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  int,
+  int,
+  int,
+  int,
+  double,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
 typedef _SetFeaturesSAMFunc = void Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Float>,
   int,
 );
+typedef _SetContextSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ImageContext>,
+);
+typedef _ConfigureDuplicatesSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  bool,
+  int,
+  int,
+  int,
+  bool,
+);
+typedef _ReuseDuplicateSAMFunc = bool Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<ffi.Float>,
+);
 typedef _TransformCoordsSAMFunc = void Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Float>,
@@ -119,6 +572,19 @@ typedef _PostprocessSAMFunc = void Function(
   ffi.Pointer<ffi.Float>,
   int,
 );
+typedef _ConfigureQuantizationSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  double,
+  int,
+  bool,
+);
+typedef _PostprocessQuantizedSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Float>,
+  int,
+  ffi.Pointer<ffi.Uint8>,
+  int,
+);
 typedef _AddPointAndLabelSAMFunc = bool Function(
   ffi.Pointer<SAMImage>,
   ffi.Pointer<ffi.Int32>,
@@ -140,17 +606,337 @@ typedef _MakeStickerSAMFunc = void Function(
 );
 typedef _GetTotalPointsSAMFunc = int Function(ffi.Pointer<SAMImage>);
 typedef _CheckSetImageSAMFunc = bool Function(ffi.Pointer<SAMImage>);
-// End SAMImage functions
-
-class CutoutBinding {
-  static final ffi.DynamicLibrary _lib = _openDynamicLibrary();
-
-  // Getting a library that holds needed symbols
-  static ffi.DynamicLibrary _openDynamicLibrary() {
-    if (Platform.isAndroid) {
-      return ffi.DynamicLibrary.open('libcutout.so');
-    }
-
+typedef _GetPromptBucketSAMFunc = int Function(ffi.Pointer<SAMImage>, int);
+typedef _TransformCoordsPaddedSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  int,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _AddObjectSAMFunc = int Function(ffi.Pointer<SAMImage>, ffi.Pointer<Utf8>);
+typedef _RemoveObjectSAMFunc = bool Function(ffi.Pointer<SAMImage>, int);
+typedef _AddObjectPointAndLabelSAMFunc = bool Function(
+  ffi.Pointer<SAMImage>,
+  int,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+typedef _PopObjectPointAndLabelSAMFunc = bool Function(ffi.Pointer<SAMImage>, int);
+typedef _GetTotalObjectsSAMFunc = int Function(ffi.Pointer<SAMImage>);
+typedef _GetDirtyObjectsSAMFunc = int Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+typedef _TransformCoordsBatchSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  int,
+  int,
+  ffi.Pointer<ffi.Float>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _PostprocessBatchSAMFunc = void Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<ffi.Int32>,
+  int,
+  ffi.Pointer<ffi.Float>,
+  int,
+  ffi.Pointer<ffi.Float>,
+  int,
+);
+typedef _GetLabelMapSAMFunc = bool Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _MakeStickersSAMFunc = int Function(
+  ffi.Pointer<SAMImage>,
+  ffi.Pointer<Utf8>,
+);
+typedef _GetBatchDecodeSAMFunc = int Function(ffi.Pointer<SAMImage>);
+typedef _SetBatchDecodeSAMFunc = void Function(ffi.Pointer<SAMImage>, int);
+// End SAMImage functions
+
+// Start U2NetStream functions
+typedef _CreateStreamFunc = ffi.Pointer<U2NetStream> Function();
+typedef _DestroyStreamFunc = void Function(ffi.Pointer<U2NetStream>);
+typedef _ConfigureStreamFunc = void Function(
+  ffi.Pointer<U2NetStream>,
+  int,
+  int,
+  double,
+);
+typedef _GetU2NetStreamFunc = ffi.Pointer<U2NetSegmentImage> Function(ffi.Pointer<U2NetStream>);
+typedef _PushFrameStreamFunc = void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Uint8>,
+  int,
+  int,
+  int,
+  int,
+  int,
+  int,
+);
+typedef _PollStreamFunc = int Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Float>,
+);
+typedef _SubmitMaskStreamFunc = void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Float>,
+  int,
+);
+typedef _GetMaskStreamFunc = bool Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Uint8>,
+  int,
+  int,
+);
+typedef _ConfigureGateStreamFunc = void Function(
+  ffi.Pointer<U2NetStream>,
+  bool,
+  double,
+  bool,
+  double,
+);
+typedef _GetStatsStreamFunc = void Function(
+  ffi.Pointer<U2NetStream>,
+  ffi.Pointer<ffi.Double>,
+);
+// End U2NetStream functions
+
+// Start ResultCache functions
+typedef _CreateCacheFunc = ffi.Pointer<ResultCache> Function();
+typedef _DestroyCacheFunc = void Function(ffi.Pointer<ResultCache>);
+typedef _ConfigureCacheFunc = void Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Pointer<Utf8>,
+  int,
+  int,
+);
+typedef _KeyCacheFunc = int Function(
+  ffi.Pointer<ResultCache>,
+  ffi.Pointer<Utf8>,
+  ffi.Pointer<Utf8>,
+);
+typedef _LookupCacheFunc = int Function(
+  ffi.Pointer<ResultCache>,
+  int,
+  ffi.Pointer<Utf8>,
+);
+typedef _StoreCacheFunc = bool Function(
+  ffi.Pointer<ResultCache>,
+  int,
+  ffi.Pointer<Utf8>,
+  bool,
+);
+typedef _ClearCacheFunc = void Function(ffi.Pointer<ResultCache>);
+// End ResultCache functions
+
+// Start ImageContext functions
+typedef _CreateImageContextFunc = ffi.Pointer<ImageContext> Function(ffi.Pointer<Utf8>);
+typedef _RetainImageContextFunc = void Function(ffi.Pointer<ImageContext>);
+typedef _ReleaseImageContextFunc = void Function(ffi.Pointer<ImageContext>);
+typedef _GetSizeImageContextFunc = bool Function(
+  ffi.Pointer<ImageContext>,
+  ffi.Pointer<ffi.Int32>,
+  ffi.Pointer<ffi.Int32>,
+);
+// End ImageContext functions
+
+// Start ModelRegistry functions
+typedef _AcquireModelFunc = int Function(ffi.Pointer<Utf8>);
+typedef _PublishModelFunc = int Function(ffi.Pointer<Utf8>, int, int);
+typedef _ReleaseModelFunc = int Function(ffi.Pointer<Utf8>);
+typedef _LeaseModelFunc = int Function(ffi.Pointer<Utf8>);
+typedef _ReturnLeaseModelFunc = bool Function(int);
+typedef _SwapModelFunc = int Function(ffi.Pointer<Utf8>, int, int);
+typedef _GetModelVersionFunc = int Function(ffi.Pointer<Utf8>);
+typedef _GetModelContentFunc = int Function(ffi.Pointer<Utf8>);
+// End ModelRegistry functions
+
+// Start WarmUp functions
+typedef _WarmUpOpenCVFunc = double Function();
+typedef _WriteWarmUpImageFunc = bool Function(ffi.Pointer<Utf8>, int, int);
+// End WarmUp functions
+
+// Start Threading functions
+typedef _SetThreadsOpenCVFunc = void Function(int);
+typedef _GetThreadsOpenCVFunc = int Function();
+// End Threading functions
+
+// Start MatPool functions
+typedef _GetPoolStatsU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<ffi.Int64>);
+typedef _TrimPoolU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _GetPoolStatsSAMFunc = void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Int64>);
+typedef _TrimPoolSAMFunc = void Function(ffi.Pointer<SAMImage>);
+typedef _AcquireTensorSAMFunc = ffi.Pointer<ffi.Void> Function(ffi.Pointer<SAMImage>, int, int);
+typedef _RecycleTensorSAMFunc = void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Void>);
+// End MatPool functions
+
+// Start MemoryBudget functions
+typedef _SetMemoryBudgetFunc = void Function(int);
+typedef _GetMemoryUsageFunc = void Function(ffi.Pointer<ffi.Int64>);
+typedef _ResetPeakMemoryFunc = void Function();
+typedef _PlanMemoryBudgetFunc = bool Function(ffi.Pointer<Utf8>, ffi.Pointer<ffi.Int64>);
+// End MemoryBudget functions
+
+// Start Strip functions
+typedef _LoadStripsU2NetFunc = bool Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<Utf8>, int);
+typedef _PostprocessStripsU2NetFunc = bool Function(
+  ffi.Pointer<U2NetSegmentImage>,
+  ffi.Pointer<ffi.Float>,
+  int,
+  ffi.Pointer<Utf8>,
+);
+// End Strip functions
+
+// Start Trace functions
+typedef _SetTraceEnabledFunc = void Function(bool);
+typedef _IsTraceEnabledFunc = bool Function();
+typedef _SetTracePerfEnabledFunc = bool Function(bool);
+typedef _IsTracePerfEnabledFunc = bool Function();
+typedef _NextTraceRequestFunc = int Function();
+typedef _GetTraceTimeFunc = int Function();
+typedef _AddTraceSpanFunc = void Function(int, int, int, int);
+typedef _ClearTraceFunc = void Function();
+typedef _DumpTraceFunc = bool Function(ffi.Pointer<Utf8>);
+typedef _SetTraceRequestU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>, int);
+typedef _SetTraceRequestSAMFunc = void Function(ffi.Pointer<SAMImage>, int);
+// End Trace functions
+
+// Start MemoryStats functions
+typedef _AllocateTensorFunc = ffi.Pointer<ffi.Void> Function(int, int);
+typedef _FreeTensorFunc = void Function(ffi.Pointer<ffi.Void>);
+typedef _GetStageMemoryFunc = void Function(ffi.Pointer<ffi.Int64>);
+typedef _ResetStageMemoryFunc = void Function();
+typedef _GetMemoryStatsU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>, ffi.Pointer<ffi.Int64>);
+typedef _ResetMemoryStatsU2NetFunc = void Function(ffi.Pointer<U2NetSegmentImage>);
+typedef _GetMemoryStatsSAMFunc = void Function(ffi.Pointer<SAMImage>, ffi.Pointer<ffi.Int64>);
+typedef _ResetMemoryStatsSAMFunc = void Function(ffi.Pointer<SAMImage>);
+// End MemoryStats functions
+
+/// Native buffers of the padded SAM decoder runs of one call.
+///
+/// The buffers come from the tensor pool of the native SAM instance and go
+/// back to it on [release], so the following calls reuse them: one set per
+/// prompt bucket, and one more for each call running at the same time. The
+/// pool lives with the native instance rather than the Dart object, which
+/// each isolate gets a copy of. The native side writes the padded prompts
+/// into them and the decoder outputs are written straight into the scores
+/// and masks buffers, which the native postprocess reads in place.
+class SAMDecodeBuffers {
+  // Must match SAMImage::prompt_buckets
+  static const List<int> promptBuckets = [4, 8, 16];
+
+  final Map<int, (ffi.Pointer<ffi.Float>, ffi.Pointer<ffi.Float>)> _prompts = {};
+  final SAMTensorPool _inputs;
+  final SAMTensorPool _outputs;
+  final int scoresSize;
+  final int masksSize;
+  late final ffi.Pointer<ffi.Float> scores;
+  late final ffi.Pointer<ffi.Float> masks;
+
+  SAMDecodeBuffers(ffi.Pointer<SAMImage> sam, {required this.scoresSize, required this.masksSize})
+      : _inputs = SAMTensorPool(sam, TensorAllocator.preprocess),
+        _outputs = SAMTensorPool(sam, TensorAllocator.postprocess) {
+    scores = _outputs<ffi.Float>(scoresSize);
+    masks = _outputs<ffi.Float>(masksSize);
+  }
+
+  /// Coordinates and labels of a prompt bucket, taken on first use
+  (ffi.Pointer<ffi.Float>, ffi.Pointer<ffi.Float>) prompt(int bucket) {
+    return _prompts.putIfAbsent(bucket, () => (_inputs<ffi.Float>(bucket * 2), _inputs<ffi.Float>(bucket)));
+  }
+
+  Float32List get scoresList => scores.asTypedList(scoresSize);
+  Float32List get masksList => masks.asTypedList(masksSize);
+
+  /// Gives the buffers back to the pool of the native instance
+  void release() {
+    for (final (coords, labels) in _prompts.values) {
+      _inputs.free(coords);
+      _inputs.free(labels);
+    }
+    _prompts.clear();
+    _outputs.free(scores);
+    _outputs.free(masks);
+  }
+}
+
+/// Tensor buffers of one native SAM instance, counted like [TensorAllocator]
+/// for its stage. Freed buffers are kept by the instance for the following
+/// calls, so a reused buffer holds the data of its last call rather than
+/// zeros. `SAMModel.trimPool` frees them.
+class SAMTensorPool implements ffi.Allocator {
+  final ffi.Pointer<SAMImage> sam;
+  final TensorAllocator _stage;
+
+  const SAMTensorPool(this.sam, this._stage);
+
+  static final _AcquireTensorSAMFunc _acquireTensorSAM =
+      CutoutBinding._lib.lookup<ffi.NativeFunction<_CAcquireTensorSAMFunc>>('acquire_tensor_sam').asFunction();
+  static final _RecycleTensorSAMFunc _recycleTensorSAM =
+      CutoutBinding._lib.lookup<ffi.NativeFunction<_CRecycleTensorSAMFunc>>('recycle_tensor_sam').asFunction();
+
+  @override
+  ffi.Pointer<T> allocate<T extends ffi.NativeType>(int byteCount, {int? alignment}) {
+    final pointer = _acquireTensorSAM(sam, byteCount, _stage.stage);
+    if (pointer.address == 0) {
+      throw ArgumentError('Could not allocate $byteCount bytes.');
+    }
+    return pointer.cast();
+  }
+
+  @override
+  void free(ffi.Pointer pointer) {
+    _recycleTensorSAM(sam, pointer.cast());
+  }
+}
+
+/// Allocates the tensor buffers passed to the native side, zeroed like
+/// [calloc], and counts them in the native per-stage memory statistics
+class TensorAllocator implements ffi.Allocator {
+  /// Index of the native stage the buffers are counted for
+  final int stage;
+
+  const TensorAllocator._(this.stage);
+
+  /// Model inputs written by the preprocess functions
+  static const preprocess = TensorAllocator._(0);
+
+  /// Model outputs handed to the postprocess functions
+  static const postprocess = TensorAllocator._(1);
+
+  static final _AllocateTensorFunc _allocateTensor =
+      CutoutBinding._lib.lookup<ffi.NativeFunction<_CAllocateTensorFunc>>('allocate_tensor').asFunction();
+  static final _FreeTensorFunc _freeTensor =
+      CutoutBinding._lib.lookup<ffi.NativeFunction<_CFreeTensorFunc>>('free_tensor').asFunction();
+
+  @override
+  ffi.Pointer<T> allocate<T extends ffi.NativeType>(int byteCount, {int? alignment}) {
+    final pointer = _allocateTensor(byteCount, stage);
+    if (pointer.address == 0) {
+      throw ArgumentError('Could not allocate $byteCount bytes.');
+    }
+    return pointer.cast();
+  }
+
+  @override
+  void free(ffi.Pointer pointer) {
+    _freeTensor(pointer.cast());
+  }
+}
+
+class CutoutBinding {
+  static final ffi.DynamicLibrary _lib = _openDynamicLibrary();
+
+  // Getting a library that holds needed symbols
+  static ffi.DynamicLibrary _openDynamicLibrary() {
+    if (Platform.isAndroid) {
+      return ffi.DynamicLibrary.open('libcutout.so');
+    }
+
     return ffi.DynamicLibrary.process();
   }
 
@@ -160,8 +946,38 @@ class CutoutBinding {
   final _DestroyU2NetFunc _destroyU2Net =
       _lib.lookup<ffi.NativeFunction<_CDestroyU2NetFunc>>('destroy_u2net').asFunction();
   final _ClearU2NetFunc _clearU2Net = _lib.lookup<ffi.NativeFunction<_CClearU2NetFunc>>('clear_u2net').asFunction();
+  final _ConfigureU2NetFunc _configureU2Net =
+      _lib.lookup<ffi.NativeFunction<_CConfigureU2NetFunc>>('configure_u2net').asFunction();
   final _PreprocessU2NetFunc _preprocessU2Net =
       _lib.lookup<ffi.NativeFunction<_CPreprocessU2NetFunc>>('preprocess_u2net').asFunction();
+  final _PreprocessLoadedU2NetFunc _preprocessLoadedU2Net =
+      _lib.lookup<ffi.NativeFunction<_CPreprocessLoadedU2NetFunc>>('preprocess_loaded_u2net').asFunction();
+  final _PreprocessFp16U2NetFunc _preprocessFp16U2Net =
+      _lib.lookup<ffi.NativeFunction<_CPreprocessFp16U2NetFunc>>('preprocess_fp16_u2net').asFunction();
+  final _PreprocessUint8U2NetFunc _preprocessUint8U2Net =
+      _lib.lookup<ffi.NativeFunction<_CPreprocessUint8U2NetFunc>>('preprocess_uint8_u2net').asFunction();
+  final _ConfigureQuantizationU2NetFunc _configureQuantizationU2Net =
+      _lib.lookup<ffi.NativeFunction<_CConfigureQuantizationU2NetFunc>>('configure_quantization_u2net').asFunction();
+  final _PostprocessQuantizedU2NetFunc _postprocessQuantizedU2Net =
+      _lib.lookup<ffi.NativeFunction<_CPostprocessQuantizedU2NetFunc>>('postprocess_quantized_u2net').asFunction();
+  final _ConfigureGateU2NetFunc _configureGateU2Net =
+      _lib.lookup<ffi.NativeFunction<_CConfigureGateU2NetFunc>>('configure_gate_u2net').asFunction();
+  final _SetContextU2NetFunc _setContextU2Net =
+      _lib.lookup<ffi.NativeFunction<_CSetContextU2NetFunc>>('set_context_u2net').asFunction();
+  final _ShareImageU2NetFunc _shareImageU2Net =
+      _lib.lookup<ffi.NativeFunction<_CShareImageU2NetFunc>>('share_image_u2net').asFunction();
+  final _IsChangedU2NetFunc _isChangedU2Net =
+      _lib.lookup<ffi.NativeFunction<_CIsChangedU2NetFunc>>('is_changed_u2net').asFunction();
+  final _ConfigureDuplicatesU2NetFunc _configureDuplicatesU2Net =
+      _lib.lookup<ffi.NativeFunction<_CConfigureDuplicatesU2NetFunc>>('configure_duplicates_u2net').asFunction();
+  final _ReuseDuplicateU2NetFunc _reuseDuplicateU2Net =
+      _lib.lookup<ffi.NativeFunction<_CReuseDuplicateU2NetFunc>>('reuse_duplicate_u2net').asFunction();
+  final _ScoreMaskU2NetFunc _scoreMaskU2Net =
+      _lib.lookup<ffi.NativeFunction<_CScoreMaskU2NetFunc>>('score_mask_u2net').asFunction();
+  final _PrepareRoiU2NetFunc _prepareRoiU2Net =
+      _lib.lookup<ffi.NativeFunction<_CPrepareRoiU2NetFunc>>('prepare_roi_u2net').asFunction();
+  final _PostprocessRoiU2NetFunc _postprocessRoiU2Net =
+      _lib.lookup<ffi.NativeFunction<_CPostprocessRoiU2NetFunc>>('postprocess_roi_u2net').asFunction();
   final _PostprocessU2NetFunc _postprocessU2Net =
       _lib.lookup<ffi.NativeFunction<_CPostprocessU2NetFunc>>('postprocess_u2net').asFunction();
   // End U2Net functions
@@ -172,12 +988,24 @@ class CutoutBinding {
   final _ClearSAMFunc _clearSAM = _lib.lookup<ffi.NativeFunction<_CClearSAMFunc>>('clear_sam').asFunction();
   final _PreprocessSAMFunc _preprocessSAM =
       _lib.lookup<ffi.NativeFunction<_CPreprocessSAMFunc>>('preprocess_sam').asFunction();
+  final _ConfigureSAMFunc _configureSAM =
+      _lib.lookup<ffi.NativeFunction<_CConfigureSAMFunc>>('configure_sam').asFunction();
   final _SetFeaturesSAMFunc _setFeaturesSAM =
       _lib.lookup<ffi.NativeFunction<_CSetFeaturesSAMFunc>>('set_features_sam').asFunction();
+  final _SetContextSAMFunc _setContextSAM =
+      _lib.lookup<ffi.NativeFunction<_CSetContextSAMFunc>>('set_context_sam').asFunction();
+  final _ConfigureDuplicatesSAMFunc _configureDuplicatesSAM =
+      _lib.lookup<ffi.NativeFunction<_CConfigureDuplicatesSAMFunc>>('configure_duplicates_sam').asFunction();
+  final _ReuseDuplicateSAMFunc _reuseDuplicateSAM =
+      _lib.lookup<ffi.NativeFunction<_CReuseDuplicateSAMFunc>>('reuse_duplicate_sam').asFunction();
   final _TransformCoordsSAMFunc _transformCoordsSAM =
       _lib.lookup<ffi.NativeFunction<_CTransformCoordsSAMFunc>>('transform_coords_sam').asFunction();
   final _PostprocessSAMFunc _postprocessSAM =
       _lib.lookup<ffi.NativeFunction<_CPostprocessSAMFunc>>('postprocess_sam').asFunction();
+  final _ConfigureQuantizationSAMFunc _configureQuantizationSAM =
+      _lib.lookup<ffi.NativeFunction<_CConfigureQuantizationSAMFunc>>('configure_quantization_sam').asFunction();
+  final _PostprocessQuantizedSAMFunc _postprocessQuantizedSAM =
+      _lib.lookup<ffi.NativeFunction<_CPostprocessQuantizedSAMFunc>>('postprocess_quantized_sam').asFunction();
   final _AddPointAndLabelSAMFunc _addPointAndLabelSAM =
       _lib.lookup<ffi.NativeFunction<_CAddPointAndLabelSAMFunc>>('add_point_and_label_sam').asFunction();
   final _PopPointAndLabelSAMFunc _popPointAndLabelSAM =
@@ -191,8 +1019,180 @@ class CutoutBinding {
       _lib.lookup<ffi.NativeFunction<_CGetTotalPointsSAMFunc>>('get_total_points_sam').asFunction();
   final _CheckSetImageSAMFunc _checkSetImageSAM =
       _lib.lookup<ffi.NativeFunction<_CCheckSetImageSAMFunc>>('check_set_image_sam').asFunction();
+  final _GetPromptBucketSAMFunc _getPromptBucketSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetPromptBucketSAMFunc>>('get_prompt_bucket_sam').asFunction();
+  final _TransformCoordsPaddedSAMFunc _transformCoordsPaddedSAM =
+      _lib.lookup<ffi.NativeFunction<_CTransformCoordsPaddedSAMFunc>>('transform_coords_padded_sam').asFunction();
+  final _AddObjectSAMFunc _addObjectSAM =
+      _lib.lookup<ffi.NativeFunction<_CAddObjectSAMFunc>>('add_object_sam').asFunction();
+  final _RemoveObjectSAMFunc _removeObjectSAM =
+      _lib.lookup<ffi.NativeFunction<_CRemoveObjectSAMFunc>>('remove_object_sam').asFunction();
+  final _AddObjectPointAndLabelSAMFunc _addObjectPointAndLabelSAM =
+      _lib.lookup<ffi.NativeFunction<_CAddObjectPointAndLabelSAMFunc>>('add_object_point_and_label_sam').asFunction();
+  final _PopObjectPointAndLabelSAMFunc _popObjectPointAndLabelSAM =
+      _lib.lookup<ffi.NativeFunction<_CPopObjectPointAndLabelSAMFunc>>('pop_object_point_and_label_sam').asFunction();
+  final _GetTotalObjectsSAMFunc _getTotalObjectsSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetTotalObjectsSAMFunc>>('get_total_objects_sam').asFunction();
+  final _GetDirtyObjectsSAMFunc _getDirtyObjectsSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetDirtyObjectsSAMFunc>>('get_dirty_objects_sam').asFunction();
+  final _TransformCoordsBatchSAMFunc _transformCoordsBatchSAM =
+      _lib.lookup<ffi.NativeFunction<_CTransformCoordsBatchSAMFunc>>('transform_coords_batch_sam').asFunction();
+  final _PostprocessBatchSAMFunc _postprocessBatchSAM =
+      _lib.lookup<ffi.NativeFunction<_CPostprocessBatchSAMFunc>>('postprocess_batch_sam').asFunction();
+  final _GetLabelMapSAMFunc _getLabelMapSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetLabelMapSAMFunc>>('get_label_map_sam').asFunction();
+  final _MakeStickersSAMFunc _makeStickersSAM =
+      _lib.lookup<ffi.NativeFunction<_CMakeStickersSAMFunc>>('make_stickers_sam').asFunction();
+  final _GetBatchDecodeSAMFunc _getBatchDecodeSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetBatchDecodeSAMFunc>>('get_batch_decode_sam').asFunction();
+  final _SetBatchDecodeSAMFunc _setBatchDecodeSAM =
+      _lib.lookup<ffi.NativeFunction<_CSetBatchDecodeSAMFunc>>('set_batch_decode_sam').asFunction();
   // End SAMImage functions
 
+  // Start U2NetStream functions
+  final _CreateStreamFunc _createStream =
+      _lib.lookup<ffi.NativeFunction<_CCreateStreamFunc>>('create_stream').asFunction();
+  final _DestroyStreamFunc _destroyStream =
+      _lib.lookup<ffi.NativeFunction<_CDestroyStreamFunc>>('destroy_stream').asFunction();
+  final _ConfigureStreamFunc _configureStream =
+      _lib.lookup<ffi.NativeFunction<_CConfigureStreamFunc>>('configure_stream').asFunction();
+  final _GetU2NetStreamFunc _getU2NetStream =
+      _lib.lookup<ffi.NativeFunction<_CGetU2NetStreamFunc>>('get_u2net_stream').asFunction();
+  final _PushFrameStreamFunc _pushFrameStream =
+      _lib.lookup<ffi.NativeFunction<_CPushFrameStreamFunc>>('push_frame_stream').asFunction();
+  final _PollStreamFunc _pollStream = _lib.lookup<ffi.NativeFunction<_CPollStreamFunc>>('poll_stream').asFunction();
+  final _SubmitMaskStreamFunc _submitMaskStream =
+      _lib.lookup<ffi.NativeFunction<_CSubmitMaskStreamFunc>>('submit_mask_stream').asFunction();
+  final _GetMaskStreamFunc _getMaskStream =
+      _lib.lookup<ffi.NativeFunction<_CGetMaskStreamFunc>>('get_mask_stream').asFunction();
+  final _ConfigureGateStreamFunc _configureGateStream =
+      _lib.lookup<ffi.NativeFunction<_CConfigureGateStreamFunc>>('configure_gate_stream').asFunction();
+  final _GetStatsStreamFunc _getStatsStream =
+      _lib.lookup<ffi.NativeFunction<_CGetStatsStreamFunc>>('get_stats_stream').asFunction();
+  // End U2NetStream functions
+
+  // Start ResultCache functions
+  final _CreateCacheFunc _createCache =
+      _lib.lookup<ffi.NativeFunction<_CCreateCacheFunc>>('create_cache').asFunction();
+  final _DestroyCacheFunc _destroyCache =
+      _lib.lookup<ffi.NativeFunction<_CDestroyCacheFunc>>('destroy_cache').asFunction();
+  final _ConfigureCacheFunc _configureCache =
+      _lib.lookup<ffi.NativeFunction<_CConfigureCacheFunc>>('configure_cache').asFunction();
+  final _KeyCacheFunc _keyCache = _lib.lookup<ffi.NativeFunction<_CKeyCacheFunc>>('key_cache').asFunction();
+  final _LookupCacheFunc _lookupCache =
+      _lib.lookup<ffi.NativeFunction<_CLookupCacheFunc>>('lookup_cache').asFunction();
+  final _StoreCacheFunc _storeCache = _lib.lookup<ffi.NativeFunction<_CStoreCacheFunc>>('store_cache').asFunction();
+  final _ClearCacheFunc _clearCache = _lib.lookup<ffi.NativeFunction<_CClearCacheFunc>>('clear_cache').asFunction();
+  // End ResultCache functions
+
+  // Start ImageContext functions
+  final _CreateImageContextFunc _createImageContext =
+      _lib.lookup<ffi.NativeFunction<_CCreateImageContextFunc>>('create_image_context').asFunction();
+  final _RetainImageContextFunc _retainImageContext =
+      _lib.lookup<ffi.NativeFunction<_CRetainImageContextFunc>>('retain_image_context').asFunction();
+  final _ReleaseImageContextFunc _releaseImageContext =
+      _lib.lookup<ffi.NativeFunction<_CReleaseImageContextFunc>>('release_image_context').asFunction();
+  final _GetSizeImageContextFunc _getSizeImageContext =
+      _lib.lookup<ffi.NativeFunction<_CGetSizeImageContextFunc>>('get_size_image_context').asFunction();
+  // End ImageContext functions
+
+  // Start ModelRegistry functions
+  final _AcquireModelFunc _acquireModel =
+      _lib.lookup<ffi.NativeFunction<_CAcquireModelFunc>>('acquire_model').asFunction();
+  final _PublishModelFunc _publishModel =
+      _lib.lookup<ffi.NativeFunction<_CPublishModelFunc>>('publish_model').asFunction();
+  final _ReleaseModelFunc _releaseModel =
+      _lib.lookup<ffi.NativeFunction<_CReleaseModelFunc>>('release_model').asFunction();
+  final _LeaseModelFunc _leaseModel = _lib.lookup<ffi.NativeFunction<_CLeaseModelFunc>>('lease_model').asFunction();
+  final _ReturnLeaseModelFunc _returnLeaseModel =
+      _lib.lookup<ffi.NativeFunction<_CReturnLeaseModelFunc>>('return_lease_model').asFunction();
+  final _SwapModelFunc _swapModel = _lib.lookup<ffi.NativeFunction<_CSwapModelFunc>>('swap_model').asFunction();
+  final _GetModelVersionFunc _getModelVersion =
+      _lib.lookup<ffi.NativeFunction<_CGetModelVersionFunc>>('get_model_version').asFunction();
+  final _GetModelContentFunc _getModelContent =
+      _lib.lookup<ffi.NativeFunction<_CGetModelContentFunc>>('get_model_content').asFunction();
+  // End ModelRegistry functions
+
+  // Start WarmUp functions
+  final _WarmUpOpenCVFunc _warmUpOpenCV =
+      _lib.lookup<ffi.NativeFunction<_CWarmUpOpenCVFunc>>('warm_up_opencv').asFunction();
+  final _WriteWarmUpImageFunc _writeWarmUpImage =
+      _lib.lookup<ffi.NativeFunction<_CWriteWarmUpImageFunc>>('write_warm_up_image').asFunction();
+  // End WarmUp functions
+
+  // Start Threading functions
+  final _SetThreadsOpenCVFunc _setThreadsOpenCV =
+      _lib.lookup<ffi.NativeFunction<_CSetThreadsOpenCVFunc>>('set_threads_opencv').asFunction();
+  final _GetThreadsOpenCVFunc _getThreadsOpenCV =
+      _lib.lookup<ffi.NativeFunction<_CGetThreadsOpenCVFunc>>('get_threads_opencv').asFunction();
+  // End Threading functions
+
+  // Start MatPool functions
+  final _GetPoolStatsU2NetFunc _getPoolStatsU2Net =
+      _lib.lookup<ffi.NativeFunction<_CGetPoolStatsU2NetFunc>>('get_pool_stats_u2net').asFunction();
+  final _TrimPoolU2NetFunc _trimPoolU2Net =
+      _lib.lookup<ffi.NativeFunction<_CTrimPoolU2NetFunc>>('trim_pool_u2net').asFunction();
+  final _GetPoolStatsSAMFunc _getPoolStatsSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetPoolStatsSAMFunc>>('get_pool_stats_sam').asFunction();
+  final _TrimPoolSAMFunc _trimPoolSAM = _lib.lookup<ffi.NativeFunction<_CTrimPoolSAMFunc>>('trim_pool_sam').asFunction();
+  // End MatPool functions
+
+  // Start MemoryBudget functions
+  final _SetMemoryBudgetFunc _setMemoryBudget =
+      _lib.lookup<ffi.NativeFunction<_CSetMemoryBudgetFunc>>('set_memory_budget').asFunction();
+  final _GetMemoryUsageFunc _getMemoryUsage =
+      _lib.lookup<ffi.NativeFunction<_CGetMemoryUsageFunc>>('get_memory_usage').asFunction();
+  final _ResetPeakMemoryFunc _resetPeakMemory =
+      _lib.lookup<ffi.NativeFunction<_CResetPeakMemoryFunc>>('reset_peak_memory').asFunction();
+  final _PlanMemoryBudgetFunc _planMemoryBudget =
+      _lib.lookup<ffi.NativeFunction<_CPlanMemoryBudgetFunc>>('plan_memory_budget').asFunction();
+  // End MemoryBudget functions
+
+  // Start Strip functions
+  final _LoadStripsU2NetFunc _loadStripsU2Net =
+      _lib.lookup<ffi.NativeFunction<_CLoadStripsU2NetFunc>>('load_strips_u2net').asFunction();
+  final _PostprocessStripsU2NetFunc _postprocessStripsU2Net =
+      _lib.lookup<ffi.NativeFunction<_CPostprocessStripsU2NetFunc>>('postprocess_strips_u2net').asFunction();
+  // End Strip functions
+
+  // Start Trace functions
+  final _SetTraceEnabledFunc _setTraceEnabled =
+      _lib.lookup<ffi.NativeFunction<_CSetTraceEnabledFunc>>('set_trace_enabled').asFunction();
+  final _IsTraceEnabledFunc _isTraceEnabled =
+      _lib.lookup<ffi.NativeFunction<_CIsTraceEnabledFunc>>('is_trace_enabled').asFunction();
+  final _SetTracePerfEnabledFunc _setTracePerfEnabled =
+      _lib.lookup<ffi.NativeFunction<_CSetTracePerfEnabledFunc>>('set_trace_perf_enabled').asFunction();
+  final _IsTracePerfEnabledFunc _isTracePerfEnabled =
+      _lib.lookup<ffi.NativeFunction<_CIsTracePerfEnabledFunc>>('is_trace_perf_enabled').asFunction();
+  final _NextTraceRequestFunc _nextTraceRequest =
+      _lib.lookup<ffi.NativeFunction<_CNextTraceRequestFunc>>('next_trace_request').asFunction();
+  final _GetTraceTimeFunc _getTraceTime =
+      _lib.lookup<ffi.NativeFunction<_CGetTraceTimeFunc>>('get_trace_time').asFunction();
+  final _AddTraceSpanFunc _addTraceSpan =
+      _lib.lookup<ffi.NativeFunction<_CAddTraceSpanFunc>>('add_trace_span').asFunction();
+  final _ClearTraceFunc _clearTrace = _lib.lookup<ffi.NativeFunction<_CClearTraceFunc>>('clear_trace').asFunction();
+  final _DumpTraceFunc _dumpTrace = _lib.lookup<ffi.NativeFunction<_CDumpTraceFunc>>('dump_trace').asFunction();
+  final _SetTraceRequestU2NetFunc _setTraceRequestU2Net =
+      _lib.lookup<ffi.NativeFunction<_CSetTraceRequestU2NetFunc>>('set_trace_request_u2net').asFunction();
+  final _SetTraceRequestSAMFunc _setTraceRequestSAM =
+      _lib.lookup<ffi.NativeFunction<_CSetTraceRequestSAMFunc>>('set_trace_request_sam').asFunction();
+  // End Trace functions
+
+  // Start MemoryStats functions
+  final _GetStageMemoryFunc _getStageMemory =
+      _lib.lookup<ffi.NativeFunction<_CGetStageMemoryFunc>>('get_stage_memory').asFunction();
+  final _ResetStageMemoryFunc _resetStageMemory =
+      _lib.lookup<ffi.NativeFunction<_CResetStageMemoryFunc>>('reset_stage_memory').asFunction();
+  final _GetMemoryStatsU2NetFunc _getMemoryStatsU2Net =
+      _lib.lookup<ffi.NativeFunction<_CGetMemoryStatsU2NetFunc>>('get_memory_stats_u2net').asFunction();
+  final _ResetMemoryStatsU2NetFunc _resetMemoryStatsU2Net =
+      _lib.lookup<ffi.NativeFunction<_CResetMemoryStatsU2NetFunc>>('reset_memory_stats_u2net').asFunction();
+  final _GetMemoryStatsSAMFunc _getMemoryStatsSAM =
+      _lib.lookup<ffi.NativeFunction<_CGetMemoryStatsSAMFunc>>('get_memory_stats_sam').asFunction();
+  final _ResetMemoryStatsSAMFunc _resetMemoryStatsSAM =
+      _lib.lookup<ffi.NativeFunction<_CResetMemoryStatsSAMFunc>>('reset_memory_stats_sam').asFunction();
+  // End MemoryStats functions
+
   // Wrapper functions
   // U2NetSegmentImage sections
   ffi.Pointer<U2NetSegmentImage> createU2Net() {
@@ -207,18 +1207,51 @@ class CutoutBinding {
     _clearU2Net(u2net);
   }
 
-  Future<Float32List> preprocessU2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath) async {
+  /// [layout] and [activation] are the indices of TensorLayout and
+  /// MaskActivation, which match the native enums.
+  void configureU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net, {
+    required int inputWidth,
+    required int inputHeight,
+    required List<double> mean,
+    required List<double> std,
+    required bool scaleByMax,
+    required int layout,
+    required int activation,
+    required double areaRatio,
+  }) {
+    final meanPointer = calloc<ffi.Float>(3);
+    final stdPointer = calloc<ffi.Float>(3);
+
+    try {
+      meanPointer.asTypedList(3).setAll(0, mean);
+      stdPointer.asTypedList(3).setAll(0, std);
+
+      _configureU2Net(
+        u2net,
+        inputWidth,
+        inputHeight,
+        meanPointer,
+        stdPointer,
+        scaleByMax,
+        layout,
+        activation,
+        areaRatio,
+      );
+    } finally {
+      calloc.free(meanPointer);
+      calloc.free(stdPointer);
+    }
+  }
+
+  /// [size] is the input tensor size, 1 * 3 * inputHeight * inputWidth
+  Future<Float32List> preprocessU2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath, int size) async {
     late final ffi.Pointer<ffi.Float> floatPointer;
     final imagePathPointer = imagePath.toNativeUtf8();
 
     try {
-      // imageSize is a constant value
-      // It will return a float array of size (1 * 3 * 320 * 320) = 307200
-      const outputImageSize = 320;
-      const size = 1 * 3 * outputImageSize * outputImageSize;
-
       // allocate memory for the float array
-      floatPointer = calloc<ffi.Float>(size);
+      floatPointer = TensorAllocator.preprocess<ffi.Float>(size);
       _preprocessU2Net(u2net, imagePathPointer, floatPointer);
       final floatArray = floatPointer.asTypedList(size);
 
@@ -229,8 +1262,198 @@ class CutoutBinding {
       return result;
     } finally {
       // free the memory allocated for the float array
-      calloc.free(floatPointer);
+      TensorAllocator.preprocess.free(floatPointer);
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  /// Builds the input tensor again from the image loaded by the last
+  /// [preprocessU2Net] call, for a model with different input geometry.
+  Future<Float32List> preprocessLoadedU2Net(ffi.Pointer<U2NetSegmentImage> u2net, int size) async {
+    final floatPointer = TensorAllocator.preprocess<ffi.Float>(size);
+
+    try {
+      _preprocessLoadedU2Net(u2net, floatPointer);
+      return Float32List.fromList(floatPointer.asTypedList(size));
+    } finally {
+      TensorAllocator.preprocess.free(floatPointer);
+    }
+  }
+
+  /// Half precision input tensor for fp16-exported models, as raw binary16
+  /// bits. Half the size of the [preprocessU2Net] tensor.
+  Future<Uint16List> preprocessFp16U2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath, int size) async {
+    final halfPointer = TensorAllocator.preprocess<ffi.Uint16>(size);
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      _preprocessFp16U2Net(u2net, imagePathPointer, halfPointer);
+      return Uint16List.fromList(halfPointer.asTypedList(size));
+    } finally {
+      TensorAllocator.preprocess.free(halfPointer);
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  /// Raw uint8 pixels for quantized models that fold mean/std into the graph
+  Future<Uint8List> preprocessUint8U2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath, int size) async {
+    final bytePointer = TensorAllocator.preprocess<ffi.Uint8>(size);
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      _preprocessUint8U2Net(u2net, imagePathPointer, bytePointer);
+      return Uint8List.fromList(bytePointer.asTypedList(size));
+    } finally {
+      TensorAllocator.preprocess.free(bytePointer);
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  /// Output quantization of 8-bit mask exports. Call after [configureU2Net],
+  /// which resets it.
+  void configureQuantizationU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net, {
+    required double scale,
+    required int zeroPoint,
+    required bool isSigned,
+  }) {
+    _configureQuantizationU2Net(u2net, scale, zeroPoint, isSigned);
+  }
+
+  /// [mask] holds the raw uint8/int8 output bytes
+  Future<bool> postprocessQuantizedU2Net(ffi.Pointer<U2NetSegmentImage> u2net, Uint8List mask, String outputPath) async {
+    final maskPointer = TensorAllocator.postprocess<ffi.Uint8>(mask.length);
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      maskPointer.asTypedList(mask.length).setAll(0, mask);
+      return _postprocessQuantizedU2Net(u2net, maskPointer, outputPathPointer);
+    } finally {
+      TensorAllocator.postprocess.free(maskPointer);
+      calloc.free(outputPathPointer);
+    }
+  }
+
+  /// [threshold] is the mean absolute gray level difference, and
+  /// [foregroundRatio] the share of foreground pixels with
+  /// [useBackgroundModel], that count as a change
+  void configureGateU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net, {
+    required bool enabled,
+    required double threshold,
+    required bool useBackgroundModel,
+    required double foregroundRatio,
+  }) {
+    _configureGateU2Net(u2net, enabled, threshold, useBackgroundModel, foregroundRatio);
+  }
+
+  /// Whether the image differs from the last one that was segmented. Always
+  /// true while the gate is disabled.
+  bool isChangedU2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      return _isChangedU2Net(u2net, imagePathPointer);
+    } finally {
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  /// Uses an image decoded once for several pipelines; the next call on its
+  /// path does not decode the file again
+  void setContextU2Net(ffi.Pointer<U2NetSegmentImage> u2net, ffi.Pointer<ImageContext> context) {
+    _setContextU2Net(u2net, context);
+  }
+
+  /// Uses the image [source] loaded, without decoding it again; each
+  /// instance keeps its own model configuration
+  void shareImageU2Net(ffi.Pointer<U2NetSegmentImage> u2net, ffi.Pointer<U2NetSegmentImage> source) {
+    _shareImageU2Net(u2net, source);
+  }
+
+  /// Images whose DCT hash is within [maxHashDistance] bits of a cached one
+  /// and that match it with at least [minInliers] ORB inliers reuse its
+  /// mask; the [capacity] most recent masks are kept
+  void configureDuplicatesU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net, {
+    required bool enabled,
+    required int maxHashDistance,
+    required int minInliers,
+    required int capacity,
+  }) {
+    _configureDuplicatesU2Net(u2net, enabled, maxHashDistance, minInliers, capacity);
+  }
+
+  /// Writes the cutout from the warped mask of a near duplicate and returns
+  /// true, or returns false so the model runs; the image is decoded only
+  /// once either way
+  bool reuseDuplicateU2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath, String outputPath) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      return _reuseDuplicateU2Net(u2net, imagePathPointer, outputPathPointer);
+    } finally {
       calloc.free(imagePathPointer);
+      calloc.free(outputPathPointer);
+    }
+  }
+
+  /// Confidence of a low-res mask in [0, 1]; near-binary masks score high
+  double scoreMaskU2Net(ffi.Pointer<U2NetSegmentImage> u2net, Float32List mask) {
+    final maskPointer = TensorAllocator.postprocess<ffi.Float>(mask.length);
+
+    try {
+      maskPointer.asTypedList(mask.length).setAll(0, mask);
+      return _scoreMaskU2Net(u2net, maskPointer, mask.length);
+    } finally {
+      TensorAllocator.postprocess.free(maskPointer);
+    }
+  }
+
+  /// Returns the model input for the subject region found in [mask], or
+  /// null when the subject already fills most of the image.
+  Future<Float32List?> prepareRoiU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net,
+    Float32List mask,
+    double margin,
+    int size,
+  ) async {
+    final maskPointer = TensorAllocator.postprocess<ffi.Float>(mask.length);
+    final floatPointer = TensorAllocator.preprocess<ffi.Float>(size);
+
+    try {
+      maskPointer.asTypedList(mask.length).setAll(0, mask);
+      if (!_prepareRoiU2Net(u2net, maskPointer, mask.length, margin, floatPointer)) {
+        return null;
+      }
+
+      return Float32List.fromList(floatPointer.asTypedList(size));
+    } finally {
+      TensorAllocator.postprocess.free(maskPointer);
+      TensorAllocator.preprocess.free(floatPointer);
+    }
+  }
+
+  Future<bool> postprocessRoiU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net,
+    Float32List mask,
+    Float32List roiMask,
+    String outputPath,
+  ) async {
+    final maskPointer = TensorAllocator.postprocess<ffi.Float>(mask.length);
+    final roiMaskPointer = TensorAllocator.postprocess<ffi.Float>(roiMask.length);
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      maskPointer.asTypedList(mask.length).setAll(0, mask);
+      roiMaskPointer.asTypedList(roiMask.length).setAll(0, roiMask);
+
+      return _postprocessRoiU2Net(u2net, maskPointer, roiMaskPointer, mask.length, outputPathPointer);
+    } finally {
+      TensorAllocator.postprocess.free(maskPointer);
+      TensorAllocator.postprocess.free(roiMaskPointer);
+      calloc.free(outputPathPointer);
     }
   }
 
@@ -242,7 +1465,7 @@ class CutoutBinding {
       final bytesMaskSize = bytesMask.length;
 
       // convert mask to pointers
-      bytesMaskPointer = calloc<ffi.Float>(bytesMaskSize);
+      bytesMaskPointer = TensorAllocator.postprocess<ffi.Float>(bytesMaskSize);
       final maskBuffer = bytesMaskPointer.asTypedList(bytesMaskSize);
       maskBuffer.setAll(0, bytesMask);
 
@@ -253,7 +1476,7 @@ class CutoutBinding {
         outputPathPointer,
       ));
     } finally {
-      calloc.free(bytesMaskPointer);
+      TensorAllocator.postprocess.free(bytesMaskPointer);
       calloc.free(outputPathPointer);
     }
   }
@@ -275,17 +1498,47 @@ class CutoutBinding {
     return _getTotalPointsSAM(sam);
   }
 
-  Future<Float32List> preprocessSAM(ffi.Pointer<SAMImage> sam, String imagePath) async {
+  void configureSAM(
+    ffi.Pointer<SAMImage> sam, {
+    required int imageSize,
+    required int embeddingDim,
+    required int embeddingSize,
+    required int lowResMaskSize,
+    required double maskThreshold,
+    required List<double> pixelMean,
+    required List<double> pixelStd,
+  }) {
+    final pixelMeanPointer = calloc<ffi.Float>(3);
+    final pixelStdPointer = calloc<ffi.Float>(3);
+
+    try {
+      pixelMeanPointer.asTypedList(3).setAll(0, pixelMean);
+      pixelStdPointer.asTypedList(3).setAll(0, pixelStd);
+
+      _configureSAM(
+        sam,
+        imageSize,
+        embeddingDim,
+        embeddingSize,
+        lowResMaskSize,
+        maskThreshold,
+        pixelMeanPointer,
+        pixelStdPointer,
+      );
+    } finally {
+      calloc.free(pixelMeanPointer);
+      calloc.free(pixelStdPointer);
+    }
+  }
+
+  /// [size] is the encoder input tensor size, 1 * 3 * imageSize * imageSize
+  Future<Float32List> preprocessSAM(ffi.Pointer<SAMImage> sam, String imagePath, int size) async {
     late final ffi.Pointer<ffi.Float> floatPointer;
     final imagePathPointer = imagePath.toNativeUtf8();
 
     try {
-      // imageSize is a constant value
-      // It will return a float array of size (1 * 3 * 1024 * 1024) = 3145728
-      const size = 1 * 3 * 1024 * 1024;
-
       // allocate memory for the float array
-      floatPointer = calloc<ffi.Float>(size);
+      floatPointer = TensorAllocator.preprocess<ffi.Float>(size);
       _preprocessSAM(sam, imagePathPointer, floatPointer);
       final floatArray = floatPointer.asTypedList(size);
 
@@ -295,7 +1548,7 @@ class CutoutBinding {
 
       return result;
     } finally {
-      calloc.free(floatPointer);
+      TensorAllocator.preprocess.free(floatPointer);
       calloc.free(imagePathPointer);
     }
   }
@@ -305,13 +1558,49 @@ class CutoutBinding {
 
     try {
       final featuresSize = features.length;
-      featuresPointer = calloc<ffi.Float>(featuresSize);
+      featuresPointer = TensorAllocator.postprocess<ffi.Float>(featuresSize);
       final featuresBuffer = featuresPointer.asTypedList(featuresSize);
       featuresBuffer.setAll(0, features);
 
       _setFeaturesSAM(sam, featuresPointer, featuresSize);
     } finally {
-      calloc.free(featuresPointer);
+      TensorAllocator.postprocess.free(featuresPointer);
+    }
+  }
+
+  /// Starts a new image from an already decoded context, like
+  /// [preprocessSAM] does from a file
+  void setContextSAM(ffi.Pointer<SAMImage> sam, ffi.Pointer<ImageContext> context) {
+    _setContextSAM(sam, context);
+  }
+
+  /// Without [warpEmbeddings], only images aligned with a cached one to
+  /// within half an embedding cell reuse its embedding
+  void configureDuplicatesSAM(
+    ffi.Pointer<SAMImage> sam, {
+    required bool enabled,
+    required int maxHashDistance,
+    required int minInliers,
+    required int capacity,
+    required bool warpEmbeddings,
+  }) {
+    _configureDuplicatesSAM(sam, enabled, maxHashDistance, minInliers, capacity, warpEmbeddings);
+  }
+
+  /// The warped embedding of a near duplicate, already set on [sam], or
+  /// null when the encoder has to run
+  Float32List? reuseDuplicateSAM(ffi.Pointer<SAMImage> sam, String imagePath, int featuresSize) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+    final featuresPointer = TensorAllocator.postprocess<ffi.Float>(featuresSize);
+
+    try {
+      if (!_reuseDuplicateSAM(sam, imagePathPointer, featuresPointer)) {
+        return null;
+      }
+      return Float32List.fromList(featuresPointer.asTypedList(featuresSize));
+    } finally {
+      calloc.free(imagePathPointer);
+      TensorAllocator.postprocess.free(featuresPointer);
     }
   }
 
@@ -353,18 +1642,45 @@ class CutoutBinding {
       final lowResMasksSize = lowResMasks.length;
 
       // convert scores and lowResMasks to pointers
-      scoresPointer = calloc<ffi.Float>(scoresSize);
+      scoresPointer = TensorAllocator.postprocess<ffi.Float>(scoresSize);
       final scoresBuffer = scoresPointer.asTypedList(scoresSize);
       scoresBuffer.setAll(0, scores);
 
-      lowResMasksPointer = calloc<ffi.Float>(lowResMasksSize);
+      lowResMasksPointer = TensorAllocator.postprocess<ffi.Float>(lowResMasksSize);
       final lowResMasksBuffer = lowResMasksPointer.asTypedList(lowResMasksSize);
       lowResMasksBuffer.setAll(0, lowResMasks);
 
       _postprocessSAM(sam, scoresPointer, scoresSize, lowResMasksPointer, lowResMasksSize);
     } finally {
-      calloc.free(scoresPointer);
-      calloc.free(lowResMasksPointer);
+      TensorAllocator.postprocess.free(scoresPointer);
+      TensorAllocator.postprocess.free(lowResMasksPointer);
+    }
+  }
+
+  /// Quantization of 8-bit low_res_masks outputs. Call after [configureSAM],
+  /// which resets it.
+  void configureQuantizationSAM(
+    ffi.Pointer<SAMImage> sam, {
+    required double scale,
+    required int zeroPoint,
+    required bool isSigned,
+  }) {
+    _configureQuantizationSAM(sam, scale, zeroPoint, isSigned);
+  }
+
+  /// [lowResMasks] holds the raw uint8/int8 decoder output bytes. Masks too
+  /// short for the scores leave no mask instead of being read past.
+  Future<void> postprocessQuantizedSAM(ffi.Pointer<SAMImage> sam, Float32List scores, Uint8List lowResMasks) async {
+    final scoresPointer = TensorAllocator.postprocess<ffi.Float>(scores.length);
+    final lowResMasksPointer = TensorAllocator.postprocess<ffi.Uint8>(lowResMasks.length);
+
+    try {
+      scoresPointer.asTypedList(scores.length).setAll(0, scores);
+      lowResMasksPointer.asTypedList(lowResMasks.length).setAll(0, lowResMasks);
+      _postprocessQuantizedSAM(sam, scoresPointer, scores.length, lowResMasksPointer, lowResMasks.length);
+    } finally {
+      TensorAllocator.postprocess.free(scoresPointer);
+      TensorAllocator.postprocess.free(lowResMasksPointer);
     }
   }
 
@@ -448,4 +1764,702 @@ class CutoutBinding {
   bool checkSetImageSAM(ffi.Pointer<SAMImage> sam) {
     return _checkSetImageSAM(sam);
   }
+
+  int addObjectSAM(ffi.Pointer<SAMImage> sam, String name) {
+    final namePointer = name.toNativeUtf8();
+
+    try {
+      return _addObjectSAM(sam, namePointer);
+    } finally {
+      calloc.free(namePointer);
+    }
+  }
+
+  bool removeObjectSAM(ffi.Pointer<SAMImage> sam, int objectId) {
+    return _removeObjectSAM(sam, objectId);
+  }
+
+  Future<bool> addObjectPointAndLabelSAM(
+    ffi.Pointer<SAMImage> sam,
+    int objectId,
+    Int32List coord,
+    Int32List label,
+  ) async {
+    late final ffi.Pointer<ffi.Int32> coordPointer;
+    late final ffi.Pointer<ffi.Int32> labelPointer;
+
+    try {
+      coordPointer = calloc<ffi.Int32>(coord.length); // must be 2
+      coordPointer.asTypedList(coord.length).setAll(0, coord);
+
+      labelPointer = calloc<ffi.Int32>(label.length); // must be 1
+      labelPointer.asTypedList(label.length).setAll(0, label);
+
+      return _addObjectPointAndLabelSAM(sam, objectId, coordPointer, labelPointer);
+    } finally {
+      calloc.free(coordPointer);
+      calloc.free(labelPointer);
+    }
+  }
+
+  bool popObjectPointAndLabelSAM(ffi.Pointer<SAMImage> sam, int objectId) {
+    return _popObjectPointAndLabelSAM(sam, objectId);
+  }
+
+  int getTotalObjectsSAM(ffi.Pointer<SAMImage> sam) {
+    return _getTotalObjectsSAM(sam);
+  }
+
+  /// Returns the ids of objects whose prompts changed since the last decode
+  /// and the largest prompt count among them.
+  (Int32List, int) getDirtyObjectsSAM(ffi.Pointer<SAMImage> sam) {
+    late final ffi.Pointer<ffi.Int32> objectIdsPointer;
+    late final ffi.Pointer<ffi.Int32> maxPointsPointer;
+
+    try {
+      // Object ids are limited to 1..255 so they fit in the label map
+      const maxObjects = 255;
+      objectIdsPointer = calloc<ffi.Int32>(maxObjects);
+      maxPointsPointer = calloc<ffi.Int32>(1);
+
+      final totalDirty = _getDirtyObjectsSAM(sam, objectIdsPointer, maxPointsPointer);
+      final objectIds = Int32List.fromList(objectIdsPointer.asTypedList(totalDirty));
+
+      return (objectIds, maxPointsPointer.value);
+    } finally {
+      calloc.free(objectIdsPointer);
+      calloc.free(maxPointsPointer);
+    }
+  }
+
+  Future<(Float32List, Float32List)> transformCoordsBatchSAM(
+    ffi.Pointer<SAMImage> sam,
+    Int32List objectIds,
+    int numPoints,
+  ) async {
+    late final ffi.Pointer<ffi.Int32> objectIdsPointer;
+    late final ffi.Pointer<ffi.Float> coordsPointer;
+    late final ffi.Pointer<ffi.Float> labelsPointer;
+
+    try {
+      final batch = objectIds.length;
+      final coordsSize = batch * numPoints * 2;
+      final labelsSize = batch * numPoints;
+
+      objectIdsPointer = calloc<ffi.Int32>(batch);
+      objectIdsPointer.asTypedList(batch).setAll(0, objectIds);
+      coordsPointer = calloc<ffi.Float>(coordsSize);
+      labelsPointer = calloc<ffi.Float>(labelsSize);
+
+      _transformCoordsBatchSAM(sam, objectIdsPointer, batch, numPoints, coordsPointer, labelsPointer);
+
+      return (
+        Float32List.fromList(coordsPointer.asTypedList(coordsSize)),
+        Float32List.fromList(labelsPointer.asTypedList(labelsSize)),
+      );
+    } finally {
+      calloc.free(objectIdsPointer);
+      calloc.free(coordsPointer);
+      calloc.free(labelsPointer);
+    }
+  }
+
+  Future<void> postprocessBatchSAM(
+    ffi.Pointer<SAMImage> sam,
+    Int32List objectIds,
+    Float32List scores,
+    Float32List lowResMasks,
+  ) async {
+    late final ffi.Pointer<ffi.Int32> objectIdsPointer;
+    late final ffi.Pointer<ffi.Float> scoresPointer;
+    late final ffi.Pointer<ffi.Float> lowResMasksPointer;
+
+    try {
+      final batch = objectIds.length;
+      objectIdsPointer = calloc<ffi.Int32>(batch);
+      objectIdsPointer.asTypedList(batch).setAll(0, objectIds);
+
+      scoresPointer = TensorAllocator.postprocess<ffi.Float>(scores.length);
+      scoresPointer.asTypedList(scores.length).setAll(0, scores);
+
+      lowResMasksPointer = TensorAllocator.postprocess<ffi.Float>(lowResMasks.length);
+      lowResMasksPointer.asTypedList(lowResMasks.length).setAll(0, lowResMasks);
+
+      _postprocessBatchSAM(
+        sam,
+        objectIdsPointer,
+        batch,
+        scoresPointer,
+        scores.length,
+        lowResMasksPointer,
+        lowResMasks.length,
+      );
+    } finally {
+      calloc.free(objectIdsPointer);
+      TensorAllocator.postprocess.free(scoresPointer);
+      TensorAllocator.postprocess.free(lowResMasksPointer);
+    }
+  }
+
+  Future<bool> getLabelMapSAM(ffi.Pointer<SAMImage> sam, String labelMapPath) async {
+    final labelMapPathPointer = labelMapPath.toNativeUtf8();
+
+    try {
+      return _getLabelMapSAM(sam, labelMapPathPointer);
+    } finally {
+      calloc.free(labelMapPathPointer);
+    }
+  }
+
+  Future<int> makeStickersSAM(ffi.Pointer<SAMImage> sam, String outputDir) async {
+    final outputDirPointer = outputDir.toNativeUtf8();
+
+    try {
+      return _makeStickersSAM(sam, outputDirPointer);
+    } finally {
+      calloc.free(outputDirPointer);
+    }
+  }
+
+  /// Whether the decoder takes a batch of prompts: null until a batched
+  /// decode was tried
+  bool? getBatchDecodeSAM(ffi.Pointer<SAMImage> sam) {
+    final batchDecode = _getBatchDecodeSAM(sam);
+    return batchDecode == 0 ? null : batchDecode > 0;
+  }
+
+  void setBatchDecodeSAM(ffi.Pointer<SAMImage> sam, bool isSupported) {
+    _setBatchDecodeSAM(sam, isSupported ? 1 : -1);
+  }
+
+  int getPromptBucketSAM(ffi.Pointer<SAMImage> sam, int numPoints) {
+    return _getPromptBucketSAM(sam, numPoints);
+  }
+
+  /// Writes the prompts padded to their bucket size into [buffers] and returns
+  /// views of them, shaped [1, bucket, 2] and [1, bucket].
+  (Float32List, Float32List) transformCoordsPaddedSAM(ffi.Pointer<SAMImage> sam, SAMDecodeBuffers buffers) {
+    final bucket = getPromptBucketSAM(sam, getTotalPointsSAM(sam));
+    final (coordsPointer, labelsPointer) = buffers.prompt(bucket);
+
+    _transformCoordsPaddedSAM(sam, bucket, coordsPointer, labelsPointer);
+    return (coordsPointer.asTypedList(bucket * 2), labelsPointer.asTypedList(bucket));
+  }
+
+  /// Postprocesses the decoder outputs written into [buffers] in place
+  void postprocessSAMFromBuffers(ffi.Pointer<SAMImage> sam, SAMDecodeBuffers buffers) {
+    _postprocessSAM(sam, buffers.scores, buffers.scoresSize, buffers.masks, buffers.masksSize);
+  }
+
+  // U2NetStream sections
+  ffi.Pointer<U2NetStream> createStream() {
+    return _createStream();
+  }
+
+  void destroyStream(ffi.Pointer<U2NetStream> stream) {
+    _destroyStream(stream);
+  }
+
+  void configureStream(
+    ffi.Pointer<U2NetStream> stream, {
+    required int keyframeInterval,
+    required int flowWidth,
+    required double maxMotion,
+  }) {
+    _configureStream(stream, keyframeInterval, flowWidth, maxMotion);
+  }
+
+  /// The stream's own U2Net instance, configured with [configureU2Net]
+  ffi.Pointer<U2NetSegmentImage> getU2NetStream(ffi.Pointer<U2NetStream> stream) {
+    return _getU2NetStream(stream);
+  }
+
+  /// [format] is the index of StreamFrameFormat, which matches the native
+  /// enum. The frame is converted before this returns, so [data] can be
+  /// reused right away.
+  void pushFrameStream(
+    ffi.Pointer<U2NetStream> stream,
+    ffi.Pointer<ffi.Uint8> data, {
+    required int width,
+    required int height,
+    required int stride,
+    required int format,
+    required int rotation,
+    required int timestampUs,
+  }) {
+    _pushFrameStream(stream, data, width, height, stride, format, rotation, timestampUs);
+  }
+
+  /// 0: no new frame, 1: keyframe with the model input written to [input],
+  /// 2: mask propagated to the new frame, 3: frame unchanged, mask kept
+  int pollStream(ffi.Pointer<U2NetStream> stream, ffi.Pointer<ffi.Float> input) {
+    return _pollStream(stream, input);
+  }
+
+  void submitMaskStream(ffi.Pointer<U2NetStream> stream, Float32List mask) {
+    final maskPointer = TensorAllocator.postprocess<ffi.Float>(mask.length);
+
+    try {
+      maskPointer.asTypedList(mask.length).setAll(0, mask);
+      _submitMaskStream(stream, maskPointer, mask.length);
+    } finally {
+      TensorAllocator.postprocess.free(maskPointer);
+    }
+  }
+
+  bool getMaskStream(ffi.Pointer<U2NetStream> stream, ffi.Pointer<ffi.Uint8> output, int width, int height) {
+    return _getMaskStream(stream, output, width, height);
+  }
+
+  void configureGateStream(
+    ffi.Pointer<U2NetStream> stream, {
+    required bool enabled,
+    required double threshold,
+    required bool useBackgroundModel,
+    required double foregroundRatio,
+  }) {
+    _configureGateStream(stream, enabled, threshold, useBackgroundModel, foregroundRatio);
+  }
+
+  /// Frames, keyframes, dropped frames, fps, propagation error and unchanged
+  /// frames
+  List<double> getStatsStream(ffi.Pointer<U2NetStream> stream) {
+    final statsPointer = calloc<ffi.Double>(6);
+
+    try {
+      _getStatsStream(stream, statsPointer);
+      return List<double>.from(statsPointer.asTypedList(6));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  // ResultCache sections
+  ffi.Pointer<ResultCache> createCache() {
+    return _createCache();
+  }
+
+  void destroyCache(ffi.Pointer<ResultCache> cache) {
+    _destroyCache(cache);
+  }
+
+  /// Rebuilds the disk index from [directory]; an empty directory keeps the
+  /// cache in memory only
+  void configureCache(
+    ffi.Pointer<ResultCache> cache, {
+    required String directory,
+    required int memoryBytes,
+    required int diskBytes,
+  }) {
+    final directoryPointer = directory.toNativeUtf8();
+
+    try {
+      _configureCache(cache, directoryPointer, memoryBytes, diskBytes);
+    } finally {
+      calloc.free(directoryPointer);
+    }
+  }
+
+  /// Hash of the encoded image and [modelKey], or 0 when the image cannot be
+  /// read
+  int keyCache(ffi.Pointer<ResultCache> cache, String imagePath, String modelKey) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+    final modelKeyPointer = modelKey.toNativeUtf8();
+
+    try {
+      return _keyCache(cache, imagePathPointer, modelKeyPointer);
+    } finally {
+      calloc.free(imagePathPointer);
+      calloc.free(modelKeyPointer);
+    }
+  }
+
+  /// -1: miss, 0: the run failed before, 1: hit, written to [outputPath]
+  int lookupCache(ffi.Pointer<ResultCache> cache, int key, String outputPath) {
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      return _lookupCache(cache, key, outputPathPointer);
+    } finally {
+      calloc.free(outputPathPointer);
+    }
+  }
+
+  bool storeCache(ffi.Pointer<ResultCache> cache, int key, String outputPath, bool isSuccess) {
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      return _storeCache(cache, key, outputPathPointer, isSuccess);
+    } finally {
+      calloc.free(outputPathPointer);
+    }
+  }
+
+  void clearCache(ffi.Pointer<ResultCache> cache) {
+    _clearCache(cache);
+  }
+
+  // ImageContext sections
+  /// Decodes the image; the returned reference is owned by the caller
+  ffi.Pointer<ImageContext> createImageContext(String imagePath) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      return _createImageContext(imagePathPointer);
+    } finally {
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  void retainImageContext(ffi.Pointer<ImageContext> context) {
+    _retainImageContext(context);
+  }
+
+  void releaseImageContext(ffi.Pointer<ImageContext> context) {
+    _releaseImageContext(context);
+  }
+
+  /// Width and height, or null when the file could not be decoded
+  (int, int)? getSizeImageContext(ffi.Pointer<ImageContext> context) {
+    final widthPointer = calloc<ffi.Int32>();
+    final heightPointer = calloc<ffi.Int32>();
+
+    try {
+      if (!_getSizeImageContext(context, widthPointer, heightPointer)) {
+        return null;
+      }
+      return (widthPointer.value, heightPointer.value);
+    } finally {
+      calloc.free(widthPointer);
+      calloc.free(heightPointer);
+    }
+  }
+
+  // ModelRegistry sections
+  // Sessions are passed around by address, which is valid in every isolate
+
+  /// Session address of [key], or 0 when the caller has to load it and
+  /// [publishModel] it; only a nonzero result adds a holder
+  int acquireModel(String key) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _acquireModel(keyPointer);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  /// The session everyone uses, held by the caller from now on; when it
+  /// differs from [address], the caller lost a race and frees its own.
+  /// [content] identifies the loaded weights, see [getModelContent].
+  int publishModel(String key, int address, int content) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _publishModel(keyPointer, address, content);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  /// Address of a session the caller must free now, or 0
+  int releaseModel(String key) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _releaseModel(keyPointer);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  int leaseModel(String key) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _leaseModel(keyPointer);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  /// Whether the caller must free the session
+  bool returnLeaseModel(int address) {
+    return _returnLeaseModel(address);
+  }
+
+  /// Address of the replaced session when the caller must free it now, or
+  /// 0; [address] itself when nobody holds [key] and nothing was swapped
+  int swapModel(String key, int address, int content) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _swapModel(keyPointer, address, content);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  /// Changes with every swap of [key]; 0 for the model as it was loaded
+  int getModelVersion(String key) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _getModelVersion(keyPointer);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  /// Content identity published with the current session of [key]; 0 when
+  /// it is not loaded
+  int getModelContent(String key) {
+    final keyPointer = key.toNativeUtf8();
+
+    try {
+      return _getModelContent(keyPointer);
+    } finally {
+      calloc.free(keyPointer);
+    }
+  }
+
+  // WarmUp sections
+  /// Initializes OpenCV's thread pool, kernel dispatch and image codecs;
+  /// returns the milliseconds it took
+  double warmUpOpenCV() {
+    return _warmUpOpenCV();
+  }
+
+  /// Writes a synthetic photo for a warm-up pass through a model
+  bool writeWarmUpImage(String imagePath, {int width = 1024, int height = 768}) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      return _writeWarmUpImage(imagePathPointer, width, height);
+    } finally {
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  // Threading sections
+  /// Sets the threads of OpenCV's parallel backend for the whole process
+  void setThreadsOpenCV(int threads) {
+    _setThreadsOpenCV(threads);
+  }
+
+  int getThreadsOpenCV() {
+    return _getThreadsOpenCV();
+  }
+
+  // MatPool sections
+  /// In use, cached and high-water bytes, then cache hits and misses
+  List<int> getPoolStatsU2Net(ffi.Pointer<U2NetSegmentImage> u2net) {
+    final statsPointer = calloc<ffi.Int64>(5);
+
+    try {
+      _getPoolStatsU2Net(u2net, statsPointer);
+      return List<int>.from(statsPointer.asTypedList(5));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  void trimPoolU2Net(ffi.Pointer<U2NetSegmentImage> u2net) {
+    _trimPoolU2Net(u2net);
+  }
+
+  /// In use, cached and high-water bytes, then cache hits and misses
+  List<int> getPoolStatsSAM(ffi.Pointer<SAMImage> sam) {
+    final statsPointer = calloc<ffi.Int64>(5);
+
+    try {
+      _getPoolStatsSAM(sam, statsPointer);
+      return List<int>.from(statsPointer.asTypedList(5));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  void trimPoolSAM(ffi.Pointer<SAMImage> sam) {
+    _trimPoolSAM(sam);
+  }
+
+  // MemoryBudget sections
+  void setMemoryBudget(int bytes) {
+    _setMemoryBudget(bytes);
+  }
+
+  /// Current and peak native bytes, then the budget
+  List<int> getMemoryUsage() {
+    final usagePointer = calloc<ffi.Int64>(3);
+
+    try {
+      _getMemoryUsage(usagePointer);
+      return List<int>.from(usagePointer.asTypedList(3));
+    } finally {
+      calloc.free(usagePointer);
+    }
+  }
+
+  void resetPeakMemory() {
+    _resetPeakMemory();
+  }
+
+  /// Width and height of the file, the decode reduction, the processed
+  /// width and height, the estimated bytes and the rows per strip, or null
+  /// when the header could not be read
+  List<int>? planMemoryBudget(String imagePath) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+    final planPointer = calloc<ffi.Int64>(7);
+
+    try {
+      if (!_planMemoryBudget(imagePathPointer, planPointer)) {
+        return null;
+      }
+      return List<int>.from(planPointer.asTypedList(7));
+    } finally {
+      calloc.free(imagePathPointer);
+      calloc.free(planPointer);
+    }
+  }
+
+  // Strip sections
+  /// Reads the image in strips of [stripRows] rows into a preview for
+  /// [preprocessLoadedU2Net], without decoding it at full size at once
+  bool loadStripsU2Net(ffi.Pointer<U2NetSegmentImage> u2net, String imagePath, int stripRows) {
+    final imagePathPointer = imagePath.toNativeUtf8();
+
+    try {
+      return _loadStripsU2Net(u2net, imagePathPointer, stripRows);
+    } finally {
+      calloc.free(imagePathPointer);
+    }
+  }
+
+  /// Writes the full-resolution cutout of the image loaded with
+  /// [loadStripsU2Net] as a PNG, strip by strip
+  Future<bool> postprocessStripsU2Net(
+    ffi.Pointer<U2NetSegmentImage> u2net,
+    Float32List bytesMask,
+    String outputPath,
+  ) async {
+    final bytesMaskPointer = TensorAllocator.postprocess<ffi.Float>(bytesMask.length);
+    final outputPathPointer = outputPath.toNativeUtf8();
+
+    try {
+      bytesMaskPointer.asTypedList(bytesMask.length).setAll(0, bytesMask);
+      return await Future.value(_postprocessStripsU2Net(
+        u2net,
+        bytesMaskPointer,
+        bytesMask.length,
+        outputPathPointer,
+      ));
+    } finally {
+      TensorAllocator.postprocess.free(bytesMaskPointer);
+      calloc.free(outputPathPointer);
+    }
+  }
+
+  // Trace sections
+  void setTraceEnabled(bool enabled) {
+    _setTraceEnabled(enabled);
+  }
+
+  bool isTraceEnabled() {
+    return _isTraceEnabled();
+  }
+
+  /// False when the system counts none of the perf events
+  bool setTracePerfEnabled(bool enabled) {
+    return _setTracePerfEnabled(enabled);
+  }
+
+  bool isTracePerfEnabled() {
+    return _isTracePerfEnabled();
+  }
+
+  int nextTraceRequest() {
+    return _nextTraceRequest();
+  }
+
+  int getTraceTime() {
+    return _getTraceTime();
+  }
+
+  void addTraceSpan(int stage, int request, int start, int end) {
+    _addTraceSpan(stage, request, start, end);
+  }
+
+  void clearTrace() {
+    _clearTrace();
+  }
+
+  bool dumpTrace(String path) {
+    final pathPointer = path.toNativeUtf8();
+
+    try {
+      return _dumpTrace(pathPointer);
+    } finally {
+      calloc.free(pathPointer);
+    }
+  }
+
+  void setTraceRequestU2Net(ffi.Pointer<U2NetSegmentImage> u2net, int request) {
+    _setTraceRequestU2Net(u2net, request);
+  }
+
+  void setTraceRequestSAM(ffi.Pointer<SAMImage> sam, int request) {
+    _setTraceRequestSAM(sam, request);
+  }
+
+  // MemoryStats sections
+  /// Bytes allocated, live and peak for each native stage, then for
+  /// allocations outside any stage
+  List<int> getStageMemory(int stageCount) {
+    final statsPointer = calloc<ffi.Int64>(stageCount * 3);
+
+    try {
+      _getStageMemory(statsPointer);
+      return List<int>.from(statsPointer.asTypedList(stageCount * 3));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  void resetStageMemory() {
+    _resetStageMemory();
+  }
+
+  /// Bytes allocated, live and peak for the calls of [u2net]
+  List<int> getMemoryStatsU2Net(ffi.Pointer<U2NetSegmentImage> u2net) {
+    final statsPointer = calloc<ffi.Int64>(3);
+
+    try {
+      _getMemoryStatsU2Net(u2net, statsPointer);
+      return List<int>.from(statsPointer.asTypedList(3));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  void resetMemoryStatsU2Net(ffi.Pointer<U2NetSegmentImage> u2net) {
+    _resetMemoryStatsU2Net(u2net);
+  }
+
+  /// Bytes allocated, live and peak for the calls of [sam]
+  List<int> getMemoryStatsSAM(ffi.Pointer<SAMImage> sam) {
+    final statsPointer = calloc<ffi.Int64>(3);
+
+    try {
+      _getMemoryStatsSAM(sam, statsPointer);
+      return List<int>.from(statsPointer.asTypedList(3));
+    } finally {
+      calloc.free(statsPointer);
+    }
+  }
+
+  void resetMemoryStatsSAM(ffi.Pointer<SAMImage> sam) {
+    _resetMemoryStatsSAM(sam);
+  }
 }
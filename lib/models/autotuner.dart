@@ -0,0 +1,271 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:io';
+import 'dart:isolate';
+import 'dart:typed_data';
+
+import 'package:flutter/services.dart';
+import 'package:onnxruntime/onnxruntime.dart';
+
+import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/model_store.dart';
+
+/// Session settings an [Autotuner] picked for one model
+class TunedSettings {
+  final int intraOpThreads;
+  final GraphOptimizationLevel optimizationLevel;
+
+  /// Median run time measured with these settings
+  final Duration latency;
+
+  const TunedSettings({
+    required this.intraOpThreads,
+    required this.optimizationLevel,
+    required this.latency,
+  });
+
+  factory TunedSettings.fromJson(Map<String, dynamic> json) {
+    return TunedSettings(
+      intraOpThreads: json['intraOpThreads'] as int,
+      optimizationLevel: GraphOptimizationLevel.values.byName(json['optimizationLevel'] as String),
+      latency: Duration(microseconds: json['latencyUs'] as int),
+    );
+  }
+
+  Map<String, dynamic> toJson() => {
+        'intraOpThreads': intraOpThreads,
+        'optimizationLevel': optimizationLevel.name,
+        'latencyUs': latency.inMicroseconds,
+      };
+
+  OrtSessionOptions createSessionOptions() {
+    return OrtSessionOptions()
+      ..setIntraOpNumThreads(intraOpThreads)
+      ..setSessionGraphOptimizationLevel(optimizationLevel);
+  }
+}
+
+/// Zero-filled inputs of a model, used to time it
+typedef TuningInputs = Map<String, OrtValue> Function();
+
+/// Picks thread counts and the graph optimization level for each model, and
+/// the thread count of OpenCV's parallel backend, by timing a small grid of
+/// candidates on the device. Defaults are often far off on big.LITTLE
+/// phones, where using every core drags the big cores down to the speed of
+/// the little ones.
+///
+/// Tuning happens once, in the background after first use, while the
+/// models run with default settings; the results are stored as JSON at
+/// [path] and applied from the next `initModel` on, without measuring.
+/// They are measured again when the number of processors changes, e.g.
+/// after a backup was restored on another device. Await [tuned] to know
+/// when a first launch is done tuning.
+///
+/// Pass one tuner to every model; each model is tuned under its asset path.
+class Autotuner {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  /// JSON file the results are kept in, e.g. in the app support directory
+  final String path;
+
+  /// Loads the models to time from files instead of the asset bundle
+  final ModelStore? store;
+
+  /// Timed runs per candidate, after one untimed run
+  final int runs;
+
+  Future<Map<String, dynamic>>? _results;
+  // Tuning in progress, by model path or openCVKey, so a model is tuned
+  // once however many models ask for it at the same time
+  final Map<String, Future<void>> _tuning = {};
+  // Last write of the results; writes are chained so they never overlap
+  Future<void> _saving = Future.value();
+
+  static const openCVKey = 'openCVThreads';
+
+  Autotuner(this.path, {this.store, this.runs = 3});
+
+  /// Completes when the tuning started so far is done and stored
+  Future<void> get tuned async {
+    while (_tuning.isNotEmpty) {
+      await Future.wait(_tuning.values.toList());
+    }
+    await _saving;
+  }
+
+  /// Thread counts worth trying: one, two and four cores, half of them and
+  /// all of them
+  static List<int> get threadCandidates {
+    final processors = Platform.numberOfProcessors;
+    return ({1, 2, 4, processors ~/ 2, processors}.where((threads) => threads >= 1 && threads <= processors).toList())
+      ..sort();
+  }
+
+  /// Session options for [modelPath]: the tuned ones, or defaults while
+  /// [inputs] are timed in the background when it has not been tuned on
+  /// this device yet. The caller releases them.
+  Future<OrtSessionOptions> sessionOptions(String modelPath, TuningInputs inputs) async {
+    final models = (await _load())['models'] as Map<String, dynamic>;
+    final saved = models[modelPath];
+    if (saved != null) {
+      return TunedSettings.fromJson(saved as Map<String, dynamic>).createSessionOptions();
+    }
+
+    _startTuning(modelPath, () async {
+      final settings = await _tuneModel(modelPath, inputs);
+      models[modelPath] = settings.toJson();
+    });
+    return OrtSessionOptions();
+  }
+
+  /// Sets the thread count of OpenCV's parallel backend and returns it, or
+  /// returns null and tunes it in the background, setting it when done
+  Future<int?> applyOpenCVThreads() async {
+    final results = await _load();
+    final threads = results[openCVKey] as int?;
+
+    if (threads == null) {
+      _startTuning(openCVKey, () async {
+        final tunedThreads = await _tuneOpenCVThreads();
+        results[openCVKey] = tunedThreads;
+        _binding.setThreadsOpenCV(tunedThreads);
+      });
+      return null;
+    }
+
+    _binding.setThreadsOpenCV(threads);
+    return threads;
+  }
+
+  /// Runs [tune] unless [key] is already being tuned, then stores the
+  /// results. A failed tuning is retried on the next launch.
+  void _startTuning(String key, Future<void> Function() tune) {
+    _tuning.putIfAbsent(key, () async {
+      try {
+        await tune();
+        await _save();
+      } catch (_) {
+        // Defaults stay in use
+      } finally {
+        _tuning.remove(key);
+      }
+    });
+  }
+
+  Future<int> _tuneOpenCVThreads() async {
+    return await Isolate.run(() {
+      var bestThreads = 0;
+      var bestMilliseconds = double.infinity;
+      for (final candidate in threadCandidates) {
+        _binding.setThreadsOpenCV(candidate);
+        // The first pass starts the thread pool
+        _binding.warmUpOpenCV();
+        final milliseconds = _binding.warmUpOpenCV();
+        if (milliseconds < bestMilliseconds) {
+          bestThreads = candidate;
+          bestMilliseconds = milliseconds;
+        }
+      }
+      return bestThreads;
+    });
+  }
+
+  /// Times the thread counts at full graph optimization first, then the
+  /// lower optimization levels at the best thread count. Each candidate
+  /// loads its own session, so this runs in a background isolate.
+  Future<TunedSettings> _tuneModel(String modelPath, TuningInputs inputs) async {
+    final modelFile = store == null ? null : await store!.resolve(modelPath);
+    final Uint8List? modelBytes;
+    if (modelFile == null) {
+      final rawModelFile = await rootBundle.load(modelPath);
+      modelBytes = rawModelFile.buffer.asUint8List();
+    } else {
+      modelBytes = null;
+    }
+    final runs = this.runs;
+
+    return await Isolate.run(() {
+      OrtEnv.instance.init();
+
+      TunedSettings measure(int intraOpThreads, GraphOptimizationLevel optimizationLevel) {
+        final options = OrtSessionOptions()
+          ..setIntraOpNumThreads(intraOpThreads)
+          ..setSessionGraphOptimizationLevel(optimizationLevel);
+        final session = modelFile != null
+            ? OrtSession.fromFile(File(modelFile), options)
+            : OrtSession.fromBuffer(modelBytes!, options);
+        final values = inputs();
+        final runOptions = OrtRunOptions();
+        final latencies = <Duration>[];
+
+        try {
+          // The first run plans memory and is not timed
+          for (int run = 0; run <= runs; run++) {
+            final stopwatch = Stopwatch()..start();
+            final outputs = session.run(runOptions, values);
+            stopwatch.stop();
+            outputs.forEach((output) => output?.release());
+            if (run > 0) {
+              latencies.add(stopwatch.elapsed);
+            }
+          }
+        } finally {
+          values.forEach((_, value) => value.release());
+          runOptions.release();
+          session.release();
+          options.release();
+        }
+
+        latencies.sort();
+        return TunedSettings(
+          intraOpThreads: intraOpThreads,
+          optimizationLevel: optimizationLevel,
+          latency: latencies[latencies.length ~/ 2],
+        );
+      }
+
+      TunedSettings faster(TunedSettings a, TunedSettings b) => b.latency < a.latency ? b : a;
+
+      var best = threadCandidates
+          .map((threads) => measure(threads, GraphOptimizationLevel.ortEnableAll))
+          .reduce(faster);
+      for (final level in [GraphOptimizationLevel.ortEnableExtended, GraphOptimizationLevel.ortEnableBasic]) {
+        best = faster(best, measure(best.intraOpThreads, level));
+      }
+      return best;
+    });
+  }
+
+  Future<Map<String, dynamic>> _load() {
+    return _results ??= _read();
+  }
+
+  Future<Map<String, dynamic>> _read() async {
+    final processors = Platform.numberOfProcessors;
+    final file = File(path);
+    if (await file.exists()) {
+      try {
+        final json = jsonDecode(await file.readAsString()) as Map<String, dynamic>;
+        if (json['processors'] == processors) {
+          return json;
+        }
+      } on FormatException {
+        // Rewritten below
+      }
+    }
+    return {'processors': processors, 'models': <String, dynamic>{}};
+  }
+
+  // Writes to a temporary file first, so an interrupted write never leaves
+  // a truncated file behind; each write starts after the previous one
+  Future<void> _save() {
+    return _saving = _saving.then((_) async {
+      final results = await _load();
+      final file = File(path);
+      await file.parent.create(recursive: true);
+      final temporary = File('$path.tmp');
+      await temporary.writeAsString(jsonEncode(results), flush: true);
+      await temporary.rename(path);
+    });
+  }
+}
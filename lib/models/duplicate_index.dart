@@ -0,0 +1,30 @@
+/// Reuses the result of a recent near-identical image, such as another shot
+/// of the same burst, warped onto the new image instead of running the model.
+///
+/// Candidates are found by a 64-bit DCT hash and confirmed by matching ORB
+/// features and estimating a homography; the model only runs when no
+/// candidate is confirmed.
+class DuplicateIndex {
+  /// Hash bits that may differ for an image to be a candidate
+  final int maxHashDistance;
+
+  /// Feature matches consistent with the homography needed to accept it
+  final int minInliers;
+
+  /// Number of recent results kept
+  final int capacity;
+
+  /// Lets SAM warp a cached embedding onto a re-framed duplicate, which
+  /// only approximates what the encoder would compute for it. Off by
+  /// default, so SAM only reuses embeddings of images that line up with a
+  /// cached one to within half an embedding cell, such as re-shares and
+  /// re-encodes; U2Net masks are always warped.
+  final bool warpEmbeddings;
+
+  const DuplicateIndex({
+    this.maxHashDistance = 10,
+    this.minInliers = 40,
+    this.capacity = 8,
+    this.warpEmbeddings = false,
+  });
+}
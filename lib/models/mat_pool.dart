@@ -0,0 +1,43 @@
+/// Usage of the native buffer pool of a model session, see
+/// `U2NetModel.poolStats` and `SAMModel.poolStats`.
+///
+/// The full-resolution intermediates of each image (resized masks,
+/// morphology outputs, the cutout) are taken from the pool and returned to
+/// it, so after the first image of a size they do not touch the heap.
+class MatPoolStats {
+  /// Bytes of buffers held by the current image
+  final int inUse;
+
+  /// Bytes of returned buffers kept for the next image
+  final int cached;
+
+  /// Most bytes held at once since the session started or was trimmed
+  final int highWater;
+
+  /// Buffers taken from the pool, and those that had to be allocated
+  final int hits;
+  final int misses;
+
+  const MatPoolStats({
+    required this.inUse,
+    required this.cached,
+    required this.highWater,
+    required this.hits,
+    required this.misses,
+  });
+
+  /// From the values returned by the native stats functions
+  factory MatPoolStats.fromList(List<int> values) {
+    return MatPoolStats(
+      inUse: values[0],
+      cached: values[1],
+      highWater: values[2],
+      hits: values[3],
+      misses: values[4],
+    );
+  }
+
+  @override
+  String toString() =>
+      'MatPoolStats(inUse: $inUse, cached: $cached, highWater: $highWater, hits: $hits, misses: $misses)';
+}
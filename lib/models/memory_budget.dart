@@ -0,0 +1,111 @@
+import 'package:cutout/cutout_binding.dart';
+
+/// Native memory held by the pipelines, see [MemoryBudget.usage]
+class NativeMemoryUsage {
+  /// Bytes of image, mask and cutout buffers allocated now
+  final int current;
+
+  /// Most bytes allocated at once since start or [MemoryBudget.resetPeak]
+  final int peak;
+
+  /// The budget, or zero without one
+  final int budget;
+
+  const NativeMemoryUsage({required this.current, required this.peak, required this.budget});
+
+  @override
+  String toString() => 'NativeMemoryUsage(current: $current, peak: $peak, budget: $budget)';
+}
+
+/// How an image will be decoded under the budget, see [MemoryBudget.plan]
+class DecodePlan {
+  /// Size stored in the file
+  final int width;
+  final int height;
+
+  /// The image is decoded at 1 / [reduction] of its size: 1, 2, 4 or 8
+  final int reduction;
+
+  /// Size the image is processed at, and the cutouts have
+  final int targetWidth;
+  final int targetHeight;
+
+  /// Native bytes the pipelines are expected to need
+  final int estimatedBytes;
+
+  /// Rows per strip when the image fits at full size through the strip
+  /// pipeline but not whole, zero otherwise
+  final int stripRows;
+
+  const DecodePlan({
+    required this.width,
+    required this.height,
+    required this.reduction,
+    required this.targetWidth,
+    required this.targetHeight,
+    required this.estimatedBytes,
+    this.stripRows = 0,
+  });
+
+  bool get isReduced => targetWidth != width || targetHeight != height;
+
+  @override
+  String toString() =>
+      'DecodePlan(${width}x$height -> ${targetWidth}x$targetHeight, reduction: $reduction, estimatedBytes: $estimatedBytes, stripRows: $stripRows)';
+}
+
+/// Process-wide cap on the native memory of U2Net, SAM and shared images.
+///
+/// Before a photo is decoded, only its header is read for the dimensions.
+/// When processing it at full size would not fit in what is left of the
+/// budget, it is decoded at 1/2, 1/4 or 1/8 scale, and shrunk further if
+/// needed, so a 48 MP photo on a low-RAM phone gives a smaller cutout
+/// instead of getting the app killed. JPEGs decode at the reduced scale
+/// directly; other formats are decoded whole first.
+///
+/// Buffers the sessions keep for their next image do not count against
+/// what is left. Photos are never reduced below 320 pixels on their longest
+/// side, which may go over the budget when almost nothing is left.
+///
+/// ```dart
+/// MemoryBudget.set(256 * 1024 * 1024);
+/// ```
+class MemoryBudget {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  MemoryBudget._();
+
+  /// Sets the budget in bytes; zero removes it
+  static void set(int bytes) {
+    _binding.setMemoryBudget(bytes);
+  }
+
+  static NativeMemoryUsage get usage {
+    final values = _binding.getMemoryUsage();
+    return NativeMemoryUsage(current: values[0], peak: values[1], budget: values[2]);
+  }
+
+  /// Restarts the peak from the current usage, e.g. to measure one request
+  static void resetPeak() {
+    _binding.resetPeakMemory();
+  }
+
+  /// How [imagePath] would be decoded now, or null for unknown formats,
+  /// which are always decoded at full size
+  static DecodePlan? plan(String imagePath) {
+    final values = _binding.planMemoryBudget(imagePath);
+    if (values == null) {
+      return null;
+    }
+
+    return DecodePlan(
+      width: values[0],
+      height: values[1],
+      reduction: values[2],
+      targetWidth: values[3],
+      targetHeight: values[4],
+      estimatedBytes: values[5],
+      stripRows: values[6],
+    );
+  }
+}
@@ -0,0 +1,59 @@
+import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/tracing.dart';
+
+/// Native allocations counted since the counters were started or reset, see
+/// `U2NetModel.memoryStats`, `SAMModel.memoryStats` and [StageMemory].
+///
+/// Mats are counted through the native allocator and the tensor buffers
+/// through [TensorAllocator]; buffers from the session pool count while an
+/// image holds them.
+class MemorySnapshot {
+  /// Bytes allocated in total
+  final int allocated;
+
+  /// Bytes allocated and not freed yet
+  final int live;
+
+  /// Most bytes live at once
+  final int peak;
+
+  const MemorySnapshot({
+    required this.allocated,
+    required this.live,
+    required this.peak,
+  });
+
+  /// From the values returned by the native stats functions
+  factory MemorySnapshot.fromList(List<int> values, [int offset = 0]) {
+    return MemorySnapshot(
+      allocated: values[offset],
+      live: values[offset + 1],
+      peak: values[offset + 2],
+    );
+  }
+
+  @override
+  String toString() => 'MemorySnapshot(allocated: $allocated, live: $live, peak: $peak)';
+}
+
+/// Process-wide native allocations by the pipeline stage they were made in.
+/// Allocations outside any stage go to [TraceStage.other].
+///
+/// Counting does not depend on [Tracing] being enabled.
+class StageMemory {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  StageMemory._();
+
+  static Map<TraceStage, MemorySnapshot> snapshot() {
+    final values = _binding.getStageMemory(TraceStage.values.length);
+    return {
+      for (final stage in TraceStage.values) stage: MemorySnapshot.fromList(values, stage.index * 3),
+    };
+  }
+
+  /// Starts the totals and peaks over; live bytes are kept
+  static void reset() {
+    _binding.resetStageMemory();
+  }
+}
@@ -0,0 +1,244 @@
+import 'dart:convert';
+
+import 'package:flutter/foundation.dart';
+import 'package:flutter/services.dart';
+
+/// Affine quantization of an 8-bit model output:
+/// real = (q - zeroPoint) * scale
+class QuantizationParams {
+  final double scale;
+  final int zeroPoint;
+
+  /// int8 output, otherwise uint8
+  final bool isSigned;
+
+  const QuantizationParams({
+    required this.scale,
+    this.zeroPoint = 0,
+    this.isSigned = false,
+  });
+
+  factory QuantizationParams.fromJson(Map<String, dynamic> json) {
+    return QuantizationParams(
+      scale: (json['scale'] as num).toDouble(),
+      zeroPoint: json['zero_point'] ?? 0,
+      isSigned: json['signed'] ?? false,
+    );
+  }
+
+  @override
+  String toString() => '$scale:$zeroPoint:$isSigned';
+
+  static QuantizationParams? _fromJsonOrNull(dynamic json) =>
+      json == null ? null : QuantizationParams.fromJson(json as Map<String, dynamic>);
+}
+
+/// Input geometry and normalization of a SAM encoder/decoder pair.
+///
+/// The native preprocessing, postprocessing and caching code is shared by
+/// every variant; only these values change between them.
+class SAMModelDescriptor {
+  /// Longest side of the encoder input, which is padded to a square
+  final int imageSize;
+
+  /// Image embedding shape is [1, embeddingDim, embeddingSize, embeddingSize]
+  final int embeddingDim;
+  final int embeddingSize;
+
+  /// Decoder masks are [1, numMasks, lowResMaskSize, lowResMaskSize]
+  final int lowResMaskSize;
+  final int numMasks;
+
+  final double maskThreshold;
+  final List<double> pixelMean;
+  final List<double> pixelStd;
+
+  final String imageInputName;
+
+  /// Set for decoders whose low_res_masks output is uint8/int8; the masks
+  /// are then thresholded without being converted to float
+  final QuantizationParams? maskQuantization;
+
+  const SAMModelDescriptor({
+    this.imageSize = 1024,
+    this.embeddingDim = 256,
+    this.embeddingSize = 64,
+    this.lowResMaskSize = 256,
+    this.numMasks = 4,
+    this.maskThreshold = 0.0,
+    this.pixelMean = const [123.675, 116.28, 103.53],
+    this.pixelStd = const [58.395, 57.12, 57.375],
+    this.imageInputName = 'image',
+    this.maskQuantization,
+  });
+
+  /// Original ViT-B/L/H encoders, and MobileSAM, whose TinyViT encoder
+  /// keeps SAM's input geometry, normalization and prompt decoder
+  static const sam = SAMModelDescriptor();
+
+  int get inputTensorSize => 3 * imageSize * imageSize;
+  int get embeddingTensorSize => embeddingDim * embeddingSize * embeddingSize;
+  int get lowResMasksTensorSize => numMasks * lowResMaskSize * lowResMaskSize;
+
+  factory SAMModelDescriptor.fromJson(Map<String, dynamic> json) {
+    const fallback = SAMModelDescriptor.sam;
+
+    return SAMModelDescriptor(
+      imageSize: json['image_size'] ?? fallback.imageSize,
+      embeddingDim: json['embedding_dim'] ?? fallback.embeddingDim,
+      embeddingSize: json['embedding_size'] ?? fallback.embeddingSize,
+      lowResMaskSize: json['low_res_mask_size'] ?? fallback.lowResMaskSize,
+      numMasks: json['num_masks'] ?? fallback.numMasks,
+      maskThreshold: (json['mask_threshold'] ?? fallback.maskThreshold).toDouble(),
+      pixelMean: _toDoubleList(json['pixel_mean']) ?? fallback.pixelMean,
+      pixelStd: _toDoubleList(json['pixel_std']) ?? fallback.pixelStd,
+      imageInputName: json['image_input_name'] ?? fallback.imageInputName,
+      maskQuantization: QuantizationParams._fromJsonOrNull(json['mask_quantization']),
+    );
+  }
+
+  /// Reads a descriptor shipped as a JSON asset next to the model files
+  static Future<SAMModelDescriptor> load(String assetPath) async {
+    final json = jsonDecode(await rootBundle.loadString(assetPath));
+    return SAMModelDescriptor.fromJson(json as Map<String, dynamic>);
+  }
+}
+
+List<double>? _toDoubleList(dynamic value) {
+  if (value == null) return null;
+  return (value as List).map((x) => (x as num).toDouble()).toList();
+}
+
+/// Memory layout of an image input tensor
+enum TensorLayout { nchw, nhwc }
+
+/// Function applied to the raw model output before it is used as a mask
+enum MaskActivation { none, sigmoid }
+
+/// Input geometry, normalization and output handling of a salient-object
+/// model run through the U2Net pipeline.
+class U2NetModelDescriptor {
+  final int inputWidth;
+  final int inputHeight;
+  final List<double> mean;
+  final List<double> std;
+
+  /// Scale pixels by the image maximum (U2Net reference code) or by 255
+  final bool scaleByMax;
+  final TensorLayout layout;
+
+  final String inputName;
+
+  /// Index of the session output holding the [1, 1, H, W] mask
+  final int outputIndex;
+  final MaskActivation activation;
+
+  /// Masks covering less than this share of the input are rejected
+  final double areaRatio;
+
+  /// Feed raw uint8 pixels, for quantized models with mean/std folded into
+  /// the graph or the input quantization parameters
+  final bool uint8Input;
+
+  /// Set for models whose mask output is uint8/int8
+  final QuantizationParams? outputQuantization;
+
+  const U2NetModelDescriptor({
+    this.inputWidth = 320,
+    this.inputHeight = 320,
+    this.mean = const [0.485, 0.456, 0.406],
+    this.std = const [0.229, 0.224, 0.225],
+    this.scaleByMax = true,
+    this.layout = TensorLayout.nchw,
+    this.inputName = 'input.1',
+    this.outputIndex = 0,
+    this.activation = MaskActivation.none,
+    this.areaRatio = 0.05,
+    this.uint8Input = false,
+    this.outputQuantization,
+  });
+
+  /// Full U2Net (176 MB), and the small u2netp (4.7 MB), which has the
+  /// same input and outputs
+  static const u2net = U2NetModelDescriptor();
+
+  /// DIS/ISNet general-use model at 1024x1024; pixels are scaled by 255
+  /// as in its reference code
+  static const isnet = U2NetModelDescriptor(
+    inputWidth: 1024,
+    inputHeight: 1024,
+    mean: [0.5, 0.5, 0.5],
+    std: [1.0, 1.0, 1.0],
+    scaleByMax: false,
+    inputName: 'input_image',
+  );
+
+  /// BiRefNet-lite, which scales pixels by 255 and outputs logits
+  static const birefnetLite = U2NetModelDescriptor(
+    inputWidth: 1024,
+    inputHeight: 1024,
+    scaleByMax: false,
+    inputName: 'input_image',
+    activation: MaskActivation.sigmoid,
+  );
+
+  int get inputTensorSize => 3 * inputWidth * inputHeight;
+  int get maskSize => inputWidth * inputHeight;
+
+  bool get isQuantized => uint8Input || outputQuantization != null;
+
+  List<int> get inputShape =>
+      layout == TensorLayout.nchw ? [1, 3, inputHeight, inputWidth] : [1, inputHeight, inputWidth, 3];
+
+  /// Whether both models take the exact same input tensor for an image
+  bool sharesInputWith(U2NetModelDescriptor other) =>
+      inputWidth == other.inputWidth &&
+      inputHeight == other.inputHeight &&
+      listEquals(mean, other.mean) &&
+      listEquals(std, other.std) &&
+      scaleByMax == other.scaleByMax &&
+      layout == other.layout &&
+      uint8Input == other.uint8Input;
+
+  /// Every value that can change the produced cutout, used as part of
+  /// result cache keys
+  String get identity => [
+        inputWidth,
+        inputHeight,
+        mean.join(','),
+        std.join(','),
+        scaleByMax,
+        layout.name,
+        inputName,
+        outputIndex,
+        activation.name,
+        areaRatio,
+        uint8Input,
+        outputQuantization,
+      ].join('|');
+
+  factory U2NetModelDescriptor.fromJson(Map<String, dynamic> json) {
+    const fallback = U2NetModelDescriptor.u2net;
+
+    return U2NetModelDescriptor(
+      inputWidth: json['input_width'] ?? fallback.inputWidth,
+      inputHeight: json['input_height'] ?? fallback.inputHeight,
+      mean: _toDoubleList(json['mean']) ?? fallback.mean,
+      std: _toDoubleList(json['std']) ?? fallback.std,
+      scaleByMax: json['scale_by_max'] ?? fallback.scaleByMax,
+      layout: json['layout'] == 'nhwc' ? TensorLayout.nhwc : TensorLayout.nchw,
+      inputName: json['input_name'] ?? fallback.inputName,
+      outputIndex: json['output_index'] ?? fallback.outputIndex,
+      activation: json['activation'] == 'sigmoid' ? MaskActivation.sigmoid : MaskActivation.none,
+      areaRatio: (json['area_ratio'] ?? fallback.areaRatio).toDouble(),
+      uint8Input: json['uint8_input'] ?? fallback.uint8Input,
+      outputQuantization: QuantizationParams._fromJsonOrNull(json['output_quantization']),
+    );
+  }
+
+  /// Reads a descriptor shipped as a JSON asset next to the model file
+  static Future<U2NetModelDescriptor> load(String assetPath) async {
+    final json = jsonDecode(await rootBundle.loadString(assetPath));
+    return U2NetModelDescriptor.fromJson(json as Map<String, dynamic>);
+  }
+}
@@ -0,0 +1,125 @@
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:flutter/services.dart';
+import 'package:onnxruntime/onnxruntime.dart';
+
+import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/model_store.dart';
+
+/// Shares one [OrtSession] per model across every model object and isolate
+/// of the process, so two screens using the same model hold its weights
+/// once and load them once.
+///
+/// Model objects [acquire] their models in `initModel` and [release] them
+/// in `release`. Each request runs on a session leased with [use], which
+/// lets [swap] replace a model while requests are running: they finish on
+/// the session they started with, which is freed after the last of them.
+///
+/// Models are keyed by asset path. The session options of the first
+/// holder apply to everyone sharing the model.
+///
+/// Each loaded model also carries a [content] identity, which stays the
+/// same across restarts as long as the weights do, for results cached by
+/// model.
+class ModelRegistry {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  /// Loads the model unless another holder already did. Two holders that
+  /// acquire the same model at the same time may both load it, but only one
+  /// session is kept. A load that throws leaves no holder behind.
+  ///
+  /// With a [store], the session is created from the model file in app
+  /// storage instead of a copy of the asset, and the file size and
+  /// modification time identify its content rather than a hash of it.
+  static Future<void> acquire(String modelPath, OrtSessionOptions options, {ModelStore? store}) async {
+    if (_binding.acquireModel(modelPath) != 0) {
+      return;
+    }
+
+    final OrtSession session;
+    final int content;
+    if (store != null) {
+      final file = File(await store.resolve(modelPath));
+      final stat = await file.stat();
+      content = _hash(ByteData(16)
+        ..setInt64(0, stat.size)
+        ..setInt64(8, stat.modified.microsecondsSinceEpoch));
+      session = OrtSession.fromFile(file, options);
+    } else {
+      final rawModelFile = await rootBundle.load(modelPath);
+      content = _hash(rawModelFile);
+      session = OrtSession.fromBuffer(rawModelFile.buffer.asUint8List(), options);
+    }
+    if (_binding.publishModel(modelPath, session.address, content) != session.address) {
+      session.release();
+    }
+  }
+
+  /// Frees the session once the last holder and request are done with it
+  static void release(String modelPath) {
+    final address = _binding.releaseModel(modelPath);
+    if (address != 0) {
+      OrtSession.fromAddress(address).release();
+    }
+  }
+
+  /// Runs [body] on the current session of an acquired model
+  static Future<T> use<T>(String modelPath, Future<T> Function(OrtSession session) body) async {
+    final address = _binding.leaseModel(modelPath);
+    if (address == 0) {
+      throw StateError('$modelPath is not loaded');
+    }
+
+    final session = OrtSession.fromAddress(address);
+    try {
+      return await body(session);
+    } finally {
+      if (_binding.returnLeaseModel(address)) {
+        session.release();
+      }
+    }
+  }
+
+  /// Identifies the weights currently loaded for [modelPath]: 0 as loaded,
+  /// and a new value after every [swap]
+  static int version(String modelPath) {
+    return _binding.getModelVersion(modelPath);
+  }
+
+  /// Identifies the content of the weights currently loaded for
+  /// [modelPath], the same in every run that loads the same bytes; 0 when
+  /// it is not loaded
+  static int content(String modelPath) {
+    return _binding.getModelContent(modelPath);
+  }
+
+  /// FNV-1a over 8-byte words, never 0. Stable across runs, unlike
+  /// [Object.hash], and fast enough to run once per model load.
+  static int _hash(ByteData data) {
+    int hash = 0xcbf29ce484222325;
+    final words = data.lengthInBytes ~/ 8;
+    for (int i = 0; i < words; i++) {
+      hash = (hash ^ data.getUint64(i * 8, Endian.little)) * 0x100000001b3;
+    }
+    for (int i = words * 8; i < data.lengthInBytes; i++) {
+      hash = (hash ^ data.getUint8(i)) * 0x100000001b3;
+    }
+    return hash == 0 ? 1 : hash;
+  }
+
+  /// Replaces the model for every holder, e.g. with updated weights.
+  /// Requests started before keep their session until they finish. Throws
+  /// a [StateError] when nobody holds the model.
+  static Future<void> swap(String modelPath, Uint8List modelBytes, OrtSessionOptions options) async {
+    final session = OrtSession.fromBuffer(modelBytes, options);
+    final previous = _binding.swapModel(modelPath, session.address, _hash(ByteData.sublistView(modelBytes)));
+    if (previous == session.address) {
+      session.release();
+      throw StateError('$modelPath is not loaded');
+    }
+    if (previous != 0) {
+      OrtSession.fromAddress(previous).release();
+    }
+  }
+}
@@ -0,0 +1,74 @@
+import 'dart:io';
+
+import 'package:flutter/services.dart';
+
+/// Keeps model assets as files in app storage, so sessions are created
+/// from a file path and ONNX Runtime reads the model itself instead of
+/// receiving a copy of it through the Dart heap on every cold start.
+///
+/// An asset is written to [directory] the first time it is needed. When a
+/// `.ort` asset exists next to an `.onnx` one (e.g. `u2net.ort` produced by
+/// `python -m onnxruntime.tools.convert_onnx_models_to_ort`), the
+/// pre-optimized ORT format model is used instead, skipping graph
+/// optimization at load time.
+///
+/// Files are named after the asset and [version]; change [version] when an
+/// app update replaces a model under the same asset path.
+class ModelStore {
+  /// Writable directory for the model files, e.g. the app support directory
+  final String directory;
+
+  final String version;
+
+  const ModelStore(this.directory, {this.version = ''});
+
+  /// Path of the model file for [modelPath], written from the asset bundle
+  /// if needed
+  Future<String> resolve(String modelPath) async {
+    final candidates = [
+      if (modelPath.endsWith('.onnx')) '${modelPath.substring(0, modelPath.length - 5)}.ort',
+      modelPath,
+    ];
+
+    for (final candidate in candidates) {
+      final file = _file(candidate);
+      if (await file.exists()) {
+        return file.path;
+      }
+    }
+
+    for (final candidate in candidates) {
+      final ByteData data;
+      try {
+        data = await rootBundle.load(candidate);
+      } on FlutterError {
+        continue;
+      }
+      return _write(_file(candidate), data);
+    }
+    throw FlutterError('Unable to load asset: $modelPath');
+  }
+
+  File _file(String assetPath) {
+    final name = assetPath.split('/').last;
+    return File('$directory/${version.isEmpty ? name : '$version-$name'}');
+  }
+
+  // Writes to a temporary file first, so an interrupted write never leaves
+  // a truncated model behind. Each write gets its own temporary directory,
+  // as isolates may resolve the same model at once; the last rename wins
+  // with identical content.
+  Future<String> _write(File file, ByteData data) async {
+    await Directory(directory).create(recursive: true);
+    final temporaryDirectory = await Directory(directory).createTemp('.${file.uri.pathSegments.last}.');
+
+    try {
+      final temporary = File('${temporaryDirectory.path}/model.tmp');
+      await temporary.writeAsBytes(data.buffer.asUint8List(data.offsetInBytes, data.lengthInBytes), flush: true);
+      await temporary.rename(file.path);
+      return file.path;
+    } finally {
+      await temporaryDirectory.delete(recursive: true);
+    }
+  }
+}
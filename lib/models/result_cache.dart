@@ -0,0 +1,70 @@
+import 'dart:ffi' as ffi;
+
+import 'package:cutout/cutout_binding.dart';
+
+/// Outcome of a [U2NetResultCache.lookup]
+enum CacheLookup { miss, failure, hit }
+
+/// Stores finished cutouts by a hash of the encoded input file and the model
+/// settings, so resubmitted photos (retries, re-shares, album duplicates)
+/// are answered with a file copy instead of a full model run.
+///
+/// Entries are kept in memory and, when [directory] is given, on disk, each
+/// tier bounded in bytes and evicted least recently used first. The disk
+/// tier survives restarts; pass an app cache directory so the OS may reclaim
+/// it. Failures are only kept in memory, so they are retried after a
+/// restart. A cache can be shared by several models, as their settings and
+/// the content of their weights are part of the key.
+class U2NetResultCache {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  final String directory;
+  final int memoryBytes;
+  final int diskBytes;
+
+  ffi.Pointer<ResultCache>? _cacheInstance;
+
+  U2NetResultCache({
+    this.directory = '',
+    this.memoryBytes = 32 << 20,
+    this.diskBytes = 256 << 20,
+  }) {
+    _cacheInstance = _binding.createCache();
+    _binding.configureCache(
+      _cacheInstance!,
+      directory: directory,
+      memoryBytes: memoryBytes,
+      diskBytes: diskBytes,
+    );
+  }
+
+  /// 0 when the image cannot be read, which is never cached
+  int key(String imagePath, String modelKey) {
+    return _binding.keyCache(_cacheInstance!, imagePath, modelKey);
+  }
+
+  /// Writes the cached cutout to [outputPath] on a hit
+  CacheLookup lookup(int key, String outputPath) {
+    return CacheLookup.values[_binding.lookupCache(_cacheInstance!, key, outputPath) + 1];
+  }
+
+  /// Caches the cutout at [outputPath], or a failure when [isSuccess] is
+  /// false so images without a subject are not run again while this cache
+  /// lives
+  void store(int key, String outputPath, bool isSuccess) {
+    _binding.storeCache(_cacheInstance!, key, outputPath, isSuccess);
+  }
+
+  /// Drops every entry, including the files on disk
+  void clear() {
+    _binding.clearCache(_cacheInstance!);
+  }
+
+  void release() {
+    try {
+      _binding.destroyCache(_cacheInstance!);
+    } finally {
+      _cacheInstance = null;
+    }
+  }
+}
@@ -2,67 +2,188 @@ import 'dart:async';
 import 'dart:ffi' as ffi;
 import 'dart:typed_data';
 
-import 'package:flutter/services.dart';
 import 'package:onnxruntime/onnxruntime.dart';
 
 import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/autotuner.dart';
+import 'package:cutout/models/duplicate_index.dart';
 import 'package:cutout/models/isolate_helper.dart';
+import 'package:cutout/models/mat_pool.dart';
+import 'package:cutout/models/memory_stats.dart';
+import 'package:cutout/models/model_descriptor.dart';
+import 'package:cutout/models/model_registry.dart';
+import 'package:cutout/models/model_store.dart';
+import 'package:cutout/models/shared_image.dart';
+import 'package:cutout/models/tracing.dart';
+import 'package:cutout/models/warm_up.dart';
 
 class SAMModel with IsolateHelperMixin {
   static final CutoutBinding _binding = CutoutBinding();
 
   final String encoderPath;
   final String decoderPath;
-  OrtSessionOptions? _sessionOptions;
-  OrtSession? _encoderSession;
-  OrtSession? _decoderSession;
-  ffi.Pointer<SAMImage>? _samInstance;
 
-  SAMModel(this.encoderPath, this.decoderPath) {
+  /// JSON asset describing the model pair, read in [initModel]. When it is
+  /// not given, [descriptor] is used as is.
+  final String? descriptorPath;
+  SAMModelDescriptor descriptor;
+
+  /// Pads prompts to fixed bucket sizes (4, 8, 16) with the -1 label so the
+  /// decoder sees a handful of stable shapes and reuses its memory plans.
+  final bool paddedPrompts;
+
+  /// Reuses the embedding of a recent near-identical image instead of
+  /// running the encoder; see [DuplicateIndex.warpEmbeddings]
+  final DuplicateIndex? duplicateIndex;
+
+  /// Loads models from files in app storage instead of asset copies
+  final ModelStore? modelStore;
+
+  /// Picks thread counts and graph optimization per model in the
+  /// background on first launch and applies the stored choice afterwards
+  final Autotuner? autotuner;
+  OrtSessionOptions? _encoderSessionOptions;
+  OrtSessionOptions? _decoderSessionOptions;
+  // Models this object holds in the ModelRegistry, released only by it
+  final List<String> _acquiredPaths = [];
+  ffi.Pointer<SAMImage>? _samInstance;
+  // Request of the call in progress, zero without tracing
+  int _traceRequest = 0;
+
+  SAMModel(
+    this.encoderPath,
+    this.decoderPath, {
+    this.paddedPrompts = false,
+    this.descriptorPath,
+    this.descriptor = SAMModelDescriptor.sam,
+    this.duplicateIndex,
+    this.modelStore,
+    this.autotuner,
+  }) {
     OrtEnv.instance.init();
     _samInstance = _binding.createSAM();
   }
 
   Future<void> initModel() async {
-    _sessionOptions = OrtSessionOptions();
+    if (descriptorPath != null) {
+      descriptor = await SAMModelDescriptor.load(descriptorPath!);
+    }
+    _binding.configureSAM(
+      _samInstance!,
+      imageSize: descriptor.imageSize,
+      embeddingDim: descriptor.embeddingDim,
+      embeddingSize: descriptor.embeddingSize,
+      lowResMaskSize: descriptor.lowResMaskSize,
+      maskThreshold: descriptor.maskThreshold,
+      pixelMean: descriptor.pixelMean,
+      pixelStd: descriptor.pixelStd,
+    );
+
+    final quantization = descriptor.maskQuantization;
+    if (quantization != null) {
+      _binding.configureQuantizationSAM(
+        _samInstance!,
+        scale: quantization.scale,
+        zeroPoint: quantization.zeroPoint,
+        isSigned: quantization.isSigned,
+      );
+    }
+
+    if (duplicateIndex != null) {
+      _binding.configureDuplicatesSAM(
+        _samInstance!,
+        enabled: true,
+        maxHashDistance: duplicateIndex!.maxHashDistance,
+        minInliers: duplicateIndex!.minInliers,
+        capacity: duplicateIndex!.capacity,
+        warpEmbeddings: duplicateIndex!.warpEmbeddings,
+      );
+    }
 
-    final rawEncoderModelFile = await rootBundle.load(encoderPath);
-    final encoderModelBytes = rawEncoderModelFile.buffer.asUint8List();
-    _encoderSession = OrtSession.fromBuffer(encoderModelBytes, _sessionOptions!);
+    if (autotuner != null) {
+      _encoderSessionOptions = await autotuner!.sessionOptions(encoderPath, _encoderTuningInputs(descriptor));
+      _decoderSessionOptions =
+          await autotuner!.sessionOptions(decoderPath, _decoderTuningInputs(descriptor, paddedPrompts));
+      await autotuner!.applyOpenCVThreads();
+    } else {
+      _encoderSessionOptions = OrtSessionOptions();
+      _decoderSessionOptions = OrtSessionOptions();
+    }
 
-    final rawDecoderModelFile = await rootBundle.load(decoderPath);
-    final decoderModelBytes = rawDecoderModelFile.buffer.asUint8List();
-    _decoderSession = OrtSession.fromBuffer(decoderModelBytes, _sessionOptions!);
+    // Shared with every other user of the same models in the process
+    await ModelRegistry.acquire(encoderPath, _encoderSessionOptions!, store: modelStore);
+    _acquiredPaths.add(encoderPath);
+    await ModelRegistry.acquire(decoderPath, _decoderSessionOptions!, store: modelStore);
+    _acquiredPaths.add(decoderPath);
   }
 
   Future<void> release() async {
     try {
       _binding.destroySAM(_samInstance!);
-      _encoderSession?.release();
-      _decoderSession?.release();
-      _sessionOptions?.release();
+      _acquiredPaths.forEach(ModelRegistry.release);
+      _encoderSessionOptions?.release();
+      _decoderSessionOptions?.release();
     } finally {
+      _acquiredPaths.clear();
       _samInstance = null;
-      _encoderSession = null;
-      _decoderSession = null;
-      _sessionOptions = null;
+      _encoderSessionOptions = null;
+      _decoderSessionOptions = null;
     }
   }
 
-  Future<Float32List> _encode(Float32List preprocessedImage) async {
-    // Should be input tensor size is [1, 3, 1024, 1024]
-    final inputOrtValue = OrtValueTensor.createTensorWithDataList(preprocessedImage, [1, 3, 1024, 1024]);
+  /// Native buffers kept for the masks of the next prompt or image
+  MatPoolStats get poolStats => MatPoolStats.fromList(_binding.getPoolStatsSAM(_samInstance!));
+
+  /// Frees the buffers kept for the next prompt or image, e.g. when the app
+  /// is asked to reduce its memory use
+  void trimPool() {
+    _binding.trimPoolSAM(_samInstance!);
+  }
+
+  /// Native allocations made by the calls of this model
+  MemorySnapshot get memoryStats => MemorySnapshot.fromList(_binding.getMemoryStatsSAM(_samInstance!));
+
+  /// Starts the totals and peak of [memoryStats] over
+  void resetMemoryStats() {
+    _binding.resetMemoryStatsSAM(_samInstance!);
+  }
+
+  static TuningInputs _encoderTuningInputs(SAMModelDescriptor descriptor) {
+    return () => {
+          descriptor.imageInputName: OrtValueTensor.createTensorWithDataList(
+            Float32List(descriptor.inputTensorSize),
+            [1, 3, descriptor.imageSize, descriptor.imageSize],
+          ),
+        };
+  }
+
+  /// One point plus the padding point, or the smallest prompt bucket
+  static TuningInputs _decoderTuningInputs(SAMModelDescriptor descriptor, bool paddedPrompts) {
+    final totalPoints = paddedPrompts ? SAMDecodeBuffers.promptBuckets.first : 2;
+    return () => {
+          "image_embeddings": OrtValueTensor.createTensorWithDataList(
+            Float32List(descriptor.embeddingTensorSize),
+            [1, descriptor.embeddingDim, descriptor.embeddingSize, descriptor.embeddingSize],
+          ),
+          "point_coords": OrtValueTensor.createTensorWithDataList(Float32List(totalPoints * 2), [1, totalPoints, 2]),
+          "point_labels": OrtValueTensor.createTensorWithDataList(Float32List(totalPoints), [1, totalPoints]),
+        };
+  }
+
+  Future<Float32List> _encode(OrtSession session, Float32List preprocessedImage) async {
+    // Should be input tensor size is [1, 3, imageSize, imageSize]
+    final imageSize = descriptor.imageSize;
+    final inputOrtValue = OrtValueTensor.createTensorWithDataList(preprocessedImage, [1, 3, imageSize, imageSize]);
     final runOptions = OrtRunOptions();
-    // Input name should be "image"
-    final inputs = {"image": inputOrtValue};
+    final inputs = {descriptor.imageInputName: inputOrtValue};
     final List<OrtValue?>? outputs;
-    outputs = _encoderSession?.run(runOptions, inputs);
+    outputs = Tracing.measure(TraceStage.inference, _traceRequest, () => session.run(runOptions, inputs));
 
     inputOrtValue.release();
     runOptions.release();
 
-    // output is [1, 256, 64, 64]
-    final output = (outputs?[0]?.value as List<List<List<List<double>>>>)[0]; // [256, 64, 64]
+    // output is [1, embeddingDim, embeddingSize, embeddingSize]
+    final output = (outputs?[0]?.value as List<List<List<List<double>>>>)[0];
 
     // Release the outputs
     outputs?.forEach((output) => output?.release());
@@ -70,15 +191,24 @@ class SAMModel with IsolateHelperMixin {
     return Float32List.fromList(output.expand((x) => x.expand((y) => y)).toList());
   }
 
-  Future<(Float32List, Float32List)> _decode(
+  List<int> get _embeddingShape =>
+      [1, descriptor.embeddingDim, descriptor.embeddingSize, descriptor.embeddingSize];
+
+  /// Runs the decoder for a single prompt set and returns the first batch
+  /// entry of the scores and masks outputs. The input OrtValues and the
+  /// nested output Lists are still created on every run: the onnxruntime
+  /// package copies inputs into its own tensors and has no way to bind
+  /// preallocated outputs.
+  Future<(List, List)> _runDecoder(
+    OrtSession session,
     Float32List features,
     Float32List transformedCoords,
     Float32List transformedLabels,
   ) async {
     final totalPoints = transformedLabels.length;
 
-    // Should be features tensor size is [1, 256, 64, 64]
-    final featuresOrtValue = OrtValueTensor.createTensorWithDataList(features, [1, 256, 64, 64]);
+    // Should be features tensor size is [1, embeddingDim, embeddingSize, embeddingSize]
+    final featuresOrtValue = OrtValueTensor.createTensorWithDataList(features, _embeddingShape);
     // Should be coords tensor size is [1, n, 2]
     final coordsOrtValue = OrtValueTensor.createTensorWithDataList(transformedCoords, [1, totalPoints, 2]);
     // Should be labels tensor size is [1, n]
@@ -91,32 +221,188 @@ class SAMModel with IsolateHelperMixin {
       "point_labels": labelsOrtValue
     };
     final List<OrtValue?>? outputs;
-    outputs = _decoderSession?.run(runOptions, inputs);
+    outputs = Tracing.measure(TraceStage.inference, _traceRequest, () => session.run(runOptions, inputs));
+
+    featuresOrtValue.release();
+    coordsOrtValue.release();
+    labelsOrtValue.release();
+    runOptions.release();
+
+    // scores is [1, numMasks]
+    // masks is [1, numMasks, lowResMaskSize, lowResMaskSize]
+    final scores = (outputs?[0]?.value as List)[0] as List;
+    final masks = (outputs?[1]?.value as List)[0] as List;
+
+    // Release the outputs
+    outputs?.forEach((output) => output?.release());
+
+    return (scores, masks);
+  }
+
+  Future<(Float32List, Float32List)> _decode(
+    OrtSession session,
+    Float32List features,
+    Float32List transformedCoords,
+    Float32List transformedLabels,
+  ) async {
+    final (scores, masks) = await _runDecoder(session, features, transformedCoords, transformedLabels);
+
+    // Flatten the output
+    return (
+      Float32List.fromList(scores as List<double>),
+      Float32List.fromList(masks.expand((x) => (x as List).expand((y) => y as List<double>)).toList()),
+    );
+  }
+
+  /// Runs the decoder and writes the first batch entry of its outputs into
+  /// [buffers], row by row from the session output
+  Future<void> _decodeInto(
+    OrtSession session,
+    Float32List features,
+    Float32List transformedCoords,
+    Float32List transformedLabels,
+    SAMDecodeBuffers buffers,
+  ) async {
+    final (scores, masks) = await _runDecoder(session, features, transformedCoords, transformedLabels);
+
+    buffers.scoresList.setAll(0, scores.cast<double>());
+    final masksList = buffers.masksList;
+    int offset = 0;
+    for (final mask in masks) {
+      for (final row in mask as List) {
+        masksList.setAll(offset, (row as List).cast<double>());
+        offset += row.length;
+      }
+    }
+  }
+
+  /// Decoder with uint8/int8 masks and float IoU scores; int8 values wrap to
+  /// their two's complement bytes, which is what the native side expects
+  Future<(Float32List, Uint8List)> _decodeQuantized(
+    OrtSession session,
+    Float32List features,
+    Float32List transformedCoords,
+    Float32List transformedLabels,
+  ) async {
+    final (scores, masks) = await _runDecoder(session, features, transformedCoords, transformedLabels);
+
+    return (
+      Float32List.fromList(scores as List<double>),
+      Uint8List.fromList(masks.expand((x) => (x as List).expand((y) => y as List<int>)).toList()),
+    );
+  }
+
+  Future<(Float32List, Float32List)> _decodeBatch(
+    OrtSession session,
+    Float32List features,
+    Float32List transformedCoords,
+    Float32List transformedLabels,
+    int batch,
+    int numPoints,
+  ) async {
+    // Every object shares the same image embedding
+    final featuresOrtValue = OrtValueTensor.createTensorWithDataList(features, _embeddingShape);
+    // Should be coords tensor size is [B, n, 2]
+    final coordsOrtValue = OrtValueTensor.createTensorWithDataList(transformedCoords, [batch, numPoints, 2]);
+    // Should be labels tensor size is [B, n]
+    final labelsOrtValue = OrtValueTensor.createTensorWithDataList(transformedLabels, [batch, numPoints]);
+
+    final runOptions = OrtRunOptions();
+    final inputs = {
+      "image_embeddings": featuresOrtValue,
+      "point_coords": coordsOrtValue,
+      "point_labels": labelsOrtValue
+    };
+    final List<OrtValue?>? outputs;
+    outputs = Tracing.measure(TraceStage.inference, _traceRequest, () => session.run(runOptions, inputs));
 
     featuresOrtValue.release();
     coordsOrtValue.release();
     labelsOrtValue.release();
     runOptions.release();
 
-    // scores is [1, 4]
-    // masks is [1, 4, 256, 256]
-    final scores = (outputs?[0]?.value as List<List<double>>)[0]; // [4]
-    final masks = (outputs?[1]?.value as List<List<List<List<double>>>>)[0]; // [4, 256, 256]
+    // scores is [B, numMasks]
+    // masks is [B, numMasks, lowResMaskSize, lowResMaskSize]
+    final scores = outputs?[0]?.value as List<List<double>>;
+    final masks = outputs?[1]?.value as List<List<List<List<double>>>>;
 
     // Release the outputs
     outputs?.forEach((output) => output?.release());
 
     // Flatten the output
     return (
-      Float32List.fromList(scores),
-      Float32List.fromList(masks.expand((x) => x.expand((y) => y)).toList()),
+      Float32List.fromList(scores.expand((x) => x).toList()),
+      Float32List.fromList(masks.expand((x) => x.expand((y) => y.expand((z) => z))).toList()),
     );
   }
 
-  Future<(bool, Float32List?)> preprocessAndEncode(String imagePath) async {
+  /// Decodes every object in one run when the decoder takes a batch of
+  /// prompts, and one object per run otherwise. Many exports fix the batch
+  /// at one, which the session does not tell, so the first batch with more
+  /// than one object finds out: the session rejects the input dimensions,
+  /// or the outputs have another batch size or nesting. The answer is kept
+  /// on the native instance for the following calls. Any other error is
+  /// rethrown and leaves the answer open.
+  Future<(Float32List, Float32List)> _decodeObjects(
+    OrtSession session,
+    Float32List features,
+    Float32List transformedCoords,
+    Float32List transformedLabels,
+    int batch,
+    int numPoints,
+  ) async {
+    if (batch > 1 && _binding.getBatchDecodeSAM(_samInstance!) != false) {
+      try {
+        final (scores, masks) =
+            await _decodeBatch(session, features, transformedCoords, transformedLabels, batch, numPoints);
+        if (scores.length == batch * descriptor.numMasks && masks.length == batch * descriptor.lowResMasksTensorSize) {
+          _binding.setBatchDecodeSAM(_samInstance!, true);
+          return (scores, masks);
+        }
+      } on OrtException catch (e) {
+        // Input dimensions the model does not accept
+        if (e.code != OrtErrorCode.invalidArgument) {
+          rethrow;
+        }
+      } on TypeError {
+        // Outputs nested other than [B, numMasks, ...]
+      }
+      _binding.setBatchDecodeSAM(_samInstance!, false);
+    }
+
+    final scores = Float32List(batch * descriptor.numMasks);
+    final masks = Float32List(batch * descriptor.lowResMasksTensorSize);
+    for (int i = 0; i < batch; i++) {
+      final (objectScores, objectMasks) = await _decode(
+        session,
+        features,
+        transformedCoords.sublist(i * numPoints * 2, (i + 1) * numPoints * 2),
+        transformedLabels.sublist(i * numPoints, (i + 1) * numPoints),
+      );
+      scores.setAll(i * descriptor.numMasks, objectScores);
+      masks.setAll(i * descriptor.lowResMasksTensorSize, objectMasks);
+    }
+    return (scores, masks);
+  }
+
+  /// Pass [image] when the photo at [imagePath] is already decoded, e.g. by
+  /// an auto-cutout; stickers are then exported from the same pixels.
+  Future<(bool, Float32List?)> preprocessAndEncode(String imagePath, {SharedImage? image}) async {
     return await loadWithIsolate(() async {
-      final preprocessedImage = await _binding.preprocessSAM(_samInstance!, imagePath);
-      final features = await _encode(preprocessedImage);
+      _beginTrace();
+      if (image != null) {
+        _binding.setContextSAM(_samInstance!, image.instance);
+      }
+
+      if (duplicateIndex != null) {
+        final reusedFeatures = _binding.reuseDuplicateSAM(_samInstance!, imagePath, descriptor.embeddingTensorSize);
+        if (reusedFeatures != null) {
+          return (_binding.checkSetImageSAM(_samInstance!), reusedFeatures);
+        }
+      }
+
+      final preprocessedImage = await _binding.preprocessSAM(_samInstance!, imagePath, descriptor.inputTensorSize);
+      final features = await ModelRegistry.use(encoderPath, (session) => _encode(session, preprocessedImage));
       await _binding.setFeaturesSAM(_samInstance!, features);
 
       final isSuccess = _binding.checkSetImageSAM(_samInstance!);
@@ -127,14 +413,154 @@ class SAMModel with IsolateHelperMixin {
 
   Future<bool> invokeSAM(Float32List features, String maskPath) async {
     return await loadWithIsolate(() async {
-      final (transformedCoords, transformedLabels) = await _binding.transformCoordsSAM(_samInstance!);
-      final (scores, masks) = await _decode(features, transformedCoords, transformedLabels);
+      _beginTrace();
+      final buffers = paddedPrompts ? _newDecodeBuffers() : null;
+
+      try {
+        final (transformedCoords, transformedLabels) = buffers != null
+            ? _binding.transformCoordsPaddedSAM(_samInstance!, buffers)
+            : await _binding.transformCoordsSAM(_samInstance!);
+
+        if (descriptor.maskQuantization != null) {
+          final (scores, masks) = await ModelRegistry.use(
+            decoderPath,
+            (session) => _decodeQuantized(session, features, transformedCoords, transformedLabels),
+          );
+          await _binding.postprocessQuantizedSAM(_samInstance!, scores, masks);
+        } else if (buffers != null) {
+          await ModelRegistry.use(
+            decoderPath,
+            (session) => _decodeInto(session, features, transformedCoords, transformedLabels, buffers),
+          );
+          _binding.postprocessSAMFromBuffers(_samInstance!, buffers);
+        } else {
+          final (scores, masks) = await ModelRegistry.use(
+            decoderPath,
+            (session) => _decode(session, features, transformedCoords, transformedLabels),
+          );
+          await _binding.postprocessSAM(_samInstance!, scores, masks);
+        }
+
+        _binding.getMaskSAM(_samInstance!, maskPath);
+
+        return true;
+      } finally {
+        buffers?.release();
+      }
+    });
+  }
 
-      _binding.postprocessSAM(_samInstance!, scores, masks);
+  /// Buffers of the padded decoder runs of one call, taken from the native
+  /// instance's pool so the following calls reuse them; concurrent calls
+  /// each take their own
+  SAMDecodeBuffers _newDecodeBuffers() {
+    return SAMDecodeBuffers(
+      _samInstance!,
+      scoresSize: descriptor.numMasks,
+      masksSize: descriptor.lowResMasksTensorSize,
+    );
+  }
 
-      _binding.getMaskSAM(_samInstance!, maskPath);
+  /// Encodes a synthetic photo and decodes prompts on it, so the first
+  /// [preprocessAndEncode] and [invokeSAM] are as fast as the following
+  /// ones. With [paddedPrompts], every prompt bucket is decoded once so each
+  /// decoder shape is planned.
+  ///
+  /// The current image and prompts are cleared. Two temporary files are
+  /// written to a new directory in [scratchDirectory] and deleted
+  /// afterwards.
+  Future<WarmUpStats> warmUp(String scratchDirectory) async {
+    return await loadWithIsolate(() async {
+      final timer = WarmUpTimer();
+      final openCVMilliseconds = _binding.warmUpOpenCV();
+      timer.add(WarmUpStage.opencv, Duration(microseconds: (openCVMilliseconds * 1000).round()));
+
+      const width = 1024, height = 768;
+      final files = await WarmUpFiles.create(scratchDirectory);
+      final imagePath = files.imagePath;
+      final maskPath = files.outputPath;
+      final buffers = paddedPrompts ? _newDecodeBuffers() : null;
+
+      try {
+        _binding.writeWarmUpImage(imagePath, width: width, height: height);
+
+        final preprocessedImage = await timer.measure(
+          WarmUpStage.preprocess,
+          () => _binding.preprocessSAM(_samInstance!, imagePath, descriptor.inputTensorSize),
+        );
+        final features = await timer.measure(
+          WarmUpStage.inference,
+          () => ModelRegistry.use(encoderPath, (session) => _encode(session, preprocessedImage)),
+        );
+        await _binding.setFeaturesSAM(_samInstance!, features);
+
+        // Points on the synthetic subject, one more per decoder run until
+        // every bucket was used once
+        final decodedShapes = <int>{};
+        for (int point = 0; point < SAMDecodeBuffers.promptBuckets.last; point++) {
+          await _binding.addPointAndLabelSAM(
+            _samInstance!,
+            Int32List.fromList([width ~/ 2 + (point % 4 - 2) * 20, height ~/ 2 + (point ~/ 4 - 2) * 20]),
+            Int32List.fromList([1]),
+          );
+
+          final (transformedCoords, transformedLabels) = buffers != null
+              ? _binding.transformCoordsPaddedSAM(_samInstance!, buffers)
+              : await _binding.transformCoordsSAM(_samInstance!);
+          if (!decodedShapes.add(transformedLabels.length)) {
+            continue;
+          }
+
+          if (descriptor.maskQuantization != null) {
+            final (scores, masks) = await timer.measure(
+              WarmUpStage.inference,
+              () => ModelRegistry.use(
+                decoderPath,
+                (session) => _decodeQuantized(session, features, transformedCoords, transformedLabels),
+              ),
+            );
+            await timer.measure(
+              WarmUpStage.postprocess,
+              () => _binding.postprocessQuantizedSAM(_samInstance!, scores, masks),
+            );
+          } else if (buffers != null) {
+            await timer.measure(
+              WarmUpStage.inference,
+              () => ModelRegistry.use(
+                decoderPath,
+                (session) => _decodeInto(session, features, transformedCoords, transformedLabels, buffers),
+              ),
+            );
+            await timer.measure(
+              WarmUpStage.postprocess,
+              () async => _binding.postprocessSAMFromBuffers(_samInstance!, buffers),
+            );
+          } else {
+            final (scores, masks) = await timer.measure(
+              WarmUpStage.inference,
+              () => ModelRegistry.use(
+                decoderPath,
+                (session) => _decode(session, features, transformedCoords, transformedLabels),
+              ),
+            );
+            await timer.measure(
+              WarmUpStage.postprocess,
+              () => _binding.postprocessSAM(_samInstance!, scores, masks),
+            );
+          }
+          await timer.measure(WarmUpStage.postprocess, () => _binding.getMaskSAM(_samInstance!, maskPath));
+
+          if (!paddedPrompts) {
+            break;
+          }
+        }
+      } finally {
+        buffers?.release();
+        _binding.clearSAM(_samInstance!);
+        await files.delete();
+      }
 
-      return true;
+      return timer.stats;
     });
   }
 
@@ -181,9 +607,90 @@ class SAMModel with IsolateHelperMixin {
     });
   }
 
+  /// Starts a request for the spans of one call, see [Tracing]
+  void _beginTrace() {
+    _traceRequest = Tracing.nextRequest();
+    _binding.setTraceRequestSAM(_samInstance!, _traceRequest);
+  }
+
   Future<void> makeSticker(String outputPath) async {
     return await loadWithIsolate(() async {
+      _beginTrace();
       _binding.makeStickerSAM(_samInstance!, outputPath);
     });
   }
+
+  /// Adds a named object to the current image and returns its id, which is
+  /// also its value in the label map. The name becomes the sticker file name
+  /// in [makeStickers], so it must be a plain file name: not empty, `.` or
+  /// `..`, and without `/` or `\`. Returns -1 for other names or when no id
+  /// is left.
+  Future<int> addObject(String name) async {
+    return await loadWithIsolate(() async {
+      return _binding.addObjectSAM(_samInstance!, name);
+    });
+  }
+
+  Future<bool> removeObject(int objectId) async {
+    return await loadWithIsolate(() async {
+      return _binding.removeObjectSAM(_samInstance!, objectId);
+    });
+  }
+
+  Future<void> addObjectPointAndLabel(int objectId, Int32List coord, Int32List label) async {
+    return await loadWithIsolate(() async {
+      await _binding.addObjectPointAndLabelSAM(_samInstance!, objectId, coord, label);
+    });
+  }
+
+  Future<void> popObjectPointAndLabel(int objectId) async {
+    return await loadWithIsolate(() async {
+      _binding.popObjectPointAndLabelSAM(_samInstance!, objectId);
+    });
+  }
+
+  Future<int> getTotalObjects() async {
+    return await loadWithIsolate(() async {
+      return _binding.getTotalObjectsSAM(_samInstance!);
+    });
+  }
+
+  /// Decodes every object whose prompts changed in a single decoder run and
+  /// writes the composited label map. Returns the ids of the updated objects.
+  ///
+  /// Throws an [UnsupportedError] for decoders with quantized masks (see
+  /// [SAMModelDescriptor.maskQuantization]), which only [invokeSAM] handles.
+  Future<List<int>> invokeObjects(Float32List features, String labelMapPath) async {
+    if (descriptor.maskQuantization != null) {
+      throw UnsupportedError('Multi-object decoding needs a decoder with float masks');
+    }
+    return await loadWithIsolate(() async {
+      _beginTrace();
+      final (objectIds, dirtyMaxPoints) = _binding.getDirtyObjectsSAM(_samInstance!);
+      final maxPoints = paddedPrompts ? _binding.getPromptBucketSAM(_samInstance!, dirtyMaxPoints) : dirtyMaxPoints;
+
+      if (objectIds.isNotEmpty) {
+        final (transformedCoords, transformedLabels) =
+            await _binding.transformCoordsBatchSAM(_samInstance!, objectIds, maxPoints);
+        final (scores, masks) = await ModelRegistry.use(
+          decoderPath,
+          (session) => _decodeObjects(session, features, transformedCoords, transformedLabels, objectIds.length, maxPoints),
+        );
+
+        await _binding.postprocessBatchSAM(_samInstance!, objectIds, scores, masks);
+      }
+
+      await _binding.getLabelMapSAM(_samInstance!, labelMapPath);
+
+      return objectIds.toList();
+    });
+  }
+
+  /// Writes one sticker per object as `<outputDir>/<name>.png`
+  Future<int> makeStickers(String outputDir) async {
+    return await loadWithIsolate(() async {
+      _beginTrace();
+      return await _binding.makeStickersSAM(_samInstance!, outputDir);
+    });
+  }
 }
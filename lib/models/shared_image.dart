@@ -0,0 +1,38 @@
+import 'dart:ffi' as ffi;
+import 'dart:isolate';
+
+import 'package:cutout/cutout_binding.dart';
+
+/// A photo decoded once and shared by [U2NetModel], [SAMModel] and sticker
+/// export, e.g. for an auto-cutout followed by SAM refinement.
+///
+/// Downscaled pyramid levels are built on first use and shared too. Every
+/// model that uses the image keeps its own native reference, so [release]
+/// may be called as soon as this side is done with it.
+class SharedImage {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  final String path;
+  ffi.Pointer<ImageContext>? _contextInstance;
+
+  SharedImage._(this.path, this._contextInstance);
+
+  /// Decodes [path] in a background isolate
+  static Future<SharedImage> decode(String path) async {
+    final address = await Isolate.run(() => _binding.createImageContext(path).address);
+    return SharedImage._(path, ffi.Pointer<ImageContext>.fromAddress(address));
+  }
+
+  ffi.Pointer<ImageContext> get instance => _contextInstance!;
+
+  /// Width and height, or null when the file could not be decoded
+  (int, int)? get size => _binding.getSizeImageContext(_contextInstance!);
+
+  void release() {
+    try {
+      _binding.releaseImageContext(_contextInstance!);
+    } finally {
+      _contextInstance = null;
+    }
+  }
+}
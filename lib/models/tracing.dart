@@ -0,0 +1,107 @@
+import 'package:cutout/cutout_binding.dart';
+
+/// Stages that spans are recorded for, in the order of the native enum.
+/// [preprocess], [postprocess] and [sticker] span a whole native call and
+/// contain the other stages.
+enum TraceStage {
+  preprocess,
+  postprocess,
+  sticker,
+  decode,
+  resize,
+
+  /// Normalization and layout conversion, which run as one pass
+  normalize,
+  inference,
+  upsample,
+  morphology,
+  composite,
+  encode,
+
+  /// Outside any stage; only used for memory, see `StageMemory`
+  other,
+}
+
+/// Per-stage tracing of the native pipelines and the model sessions.
+///
+/// Spans go into a process-wide native ring buffer that keeps the most
+/// recent 32768, so tracing can stay on in a test build and be dumped when
+/// something looks slow. Each `run` of a model, and each SAM encode or
+/// decode, gets its own request ID, which all of its spans carry. While
+/// disabled, a native span costs one atomic load.
+///
+/// ```dart
+/// Tracing.enable();
+/// await model.run(imagePath, outputPath);
+/// Tracing.dump('${directory.path}/cutout_trace.json');
+/// ```
+///
+/// The dump is Chrome trace event JSON, which Perfetto
+/// (https://ui.perfetto.dev) and chrome://tracing open.
+///
+/// On Linux, including Android builds that allow it, [enablePerfCounters]
+/// adds hardware counters to the native spans: cycles, instructions,
+/// cache misses, branch misses and page faults, with the IPC and the
+/// memory traffic per pixel of the image derived from them. They tell
+/// memory-bound stages from compute-bound ones; reading them costs a few
+/// system calls per span.
+class Tracing {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  Tracing._();
+
+  /// Models run in their own isolates, so this is read from the native
+  /// side rather than cached
+  static bool get isEnabled => _binding.isTraceEnabled();
+
+  static void enable() {
+    _binding.setTraceEnabled(true);
+  }
+
+  static void disable() {
+    _binding.setTraceEnabled(false);
+  }
+
+  /// Whether the native spans carry perf counters
+  static bool get isPerfEnabled => _binding.isTracePerfEnabled();
+
+  /// False, and nothing changes, when the system counts none of the events,
+  /// e.g. without `perf_event_open` access
+  static bool enablePerfCounters() {
+    return _binding.setTracePerfEnabled(true);
+  }
+
+  static void disablePerfCounters() {
+    _binding.setTracePerfEnabled(false);
+  }
+
+  /// Drops the spans recorded so far
+  static void clear() {
+    _binding.clearTrace();
+  }
+
+  /// Writes the recorded spans to [path]; false when it could not be written
+  static bool dump(String path) {
+    return _binding.dumpTrace(path);
+  }
+
+  /// A new request ID, or zero while tracing is disabled
+  static int nextRequest() {
+    return _binding.nextTraceRequest();
+  }
+
+  /// Runs [function] and records it as a span of [stage], on the clock of
+  /// the native spans so they line up. Nothing is recorded for request zero.
+  static T measure<T>(TraceStage stage, int request, T Function() function) {
+    if (request == 0) {
+      return function();
+    }
+
+    final start = _binding.getTraceTime();
+    try {
+      return function();
+    } finally {
+      _binding.addTraceSpan(stage.index, request, start, _binding.getTraceTime());
+    }
+  }
+}
@@ -1,84 +1,671 @@
 import 'dart:ffi' as ffi;
+import 'dart:io';
 import 'dart:typed_data';
 
-import 'package:flutter/services.dart';
 import 'package:onnxruntime/onnxruntime.dart';
 
 import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/autotuner.dart';
+import 'package:cutout/models/duplicate_index.dart';
 import 'package:cutout/models/isolate_helper.dart';
+import 'package:cutout/models/mat_pool.dart';
+import 'package:cutout/models/memory_budget.dart';
+import 'package:cutout/models/memory_stats.dart';
+import 'package:cutout/models/model_descriptor.dart';
+import 'package:cutout/models/model_registry.dart';
+import 'package:cutout/models/model_store.dart';
+import 'package:cutout/models/result_cache.dart';
+import 'package:cutout/models/shared_image.dart';
+import 'package:cutout/models/tracing.dart';
+import 'package:cutout/models/warm_up.dart';
+
+/// Cheap first stage of a two-model cascade. The fast model runs first and
+/// its mask is kept when it scores at least [threshold] and has a subject;
+/// otherwise the full model runs on the same image.
+class U2NetCascade {
+  final String fastModelPath;
+  final U2NetModelDescriptor fastDescriptor;
+  final double threshold;
+
+  const U2NetCascade({
+    required this.fastModelPath,
+    this.fastDescriptor = U2NetModelDescriptor.u2net,
+    this.threshold = 0.85,
+  });
+}
+
+enum U2NetPath { fast, full }
+
+/// Skips inference on images that barely differ from the last segmented
+/// one, e.g. on turntables and scanner stations, and reuses its result.
+class ChangeGate {
+  /// Mean absolute gray level difference of a 64 px wide signature that
+  /// counts as a change
+  final double threshold;
+
+  /// Uses a MOG2 background model instead of the signature difference,
+  /// which copes better with flicker and sensor noise
+  final bool useBackgroundModel;
+
+  /// Share of foreground pixels that counts as a change with
+  /// [useBackgroundModel]
+  final double foregroundRatio;
+
+  const ChangeGate({
+    this.threshold = 3.0,
+    this.useBackgroundModel = false,
+    this.foregroundRatio = 0.01,
+  });
+}
+
+/// Outcome of a single [U2NetModel.runWithStats] call
+class U2NetRunStats {
+  final bool isSuccess;
+  final U2NetPath path;
+
+  /// Fast model mask score, null when no cascade is configured
+  final double? score;
+
+  /// Whether a second pass ran on the subject region
+  final bool isRoiRefined;
+
+  /// Whether the change gate found the image unchanged and the previous
+  /// result was reused; no model ran, so [path] and [score] are unknown
+  final bool isReused;
+
+  /// Whether the result came from the [U2NetResultCache]; [path] and
+  /// [score] are unknown then
+  final bool isCached;
+
+  /// Whether the mask of a near-duplicate image was warped onto this one
+  /// instead of running the model
+  final bool isDuplicate;
+
+  const U2NetRunStats({
+    required this.isSuccess,
+    required this.path,
+    this.score,
+    this.isRoiRefined = false,
+    this.isReused = false,
+    this.isCached = false,
+    this.isDuplicate = false,
+  });
+}
+
+/// Running totals of the paths taken by a cascaded model
+class U2NetCascadeStats {
+  int fastRuns = 0;
+  int fullRuns = 0;
+  double _scoreSum = 0;
+
+  int get totalRuns => fastRuns + fullRuns;
+
+  /// Share of requests answered without running the full model
+  double get fastRatio => totalRuns == 0 ? 0 : fastRuns / totalRuns;
+
+  double get averageScore => totalRuns == 0 ? 0 : _scoreSum / totalRuns;
+
+  void record(U2NetRunStats stats) {
+    if (stats.path == U2NetPath.fast) {
+      fastRuns++;
+    } else {
+      fullRuns++;
+    }
+    _scoreSum += stats.score ?? 0;
+  }
+}
 
 class U2NetModel with IsolateHelperMixin {
   static final CutoutBinding _binding = CutoutBinding();
 
   final String modelPath;
+
+  /// JSON asset describing the model, read in [initModel]. When it is not
+  /// given, [descriptor] is used as is.
+  final String? descriptorPath;
+  U2NetModelDescriptor descriptor;
+
+  /// Optional fast model tried before this one
+  final U2NetCascade? cascade;
+  final U2NetCascadeStats cascadeStats = U2NetCascadeStats();
+
+  /// Re-runs the model on the subject region found by the first pass, so
+  /// small subjects get the full model resolution at their edges
+  final bool refineRoi;
+
+  /// Share of the subject box added around it on every side, across which
+  /// the refined mask fades into the first-pass one
+  final double roiMargin;
+
+  /// Reuses the previous result for images that did not change
+  final ChangeGate? changeGate;
+
+  /// Returns stored cutouts for images seen before. Owned by the caller,
+  /// which releases it after this model.
+  final U2NetResultCache? resultCache;
+
+  /// Reuses the mask of a recent near-identical image, e.g. from the same
+  /// burst, warped onto the new one
+  final DuplicateIndex? duplicateIndex;
+
+  /// Loads models from files in app storage instead of asset copies
+  final ModelStore? modelStore;
+
+  /// Picks thread counts and graph optimization per model in the
+  /// background on first launch and applies the stored choice afterwards
+  final Autotuner? autotuner;
+
+  /// Keeps the full resolution of photos that do not fit the
+  /// [MemoryBudget] whole, by reading them and writing the cutout in strips
+  /// instead of decoding them reduced. The cutout is always a PNG then, and
+  /// the cascade and ROI refinement are skipped for such photos. Only PNG
+  /// inputs are decoded row by row; JPEG and WebP inputs are decoded whole
+  /// once, so just the mask and cutout are saved for them.
+  final bool streamLargeImages;
+  String? _lastOutputPath;
+  U2NetRunStats? _lastStats;
+  // Request of the run in progress, zero without tracing
+  int _traceRequest = 0;
   OrtSessionOptions? _sessionOptions;
-  OrtSession? _session;
+  OrtSessionOptions? _fastSessionOptions;
+  // Models this object holds in the ModelRegistry, released only by it
+  final List<String> _acquiredPaths = [];
   ffi.Pointer<U2NetSegmentImage>? _u2NetInstance;
+  // Configured once for the cascade's fast model, so requests never
+  // reconfigure the instance other isolates are using
+  ffi.Pointer<U2NetSegmentImage>? _fastInstance;
 
-  U2NetModel(this.modelPath) {
+  U2NetModel(
+    this.modelPath, {
+    this.descriptorPath,
+    this.descriptor = U2NetModelDescriptor.u2net,
+    this.cascade,
+    this.refineRoi = false,
+    this.roiMargin = 0.1,
+    this.changeGate,
+    this.resultCache,
+    this.duplicateIndex,
+    this.modelStore,
+    this.autotuner,
+    this.streamLargeImages = true,
+  }) {
     OrtEnv.instance.init();
     _u2NetInstance = _binding.createU2Net();
+    if (cascade != null) {
+      _fastInstance = _binding.createU2Net();
+    }
   }
 
   Future<void> initModel() async {
-    _sessionOptions = OrtSessionOptions();
+    if (descriptorPath != null) {
+      descriptor = await U2NetModelDescriptor.load(descriptorPath!);
+    }
+    _configure(_u2NetInstance!, descriptor);
+    if (cascade != null) {
+      _configure(_fastInstance!, cascade!.fastDescriptor);
+    }
+
+    if (changeGate != null) {
+      _binding.configureGateU2Net(
+        _u2NetInstance!,
+        enabled: true,
+        threshold: changeGate!.threshold,
+        useBackgroundModel: changeGate!.useBackgroundModel,
+        foregroundRatio: changeGate!.foregroundRatio,
+      );
+    }
+
+    if (duplicateIndex != null) {
+      _binding.configureDuplicatesU2Net(
+        _u2NetInstance!,
+        enabled: true,
+        maxHashDistance: duplicateIndex!.maxHashDistance,
+        minInliers: duplicateIndex!.minInliers,
+        capacity: duplicateIndex!.capacity,
+      );
+    }
+
+    _sessionOptions = await _createSessionOptions(modelPath, descriptor);
+    if (cascade != null) {
+      _fastSessionOptions = await _createSessionOptions(cascade!.fastModelPath, cascade!.fastDescriptor);
+    }
+    await autotuner?.applyOpenCVThreads();
+
+    // Shared with every other user of the same models in the process
+    await ModelRegistry.acquire(modelPath, _sessionOptions!, store: modelStore);
+    _acquiredPaths.add(modelPath);
+    if (cascade != null) {
+      await ModelRegistry.acquire(cascade!.fastModelPath, _fastSessionOptions!, store: modelStore);
+      _acquiredPaths.add(cascade!.fastModelPath);
+    }
+  }
+
+  Future<OrtSessionOptions> _createSessionOptions(String path, U2NetModelDescriptor descriptor) async {
+    if (autotuner == null) {
+      return OrtSessionOptions();
+    }
+    return await autotuner!.sessionOptions(path, tuningInputs(descriptor));
+  }
 
-    final rawModelFile = await rootBundle.load(modelPath);
-    final modelBytes = rawModelFile.buffer.asUint8List();
-    _session = OrtSession.fromBuffer(modelBytes, _sessionOptions!);
+  /// Zero-filled input of a model with [descriptor], for [Autotuner]
+  static TuningInputs tuningInputs(U2NetModelDescriptor descriptor) {
+    return () {
+      final size = descriptor.inputTensorSize;
+      return {
+        descriptor.inputName: OrtValueTensor.createTensorWithDataList(
+          descriptor.uint8Input ? Uint8List(size) : Float32List(size),
+          descriptor.inputShape,
+        ),
+      };
+    };
+  }
+
+  void _configure(ffi.Pointer<U2NetSegmentImage> instance, U2NetModelDescriptor descriptor) {
+    _binding.configureU2Net(
+      instance,
+      inputWidth: descriptor.inputWidth,
+      inputHeight: descriptor.inputHeight,
+      mean: descriptor.mean,
+      std: descriptor.std,
+      scaleByMax: descriptor.scaleByMax,
+      layout: descriptor.layout.index,
+      activation: descriptor.activation.index,
+      areaRatio: descriptor.areaRatio,
+    );
+
+    final quantization = descriptor.outputQuantization;
+    if (quantization != null) {
+      _binding.configureQuantizationU2Net(
+        instance,
+        scale: quantization.scale,
+        zeroPoint: quantization.zeroPoint,
+        isSigned: quantization.isSigned,
+      );
+    }
   }
 
   Future<void> release() async {
     try {
       _binding.destroyU2Net(_u2NetInstance!);
-      _session?.release();
+      if (_fastInstance != null) {
+        _binding.destroyU2Net(_fastInstance!);
+      }
+      _acquiredPaths.forEach(ModelRegistry.release);
       _sessionOptions?.release();
+      _fastSessionOptions?.release();
     } finally {
+      _acquiredPaths.clear();
       _u2NetInstance = null;
-      _session = null;
+      _fastInstance = null;
       _sessionOptions = null;
+      _fastSessionOptions = null;
+    }
+  }
+
+  /// Native buffers kept for the intermediates of the next image
+  MatPoolStats get poolStats => MatPoolStats.fromList(_binding.getPoolStatsU2Net(_u2NetInstance!));
+
+  /// Frees the buffers kept for the next image, e.g. when the app is asked
+  /// to reduce its memory use
+  void trimPool() {
+    _binding.trimPoolU2Net(_u2NetInstance!);
+    if (_fastInstance != null) {
+      _binding.trimPoolU2Net(_fastInstance!);
     }
   }
 
-  Future<Float32List> _preprocess(String imagePath) async {
-    return await _binding.preprocessU2Net(_u2NetInstance!, imagePath);
+  /// Native allocations made by the calls of this model
+  MemorySnapshot get memoryStats => MemorySnapshot.fromList(_binding.getMemoryStatsU2Net(_u2NetInstance!));
+
+  /// Starts the totals and peak of [memoryStats] over
+  void resetMemoryStats() {
+    _binding.resetMemoryStatsU2Net(_u2NetInstance!);
+  }
+
+  Future<Float32List> _preprocess(
+    ffi.Pointer<U2NetSegmentImage> instance,
+    String imagePath,
+    U2NetModelDescriptor descriptor,
+  ) async {
+    return await _binding.preprocessU2Net(instance, imagePath, descriptor.inputTensorSize);
   }
 
-  Future<Float32List> _inference(Float32List preprocessedImage) async {
-    // Should be input tensor size is [1, 3, 320, 320]
-    final inputOrtValue = OrtValueTensor.createTensorWithDataList(preprocessedImage, [1, 3, 320, 320]);
+  /// Runs the session and returns the [H, W] rows of the mask output
+  Future<List> _inferenceRows(
+    OrtSession? session,
+    U2NetModelDescriptor descriptor,
+    List<num> preprocessedImage,
+  ) async {
+    // Should be input tensor size is [1, 3, H, W] or [1, H, W, 3]
+    final inputOrtValue = OrtValueTensor.createTensorWithDataList(preprocessedImage, descriptor.inputShape);
     final runOptions = OrtRunOptions();
-    // Input name should be "input.1"
-    final inputs = {"input.1": inputOrtValue};
+    final inputs = {descriptor.inputName: inputOrtValue};
     final List<OrtValue?>? outputs;
-    outputs = _session?.run(runOptions, inputs);
+    outputs = Tracing.measure(TraceStage.inference, _traceRequest, () => session?.run(runOptions, inputs));
 
     inputOrtValue.release();
     runOptions.release();
 
-    // Outputs are total 7 and the first one is the output of the model
-    // Output size is [1, 1, 320, 320], so we get the last two dimensions
-    final output = (outputs?[0]?.value as List<List<List<List<double>>>>)[0][0];
+    // U2Net has 7 outputs and the first one is the fused mask
+    // Output size is [1, 1, H, W], so we get the last two dimensions
+    final output = (outputs?[descriptor.outputIndex]?.value as List)[0][0] as List;
 
     // Release the outputs
     outputs?.forEach((output) => output?.release());
 
+    return output;
+  }
+
+  Future<Float32List> _inference(
+    OrtSession? session,
+    U2NetModelDescriptor descriptor,
+    List<num> preprocessedImage,
+  ) async {
+    final output = await _inferenceRows(session, descriptor, preprocessedImage);
+
     // Flatten the output
-    return Float32List.fromList(output.expand((x) => x).toList());
+    return Float32List.fromList(output.expand((x) => x as List<double>).toList());
   }
 
-  Future<bool> _postprocess(String imagePath, Float32List inferencedData, String outputPath) async {
-    return await _binding.postprocessU2Net(_u2NetInstance!, inferencedData, outputPath);
+  /// Raw bytes of a uint8/int8 mask output; int8 values wrap to their two's
+  /// complement bytes, which is what the native side expects
+  Future<Uint8List> _inferenceQuantized(
+    OrtSession? session,
+    U2NetModelDescriptor descriptor,
+    List<num> preprocessedImage,
+  ) async {
+    final output = await _inferenceRows(session, descriptor, preprocessedImage);
+    return Uint8List.fromList(output.expand((x) => x as List<int>).toList());
+  }
+
+  /// Quantized models skip float normalization on the way in and float mask
+  /// handling on the way out, whichever of the two they support
+  Future<bool> _runQuantized(OrtSession session, String imagePath, String outputPath) async {
+    final List<num> input = descriptor.uint8Input
+        ? await _binding.preprocessUint8U2Net(_u2NetInstance!, imagePath, descriptor.inputTensorSize)
+        : await _preprocess(_u2NetInstance!, imagePath, descriptor);
+
+    if (descriptor.outputQuantization == null) {
+      final mask = await _inference(session, descriptor, input);
+      return await _postprocess(_u2NetInstance!, mask, outputPath);
+    }
+
+    final mask = await _inferenceQuantized(session, descriptor, input);
+    return await _binding.postprocessQuantizedU2Net(_u2NetInstance!, mask, outputPath);
+  }
+
+  Future<bool> _postprocess(
+    ffi.Pointer<U2NetSegmentImage> instance,
+    Float32List inferencedData,
+    String outputPath,
+  ) async {
+    return await _binding.postprocessU2Net(instance, inferencedData, outputPath);
+  }
+
+  /// Postprocesses the first-pass mask, running a second pass on the
+  /// subject region first when [refineRoi] is set. Returns whether the
+  /// cutout was written and whether the second pass ran.
+  Future<(bool, bool)> _finish(
+    ffi.Pointer<U2NetSegmentImage> instance,
+    OrtSession? session,
+    U2NetModelDescriptor descriptor,
+    Float32List mask,
+    String outputPath,
+  ) async {
+    if (refineRoi) {
+      final roiInput = await _binding.prepareRoiU2Net(instance, mask, roiMargin, descriptor.inputTensorSize);
+
+      if (roiInput != null) {
+        final roiMask = await _inference(session, descriptor, roiInput);
+        final isSuccess = await _binding.postprocessRoiU2Net(instance, mask, roiMask, outputPath);
+        return (isSuccess, true);
+      }
+    }
+
+    return (await _postprocess(instance, mask, outputPath), false);
   }
 
   /// Just a wrapper for the model inference
   Future<bool> run(String imagePath, String outputPath) async {
+    final stats = await runWithStats(imagePath, outputPath);
+    return stats.isSuccess;
+  }
+
+  /// Runs the model, or the cascade when one is configured, and reports
+  /// which path produced the cutout. Totals are kept in [cascadeStats].
+  ///
+  /// Quantized descriptors (see [U2NetModelDescriptor.isQuantized]) always
+  /// run this model alone, without the cascade or ROI refinement.
+  ///
+  /// With a [resultCache], images seen before are answered from it and new
+  /// results are added to it; failures only for as long as the cache lives.
+  ///
+  /// With a [duplicateIndex], near duplicates of recent images reuse their
+  /// warped mask and the model only runs when no match is confirmed.
+  ///
+  /// Pass [image] when the photo at [imagePath] is already decoded, e.g. to
+  /// refine the cutout with SAM afterwards; it is not decoded again.
+  Future<U2NetRunStats> runWithStats(String imagePath, String outputPath, {SharedImage? image}) async {
+    final lastOutputPath = _lastOutputPath;
+    final lastStats = _lastStats;
+
+    final stats = await loadWithIsolate(() async {
+      _traceRequest = Tracing.nextRequest();
+      _binding.setTraceRequestU2Net(_u2NetInstance!, _traceRequest);
+      if (_fastInstance != null) {
+        _binding.setTraceRequestU2Net(_fastInstance!, _traceRequest);
+      }
+
+      if (image != null) {
+        _binding.setContextU2Net(_u2NetInstance!, image.instance);
+      }
+
+      // The gate is always consulted so its reference follows every image
+      // that goes through the model
+      if (changeGate != null &&
+          !_binding.isChangedU2Net(_u2NetInstance!, imagePath) &&
+          lastStats != null &&
+          (!lastStats.isSuccess || await _reuseOutput(lastOutputPath!, outputPath))) {
+        return U2NetRunStats(isSuccess: lastStats.isSuccess, path: U2NetPath.full, isReused: true);
+      }
+
+      final cacheKey = resultCache?.key(imagePath, _cacheKey) ?? 0;
+      if (cacheKey != 0) {
+        final lookup = resultCache!.lookup(cacheKey, outputPath);
+        if (lookup != CacheLookup.miss) {
+          return U2NetRunStats(isSuccess: lookup == CacheLookup.hit, path: U2NetPath.full, isCached: true);
+        }
+      }
+
+      final stats = duplicateIndex != null && _binding.reuseDuplicateU2Net(_u2NetInstance!, imagePath, outputPath)
+          ? const U2NetRunStats(isSuccess: true, path: U2NetPath.full, isDuplicate: true)
+          : await ModelRegistry.use(modelPath, (session) async {
+              if (cascade == null) {
+                return await _runModel(session, null, imagePath, outputPath);
+              }
+              return await ModelRegistry.use(
+                cascade!.fastModelPath,
+                (fastSession) => _runModel(session, fastSession, imagePath, outputPath),
+              );
+            });
+      if (cacheKey != 0) {
+        resultCache!.store(cacheKey, outputPath, stats.isSuccess);
+      }
+      return stats;
+    });
+
+    if (!stats.isReused) {
+      if (!stats.isCached && !stats.isDuplicate) {
+        cascadeStats.record(stats);
+      }
+      _lastOutputPath = outputPath;
+      _lastStats = stats;
+    }
+    return stats;
+  }
+
+  /// Puts the previous cutout at [outputPath]; false when it is gone or
+  /// cannot be copied, and the model has to run again
+  Future<bool> _reuseOutput(String lastOutputPath, String outputPath) async {
+    final lastOutput = File(lastOutputPath);
+    if (!await lastOutput.exists()) {
+      return false;
+    }
+    if (lastOutputPath == outputPath) {
+      return true;
+    }
+
+    try {
+      await lastOutput.copy(outputPath);
+      return true;
+    } on FileSystemException {
+      return false;
+    }
+  }
+
+  /// Runs a synthetic photo through every stage the configured model uses,
+  /// so the first real [run] is as fast as the following ones. The change
+  /// gate, result cache and duplicate index are left untouched.
+  ///
+  /// Two temporary files are written to a new directory in
+  /// [scratchDirectory] and deleted afterwards.
+  Future<WarmUpStats> warmUp(String scratchDirectory) async {
     return await loadWithIsolate(() async {
-      final preprocessedImage = await _preprocess(imagePath);
-      final inferencedData = await _inference(preprocessedImage);
-      final isSuccess = await _postprocess(imagePath, inferencedData, outputPath);
+      final timer = WarmUpTimer();
+      final openCVMilliseconds = _binding.warmUpOpenCV();
+      timer.add(WarmUpStage.opencv, Duration(microseconds: (openCVMilliseconds * 1000).round()));
+
+      final files = await WarmUpFiles.create(scratchDirectory);
+      final imagePath = files.imagePath;
+      final outputPath = files.outputPath;
+
+      try {
+        _binding.writeWarmUpImage(imagePath);
+
+        if (cascade != null) {
+          final fastDescriptor = cascade!.fastDescriptor;
+          await ModelRegistry.use(cascade!.fastModelPath, (fastSession) async {
+            final input = await timer.measure(
+              WarmUpStage.preprocess,
+              () => _preprocess(_fastInstance!, imagePath, fastDescriptor),
+            );
+            await timer.measure(WarmUpStage.inference, () => _inference(fastSession, fastDescriptor, input));
+          });
+        }
+
+        await ModelRegistry.use(modelPath, (session) async {
+          if (!descriptor.isQuantized) {
+            final input = await timer.measure(
+              WarmUpStage.preprocess,
+              () => _preprocess(_u2NetInstance!, imagePath, descriptor),
+            );
+            final mask = await timer.measure(WarmUpStage.inference, () => _inference(session, descriptor, input));
+            await timer.measure(
+              WarmUpStage.postprocess,
+              () => _finish(_u2NetInstance!, session, descriptor, mask, outputPath),
+            );
+            return;
+          }
+
+          final List<num> input = await timer.measure(
+            WarmUpStage.preprocess,
+            () async => descriptor.uint8Input
+                ? await _binding.preprocessUint8U2Net(_u2NetInstance!, imagePath, descriptor.inputTensorSize)
+                : await _preprocess(_u2NetInstance!, imagePath, descriptor),
+          );
+          if (descriptor.outputQuantization == null) {
+            final mask = await timer.measure(WarmUpStage.inference, () => _inference(session, descriptor, input));
+            await timer.measure(WarmUpStage.postprocess, () => _postprocess(_u2NetInstance!, mask, outputPath));
+          } else {
+            final mask =
+                await timer.measure(WarmUpStage.inference, () => _inferenceQuantized(session, descriptor, input));
+            await timer.measure(
+              WarmUpStage.postprocess,
+              () => _binding.postprocessQuantizedU2Net(_u2NetInstance!, mask, outputPath),
+            );
+          }
+        });
+      } finally {
+        _binding.clearU2Net(_u2NetInstance!);
+        if (_fastInstance != null) {
+          _binding.clearU2Net(_fastInstance!);
+        }
+        await files.delete();
+      }
 
-      return isSuccess;
+      return timer.stats;
     });
   }
+
+  /// Everything besides the image that shapes the cutout, including the
+  /// content of the loaded weights, so an app update or a swap that ships
+  /// other weights under the same path never matches older results
+  String get _cacheKey => [
+        modelPath,
+        ModelRegistry.content(modelPath),
+        descriptor.identity,
+        cascade == null
+            ? ''
+            : '${cascade!.fastModelPath}|${ModelRegistry.content(cascade!.fastModelPath)}|'
+                '${cascade!.fastDescriptor.identity}|${cascade!.threshold}',
+        refineRoi ? roiMargin : '',
+      ].join('#');
+
+  /// Runs on the sessions leased for this request, so a model swapped
+  /// meanwhile does not affect it
+  Future<U2NetRunStats> _runModel(
+    OrtSession session,
+    OrtSession? fastSession,
+    String imagePath,
+    String outputPath,
+  ) async {
+    if (descriptor.isQuantized) {
+      final isSuccess = await _runQuantized(session, imagePath, outputPath);
+      return U2NetRunStats(isSuccess: isSuccess, path: U2NetPath.full);
+    }
+
+    final stripRows = streamLargeImages ? MemoryBudget.plan(imagePath)?.stripRows ?? 0 : 0;
+    if (stripRows > 0 && _binding.loadStripsU2Net(_u2NetInstance!, imagePath, stripRows)) {
+      final preprocessedImage = await _binding.preprocessLoadedU2Net(_u2NetInstance!, descriptor.inputTensorSize);
+      final inferencedData = await _inference(session, descriptor, preprocessedImage);
+      final isSuccess = await _binding.postprocessStripsU2Net(_u2NetInstance!, inferencedData, outputPath);
+      return U2NetRunStats(isSuccess: isSuccess, path: U2NetPath.full);
+    }
+
+    if (cascade == null) {
+      final preprocessedImage = await _preprocess(_u2NetInstance!, imagePath, descriptor);
+      final inferencedData = await _inference(session, descriptor, preprocessedImage);
+      final (isSuccess, isRoiRefined) = await _finish(_u2NetInstance!, session, descriptor, inferencedData, outputPath);
+
+      return U2NetRunStats(isSuccess: isSuccess, path: U2NetPath.full, isRoiRefined: isRoiRefined);
+    }
+
+    // Picks up an image already decoded for this request, by a shared
+    // context or the duplicate lookup
+    _binding.shareImageU2Net(_fastInstance!, _u2NetInstance!);
+    final fastDescriptor = cascade!.fastDescriptor;
+    final fastInput = await _preprocess(_fastInstance!, imagePath, fastDescriptor);
+    final fastMask = await _inference(fastSession, fastDescriptor, fastInput);
+    final score = _binding.scoreMaskU2Net(_fastInstance!, fastMask);
+
+    if (score >= cascade!.threshold) {
+      final (isSuccess, isRoiRefined) = await _finish(_fastInstance!, fastSession, fastDescriptor, fastMask, outputPath);
+      if (isSuccess) {
+        return U2NetRunStats(isSuccess: true, path: U2NetPath.fast, score: score, isRoiRefined: isRoiRefined);
+      }
+      // A confident mask can still have no subject large enough to keep,
+      // which the full model may find
+    }
+
+    // The image is already decoded, and the tensor is reused when both
+    // models share their input geometry
+    _binding.shareImageU2Net(_u2NetInstance!, _fastInstance!);
+    final fullInput = fastDescriptor.sharesInputWith(descriptor)
+        ? fastInput
+        : await _binding.preprocessLoadedU2Net(_u2NetInstance!, descriptor.inputTensorSize);
+    final fullMask = await _inference(session, descriptor, fullInput);
+    final (isSuccess, isRoiRefined) = await _finish(_u2NetInstance!, session, descriptor, fullMask, outputPath);
+
+    return U2NetRunStats(isSuccess: isSuccess, path: U2NetPath.full, score: score, isRoiRefined: isRoiRefined);
+  }
 }
@@ -0,0 +1,287 @@
+import 'dart:ffi' as ffi;
+import 'dart:typed_data';
+
+import 'package:ffi/ffi.dart';
+import 'package:onnxruntime/onnxruntime.dart';
+
+import 'package:cutout/cutout_binding.dart';
+import 'package:cutout/models/autotuner.dart';
+import 'package:cutout/models/isolate_helper.dart';
+import 'package:cutout/models/model_descriptor.dart';
+import 'package:cutout/models/model_registry.dart';
+import 'package:cutout/models/model_store.dart';
+import 'package:cutout/models/u2net_model.dart';
+import 'package:cutout/models/warm_up.dart';
+
+/// Pixel format of camera frames, matching the native FrameFormat
+enum StreamFrameFormat { bgra, rgba, bgr, nv21 }
+
+/// Running totals of a [U2NetStreamSession]
+class U2NetStreamStats {
+  final int frames;
+  final int keyframes;
+
+  /// Frames replaced by a newer one before they were processed
+  final int droppedFrames;
+
+  /// Masks produced per second, smoothed
+  final double fps;
+
+  /// Mean 1 - IoU between the propagated mask and the model mask on
+  /// keyframes; grows when propagation drifts
+  final double propagationError;
+
+  /// Frames the change gate found static, which kept the mask as is
+  final int unchangedFrames;
+
+  const U2NetStreamStats({
+    required this.frames,
+    required this.keyframes,
+    required this.droppedFrames,
+    required this.fps,
+    required this.propagationError,
+    this.unchangedFrames = 0,
+  });
+
+  /// Share of frames that ran the model
+  double get keyframeRatio => frames == 0 ? 0 : keyframes / frames;
+}
+
+/// Live cutout previews for a camera feed.
+///
+/// Frames are handed over with [pushFrame], typically from the camera image
+/// stream callback. The native side keeps only the newest frame, so a slow
+/// model never builds up a backlog. [process] runs the model on keyframes
+/// and warps the last mask along optical flow on the frames in between.
+class U2NetStreamSession with IsolateHelperMixin {
+  static final CutoutBinding _binding = CutoutBinding();
+
+  final String modelPath;
+  final U2NetModelDescriptor descriptor;
+
+  /// The model runs at least every this many frames
+  final int keyframeInterval;
+
+  /// Width of the grayscale frames used for optical flow
+  final int flowWidth;
+
+  /// Mean flow, in flow pixels per frame, above which a keyframe is forced
+  final double maxMotion;
+
+  /// Size of the masks returned by [process]
+  final int maskWidth;
+  final int maskHeight;
+
+  /// Keeps the mask without optical flow or inference on static frames
+  final ChangeGate? changeGate;
+
+  /// Loads models from files in app storage instead of asset copies
+  final ModelStore? modelStore;
+
+  /// Picks thread counts and graph optimization per model in the
+  /// background on first launch and applies the stored choice afterwards
+  final Autotuner? autotuner;
+
+  OrtSessionOptions? _sessionOptions;
+  // Whether this session holds the model in the ModelRegistry
+  bool _isAcquired = false;
+  ffi.Pointer<U2NetStream>? _streamInstance;
+  ffi.Pointer<ffi.Float>? _input;
+  ffi.Pointer<ffi.Uint8>? _mask;
+  ffi.Pointer<ffi.Uint8>? _frame;
+  int _frameCapacity = 0;
+
+  U2NetStreamSession(
+    this.modelPath, {
+    this.descriptor = U2NetModelDescriptor.u2net,
+    this.keyframeInterval = 5,
+    this.flowWidth = 160,
+    this.maxMotion = 4.0,
+    this.maskWidth = 320,
+    this.maskHeight = 320,
+    this.changeGate,
+    this.modelStore,
+    this.autotuner,
+  }) {
+    OrtEnv.instance.init();
+    _streamInstance = _binding.createStream();
+  }
+
+  Future<void> initModel() async {
+    _binding.configureU2Net(
+      _binding.getU2NetStream(_streamInstance!),
+      inputWidth: descriptor.inputWidth,
+      inputHeight: descriptor.inputHeight,
+      mean: descriptor.mean,
+      std: descriptor.std,
+      scaleByMax: descriptor.scaleByMax,
+      layout: descriptor.layout.index,
+      activation: descriptor.activation.index,
+      areaRatio: descriptor.areaRatio,
+    );
+    _binding.configureStream(
+      _streamInstance!,
+      keyframeInterval: keyframeInterval,
+      flowWidth: flowWidth,
+      maxMotion: maxMotion,
+    );
+
+    if (changeGate != null) {
+      _binding.configureGateStream(
+        _streamInstance!,
+        enabled: true,
+        threshold: changeGate!.threshold,
+        useBackgroundModel: changeGate!.useBackgroundModel,
+        foregroundRatio: changeGate!.foregroundRatio,
+      );
+    }
+
+    if (autotuner != null) {
+      _sessionOptions = await autotuner!.sessionOptions(modelPath, U2NetModel.tuningInputs(descriptor));
+      await autotuner!.applyOpenCVThreads();
+    } else {
+      _sessionOptions = OrtSessionOptions();
+    }
+    await ModelRegistry.acquire(modelPath, _sessionOptions!, store: modelStore);
+    _isAcquired = true;
+
+    // Allocated here so every isolate spawned by this session shares them
+    _input = calloc<ffi.Float>(descriptor.inputTensorSize);
+    _mask = calloc<ffi.Uint8>(maskWidth * maskHeight);
+  }
+
+  Future<void> release() async {
+    try {
+      _binding.destroyStream(_streamInstance!);
+      if (_isAcquired) {
+        ModelRegistry.release(modelPath);
+      }
+      _sessionOptions?.release();
+      if (_input != null) calloc.free(_input!);
+      if (_mask != null) calloc.free(_mask!);
+      if (_frame != null) calloc.free(_frame!);
+    } finally {
+      _isAcquired = false;
+      _streamInstance = null;
+      _sessionOptions = null;
+      _input = null;
+      _mask = null;
+      _frame = null;
+      _frameCapacity = 0;
+    }
+  }
+
+  /// Pre-faults the input, mask and frame buffers and runs the model once
+  /// on a blank input, so the first [process] is as fast as the following
+  /// ones. Pass [frameBytes], the size of the camera frames, to allocate
+  /// the frame buffer ahead of the first [pushFrame].
+  Future<WarmUpStats> warmUp({int frameBytes = 0}) async {
+    if (_frameCapacity < frameBytes) {
+      if (_frame != null) calloc.free(_frame!);
+      _frame = calloc<ffi.Uint8>(frameBytes);
+      _frameCapacity = frameBytes;
+    }
+
+    return await loadWithIsolate(() async {
+      final timer = WarmUpTimer();
+      final openCVMilliseconds = _binding.warmUpOpenCV();
+      timer.add(WarmUpStage.opencv, Duration(microseconds: (openCVMilliseconds * 1000).round()));
+
+      final input = _input!.asTypedList(descriptor.inputTensorSize);
+      await timer.measure(WarmUpStage.preprocess, () async {
+        input.fillRange(0, input.length, 0);
+        _mask!.asTypedList(maskWidth * maskHeight).fillRange(0, maskWidth * maskHeight, 0);
+        if (_frameCapacity > 0) {
+          _frame!.asTypedList(_frameCapacity).fillRange(0, _frameCapacity, 0);
+        }
+      });
+      await timer.measure(
+        WarmUpStage.inference,
+        () => ModelRegistry.use(modelPath, (session) async => _inference(session, input)),
+      );
+
+      return timer.stats;
+    });
+  }
+
+  /// Hands a camera frame to the session, replacing any frame that has not
+  /// been processed yet. [rotation] is 0, 90, 180 or 270 degrees clockwise.
+  void pushFrame(
+    Uint8List bytes, {
+    required int width,
+    required int height,
+    required int stride,
+    StreamFrameFormat format = StreamFrameFormat.bgra,
+    int rotation = 0,
+    int? timestampUs,
+  }) {
+    if (_frameCapacity < bytes.length) {
+      if (_frame != null) calloc.free(_frame!);
+      _frame = calloc<ffi.Uint8>(bytes.length);
+      _frameCapacity = bytes.length;
+    }
+    _frame!.asTypedList(bytes.length).setAll(0, bytes);
+
+    _binding.pushFrameStream(
+      _streamInstance!,
+      _frame!,
+      width: width,
+      height: height,
+      stride: stride,
+      format: format.index,
+      rotation: rotation,
+      timestampUs: timestampUs ?? DateTime.now().microsecondsSinceEpoch,
+    );
+  }
+
+  /// Processes the newest frame and returns its [maskWidth] x [maskHeight]
+  /// soft mask, or null when no new frame arrived since the last call.
+  /// Await each call before starting the next one.
+  Future<Uint8List?> process() async {
+    return await loadWithIsolate(() async {
+      final action = _binding.pollStream(_streamInstance!, _input!);
+      if (action == 0) {
+        return null;
+      }
+
+      if (action == 1) {
+        final input = _input!.asTypedList(descriptor.inputTensorSize);
+        final mask = await ModelRegistry.use(modelPath, (session) async => _inference(session, input));
+        _binding.submitMaskStream(_streamInstance!, mask);
+      }
+
+      if (!_binding.getMaskStream(_streamInstance!, _mask!, maskWidth, maskHeight)) {
+        return null;
+      }
+      return Uint8List.fromList(_mask!.asTypedList(maskWidth * maskHeight));
+    });
+  }
+
+  Float32List _inference(OrtSession session, Float32List input) {
+    final inputOrtValue = OrtValueTensor.createTensorWithDataList(input, descriptor.inputShape);
+    final runOptions = OrtRunOptions();
+    final outputs = session.run(runOptions, {descriptor.inputName: inputOrtValue});
+
+    inputOrtValue.release();
+    runOptions.release();
+
+    // Output size is [1, 1, H, W], so we get the last two dimensions
+    final output = (outputs[descriptor.outputIndex]?.value as List<List<List<List<double>>>>)[0][0];
+    outputs.forEach((output) => output?.release());
+
+    return Float32List.fromList(output.expand((x) => x).toList());
+  }
+
+  U2NetStreamStats get stats {
+    final values = _binding.getStatsStream(_streamInstance!);
+
+    return U2NetStreamStats(
+      frames: values[0].toInt(),
+      keyframes: values[1].toInt(),
+      droppedFrames: values[2].toInt(),
+      fps: values[3],
+      propagationError: values[4],
+      unchangedFrames: values[5].toInt(),
+    );
+  }
+}
@@ -0,0 +1,81 @@
+import 'dart:io';
+
+/// Time spent in each stage of a warm-up pass, see `U2NetModel.warmUp`,
+/// `SAMModel.warmUp` and `U2NetStreamSession.warmUp`.
+///
+/// The first request after `initModel` pays for ONNX Runtime's memory
+/// planning and arena growth, OpenCV's lazy initialization and first-touch
+/// page faults. A warm-up pays for them up front, e.g. during app idle time.
+class WarmUpStats {
+  /// OpenCV thread pool, kernel dispatch and image codecs
+  final Duration opencv;
+
+  /// Decoding the test image and building the input tensors
+  final Duration preprocess;
+
+  /// Session runs, including the first run's memory planning
+  final Duration inference;
+
+  /// Mask handling and writing the result
+  final Duration postprocess;
+
+  const WarmUpStats({
+    this.opencv = Duration.zero,
+    this.preprocess = Duration.zero,
+    this.inference = Duration.zero,
+    this.postprocess = Duration.zero,
+  });
+
+  Duration get total => opencv + preprocess + inference + postprocess;
+
+  @override
+  String toString() =>
+      'WarmUpStats(opencv: $opencv, preprocess: $preprocess, inference: $inference, postprocess: $postprocess)';
+}
+
+enum WarmUpStage { opencv, preprocess, inference, postprocess }
+
+/// Adds up the time of the stages of a warm-up pass
+class WarmUpTimer {
+  final Map<WarmUpStage, Duration> _elapsed = {};
+
+  Future<T> measure<T>(WarmUpStage stage, Future<T> Function() body) async {
+    final stopwatch = Stopwatch()..start();
+    try {
+      return await body();
+    } finally {
+      add(stage, stopwatch.elapsed);
+    }
+  }
+
+  void add(WarmUpStage stage, Duration elapsed) {
+    _elapsed[stage] = (_elapsed[stage] ?? Duration.zero) + elapsed;
+  }
+
+  WarmUpStats get stats => WarmUpStats(
+        opencv: _elapsed[WarmUpStage.opencv] ?? Duration.zero,
+        preprocess: _elapsed[WarmUpStage.preprocess] ?? Duration.zero,
+        inference: _elapsed[WarmUpStage.inference] ?? Duration.zero,
+        postprocess: _elapsed[WarmUpStage.postprocess] ?? Duration.zero,
+      );
+}
+
+/// Test image and output paths of one warm-up pass, in a directory of their
+/// own under the scratch directory, so passes running at the same time
+/// never share files
+class WarmUpFiles {
+  final Directory _directory;
+
+  WarmUpFiles._(this._directory);
+
+  static Future<WarmUpFiles> create(String scratchDirectory) async {
+    return WarmUpFiles._(await Directory(scratchDirectory).createTemp('cutout_warm_up.'));
+  }
+
+  String get imagePath => '${_directory.path}/image.jpg';
+  String get outputPath => '${_directory.path}/output.png';
+
+  Future<void> delete() async {
+    await _directory.delete(recursive: true);
+  }
+}
@@ -0,0 +1,181 @@
+#include "duplicate_index.hpp"
+
+#include <gtest/gtest.h>
+
+using cutout::DuplicateIndex;
+using cutout::DuplicateMatch;
+
+namespace {
+
+// Random rectangles and circles, whose corners give ORB plenty to match
+cv::Mat make_scene(cv::Size size, uint64_t seed) {
+  cv::RNG rng(seed);
+  cv::Mat scene(size, CV_8UC3, cv::Scalar(128, 128, 128));
+  for (int i = 0; i < 300; i++) {
+    cv::Point center(rng.uniform(0, size.width), rng.uniform(0, size.height));
+    cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256),
+                     rng.uniform(0, 256));
+    int radius = rng.uniform(5, 40);
+    if (i % 2 == 0) {
+      cv::rectangle(scene, cv::Rect(center, cv::Size(radius, radius * 2)),
+                    color, cv::FILLED);
+    } else {
+      cv::circle(scene, center, radius, color, cv::FILLED);
+    }
+  }
+  return scene;
+}
+
+cv::Mat make_payload(uint8_t value) {
+  return cv::Mat(4, 4, CV_8U, cv::Scalar(value));
+}
+
+// Looks the image up and, on a miss, adds `payload` for it
+bool find_or_add(DuplicateIndex &index, const cv::Mat &image,
+                 const cv::Mat &payload, DuplicateMatch &match) {
+  if (index.find(image, match)) {
+    return true;
+  }
+  index.add(payload);
+  return false;
+}
+
+class DuplicateIndexTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    index.configure(true, 10, 40, 8);
+    scene = make_scene(cv::Size(800, 600), 1);
+    image = scene(cv::Rect(40, 40, 640, 480)).clone();
+  }
+
+  DuplicateIndex index;
+  DuplicateMatch match;
+  cv::Mat scene;
+  cv::Mat image;
+};
+
+} // namespace
+
+TEST_F(DuplicateIndexTest, DisabledNeverMatches) {
+  index.configure(false, 10, 40, 8);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+  EXPECT_FALSE(index.find(image, match));
+  EXPECT_EQ(index.size(), 0);
+}
+
+TEST_F(DuplicateIndexTest, EmptyImageMisses) {
+  EXPECT_FALSE(index.find(cv::Mat(), match));
+  index.add(make_payload(1));
+  EXPECT_EQ(index.size(), 0);
+}
+
+TEST_F(DuplicateIndexTest, AddWithoutMissIsIgnored) {
+  index.add(make_payload(1));
+  EXPECT_EQ(index.size(), 0);
+
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+  EXPECT_EQ(index.size(), 1);
+  // The miss was consumed by the first add
+  index.add(make_payload(2));
+  EXPECT_EQ(index.size(), 1);
+}
+
+TEST_F(DuplicateIndexTest, SameImageMatchesWithIdentity) {
+  EXPECT_FALSE(find_or_add(index, image, make_payload(7), match));
+  ASSERT_TRUE(index.find(image, match));
+
+  EXPECT_EQ(match.size, image.size());
+  EXPECT_EQ(cv::countNonZero(match.payload != 7), 0);
+  cv::Mat identity = cv::Mat::eye(3, 3, CV_64F);
+  EXPECT_LT(cv::norm(match.homography, identity, cv::NORM_INF), 0.05);
+}
+
+TEST_F(DuplicateIndexTest, PayloadIsCopied) {
+  cv::Mat payload = make_payload(7);
+  EXPECT_FALSE(find_or_add(index, image, payload, match));
+  payload.setTo(0);
+
+  ASSERT_TRUE(index.find(image, match));
+  EXPECT_EQ(cv::countNonZero(match.payload != 7), 0);
+}
+
+TEST_F(DuplicateIndexTest, ShiftedFrameMatchesWithTranslation) {
+  // Only the features decide here
+  index.configure(true, 64, 40, 8);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+
+  cv::Mat shifted = scene(cv::Rect(56, 40, 640, 480)).clone();
+  ASSERT_TRUE(index.find(shifted, match));
+
+  // Pixels of the cached frame move 16 pixels left in the new one
+  cv::Mat_<double> h = match.homography / match.homography.at<double>(2, 2);
+  EXPECT_NEAR(h(0, 2), -16, 1.5);
+  EXPECT_NEAR(h(1, 2), 0, 1.5);
+  EXPECT_NEAR(h(0, 0), 1, 0.02);
+  EXPECT_NEAR(h(1, 1), 1, 0.02);
+}
+
+TEST_F(DuplicateIndexTest, LargeWarpIsRejected) {
+  // 1% of the 800 pixel diagonal, less than the shift
+  index.configure(true, 64, 40, 8, 0.01f);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+
+  cv::Mat shifted = scene(cv::Rect(80, 40, 640, 480)).clone();
+  EXPECT_FALSE(index.find(shifted, match));
+}
+
+TEST_F(DuplicateIndexTest, DifferentImageMisses) {
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+
+  cv::Mat other = make_scene(image.size(), 2);
+  EXPECT_FALSE(index.find(other, match));
+}
+
+TEST_F(DuplicateIndexTest, HashDistanceGatesCandidates) {
+  // The same image has the same hash, so it passes a distance of zero
+  index.configure(true, 0, 40, 8);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+  EXPECT_TRUE(index.find(image, match));
+
+  // No hash passes a negative distance, whatever the features
+  index.configure(true, -1, 40, 8);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+  EXPECT_EQ(index.size(), 1);
+  EXPECT_FALSE(index.find(image, match));
+}
+
+TEST_F(DuplicateIndexTest, CapacityEvictsOldest) {
+  index.configure(true, 10, 40, 2);
+  cv::Mat images[3] = {image, make_scene(image.size(), 2),
+                       make_scene(image.size(), 3)};
+  for (int i = 0; i < 3; i++) {
+    EXPECT_FALSE(find_or_add(index, images[i], make_payload(i), match));
+  }
+  EXPECT_EQ(index.size(), 2);
+
+  EXPECT_FALSE(index.find(images[0], match));
+  ASSERT_TRUE(index.find(images[2], match));
+  EXPECT_EQ(cv::countNonZero(match.payload != 2), 0);
+}
+
+TEST_F(DuplicateIndexTest, ResetAndConfigureClear) {
+  EXPECT_FALSE(find_or_add(index, image, make_payload(1), match));
+  index.reset();
+  EXPECT_EQ(index.size(), 0);
+  EXPECT_FALSE(index.find(image, match));
+
+  index.add(make_payload(1));
+  index.configure(true, 10, 40, 8);
+  EXPECT_EQ(index.size(), 0);
+}
+
+TEST_F(DuplicateIndexTest, MoveKeepsSettingsAndEntries) {
+  index.configure(true, 10, 40, 2);
+  EXPECT_FALSE(find_or_add(index, image, make_payload(5), match));
+
+  DuplicateIndex moved(std::move(index));
+  EXPECT_TRUE(moved.is_enabled());
+  EXPECT_EQ(moved.size(), 1);
+  ASSERT_TRUE(moved.find(image, match));
+  EXPECT_EQ(cv::countNonZero(match.payload != 5), 0);
+}
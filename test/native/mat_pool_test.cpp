@@ -0,0 +1,174 @@
+#include "mat_pool.hpp"
+
+#include <gtest/gtest.h>
+
+using cutout::make_mat_pool;
+using cutout::MatPool;
+using cutout::MatPoolRef;
+using cutout::MatPoolStats;
+using cutout::NativeMemory;
+using cutout::Stage;
+using cutout::TensorPool;
+
+namespace {
+
+// 1 MB class, which 1000x1000 and 1000x1010 bytes both round up to
+const int64_t megabyte_class = 1 << 20;
+
+cv::Mat make_mat(const MatPool &pool, int rows, int cols) {
+  cv::Mat mat = pool.mat();
+  mat.create(rows, cols, CV_8U);
+  return mat;
+}
+
+class MatPoolTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    current = NativeMemory::current();
+    cached = NativeMemory::pool_cached();
+  }
+
+  MatPoolRef pool{make_mat_pool()};
+  int64_t current{0};
+  int64_t cached{0};
+};
+
+} // namespace
+
+TEST_F(MatPoolTest, SameSizeReusesBuffer) {
+  uchar *data = make_mat(*pool, 1000, 1000).data;
+  MatPoolStats stats = pool->get_stats();
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.in_use, 0);
+  EXPECT_EQ(stats.cached, megabyte_class);
+
+  cv::Mat mat = make_mat(*pool, 1000, 1000);
+  EXPECT_EQ(mat.data, data);
+  stats = pool->get_stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.in_use, megabyte_class);
+  EXPECT_EQ(stats.cached, 0);
+  EXPECT_EQ(stats.high_water, megabyte_class);
+}
+
+TEST_F(MatPoolTest, SizeClassIsShared) {
+  uchar *data = make_mat(*pool, 1000, 1000).data;
+  EXPECT_EQ(make_mat(*pool, 1000, 1010).data, data);
+  EXPECT_EQ(pool->get_stats().hits, 1);
+
+  // Past the class, so the heap serves it
+  make_mat(*pool, 1000, 1100);
+  EXPECT_EQ(pool->get_stats().misses, 2);
+}
+
+TEST_F(MatPoolTest, ConcurrentBuffersAreDistinct) {
+  cv::Mat a = make_mat(*pool, 1000, 1000);
+  cv::Mat b = make_mat(*pool, 1000, 1000);
+  EXPECT_NE(a.data, b.data);
+  EXPECT_EQ(pool->get_stats().misses, 2);
+  EXPECT_EQ(pool->get_stats().high_water, 2 * megabyte_class);
+}
+
+TEST_F(MatPoolTest, OutputsOfPoolMatsUsePool) {
+  cv::Mat source(1000, 1000, CV_8U, cv::Scalar(1));
+  cv::Mat resized = pool->mat();
+  cv::resize(source, resized, cv::Size(2000, 1000));
+  EXPECT_EQ(pool->get_stats().misses, 1);
+  EXPECT_EQ(pool->get_stats().in_use, 2 * megabyte_class);
+}
+
+TEST_F(MatPoolTest, SmallBuffersBypassPool) {
+  make_mat(*pool, 10, 10);
+  MatPoolStats stats = pool->get_stats();
+  EXPECT_EQ(stats.hits + stats.misses, 0);
+  EXPECT_EQ(stats.cached, 0);
+  EXPECT_EQ(NativeMemory::current(), current);
+}
+
+TEST_F(MatPoolTest, NativeMemoryCountsCache) {
+  {
+    cv::Mat mat = make_mat(*pool, 1000, 1000);
+    EXPECT_EQ(NativeMemory::current(), current + megabyte_class);
+    EXPECT_EQ(NativeMemory::pool_cached(), cached);
+  }
+  // Still held, but by the cache and not in use
+  EXPECT_EQ(NativeMemory::current(), current + megabyte_class);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached + megabyte_class);
+
+  cv::Mat mat = make_mat(*pool, 1000, 1000);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached);
+}
+
+TEST_F(MatPoolTest, TrimFreesCache) {
+  cv::Mat kept = make_mat(*pool, 1000, 1000);
+  make_mat(*pool, 1000, 2000);
+  EXPECT_EQ(pool->get_stats().high_water, 3 * megabyte_class);
+
+  pool->trim();
+  MatPoolStats stats = pool->get_stats();
+  EXPECT_EQ(stats.cached, 0);
+  EXPECT_EQ(stats.in_use, megabyte_class);
+  EXPECT_EQ(stats.high_water, megabyte_class);
+  EXPECT_EQ(NativeMemory::current(), current + megabyte_class);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached);
+
+  make_mat(*pool, 1000, 2000);
+  EXPECT_EQ(pool->get_stats().misses, 3);
+}
+
+TEST_F(MatPoolTest, MatsOutliveReleasedPool) {
+  cv::Mat mat = make_mat(*pool, 1000, 1000);
+  mat.setTo(7);
+  make_mat(*pool, 1000, 2000);
+  pool.reset();
+
+  // The cache is freed with the release, the buffer in use once it is
+  // returned
+  EXPECT_EQ(NativeMemory::current(), current + megabyte_class);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached);
+  EXPECT_EQ(cv::countNonZero(mat != 7), 0);
+  mat.release();
+  EXPECT_EQ(NativeMemory::current(), current);
+}
+
+TEST_F(MatPoolTest, TensorPoolReusesBySizeAndStage) {
+  TensorPool tensors;
+  void *scores = tensors.acquire(16, Stage::POSTPROCESS);
+  void *masks = tensors.acquire(1024, Stage::POSTPROCESS);
+  tensors.recycle(scores);
+  tensors.recycle(masks);
+  EXPECT_EQ(tensors.get_cached(), 16 + 1024);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached + 16 + 1024);
+
+  EXPECT_EQ(tensors.acquire(1024, Stage::POSTPROCESS), masks);
+  EXPECT_EQ(tensors.acquire(16, Stage::POSTPROCESS), scores);
+  EXPECT_EQ(tensors.get_cached(), 0);
+
+  // Another stage or size is a new buffer
+  void *prompt = tensors.acquire(16, Stage::PREPROCESS);
+  EXPECT_NE(prompt, scores);
+  EXPECT_EQ(cutout::tensor_bytes(prompt), 16);
+  EXPECT_EQ(cutout::tensor_stage(prompt), Stage::PREPROCESS);
+  for (void *data : {scores, masks, prompt}) {
+    tensors.recycle(data);
+  }
+}
+
+TEST_F(MatPoolTest, TensorPoolTrimFreesCache) {
+  {
+    TensorPool tensors;
+    tensors.recycle(tensors.acquire(4096, Stage::POSTPROCESS));
+    EXPECT_EQ(NativeMemory::current(), current + 4096);
+
+    tensors.trim();
+    EXPECT_EQ(tensors.get_cached(), 0);
+    EXPECT_EQ(NativeMemory::current(), current);
+    EXPECT_EQ(NativeMemory::pool_cached(), cached);
+
+    tensors.recycle(tensors.acquire(4096, Stage::POSTPROCESS));
+  }
+  // The destructor frees what is left
+  EXPECT_EQ(NativeMemory::current(), current);
+  EXPECT_EQ(NativeMemory::pool_cached(), cached);
+}
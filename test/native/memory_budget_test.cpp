@@ -0,0 +1,276 @@
+#include "memory_budget.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <vector>
+
+using cutout::DecodePlan;
+using cutout::ImageFormat;
+using cutout::MemoryBudget;
+using cutout::NativeMemory;
+using cutout::read_image_size;
+
+namespace {
+
+std::string temp_path(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void write_file(const std::string &path, const std::vector<uint8_t> &bytes) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+void append_be32(std::vector<uint8_t> &bytes, uint32_t value) {
+  bytes.insert(bytes.end(), {uint8_t(value >> 24), uint8_t(value >> 16),
+                             uint8_t(value >> 8), uint8_t(value)});
+}
+
+void append_le32(std::vector<uint8_t> &bytes, uint32_t value) {
+  bytes.insert(bytes.end(), {uint8_t(value), uint8_t(value >> 8),
+                             uint8_t(value >> 16), uint8_t(value >> 24)});
+}
+
+// A JFIF header, a fill byte and a Huffman table ahead of a progressive
+// start of frame, which the header walk has to skip
+std::vector<uint8_t> jpeg_header(int width, int height) {
+  std::vector<uint8_t> bytes = {0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10};
+  bytes.insert(bytes.end(), 14, 0);
+  bytes.insert(bytes.end(), {0xff, 0xff, 0xc4, 0x00, 0x04, 0x00, 0x00});
+  bytes.insert(bytes.end(),
+               {0xff, 0xc2, 0x00, 0x11, 0x08, uint8_t(height >> 8),
+                uint8_t(height), uint8_t(width >> 8), uint8_t(width)});
+  bytes.insert(bytes.end(), 12, 0);
+  return bytes;
+}
+
+std::vector<uint8_t> png_header(int width, int height) {
+  std::vector<uint8_t> bytes = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  append_be32(bytes, 13);
+  bytes.insert(bytes.end(), {'I', 'H', 'D', 'R'});
+  append_be32(bytes, width);
+  append_be32(bytes, height);
+  bytes.insert(bytes.end(), {8, 2, 0, 0, 0});
+  append_be32(bytes, 0);
+  return bytes;
+}
+
+// RIFF header and the first bytes of a `chunk` chunk; the payload starts
+// at offset 20
+std::vector<uint8_t> webp_header(const char *chunk,
+                                 const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> bytes = {'R', 'I', 'F', 'F'};
+  append_le32(bytes, 4 + 8 + payload.size());
+  bytes.insert(bytes.end(), {'W', 'E', 'B', 'P'});
+  bytes.insert(bytes.end(), chunk, chunk + 4);
+  append_le32(bytes, payload.size());
+  bytes.insert(bytes.end(), payload.begin(), payload.end());
+  return bytes;
+}
+
+class ImageHeaderTest : public ::testing::Test {
+protected:
+  void TearDown() override { std::filesystem::remove(path); }
+
+  bool read(const std::vector<uint8_t> &bytes) {
+    write_file(path, bytes);
+    return read_image_size(path, size, &format);
+  }
+
+  std::string path{temp_path("cutout_image_header_test")};
+  cv::Size size;
+  ImageFormat format{ImageFormat::UNKNOWN};
+};
+
+// Plans for 48 MP photos against a limit of what is in use plus
+// `available`; PNGs are streamed in strips, JPEGs held whole
+class MemoryBudgetTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    budget.set_limit(0);
+    std::filesystem::remove(path);
+  }
+
+  DecodePlan plan(const std::vector<uint8_t> &header, int64_t available) {
+    write_file(path, header);
+    budget.set_limit(available == 0 ? 0 : NativeMemory::in_use() + available);
+    return budget.plan(path);
+  }
+
+  MemoryBudget &budget{MemoryBudget::instance()};
+  std::string path{temp_path("cutout_memory_budget_test")};
+  const cv::Size photo{8000, 6000};
+  const int64_t whole = 8000LL * 6000 * MemoryBudget::bytes_per_pixel;
+};
+
+} // namespace
+
+TEST_F(ImageHeaderTest, ReadsJpegFrameSize) {
+  ASSERT_TRUE(read(jpeg_header(4032, 3024)));
+  EXPECT_EQ(format, ImageFormat::JPEG);
+  EXPECT_EQ(size, cv::Size(4032, 3024));
+}
+
+TEST_F(ImageHeaderTest, ReadsPngHeaderSize) {
+  ASSERT_TRUE(read(png_header(8000, 6000)));
+  EXPECT_EQ(format, ImageFormat::PNG);
+  EXPECT_EQ(size, cv::Size(8000, 6000));
+}
+
+TEST_F(ImageHeaderTest, ReadsLossyWebPSize) {
+  // Frame tag, start code, then 14-bit sizes with 2 bits of scaling
+  std::vector<uint8_t> payload = {0, 0, 0, 0x9d, 0x01, 0x2a,
+                                  0x40, 0x46, 0x70, 0x57};
+  ASSERT_TRUE(read(webp_header("VP8 ", payload)));
+  EXPECT_EQ(format, ImageFormat::WEBP);
+  EXPECT_EQ(size, cv::Size(1600, 6000));
+}
+
+TEST_F(ImageHeaderTest, ReadsLosslessWebPSize) {
+  // Signature, then width - 1 and height - 1 in 14 bits each
+  uint32_t bits = (1920 - 1) | (1080 - 1) << 14;
+  std::vector<uint8_t> payload = {0x2f};
+  append_le32(payload, bits);
+  payload.insert(payload.end(), 5, 0);
+  ASSERT_TRUE(read(webp_header("VP8L", payload)));
+  EXPECT_EQ(size, cv::Size(1920, 1080));
+}
+
+TEST_F(ImageHeaderTest, ReadsExtendedWebPSize) {
+  // Flags, reserved bytes, then 24-bit canvas width - 1 and height - 1
+  std::vector<uint8_t> payload = {0x10, 0, 0, 0};
+  int width = 20000 - 1, height = 15000 - 1;
+  payload.insert(payload.end(), {uint8_t(width), uint8_t(width >> 8),
+                                 uint8_t(width >> 16), uint8_t(height),
+                                 uint8_t(height >> 8), uint8_t(height >> 16)});
+  ASSERT_TRUE(read(webp_header("VP8X", payload)));
+  EXPECT_EQ(size, cv::Size(20000, 15000));
+}
+
+TEST_F(ImageHeaderTest, RejectsUnknownAndTruncatedFiles) {
+  EXPECT_FALSE(read({'G', 'I', 'F', '8', '9', 'a'}));
+  EXPECT_EQ(format, ImageFormat::UNKNOWN);
+
+  std::vector<uint8_t> png = png_header(640, 480);
+  EXPECT_FALSE(read(std::vector<uint8_t>(png.begin(), png.begin() + 20)));
+
+  // Ends before the start of frame
+  std::vector<uint8_t> jpeg = jpeg_header(640, 480);
+  EXPECT_FALSE(read(std::vector<uint8_t>(jpeg.begin(), jpeg.begin() + 24)));
+
+  EXPECT_FALSE(read(png_header(0, 480)));
+  EXPECT_FALSE(read_image_size(temp_path("cutout_missing_image"), size));
+}
+
+TEST_F(MemoryBudgetTest, NoLimitKeepsFullSize) {
+  DecodePlan plan = this->plan(png_header(8000, 6000), 0);
+  EXPECT_EQ(plan.original, photo);
+  EXPECT_EQ(plan.format, ImageFormat::PNG);
+  EXPECT_EQ(plan.reduction, 1);
+  EXPECT_EQ(plan.target, photo);
+  EXPECT_EQ(plan.estimate, whole);
+  EXPECT_EQ(plan.strip_rows, 0);
+}
+
+TEST_F(MemoryBudgetTest, FittingImageKeepsFullSize) {
+  DecodePlan plan = this->plan(jpeg_header(8000, 6000), whole);
+  EXPECT_EQ(plan.reduction, 1);
+  EXPECT_EQ(plan.target, photo);
+  EXPECT_EQ(plan.strip_rows, 0);
+}
+
+TEST_F(MemoryBudgetTest, ReducesByPowersOfTwo) {
+  DecodePlan plan = this->plan(jpeg_header(8000, 6000), whole / 4);
+  EXPECT_EQ(plan.reduction, 2);
+  EXPECT_EQ(plan.target, cv::Size(4000, 3000));
+  EXPECT_EQ(plan.estimate, whole / 4);
+
+  plan = this->plan(jpeg_header(8000, 6000), whole / 64);
+  EXPECT_EQ(plan.reduction, 8);
+  EXPECT_EQ(plan.target, cv::Size(1000, 750));
+}
+
+TEST_F(MemoryBudgetTest, ReductionRoundsUp) {
+  int64_t available = 2001LL * 1501 * MemoryBudget::bytes_per_pixel;
+  DecodePlan plan = this->plan(jpeg_header(4001, 3001), available);
+  EXPECT_EQ(plan.reduction, 2);
+  EXPECT_EQ(plan.target, cv::Size(2001, 1501));
+}
+
+TEST_F(MemoryBudgetTest, ShrinksPastLargestReductionToFloor) {
+  // Nothing fits, so the target stops at the 320 pixel floor
+  DecodePlan plan = this->plan(jpeg_header(8000, 6000), 1);
+  EXPECT_EQ(plan.reduction, 8);
+  EXPECT_EQ(plan.target, cv::Size(320, 240));
+  EXPECT_EQ(plan.estimate, 320 * 240 * MemoryBudget::bytes_per_pixel);
+}
+
+TEST_F(MemoryBudgetTest, ShrinksToAreaThatFits) {
+  int64_t available = 1000LL * 750 * MemoryBudget::bytes_per_pixel / 4;
+  DecodePlan plan = this->plan(jpeg_header(8000, 6000), available);
+  EXPECT_EQ(plan.reduction, 8);
+  EXPECT_EQ(plan.target, cv::Size(500, 375));
+  EXPECT_LE(plan.estimate, available);
+}
+
+TEST_F(MemoryBudgetTest, ReductionStopsAtFloor) {
+  // A 1/4 decode would have a longest side of 250
+  DecodePlan plan = this->plan(jpeg_header(1000, 800), 1);
+  EXPECT_EQ(plan.reduction, 2);
+  EXPECT_EQ(plan.target, cv::Size(320, 256));
+}
+
+TEST_F(MemoryBudgetTest, SmallImagesAreNeverReduced) {
+  DecodePlan plan = this->plan(jpeg_header(200, 100), 1);
+  EXPECT_EQ(plan.reduction, 1);
+  EXPECT_EQ(plan.target, cv::Size(200, 100));
+  EXPECT_EQ(plan.strip_rows, 0);
+}
+
+TEST_F(MemoryBudgetTest, StripsHoldWholeImagesButPngs) {
+  // The BGR pixels of the JPEG take 144 MB of the 200, which leaves room
+  // for 512 rows per strip instead of 1024
+  int64_t available = 200LL * 1000 * 1000;
+  DecodePlan png = plan(png_header(8000, 6000), available);
+  EXPECT_EQ(png.target, cv::Size(4000, 3000));
+  EXPECT_EQ(png.strip_rows, 1024);
+
+  DecodePlan jpeg = plan(jpeg_header(8000, 6000), available);
+  EXPECT_EQ(jpeg.target, cv::Size(4000, 3000));
+  EXPECT_EQ(jpeg.strip_rows, 512);
+
+  // Not even the smallest strip fits
+  EXPECT_EQ(plan(png_header(8000, 6000), 1).strip_rows, 0);
+}
+
+TEST_F(MemoryBudgetTest, PoolCachesDoNotCount) {
+  const int64_t bytes = whole / 4 * 3;
+  NativeMemory::allocated(bytes);
+  NativeMemory::cached(bytes);
+  EXPECT_EQ(plan(jpeg_header(8000, 6000), whole).reduction, 1);
+
+  // Taken from the cache into use, the same bytes do count
+  NativeMemory::cached(-bytes);
+  EXPECT_EQ(budget.plan(path).reduction, 2);
+  NativeMemory::freed(bytes);
+}
+
+TEST_F(MemoryBudgetTest, DecodesAsPlanned) {
+  cv::Mat image(1200, 1600, CV_8UC3, cv::Scalar(30, 60, 90));
+  std::string jpeg_path = temp_path("cutout_memory_budget_test.jpg");
+  ASSERT_TRUE(cv::imwrite(jpeg_path, image));
+  image.release();
+
+  cv::Size original;
+  budget.set_limit(NativeMemory::in_use() + 800LL * 600 *
+                                                MemoryBudget::bytes_per_pixel);
+  cv::Mat decoded = budget.decode(jpeg_path, original);
+  EXPECT_EQ(original, cv::Size(1600, 1200));
+  EXPECT_EQ(decoded.size(), cv::Size(800, 600));
+
+  budget.set_limit(0);
+  decoded = budget.decode(jpeg_path, original);
+  EXPECT_EQ(decoded.size(), cv::Size(1600, 1200));
+  std::filesystem::remove(jpeg_path);
+}
@@ -0,0 +1,146 @@
+#include "model_registry.cpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Sessions are opaque to the registry, so any nonzero value stands in for
+// one
+const int64_t first = 0x1000;
+const int64_t second = 0x2000;
+const int64_t third = 0x3000;
+
+class ModelRegistryTest : public ::testing::Test {
+protected:
+  ModelRegistry registry;
+};
+
+} // namespace
+
+TEST_F(ModelRegistryTest, AcquireOfUnloadedModelAddsNoHolder) {
+  EXPECT_EQ(registry.acquire("u2net"), 0);
+  EXPECT_EQ(registry.acquire("u2net"), 0);
+  EXPECT_EQ(registry.release("u2net"), 0);
+
+  // The failed acquires left nothing to release
+  EXPECT_EQ(registry.publish("u2net", first), first);
+  EXPECT_EQ(registry.release("u2net"), first);
+}
+
+TEST_F(ModelRegistryTest, LastHolderFreesSession) {
+  EXPECT_EQ(registry.publish("u2net", first), first);
+  EXPECT_EQ(registry.acquire("u2net"), first);
+  EXPECT_EQ(registry.acquire("u2net"), first);
+
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_EQ(registry.release("u2net"), first);
+  EXPECT_EQ(registry.acquire("u2net"), 0);
+}
+
+TEST_F(ModelRegistryTest, SlowerPublisherGetsFirstSession) {
+  EXPECT_EQ(registry.publish("u2net", first), first);
+  // The caller frees its own session and still becomes a holder
+  EXPECT_EQ(registry.publish("u2net", second), first);
+
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_EQ(registry.release("u2net"), first);
+}
+
+TEST_F(ModelRegistryTest, ModelsAreCountedApart) {
+  registry.publish("u2net", first);
+  registry.publish("sam", second);
+
+  EXPECT_EQ(registry.acquire("u2net"), first);
+  EXPECT_EQ(registry.release("sam"), second);
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_EQ(registry.release("u2net"), first);
+}
+
+TEST_F(ModelRegistryTest, ReleaseOfUnknownModelFreesNothing) {
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_EQ(registry.lease("u2net"), 0);
+  EXPECT_FALSE(registry.return_lease(first));
+}
+
+TEST_F(ModelRegistryTest, LeasesDoNotFreeCurrentSession) {
+  registry.publish("u2net", first);
+  EXPECT_EQ(registry.lease("u2net"), first);
+  EXPECT_EQ(registry.lease("u2net"), first);
+  EXPECT_FALSE(registry.return_lease(first));
+  EXPECT_FALSE(registry.return_lease(first));
+}
+
+TEST_F(ModelRegistryTest, SwapFreesIdleSessionRightAway) {
+  registry.publish("u2net", first);
+  EXPECT_EQ(registry.swap("u2net", second), first);
+  EXPECT_EQ(registry.lease("u2net"), second);
+  EXPECT_EQ(registry.acquire("u2net"), second);
+}
+
+TEST_F(ModelRegistryTest, LastLeaseFreesRetiredSession) {
+  registry.publish("u2net", first);
+  int64_t leased = registry.lease("u2net");
+  registry.lease("u2net");
+
+  EXPECT_EQ(registry.swap("u2net", second), 0);
+  EXPECT_EQ(registry.lease("u2net"), second);
+
+  EXPECT_FALSE(registry.return_lease(leased));
+  EXPECT_TRUE(registry.return_lease(leased));
+  EXPECT_FALSE(registry.return_lease(second));
+}
+
+TEST_F(ModelRegistryTest, SwapOfUnheldModelReturnsCallersSession) {
+  EXPECT_EQ(registry.swap("u2net", first), first);
+  EXPECT_EQ(registry.lease("u2net"), 0);
+
+  registry.publish("u2net", first);
+  registry.release("u2net");
+  EXPECT_EQ(registry.swap("u2net", second), second);
+}
+
+TEST_F(ModelRegistryTest, ReleaseAfterSwapFreesNewSession) {
+  registry.publish("u2net", first);
+  registry.swap("u2net", second);
+  EXPECT_EQ(registry.release("u2net"), second);
+}
+
+TEST_F(ModelRegistryTest, ReleaseDuringLeaseLeavesFreeingToLease) {
+  registry.publish("u2net", first);
+  registry.swap("u2net", second);
+  registry.lease("u2net");
+
+  EXPECT_EQ(registry.release("u2net"), 0);
+  EXPECT_TRUE(registry.return_lease(second));
+}
+
+TEST_F(ModelRegistryTest, VersionChangesWithEverySwap) {
+  EXPECT_EQ(registry.version("u2net"), 0u);
+  registry.publish("u2net", first);
+  EXPECT_EQ(registry.version("u2net"), 0u);
+
+  registry.swap("u2net", second);
+  uint64_t swapped = registry.version("u2net");
+  EXPECT_NE(swapped, 0u);
+  registry.swap("u2net", third);
+  EXPECT_NE(registry.version("u2net"), swapped);
+
+  registry.release("u2net");
+  EXPECT_EQ(registry.version("u2net"), 0u);
+}
+
+TEST_F(ModelRegistryTest, ContentFollowsCurrentSession) {
+  EXPECT_EQ(registry.content("u2net"), 0u);
+  registry.publish("u2net", first, 0xaa);
+  // A slower loader's content goes with its discarded session
+  registry.publish("u2net", second, 0xbb);
+  EXPECT_EQ(registry.content("u2net"), 0xaau);
+
+  registry.swap("u2net", third, 0xcc);
+  EXPECT_EQ(registry.content("u2net"), 0xccu);
+
+  registry.release("u2net");
+  registry.release("u2net");
+  EXPECT_EQ(registry.content("u2net"), 0u);
+}
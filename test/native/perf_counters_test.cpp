@@ -0,0 +1,119 @@
+#include "perf_counters.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using cutout::PerfCounters;
+using cutout::PerfEvent;
+using cutout::PerfSample;
+
+namespace {
+
+PerfSample make_sample(int64_t cycles, int64_t instructions,
+                       int64_t cache_misses) {
+  PerfSample sample;
+  sample.values[(int)PerfEvent::CYCLES] = cycles;
+  sample.values[(int)PerfEvent::INSTRUCTIONS] = instructions;
+  sample.values[(int)PerfEvent::CACHE_MISSES] = cache_misses;
+  return sample;
+}
+
+} // namespace
+
+TEST(PerfSampleTest, StartsEmpty) {
+  PerfSample sample;
+  EXPECT_TRUE(sample.is_empty());
+  for (int i = 0; i < PerfSample::count; i++) {
+    EXPECT_FALSE(sample.has((PerfEvent)i));
+  }
+  EXPECT_EQ(sample.ipc(), 0);
+  EXPECT_EQ(sample.bytes_per_pixel(100), 0);
+}
+
+TEST(PerfSampleTest, SinceSubtractsCountedEvents) {
+  PerfSample start = make_sample(1000, 1500, 10);
+  PerfSample end = make_sample(4000, 7500, 30);
+
+  PerfSample delta = end.since(start);
+  EXPECT_FALSE(delta.is_empty());
+  EXPECT_EQ(delta.get(PerfEvent::CYCLES), 3000);
+  EXPECT_EQ(delta.get(PerfEvent::INSTRUCTIONS), 6000);
+  EXPECT_EQ(delta.get(PerfEvent::CACHE_MISSES), 20);
+  EXPECT_FALSE(delta.has(PerfEvent::BRANCH_MISSES));
+  EXPECT_FALSE(delta.has(PerfEvent::PAGE_FAULTS));
+}
+
+TEST(PerfSampleTest, SinceNeedsBothSamples) {
+  PerfSample start = make_sample(1000, -1, 10);
+  PerfSample end = make_sample(4000, 7500, -1);
+
+  PerfSample delta = end.since(start);
+  EXPECT_EQ(delta.get(PerfEvent::CYCLES), 3000);
+  EXPECT_FALSE(delta.has(PerfEvent::INSTRUCTIONS));
+  EXPECT_FALSE(delta.has(PerfEvent::CACHE_MISSES));
+
+  EXPECT_TRUE(PerfSample().since(start).is_empty());
+  EXPECT_TRUE(end.since(PerfSample()).is_empty());
+}
+
+TEST(PerfSampleTest, SinceClampsAtZero) {
+  // A counter scaled up for multiplexing may read lower than before
+  PerfSample delta = make_sample(900, 1500, 10).since(make_sample(1000, 1500, 5));
+  EXPECT_EQ(delta.get(PerfEvent::CYCLES), 0);
+  EXPECT_EQ(delta.get(PerfEvent::INSTRUCTIONS), 0);
+  EXPECT_EQ(delta.get(PerfEvent::CACHE_MISSES), 5);
+  EXPECT_FALSE(delta.is_empty());
+}
+
+TEST(PerfSampleTest, IpcIsInstructionsPerCycle) {
+  EXPECT_DOUBLE_EQ(make_sample(2000, 3000, -1).ipc(), 1.5);
+  EXPECT_DOUBLE_EQ(make_sample(4000, 1000, -1).ipc(), 0.25);
+}
+
+TEST(PerfSampleTest, IpcNeedsBothCounters) {
+  EXPECT_EQ(make_sample(2000, -1, -1).ipc(), 0);
+  EXPECT_EQ(make_sample(-1, 3000, -1).ipc(), 0);
+  EXPECT_EQ(make_sample(0, 3000, -1).ipc(), 0);
+}
+
+TEST(PerfSampleTest, BytesPerPixelChargesCacheLines) {
+  EXPECT_DOUBLE_EQ(make_sample(-1, -1, 100).bytes_per_pixel(3200), 2);
+  EXPECT_EQ(make_sample(-1, -1, 100).bytes_per_pixel(0), 0);
+  EXPECT_EQ(make_sample(-1, -1, -1).bytes_per_pixel(3200), 0);
+}
+
+TEST(PerfEventTest, Names) {
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::CYCLES), "cycles");
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::INSTRUCTIONS),
+               "instructions");
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::CACHE_MISSES),
+               "cache_misses");
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::BRANCH_MISSES),
+               "branch_misses");
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::PAGE_FAULTS),
+               "page_faults");
+  EXPECT_STREQ(cutout::perf_event_name(PerfEvent::COUNT), "unknown");
+}
+
+// Whatever the kernel allows here, reads never go backwards and missing
+// counters stay missing
+TEST(PerfCountersTest, CountsOnlyGrow) {
+  PerfCounters &counters = PerfCounters::for_thread();
+  EXPECT_EQ(&counters, &PerfCounters::for_thread());
+
+  PerfSample start = counters.read();
+  EXPECT_EQ(start.is_empty(), !counters.is_available());
+
+  volatile uint64_t sum = 0;
+  for (int i = 0; i < 1000000; i++) {
+    sum = sum + i;
+  }
+  PerfSample delta = counters.read().since(start);
+  for (int i = 0; i < PerfSample::count; i++) {
+    auto event = (PerfEvent)i;
+    EXPECT_EQ(delta.has(event), start.has(event)) << i;
+  }
+  if (delta.has(PerfEvent::INSTRUCTIONS)) {
+    EXPECT_GT(delta.get(PerfEvent::INSTRUCTIONS), 1000000);
+  }
+}
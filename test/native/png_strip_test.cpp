@@ -0,0 +1,303 @@
+#include "png_strip.hpp"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+
+using cutout::PngStripReader;
+using cutout::PngStripWriter;
+
+namespace {
+
+enum Filter { NONE = 0, SUB = 1, UP = 2, AVERAGE = 3, PAETH = 4 };
+
+std::string temp_path(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+std::vector<uint8_t> random_bytes(size_t size, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t &byte : bytes) {
+    byte = rng() & 0xff;
+  }
+  return bytes;
+}
+
+int channels_of(int color_type) {
+  switch (color_type) {
+  case 0:
+    return 1;
+  case 2:
+    return 3;
+  case 4:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+// BGR as the reader returns the pixels of a PNG row: gray is replicated
+// and alpha dropped
+std::vector<uint8_t> to_bgr(const std::vector<uint8_t> &pixels, int width,
+                            int height, int channels) {
+  std::vector<uint8_t> bgr((size_t)width * height * 3);
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    const uint8_t *pixel = &pixels[i * channels];
+    if (channels <= 2) {
+      bgr[i * 3] = bgr[i * 3 + 1] = bgr[i * 3 + 2] = pixel[0];
+    } else {
+      bgr[i * 3] = pixel[2];
+      bgr[i * 3 + 1] = pixel[1];
+      bgr[i * 3 + 2] = pixel[0];
+    }
+  }
+  return bgr;
+}
+
+uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// A row as the PNG encoder filters it, after its filter byte
+std::vector<uint8_t> filter_row(const uint8_t *row, const uint8_t *above,
+                                int size, int bpp, uint8_t filter) {
+  std::vector<uint8_t> filtered = {filter};
+  for (int i = 0; i < size; i++) {
+    int a = i >= bpp ? row[i - bpp] : 0;
+    int b = above[i];
+    int c = i >= bpp ? above[i - bpp] : 0;
+    int predictor = filter == SUB       ? a
+                    : filter == UP      ? b
+                    : filter == AVERAGE ? (a + b) / 2
+                    : filter == PAETH   ? paeth(a, b, c)
+                                        : 0;
+    filtered.push_back(uint8_t(row[i] - predictor));
+  }
+  return filtered;
+}
+
+void append_be32(std::vector<uint8_t> &bytes, uint32_t value) {
+  bytes.insert(bytes.end(), {uint8_t(value >> 24), uint8_t(value >> 16),
+                             uint8_t(value >> 8), uint8_t(value)});
+}
+
+void append_chunk(std::vector<uint8_t> &png, const char *type,
+                  const uint8_t *data, size_t size) {
+  append_be32(png, size);
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data, data + size);
+  uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+  append_be32(png, crc32(crc, data, size));
+}
+
+struct PngOptions {
+  int color_type{6};
+  std::vector<uint8_t> filters{NONE};
+  size_t idat_size{1 << 16};
+  uint8_t bit_depth{8};
+  uint8_t interlace{0};
+};
+
+// A PNG whose row y uses `filters[y % filters.size()]`, with a text chunk
+// ahead of the image data and IDAT chunks of at most `idat_size` bytes
+void write_png(const std::string &path, const std::vector<uint8_t> &pixels,
+               int width, int height, const PngOptions &options) {
+  int channels = channels_of(options.color_type);
+  int size = width * channels;
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> zeros(size, 0);
+  for (int y = 0; y < height; y++) {
+    const uint8_t *row = &pixels[(size_t)y * size];
+    const uint8_t *above = y == 0 ? zeros.data() : row - size;
+    uint8_t filter = options.filters[y % options.filters.size()];
+    auto filtered = filter_row(row, above, size, channels, filter);
+    raw.insert(raw.end(), filtered.begin(), filtered.end());
+  }
+
+  uLongf compressed_size = compressBound(raw.size());
+  std::vector<uint8_t> compressed(compressed_size);
+  ASSERT_EQ(compress(compressed.data(), &compressed_size, raw.data(),
+                     raw.size()),
+            Z_OK);
+  compressed.resize(compressed_size);
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  std::vector<uint8_t> header;
+  append_be32(header, width);
+  append_be32(header, height);
+  header.insert(header.end(), {options.bit_depth, (uint8_t)options.color_type,
+                               0, 0, options.interlace});
+  append_chunk(png, "IHDR", header.data(), header.size());
+  const char text[] = "Software\0cutout";
+  append_chunk(png, "tEXt", reinterpret_cast<const uint8_t *>(text),
+               sizeof(text) - 1);
+  for (size_t offset = 0; offset < compressed.size();
+       offset += options.idat_size) {
+    size_t chunk = std::min(options.idat_size, compressed.size() - offset);
+    append_chunk(png, "IDAT", compressed.data() + offset, chunk);
+  }
+  append_chunk(png, "IEND", nullptr, 0);
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  std::fwrite(png.data(), 1, png.size(), file);
+  std::fclose(file);
+}
+
+// Every row of the PNG at `path` through the reader
+std::vector<uint8_t> read_png(const std::string &path, int width,
+                              int height) {
+  PngStripReader reader;
+  EXPECT_TRUE(reader.open(path));
+  EXPECT_EQ(reader.get_width(), width);
+  EXPECT_EQ(reader.get_height(), height);
+
+  std::vector<uint8_t> bgr((size_t)width * height * 3);
+  for (int y = 0; y < height; y++) {
+    EXPECT_TRUE(reader.read_row(&bgr[(size_t)y * width * 3])) << "row " << y;
+  }
+  uint8_t extra[3 * 64];
+  EXPECT_FALSE(reader.read_row(extra));
+  return bgr;
+}
+
+class PngStripTest : public ::testing::Test {
+protected:
+  void TearDown() override { std::filesystem::remove(path); }
+
+  std::string path{temp_path("cutout_png_strip_test.png")};
+};
+
+// Color type and filters of each row
+using FilterCase = std::tuple<int, std::vector<uint8_t>>;
+
+class PngStripFilterTest : public PngStripTest,
+                           public ::testing::WithParamInterface<FilterCase> {
+};
+
+} // namespace
+
+TEST_P(PngStripFilterTest, DecodesFilteredRows) {
+  const int width = 61, height = 23;
+  PngOptions options;
+  options.color_type = std::get<0>(GetParam());
+  options.filters = std::get<1>(GetParam());
+  options.idat_size = 97;
+  int channels = channels_of(options.color_type);
+
+  auto pixels = random_bytes((size_t)width * height * channels, 7);
+  // Smooth rows too, where the predictors are exact and the wrap-around of
+  // the byte arithmetic does not hide mistakes
+  for (int y = 0; y < height / 2; y++) {
+    for (int i = 0; i < width * channels; i++) {
+      pixels[(size_t)y * width * channels + i] = uint8_t(i + y * 3);
+    }
+  }
+  write_png(path, pixels, width, height, options);
+
+  EXPECT_EQ(read_png(path, width, height),
+            to_bgr(pixels, width, height, channels));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    EveryFilter, PngStripFilterTest,
+    ::testing::Combine(
+        ::testing::Values(0, 2, 4, 6),
+        ::testing::Values(std::vector<uint8_t>{NONE}, std::vector<uint8_t>{SUB},
+                          std::vector<uint8_t>{UP},
+                          std::vector<uint8_t>{AVERAGE},
+                          std::vector<uint8_t>{PAETH},
+                          std::vector<uint8_t>{NONE, SUB, UP, AVERAGE, PAETH},
+                          std::vector<uint8_t>{PAETH, UP, AVERAGE, SUB})));
+
+TEST_F(PngStripTest, RejectsUnknownFilter) {
+  const int width = 8, height = 4;
+  PngOptions options;
+  options.filters = {NONE, SUB, 5};
+  write_png(path, random_bytes(width * height * 4, 1), width, height, options);
+
+  PngStripReader reader;
+  ASSERT_TRUE(reader.open(path));
+  std::vector<uint8_t> bgr(width * 3);
+  EXPECT_TRUE(reader.read_row(bgr.data()));
+  EXPECT_TRUE(reader.read_row(bgr.data()));
+  EXPECT_FALSE(reader.read_row(bgr.data()));
+}
+
+TEST_F(PngStripTest, RejectsUnsupportedFormats) {
+  auto pixels = random_bytes(8 * 8 * 8, 1);
+  PngOptions options;
+  options.bit_depth = 16;
+  write_png(path, pixels, 8, 8, options);
+  PngStripReader reader;
+  EXPECT_FALSE(reader.open(path));
+
+  options.bit_depth = 8;
+  options.interlace = 1;
+  write_png(path, pixels, 8, 8, options);
+  EXPECT_FALSE(reader.open(path));
+
+  // Palette
+  options.interlace = 0;
+  options.color_type = 3;
+  write_png(path, pixels, 8, 8, options);
+  EXPECT_FALSE(reader.open(path));
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  std::fputs("not a png", file);
+  std::fclose(file);
+  EXPECT_FALSE(reader.open(path));
+  EXPECT_FALSE(reader.open(temp_path("cutout_missing.png")));
+}
+
+TEST_F(PngStripTest, RejectsTruncatedData) {
+  const int width = 64, height = 64;
+  write_png(path, random_bytes(width * height * 4, 1), width, height,
+            PngOptions());
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+
+  PngStripReader reader;
+  ASSERT_TRUE(reader.open(path));
+  std::vector<uint8_t> bgr(width * 3);
+  int rows = 0;
+  while (rows < height && reader.read_row(bgr.data())) {
+    rows++;
+  }
+  EXPECT_LT(rows, height);
+}
+
+TEST_F(PngStripTest, WriterRoundTrip) {
+  // Noise, so the output spans several IDAT chunks
+  const int width = 301, height = 211;
+  auto bgra = random_bytes((size_t)width * height * 4, 3);
+
+  PngStripWriter writer;
+  ASSERT_TRUE(writer.open(path, width, height));
+  for (int y = 0; y < height; y++) {
+    ASSERT_TRUE(writer.write_row(&bgra[(size_t)y * width * 4]));
+  }
+  EXPECT_FALSE(writer.write_row(bgra.data()));
+  ASSERT_TRUE(writer.finish());
+
+  std::vector<uint8_t> bgr((size_t)width * height * 3);
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    std::copy_n(&bgra[i * 4], 3, &bgr[i * 3]);
+  }
+  EXPECT_EQ(read_png(path, width, height), bgr);
+}
+
+TEST_F(PngStripTest, UnfinishedWriteIsRemoved) {
+  const int width = 16, height = 4;
+  auto bgra = random_bytes(width * 4, 1);
+  {
+    PngStripWriter writer;
+    ASSERT_TRUE(writer.open(path, width, height));
+    EXPECT_TRUE(writer.write_row(bgra.data()));
+    EXPECT_FALSE(writer.finish());
+    EXPECT_TRUE(std::filesystem::exists(path));
+  }
+  EXPECT_FALSE(std::filesystem::exists(path));
+}
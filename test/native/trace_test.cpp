@@ -0,0 +1,320 @@
+#include "trace.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using cutout::PerfEvent;
+using cutout::PerfSample;
+using cutout::Stage;
+using cutout::Trace;
+using cutout::TraceSession;
+using cutout::TraceSpan;
+
+namespace {
+
+// Just enough of a JSON parser to check the dumps are valid and to read
+// the spans back; fails the test on any syntax error
+struct Json {
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type{NUL};
+  double number{0};
+  std::string string;
+  std::vector<Json> array;
+  std::map<std::string, Json> object;
+
+  const Json &operator[](const std::string &key) const {
+    static const Json missing;
+    auto found = object.find(key);
+    return found == object.end() ? missing : found->second;
+  }
+};
+
+class JsonParser {
+public:
+  explicit JsonParser(const std::string &text) : text(text) {}
+
+  bool parse(Json &value) {
+    return parse_value(value) && (skip_space(), position == text.size());
+  }
+
+private:
+  void skip_space() {
+    while (position < text.size() && std::isspace((uint8_t)text[position])) {
+      position++;
+    }
+  }
+
+  bool consume(char c) {
+    skip_space();
+    if (position < text.size() && text[position] == c) {
+      position++;
+      return true;
+    }
+    return false;
+  }
+
+  bool parse_value(Json &value) {
+    skip_space();
+    if (position >= text.size()) {
+      return false;
+    }
+    char c = text[position];
+    if (c == '{') {
+      return parse_object(value);
+    }
+    if (c == '[') {
+      return parse_array(value);
+    }
+    if (c == '"') {
+      value.type = Json::STRING;
+      return parse_string(value.string);
+    }
+    for (const char *word : {"true", "false", "null"}) {
+      if (text.compare(position, std::strlen(word), word) == 0) {
+        position += std::strlen(word);
+        value.type = word[0] == 'n' ? Json::NUL : Json::BOOL;
+        return true;
+      }
+    }
+    return parse_number(value);
+  }
+
+  bool parse_object(Json &value) {
+    value.type = Json::OBJECT;
+    consume('{');
+    if (consume('}')) {
+      return true;
+    }
+    do {
+      std::string key;
+      skip_space();
+      if (!parse_string(key) || !consume(':') ||
+          !parse_value(value.object[key])) {
+        return false;
+      }
+    } while (consume(','));
+    return consume('}');
+  }
+
+  bool parse_array(Json &value) {
+    value.type = Json::ARRAY;
+    consume('[');
+    if (consume(']')) {
+      return true;
+    }
+    do {
+      value.array.emplace_back();
+      if (!parse_value(value.array.back())) {
+        return false;
+      }
+    } while (consume(','));
+    return consume(']');
+  }
+
+  // Escapes are not produced by the trace, so they are not accepted
+  bool parse_string(std::string &string) {
+    if (position >= text.size() || text[position] != '"') {
+      return false;
+    }
+    size_t end = text.find('"', position + 1);
+    if (end == std::string::npos) {
+      return false;
+    }
+    string = text.substr(position + 1, end - position - 1);
+    position = end + 1;
+    return string.find('\\') == std::string::npos;
+  }
+
+  bool parse_number(Json &value) {
+    const char *start = text.c_str() + position;
+    char *end;
+    value.number = std::strtod(start, &end);
+    if (end == start || !(std::isdigit((uint8_t)*start) || *start == '-')) {
+      return false;
+    }
+    value.type = Json::NUMBER;
+    position += end - start;
+    return true;
+  }
+
+  const std::string &text;
+  size_t position{0};
+};
+
+Json parse_trace() {
+  std::string text = Trace::to_json();
+  Json trace;
+  EXPECT_TRUE(JsonParser(text).parse(trace)) << text.substr(0, 200);
+  EXPECT_EQ(trace["traceEvents"].type, Json::ARRAY);
+  EXPECT_EQ(trace["displayTimeUnit"].string, "ms");
+  return trace;
+}
+
+class TraceTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Trace::clear();
+    Trace::set_enabled(true);
+  }
+
+  void TearDown() override {
+    Trace::set_enabled(false);
+    Trace::set_perf_enabled(false);
+    Trace::clear();
+  }
+};
+
+} // namespace
+
+TEST_F(TraceTest, DisabledRecordsNothing) {
+  Trace::set_enabled(false);
+  EXPECT_EQ(Trace::next_request(), 0u);
+  {
+    TraceSession session;
+    TraceSpan span(Stage::PREPROCESS, session);
+    TraceSpan inner(Stage::DECODE);
+  }
+  EXPECT_TRUE(parse_trace()["traceEvents"].array.empty());
+}
+
+TEST_F(TraceTest, SpansAreChromeCompleteEvents) {
+  TraceSession session;
+  session.request = Trace::next_request();
+  EXPECT_NE(session.request, 0u);
+  {
+    TraceSpan span(Stage::PREPROCESS, session);
+    TraceSpan inner(Stage::DECODE);
+    inner.next(Stage::RESIZE);
+  }
+
+  Json trace = parse_trace();
+  const auto &events = trace["traceEvents"].array;
+  ASSERT_EQ(events.size(), 3u);
+  // Spans are recorded as they end, the inner ones first
+  EXPECT_EQ(events[0]["name"].string, "decode");
+  EXPECT_EQ(events[1]["name"].string, "resize");
+  EXPECT_EQ(events[2]["name"].string, "preprocess");
+  for (const Json &event : events) {
+    EXPECT_EQ(event["ph"].string, "X");
+    EXPECT_EQ(event["cat"].string, "cutout");
+    EXPECT_GE(event["dur"].number, 0);
+    EXPECT_EQ(event["tid"].number, events[0]["tid"].number);
+    // Nested spans inherit the request of the outer one
+    EXPECT_EQ(event["args"]["request"].number, (double)session.request);
+  }
+  EXPECT_LE(events[0]["ts"].number, events[1]["ts"].number);
+  EXPECT_LE(events[2]["ts"].number, events[0]["ts"].number);
+
+  // The request ends with the outer span
+  {
+    TraceSpan span(Stage::OTHER);
+  }
+  trace = parse_trace();
+  EXPECT_EQ(trace["traceEvents"].array.back()["args"]["request"].number, 0);
+}
+
+TEST_F(TraceTest, TimestampsAreMicroseconds) {
+  Trace::record(Stage::ENCODE, 1, 5000, 7500);
+  Json trace = parse_trace();
+  const Json &event = trace["traceEvents"].array.at(0);
+  EXPECT_DOUBLE_EQ(event["ts"].number, 5);
+  EXPECT_DOUBLE_EQ(event["dur"].number, 2.5);
+}
+
+TEST_F(TraceTest, RingKeepsMostRecentSpans) {
+  const uint64_t capacity = Trace::capacity, extra = 10;
+  for (uint64_t i = 0; i < capacity + extra; i++) {
+    Trace::record(Stage::OTHER, i + 1, i * 1000, i * 1000 + 1);
+  }
+
+  Json trace = parse_trace();
+  const auto &events = trace["traceEvents"].array;
+  ASSERT_EQ(events.size(), capacity);
+  EXPECT_EQ(events.front()["args"]["request"].number, (double)extra + 1);
+  EXPECT_EQ(events.back()["args"]["request"].number,
+            (double)(capacity + extra));
+  for (size_t i = 1; i < events.size(); i++) {
+    ASSERT_LT(events[i - 1]["ts"].number, events[i]["ts"].number);
+  }
+}
+
+TEST_F(TraceTest, ClearDropsRecordedSpans) {
+  Trace::record(Stage::OTHER, 1, 0, 1);
+  Trace::clear();
+  EXPECT_EQ(Trace::to_json(), "{\"traceEvents\":[],\"displayTimeUnit\":\"ms\"}");
+
+  Trace::record(Stage::OTHER, 2, 0, 1);
+  Json trace = parse_trace();
+  const auto &events = trace["traceEvents"].array;
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0]["args"]["request"].number, 2);
+}
+
+TEST_F(TraceTest, PerfCountsAreSpanArguments) {
+  PerfSample perf;
+  perf.values[(int)PerfEvent::CYCLES] = 2000;
+  perf.values[(int)PerfEvent::INSTRUCTIONS] = 3000;
+  perf.values[(int)PerfEvent::CACHE_MISSES] = 10;
+  Trace::record(Stage::UPSAMPLE, 1, 0, 1, perf, 320);
+
+  Json trace = parse_trace();
+  const Json &args = trace["traceEvents"].array.at(0)["args"];
+  EXPECT_EQ(args["cycles"].number, 2000);
+  EXPECT_EQ(args["instructions"].number, 3000);
+  EXPECT_EQ(args["cache_misses"].number, 10);
+  EXPECT_EQ(args["branch_misses"].type, Json::NUL);
+  EXPECT_DOUBLE_EQ(args["ipc"].number, 1.5);
+  EXPECT_EQ(args["pixels"].number, 320);
+  EXPECT_DOUBLE_EQ(args["bytes_per_pixel"].number, 2);
+}
+
+TEST_F(TraceTest, UncountedSpansHaveNoPerfArguments) {
+  Trace::record(Stage::UPSAMPLE, 1, 0, 1);
+  Json trace = parse_trace();
+  const Json &args = trace["traceEvents"].array.at(0)["args"];
+  EXPECT_EQ(args.object.size(), 1u);
+  EXPECT_EQ(args["request"].number, 1);
+}
+
+TEST_F(TraceTest, ConcurrentWritersKeepJsonValid) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([] {
+      for (uint64_t i = 0; i < Trace::capacity; i++) {
+        Trace::record(Stage::OTHER, i, 0, 1);
+      }
+    });
+  }
+  // Read while the ring wraps under the writers
+  for (int i = 0; i < 4; i++) {
+    parse_trace();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(parse_trace()["traceEvents"].array.size(), (size_t)Trace::capacity);
+}
+
+TEST_F(TraceTest, DumpWritesJson) {
+  Trace::record(Stage::OTHER, 1, 0, 1);
+  std::string path =
+      (std::filesystem::temp_directory_path() / "cutout_trace_test.json")
+          .string();
+  ASSERT_TRUE(Trace::dump(path));
+
+  std::ifstream file(path);
+  std::stringstream text;
+  text << file.rdbuf();
+  EXPECT_EQ(text.str(), Trace::to_json());
+  std::filesystem::remove(path);
+
+  EXPECT_FALSE(Trace::dump("/nonexistent/cutout_trace.json"));
+}